@@ -0,0 +1,62 @@
+#ifndef JEMALLOC_INTERNAL_ALLOC_TAG_H
+#define JEMALLOC_INTERNAL_ALLOC_TAG_H
+
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/tsd_types.h"
+
+/*
+ * Allocation tags: each thread has a current tag (set through the thread.tag
+ * mallctl, 0 by default), and the bytes and number of allocations and
+ * deallocations it does are accounted to that tag.  The tag isn't recorded with
+ * the allocations: freeing memory credits the tag of the freeing thread, so the
+ * bytes live under a tag can't be derived from its counts.
+ *
+ * Nothing is done per allocation beyond bumping the thread counters the thread
+ * event module keeps anyway (plus the operation counts).  Instead, the thread
+ * remembers the values of those counters when its current tag was set, and the
+ * difference is credited to the tag lazily, on the next tag switch, at thread
+ * exit, or when the tags are read.
+ */
+
+/* Tags are in [0, ALLOC_TAG_NTAGS). */
+#define ALLOC_TAG_NTAGS 16
+
+typedef struct alloc_tag_counts_s alloc_tag_counts_t;
+struct alloc_tag_counts_s {
+	uint64_t allocated;
+	uint64_t deallocated;
+	uint64_t nmalloc;
+	uint64_t ndalloc;
+};
+
+typedef struct alloc_tag_tsd_s alloc_tag_tsd_t;
+struct alloc_tag_tsd_s {
+	/* The current tag. */
+	unsigned tag;
+	/* The thread counters as of when tag was set. */
+	alloc_tag_counts_t base;
+	/* The activity of the thread under each tag but the current one. */
+	alloc_tag_counts_t counts[ALLOC_TAG_NTAGS];
+};
+
+#define ALLOC_TAG_TSD_INITIALIZER {0, {0, 0, 0, 0}, {{0, 0, 0, 0}}}
+
+static inline void
+alloc_tag_counts_add(alloc_tag_counts_t *dst, const alloc_tag_counts_t *src) {
+	dst->allocated += src->allocated;
+	dst->deallocated += src->deallocated;
+	dst->nmalloc += src->nmalloc;
+	dst->ndalloc += src->ndalloc;
+}
+
+bool alloc_tag_boot(void);
+unsigned alloc_tag_get(tsd_t *tsd);
+void alloc_tag_set(tsd_t *tsd, unsigned tag);
+/* Reads the activity of all threads under tag, exited ones included. */
+void alloc_tag_read(tsdn_t *tsdn, unsigned tag, alloc_tag_counts_t *counts);
+void alloc_tag_cleanup(tsd_t *tsd);
+void alloc_tag_prefork(tsdn_t *tsdn);
+void alloc_tag_postfork_parent(tsdn_t *tsdn);
+void alloc_tag_postfork_child(tsdn_t *tsdn);
+
+#endif /* JEMALLOC_INTERNAL_ALLOC_TAG_H */
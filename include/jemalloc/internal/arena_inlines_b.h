@@ -25,6 +25,30 @@ arena_get_from_edata(edata_t *edata) {
 	    ATOMIC_RELAXED);
 }
 
+static inline pa_shard_t *
+arena_pa_shard_get(arena_t *arena) {
+	return &arena->pa_arena->pa_shard;
+}
+
+/*
+ * Extents carry the index of the arena they are handed out to, but the page
+ * allocator of a group only knows about (and merges) extents tagged with the
+ * index of its own arena.  Retag them whenever they cross the boundary.
+ */
+static inline void
+arena_edata_adopt(arena_t *arena, edata_t *edata) {
+	if (unlikely(arena->pa_arena != arena)) {
+		edata_arena_ind_set(edata, arena_ind_get(arena));
+	}
+}
+
+static inline void
+arena_edata_release(arena_t *arena, edata_t *edata) {
+	if (unlikely(arena->pa_arena != arena)) {
+		edata_arena_ind_set(edata, arena_ind_get(arena->pa_arena));
+	}
+}
+
 JEMALLOC_ALWAYS_INLINE arena_t *
 arena_choose_maybe_huge(tsd_t *tsd, arena_t *arena, size_t size) {
 	if (arena != NULL) {
@@ -616,38 +640,34 @@ arena_bin_flush_batch_impl(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
     edata_t **dalloc_slabs, unsigned ndalloc_slabs, unsigned *dalloc_count,
     edata_list_active_t *dalloc_slabs_extra) {
 	assert(binind < bin_info_nbatched_sizes);
-	bin_with_batch_t *batched_bin = (bin_with_batch_t *)bin;
-	size_t nelems_to_pop = batcher_pop_begin(tsdn,
-	    &batched_bin->remote_frees);
-
-	bin_batching_test_mid_pop(nelems_to_pop);
-	if (nelems_to_pop == BATCHER_NO_IDX) {
-		malloc_mutex_assert_not_owner(tsdn,
-		    &batched_bin->remote_frees.mtx);
+	malloc_mutex_assert_owner(tsdn, &bin->lock);
+	bin_remote_free_t *elem = bin_remote_free_pop_all(
+	    (bin_with_batch_t *)bin);
+	if (elem == NULL) {
+		bin_batching_test_mid_pop(0);
 		return;
-	} else {
-		malloc_mutex_assert_owner(tsdn,
-		    &batched_bin->remote_frees.mtx);
-	}
-
-	size_t npushes = batcher_pop_get_pushes(tsdn,
-	    &batched_bin->remote_frees);
-	bin_remote_free_data_t remote_free_data[BIN_REMOTE_FREE_ELEMS_MAX];
-	for (size_t i = 0; i < nelems_to_pop; i++) {
-		remote_free_data[i] = batched_bin->remote_free_data[i];
 	}
-	batcher_pop_end(tsdn, &batched_bin->remote_frees);
 
-	for (size_t i = 0; i < nelems_to_pop; i++) {
+	size_t npushes = 0;
+	size_t nelems = 0;
+	while (elem != NULL) {
+		/* The region is no longer ours once freed. */
+		bin_remote_free_t *next = elem->next;
+		edata_t *slab = bin_remote_free_slab_get(elem);
+		npushes += bin_remote_free_batch_head(elem);
+		nelems++;
 		arena_dalloc_bin_locked_step(tsdn, arena, bin, dalloc_bin_info,
-		    binind, remote_free_data[i].slab, remote_free_data[i].ptr,
-		    dalloc_slabs, ndalloc_slabs, dalloc_count,
-		    dalloc_slabs_extra);
+		    binind, slab, elem, dalloc_slabs, ndalloc_slabs,
+		    dalloc_count, dalloc_slabs_extra);
+		elem = next;
 	}
+	bin_batching_test_mid_pop(nelems);
 
-	bin->stats.batch_pops++;
-	bin->stats.batch_pushes += npushes;
-	bin->stats.batch_pushed_elems += nelems_to_pop;
+	if (config_stats) {
+		bin->stats.batch_pops++;
+		bin->stats.batch_pushes += npushes;
+		bin->stats.batch_pushed_elems += nelems;
+	}
 }
 
 typedef struct arena_bin_flush_batch_state_s arena_bin_flush_batch_state_t;
@@ -739,6 +759,19 @@ arena_bin_flush_batch_after_unlock(tsdn_t *tsdn, arena_t *arena, bin_t *bin,
 	}
 }
 
+/*
+ * Maps a thread's binshard, assigned among all the shards in arena_bind(), to
+ * one of those in use.
+ */
+static inline unsigned
+arena_binshard_active_get(arena_t *arena, szind_t binind, unsigned binshard) {
+	if (bin_infos[binind].n_shards_init == bin_infos[binind].n_shards) {
+		return binshard;
+	}
+	return binshard % atomic_load_u(&arena->bin_nshards_active[binind],
+	    ATOMIC_RELAXED);
+}
+
 static inline bin_t *
 arena_get_bin(arena_t *arena, szind_t binind, unsigned binshard) {
 	bin_t *shard0 = (bin_t *)((byte_t *)arena + arena_bin_offsets[binind]);
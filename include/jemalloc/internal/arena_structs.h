@@ -37,6 +37,23 @@ struct arena_s {
 	/* Next bin shard for binding new threads. Synchronization: atomic. */
 	atomic_u_t		binshard_next;
 
+	/*
+	 * Number of shards in use for each bin, which only grows (from
+	 * bin_infos[i].n_shards_init to n_shards).  Synchronization: atomic.
+	 */
+	atomic_u_t		bin_nshards_active[SC_NBINS];
+
+	/*
+	 * Bytes allocated by the threads bound to this arena, as reported
+	 * through the arena_rebalance event; the same count at the end of the
+	 * last rebalancing window; and the difference between the two (i.e. the
+	 * load of the arena in that window), adjusted by the threads migrated
+	 * since.  Synchronization: atomic.
+	 */
+	atomic_zu_t		rebalance_nbytes;
+	atomic_zu_t		rebalance_nbytes_prev;
+	atomic_zu_t		rebalance_load;
+
 	/*
 	 * When percpu_arena is enabled, to amortize the cost of reading /
 	 * updating the current CPU id, track the most recent thread accessing
@@ -77,6 +94,20 @@ struct arena_s {
 	/* The page-level allocator shard this arena uses. */
 	pa_shard_t		pa_shard;
 
+	/*
+	 * The arena whose pa_shard serves the page-level requests of this one:
+	 * itself, unless this arena was created into the group of another one
+	 * (see arenas.create_grouped), in which case its own pa_shard stays
+	 * unused.  Read-only after arena_group_join().
+	 */
+	arena_t			*pa_arena;
+
+	/*
+	 * Number of arenas sharing this arena's pa_shard.  Synchronization:
+	 * atomic.
+	 */
+	atomic_u_t		ngroup_members;
+
 	/*
 	 * A cached copy of base->ind.  This can get accessed on hot paths;
 	 * looking it up in base requires an extra pointer hop / cache miss.
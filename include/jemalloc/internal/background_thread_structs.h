@@ -36,7 +36,15 @@ struct background_thread_info_s {
 #ifdef JEMALLOC_BACKGROUND_THREAD
 	/* Background thread is pthread specific. */
 	pthread_t		thread;
+#  ifdef JEMALLOC_FUTEX_LOCK
+	/*
+	 * pthread condition variables need a pthread mutex; wait on this
+	 * futex instead, bumped on every signal.
+	 */
+	atomic_u32_t		cond;
+#  else
 	pthread_cond_t		cond;
+#  endif
 #endif
 	malloc_mutex_t		mtx;
 	background_thread_state_t	state;
@@ -62,6 +70,7 @@ struct background_thread_stats_s {
 	size_t num_threads;
 	uint64_t num_runs;
 	nstime_t run_interval;
+	uint64_t num_pressure_periods;
 	mutex_prof_data_t max_counter_per_bg_thd;
 };
 typedef struct background_thread_stats_s background_thread_stats_t;
@@ -2,18 +2,16 @@
 #define JEMALLOC_INTERNAL_BIN_H
 
 #include "jemalloc/internal/jemalloc_preamble.h"
-#include "jemalloc/internal/batcher.h"
+#include "jemalloc/internal/atomic.h"
 #include "jemalloc/internal/bin_stats.h"
 #include "jemalloc/internal/bin_types.h"
 #include "jemalloc/internal/edata.h"
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/sc.h"
 
-#define BIN_REMOTE_FREE_ELEMS_MAX 16
-
 #ifdef JEMALLOC_JET
-extern void (*bin_batching_test_after_push_hook)(size_t idx);
-extern void (*bin_batching_test_mid_pop_hook)(size_t elems_to_pop);
+extern void (*bin_batching_test_after_push_hook)(size_t nelems);
+extern void (*bin_batching_test_mid_pop_hook)(size_t nelems);
 extern void (*bin_batching_test_after_unlock_hook)(unsigned slab_dalloc_count,
     bool list_empty);
 #endif
@@ -25,21 +23,21 @@ static const unsigned bin_batching_test_ndalloc_slabs_max = (unsigned)-1;
 #endif
 
 JEMALLOC_ALWAYS_INLINE void
-bin_batching_test_after_push(size_t idx) {
-	(void)idx;
+bin_batching_test_after_push(size_t nelems) {
+	(void)nelems;
 #ifdef JEMALLOC_JET
 	if (bin_batching_test_after_push_hook != NULL) {
-		bin_batching_test_after_push_hook(idx);
+		bin_batching_test_after_push_hook(nelems);
 	}
 #endif
 }
 
 JEMALLOC_ALWAYS_INLINE void
-bin_batching_test_mid_pop(size_t elems_to_pop) {
-	(void)elems_to_pop;
+bin_batching_test_mid_pop(size_t nelems) {
+	(void)nelems;
 #ifdef JEMALLOC_JET
 	if (bin_batching_test_mid_pop_hook != NULL) {
-		bin_batching_test_mid_pop_hook(elems_to_pop);
+		bin_batching_test_mid_pop_hook(nelems);
 	}
 #endif
 }
@@ -88,21 +86,126 @@ struct bin_s {
 
 	/* List used to track full slabs. */
 	edata_list_active_t	slabs_full;
+
+	/*
+	 * lock's prof_data n_lock_ops and contended (spun or waited for)
+	 * acquisitions as of the last bin_lock_contended() check.
+	 */
+	uint64_t		contention_nlock_ops;
+	uint64_t		contention_ncontended;
+};
+
+/* Lock acquisitions between bin_lock_contended() checks. */
+#define BIN_CONTENTION_WINDOW 256
+/* A bin lock is contended when 1 in this many acquisitions are. */
+#define BIN_CONTENTION_RATIO 4
+
+/*
+ * Remote frees to a batched bin are pushed onto a lock-free (Treiber) stack,
+ * threaded through the freed regions themselves.  Pushing a batch is a single
+ * CAS regardless of its size, and there is no bound on the number of pending
+ * elements; they get drained by the next thread to acquire the bin lock (i.e.
+ * on the owner's fills and flushes).  Draining takes the whole stack at once,
+ * so there's no ABA problem to worry about.
+ */
+typedef struct bin_remote_free_s bin_remote_free_t;
+struct bin_remote_free_s {
+	bin_remote_free_t *next;
+	/*
+	 * The slab the region belongs to.  The low bit marks the first element
+	 * of each pushed batch (for stats).
+	 */
+	uintptr_t slab;
 };
 
-typedef struct bin_remote_free_data_s bin_remote_free_data_t;
-struct bin_remote_free_data_s {
-	void *ptr;
-	edata_t *slab;
+#define BIN_REMOTE_FREE_BATCH_HEAD ((uintptr_t)1)
+
+/* A batch of regions being linked together before getting pushed. */
+typedef struct bin_remote_free_batch_s bin_remote_free_batch_t;
+struct bin_remote_free_batch_s {
+	bin_remote_free_t *first;
+	bin_remote_free_t *last;
+	size_t nelems;
 };
 
 typedef struct bin_with_batch_s bin_with_batch_t;
 struct bin_with_batch_s {
 	bin_t bin;
-	batcher_t remote_frees;
-	bin_remote_free_data_t remote_free_data[BIN_REMOTE_FREE_ELEMS_MAX];
+	/* Top of the bin_remote_free_t stack; NULL when empty. */
+	atomic_p_t remote_frees;
 };
 
+/* Whether regions of the given size can hold the remote free linkage. */
+static inline bool
+bin_remote_free_reg_size_ok(size_t reg_size) {
+	return reg_size >= sizeof(bin_remote_free_t);
+}
+
+static inline void
+bin_remote_free_init(bin_with_batch_t *batched_bin) {
+	atomic_store_p(&batched_bin->remote_frees, NULL, ATOMIC_RELAXED);
+}
+
+static inline void
+bin_remote_free_batch_init(bin_remote_free_batch_t *batch) {
+	batch->first = NULL;
+	batch->last = NULL;
+	batch->nelems = 0;
+}
+
+static inline void
+bin_remote_free_batch_append(bin_remote_free_batch_t *batch, void *ptr,
+    edata_t *slab) {
+	assert(((uintptr_t)slab & BIN_REMOTE_FREE_BATCH_HEAD) == 0);
+	bin_remote_free_t *elem = (bin_remote_free_t *)ptr;
+	elem->next = NULL;
+	elem->slab = (uintptr_t)slab;
+	if (batch->first == NULL) {
+		elem->slab |= BIN_REMOTE_FREE_BATCH_HEAD;
+		batch->first = elem;
+	} else {
+		batch->last->next = elem;
+	}
+	batch->last = elem;
+	batch->nelems++;
+}
+
+static inline void
+bin_remote_free_push(bin_with_batch_t *batched_bin,
+    bin_remote_free_batch_t *batch) {
+	assert(batch->nelems > 0);
+	void *top = atomic_load_p(&batched_bin->remote_frees, ATOMIC_RELAXED);
+	do {
+		batch->last->next = (bin_remote_free_t *)top;
+	} while (!atomic_compare_exchange_weak_p(&batched_bin->remote_frees,
+	    &top, batch->first, ATOMIC_RELEASE, ATOMIC_RELAXED));
+}
+
+/*
+ * Takes all the pending elements, or returns NULL if there are none.  Must be
+ * called with the bin lock held (it's the only consumer).
+ */
+static inline bin_remote_free_t *
+bin_remote_free_pop_all(bin_with_batch_t *batched_bin) {
+	/* Avoid the RMW in the common case of nothing pending. */
+	if (atomic_load_p(&batched_bin->remote_frees, ATOMIC_RELAXED) ==
+	    NULL) {
+		return NULL;
+	}
+	return (bin_remote_free_t *)atomic_exchange_p(
+	    &batched_bin->remote_frees, NULL, ATOMIC_ACQUIRE);
+}
+
+static inline edata_t *
+bin_remote_free_slab_get(const bin_remote_free_t *elem) {
+	return (edata_t *)(elem->slab & ~BIN_REMOTE_FREE_BATCH_HEAD);
+}
+
+static inline bool
+bin_remote_free_batch_head(const bin_remote_free_t *elem) {
+	return (elem->slab & BIN_REMOTE_FREE_BATCH_HEAD) != 0;
+}
+
 /* A set of sharded bins of the same size class. */
 typedef struct bins_s bins_t;
 struct bins_s {
@@ -117,10 +220,40 @@ bool bin_update_shard_size(unsigned bin_shards[SC_NBINS], size_t start_size,
 /* Initializes a bin to empty.  Returns true on error. */
 bool bin_init(bin_t *bin, unsigned binind);
 
+/*
+ * Called with the bin lock held.  Returns whether a large enough fraction of
+ * the lock acquisitions were contended, once every BIN_CONTENTION_WINDOW of
+ * them.  Always false without stats, which the mutex prof data relies on.
+ */
+static inline bool
+bin_lock_contended(bin_t *bin) {
+	if (!config_stats) {
+		return false;
+	}
+	mutex_prof_data_t *data = &bin->lock.prof_data;
+	uint64_t ncontended = data->n_spin_acquired + data->n_wait_times;
+	if (data->n_lock_ops < bin->contention_nlock_ops
+	    || ncontended < bin->contention_ncontended) {
+		/* The prof data got reset. */
+		bin->contention_nlock_ops = data->n_lock_ops;
+		bin->contention_ncontended = ncontended;
+		return false;
+	}
+	uint64_t nlock_ops = data->n_lock_ops - bin->contention_nlock_ops;
+	if (nlock_ops < BIN_CONTENTION_WINDOW) {
+		return false;
+	}
+	bool contended = (ncontended - bin->contention_ncontended)
+	    * BIN_CONTENTION_RATIO >= nlock_ops;
+	bin->contention_nlock_ops = data->n_lock_ops;
+	bin->contention_ncontended = ncontended;
+	return contended;
+}
+
 /* Forking. */
-void bin_prefork(tsdn_t *tsdn, bin_t *bin, bool has_batch);
-void bin_postfork_parent(tsdn_t *tsdn, bin_t *bin, bool has_batch);
-void bin_postfork_child(tsdn_t *tsdn, bin_t *bin, bool has_batch);
+void bin_prefork(tsdn_t *tsdn, bin_t *bin);
+void bin_postfork_parent(tsdn_t *tsdn, bin_t *bin);
+void bin_postfork_child(tsdn_t *tsdn, bin_t *bin);
 
 /* Stats. */
 static inline void
@@ -139,7 +272,6 @@ bin_stats_merge(tsdn_t *tsdn, bin_stats_data_t *dst_bin_stats, bin_t *bin) {
 	stats->curslabs += bin->stats.curslabs;
 	stats->nonfull_slabs += bin->stats.nonfull_slabs;
 
-	stats->batch_failed_pushes += bin->stats.batch_failed_pushes;
 	stats->batch_pushes += bin->stats.batch_pushes;
 	stats->batch_pushed_elems += bin->stats.batch_pushed_elems;
 
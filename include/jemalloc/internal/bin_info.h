@@ -37,6 +37,13 @@ struct bin_info_s {
 	/* Number of sharded bins in each arena for this size class. */
 	uint32_t		n_shards;
 
+	/*
+	 * Number of them in use in new arenas.  Less than n_shards only with
+	 * opt_bin_info_shards_max; more shards then get activated as the bin
+	 * locks get contended.
+	 */
+	uint32_t		n_shards_init;
+
 	/*
 	 * Metadata used to manipulate bitmaps for slabs associated with this
 	 * bin.
@@ -46,10 +53,10 @@ struct bin_info_s {
 
 /* The maximum size a size class can be and still get batching behavior. */
 extern size_t opt_bin_info_max_batched_size;
-/* The number of batches per batched size class. */
+/* The max number of elements per remote free batch. */
 extern size_t opt_bin_info_remote_free_max_batch;
-// The max number of pending elems (across all batches)
-extern size_t opt_bin_info_remote_free_max;
+/* The number of shards contended bins can grow to; 0 to disable. */
+extern unsigned opt_bin_info_shards_max;
 
 extern szind_t bin_info_nbatched_sizes;
 extern unsigned bin_info_nbatched_bins;
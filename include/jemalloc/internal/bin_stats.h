@@ -50,7 +50,6 @@ struct bin_stats_s {
 	size_t		nonfull_slabs;
 
 	uint64_t	batch_pops;
-	uint64_t	batch_failed_pushes;
 	uint64_t	batch_pushes;
 	uint64_t	batch_pushed_elems;
 };
@@ -59,5 +58,7 @@ typedef struct bin_stats_data_s bin_stats_data_t;
 struct bin_stats_data_s {
 	bin_stats_t stats_data;
 	mutex_prof_data_t mutex_data;
+	/* Number of active shards. */
+	uint32_t nshards;
 };
 #endif /* JEMALLOC_INTERNAL_BIN_STATS_H */
@@ -724,6 +724,23 @@ cache_bin_finish_flush_stashed(cache_bin_t *bin) {
 	assert(cache_bin_nstashed_get_local(bin) == 0);
 }
 
+/*
+ * Changes the ncached_max of an enabled bin in place.  The new value must not
+ * exceed the ncached_max the bin was initialized with (i.e. what its stack was
+ * sized for); the bin must have no stashed items, and no more than the new
+ * ncached_max cached ones.
+ */
+static inline void
+cache_bin_ncached_max_set(cache_bin_t *bin, cache_bin_sz_t ncached_max) {
+	assert(ncached_max > 0);
+	assert(cache_bin_nstashed_get_local(bin) == 0);
+	assert(cache_bin_ncached_get_local(bin) <= ncached_max);
+	bin->bin_info.ncached_max = ncached_max;
+	/* No stashed items, so full is the (moved) low bound. */
+	bin->low_bits_full = cache_bin_low_bits_low_bound_get(bin);
+	assert(cache_bin_nstashed_get_local(bin) == 0);
+}
+
 /*
  * Initialize a cache_bin_info to represent up to the given number of items in
  * the cache_bins it is associated with.
@@ -55,6 +55,9 @@ typedef struct {
 	unsigned lg_minbuckets;
 	unsigned lg_curbuckets;
 
+	/* Whether removals may halve the table (see ckh_shrink_disable()). */
+	bool shrinkable;
+
 	/* Hash and comparison functions. */
 	ckh_hash_t *hash;
 	ckh_keycomp_t *keycomp;
@@ -72,6 +75,13 @@ bool ckh_new(tsd_t *tsd, ckh_t *ckh, size_t minitems, ckh_hash_t *hash,
     ckh_keycomp_t *keycomp);
 void ckh_delete(tsd_t *tsd, ckh_t *ckh);
 
+/*
+ * Keep the table at its largest size so far, for tables whose item count keeps
+ * going up and down, where shrinking would only lead to growing (and
+ * rehashing everything) again.
+ */
+void ckh_shrink_disable(ckh_t *ckh);
+
 /* Get the number of elements in the set. */
 size_t ckh_count(ckh_t *ckh);
 
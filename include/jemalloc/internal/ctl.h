@@ -83,6 +83,8 @@ struct ctl_arena_s {
 	size_t pactive;
 	size_t pdirty;
 	size_t pmuzzy;
+	/* NUMA_NODE_NONE for unbound arenas and merged stats. */
+	int numa_node;
 
 	/* NULL if !config_stats. */
 	ctl_arena_stats_t *astats;
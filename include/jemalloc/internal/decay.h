@@ -16,7 +16,8 @@
  * This is mostly a single-threaded data structure and doesn't care about
  * synchronization at all; it's the caller's responsibility to manage their
  * synchronization on their own.  There are two exceptions:
- * 1) It's OK to racily call decay_ms_read (i.e. just the simplest state query).
+ * 1) It's OK to racily call decay_ms_read and decay_ms_configured_read (i.e.
+ *    just the simplest state queries).
  * 2) The mtx and purging fields live (and are initialized) here, but are
  *    logically owned by the page allocator.  This is just a convenience (since
  *    those fields would be duplicated for both the dirty and muzzy states
@@ -37,6 +38,13 @@ struct decay_s {
 	 * and/or reused.
 	 */
 	atomic_zd_t time_ms;
+	/*
+	 * The decay time as last set through decay_reinit().  time_ms only
+	 * differs from it while shortened by decay_pressure_set().
+	 */
+	atomic_zd_t configured_ms;
+	/* time_ms is configured_ms >> pressure_lg_div (if gradual). */
+	unsigned pressure_lg_div;
 	/* time / SMOOTHSTEP_NSTEPS. */
 	nstime_t interval;
 	/*
@@ -94,6 +102,16 @@ decay_ms_read(const decay_t *decay) {
 	return atomic_load_zd(&decay->time_ms, ATOMIC_RELAXED);
 }
 
+/*
+ * The decay time setting, ignoring any shortening under memory pressure.  It
+ * always agrees with decay_ms_read() on whether decay is disabled, immediate,
+ * or gradual.
+ */
+static inline ssize_t
+decay_ms_configured_read(const decay_t *decay) {
+	return atomic_load_zd(&decay->configured_ms, ATOMIC_RELAXED);
+}
+
 /*
  * See the comment on the struct field -- the limit on pages we should allow in
  * this decay state this epoch.
@@ -165,6 +183,14 @@ bool decay_init(decay_t *decay, nstime_t *cur_time, ssize_t decay_ms);
  */
 void decay_reinit(decay_t *decay, nstime_t *cur_time, ssize_t decay_ms);
 
+/*
+ * Shortens a gradual decay time by a factor of 2^lg_div (0 restores it), e.g.
+ * while under memory pressure.  Like decay_reinit(), this restarts the backlog.
+ * The setting sticks across decay_reinit() calls.  Returns whether the decay
+ * time changed.
+ */
+bool decay_pressure_set(decay_t *decay, nstime_t *cur_time, unsigned lg_div);
+
 /*
  * Compute how many of 'npages_new' pages we would need to purge in 'time'.
  */
@@ -11,6 +11,8 @@ struct ecache_s {
 	malloc_mutex_t mtx;
 	eset_t eset;
 	eset_t guarded_eset;
+	/* The extents of the huge page regions dedicated to slabs. */
+	eset_t slab_region_eset;
 	/* All stored extents must be in the same state. */
 	extent_state_t state;
 	/* The index of the ehooks the ecache is associated with. */
@@ -25,21 +27,36 @@ struct ecache_s {
 static inline size_t
 ecache_npages_get(ecache_t *ecache) {
 	return eset_npages_get(&ecache->eset) +
-	    eset_npages_get(&ecache->guarded_eset);
+	    eset_npages_get(&ecache->guarded_eset) +
+	    eset_npages_get(&ecache->slab_region_eset);
 }
 
 /* Get the number of extents in the given page size index. */
 static inline size_t
 ecache_nextents_get(ecache_t *ecache, pszind_t ind) {
 	return eset_nextents_get(&ecache->eset, ind) +
-	    eset_nextents_get(&ecache->guarded_eset, ind);
+	    eset_nextents_get(&ecache->guarded_eset, ind) +
+	    eset_nextents_get(&ecache->slab_region_eset, ind);
 }
 
 /* Get the sum total bytes of the extents in the given page size index. */
 static inline size_t
 ecache_nbytes_get(ecache_t *ecache, pszind_t ind) {
 	return eset_nbytes_get(&ecache->eset, ind) +
-	    eset_nbytes_get(&ecache->guarded_eset, ind);
+	    eset_nbytes_get(&ecache->guarded_eset, ind) +
+	    eset_nbytes_get(&ecache->slab_region_eset, ind);
+}
+
+/* The eset the given (inactive) extent belongs in. */
+static inline eset_t *
+ecache_eset_get(ecache_t *ecache, const edata_t *edata) {
+	if (edata_guarded_get(edata)) {
+		return &ecache->guarded_eset;
+	}
+	if (edata_slab_region_get(edata)) {
+		return &ecache->slab_region_eset;
+	}
+	return &ecache->eset;
 }
 
 static inline unsigned
@@ -105,8 +105,10 @@ struct edata_s {
 	 * i: szind
 	 * f: nfree
 	 * s: bin_shard
+	 * h: is_head
+	 * r: slab_region
 	 *
-	 * 00000000 ... 0000ssss ssffffff ffffiiii iiiitttg zpcbaaaa aaaaaaaa
+	 * 00000000 ... 00rhssss ssffffff ffffiiii iiiitttg zpcbaaaa aaaaaaaa
 	 *
 	 * arena_ind: Arena from which this extent came, or all 1 bits if
 	 *            unassociated.
@@ -140,6 +142,14 @@ struct edata_s {
 	 * nfree: Number of free regions in slab.
 	 *
 	 * bin_shard: the shard of the bin from which this extent came.
+	 *
+	 * is_head: Whether the extent is the first of a mapping (see
+	 *          extent_head_state_t).
+	 *
+	 * slab_region: The slab_region flag marks the extents carved out of
+	 *              the huge page regions dedicated to slabs (see
+	 *              opt_huge_slabs).  They never merge with other extents,
+	 *              and are cached separately.
 	 */
 	uint64_t		e_bits;
 #define MASK(CURRENT_FIELD_WIDTH, CURRENT_FIELD_SHIFT) ((((((uint64_t)0x1U) << (CURRENT_FIELD_WIDTH)) - 1)) << (CURRENT_FIELD_SHIFT))
@@ -188,6 +198,10 @@ struct edata_s {
 #define EDATA_BITS_IS_HEAD_SHIFT  (EDATA_BITS_BINSHARD_WIDTH + EDATA_BITS_BINSHARD_SHIFT)
 #define EDATA_BITS_IS_HEAD_MASK  MASK(EDATA_BITS_IS_HEAD_WIDTH, EDATA_BITS_IS_HEAD_SHIFT)
 
+#define EDATA_BITS_SLAB_REGION_WIDTH 1
+#define EDATA_BITS_SLAB_REGION_SHIFT  (EDATA_BITS_IS_HEAD_WIDTH + EDATA_BITS_IS_HEAD_SHIFT)
+#define EDATA_BITS_SLAB_REGION_MASK  MASK(EDATA_BITS_SLAB_REGION_WIDTH, EDATA_BITS_SLAB_REGION_SHIFT)
+
 	/* Pointer to the extent that this structure is responsible for. */
 	void			*e_addr;
 
@@ -309,6 +323,12 @@ edata_guarded_get(const edata_t *edata) {
 	    EDATA_BITS_GUARDED_SHIFT);
 }
 
+static inline bool
+edata_slab_region_get(const edata_t *edata) {
+	return (bool)((edata->e_bits & EDATA_BITS_SLAB_REGION_MASK) >>
+	    EDATA_BITS_SLAB_REGION_SHIFT);
+}
+
 static inline bool
 edata_zeroed_get(const edata_t *edata) {
 	return (bool)((edata->e_bits & EDATA_BITS_ZEROED_MASK) >>
@@ -527,6 +547,12 @@ edata_guarded_set(edata_t *edata, bool guarded) {
 	    ((uint64_t)guarded << EDATA_BITS_GUARDED_SHIFT);
 }
 
+static inline void
+edata_slab_region_set(edata_t *edata, bool slab_region) {
+	edata->e_bits = (edata->e_bits & ~EDATA_BITS_SLAB_REGION_MASK) |
+	    ((uint64_t)slab_region << EDATA_BITS_SLAB_REGION_SHIFT);
+}
+
 static inline void
 edata_zeroed_set(edata_t *edata, bool zeroed) {
 	edata->e_bits = (edata->e_bits & ~EDATA_BITS_ZEROED_MASK) |
@@ -611,6 +637,7 @@ edata_init(edata_t *edata, unsigned arena_ind, void *addr, size_t size,
 	edata_sn_set(edata, sn);
 	edata_state_set(edata, state);
 	edata_guarded_set(edata, false);
+	edata_slab_region_set(edata, false);
 	edata_zeroed_set(edata, zeroed);
 	edata_committed_set(edata, committed);
 	edata_pai_set(edata, pai);
@@ -632,6 +659,7 @@ edata_binit(edata_t *edata, void *addr, size_t bsize, uint64_t sn,
 	edata_state_set(edata, extent_state_active);
 	/* See comments in base_edata_is_reused. */
 	edata_guarded_set(edata, reused);
+	edata_slab_region_set(edata, false);
 	edata_zeroed_set(edata, true);
 	edata_committed_set(edata, true);
 	/*
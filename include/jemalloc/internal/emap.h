@@ -210,6 +210,7 @@ extent_assert_can_coalesce(const edata_t *inner, const edata_t *outer) {
 	assert(edata_state_get(inner) == extent_state_active);
 	assert(edata_state_get(outer) == extent_state_merging);
 	assert(!edata_guarded_get(inner) && !edata_guarded_get(outer));
+	assert(edata_slab_region_get(inner) == edata_slab_region_get(outer));
 	assert(edata_base_get(inner) == edata_past_get(outer) ||
 	    edata_base_get(outer) == edata_past_get(inner));
 }
@@ -230,6 +231,35 @@ emap_edata_lookup(tsdn_t *tsdn, emap_t *emap, const void *ptr) {
 	return rtree_read(tsdn, &emap->rtree, rtree_ctx, (uintptr_t)ptr).edata;
 }
 
+/*
+ * Looks up the edatas of n arbitrary pointers, given as keys; those unknown to
+ * the map get NULL.  Best used on keys sorted by address: consecutive keys in
+ * the same leaf, or page, reuse its lookup.  elms is scratch space for n
+ * elements.  The edatas found are prefetched.
+ */
+JEMALLOC_ALWAYS_INLINE void
+emap_edata_lookup_independent_batch(tsdn_t *tsdn, emap_t *emap, size_t n,
+    const uintptr_t *keys, rtree_leaf_elm_t **elms, edata_t **r_edatas) {
+	EMAP_DECLARE_RTREE_CTX;
+
+	rtree_leaf_elm_lookup_batch(tsdn, &emap->rtree, rtree_ctx, n, keys,
+	    elms);
+	for (size_t i = 0; i < n; i++) {
+		if (elms[i] == NULL) {
+			r_edatas[i] = NULL;
+		} else if (i > 0 && elms[i] == elms[i - 1]) {
+			r_edatas[i] = r_edatas[i - 1];
+		} else {
+			r_edatas[i] = rtree_leaf_elm_read(tsdn, &emap->rtree,
+			    elms[i], /* dependent */ false).edata;
+			if (r_edatas[i] != NULL
+			    && (i == 0 || r_edatas[i] != r_edatas[i - 1])) {
+				util_prefetch_read(r_edatas[i]);
+			}
+		}
+	}
+}
+
 /* Fills in alloc_ctx with the info in the map. */
 JEMALLOC_ALWAYS_INLINE void
 emap_alloc_ctx_lookup(tsdn_t *tsdn, emap_t *emap, const void *ptr,
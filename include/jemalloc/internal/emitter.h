@@ -11,7 +11,8 @@ typedef enum emitter_output_e emitter_output_t;
 enum emitter_output_e {
 	emitter_output_json,
 	emitter_output_json_compact,
-	emitter_output_table
+	emitter_output_table,
+	emitter_output_openmetrics
 };
 
 typedef enum emitter_justify_e emitter_justify_t;
@@ -40,6 +41,12 @@ enum emitter_type_e {
 	emitter_type_title,
 };
 
+typedef enum emitter_metric_e emitter_metric_t;
+enum emitter_metric_e {
+	emitter_metric_counter,
+	emitter_metric_gauge
+};
+
 typedef struct emitter_col_s emitter_col_t;
 struct emitter_col_s {
 	/* Filled in by the user. */
@@ -79,6 +86,9 @@ struct emitter_s {
 	bool item_at_depth;
 	/* True if we emitted a key and will emit corresponding value next. */
 	bool emitted_key;
+	/* In openmetrics mode, the metric family the samples belong to. */
+	const char *metric_name;
+	emitter_metric_t metric_type;
 };
 
 static inline bool
@@ -271,6 +281,8 @@ emitter_init(emitter_t *emitter, emitter_output_t emitter_output,
 	emitter->item_at_depth = false;
 	emitter->emitted_key = false;
 	emitter->nesting_depth = 0;
+	emitter->metric_name = NULL;
+	emitter->metric_type = emitter_metric_gauge;
 }
 
 /******************************************************************************/
@@ -453,6 +465,63 @@ emitter_col_init(emitter_col_t *col, emitter_row_t *row) {
 }
 
 
+/******************************************************************************/
+/*
+ * OpenMetrics public API.  Unlike the JSON and table output, which follow the
+ * structure of the stats, OpenMetrics wants all the samples of a metric family
+ * (e.g. the nmalloc of every bin of every arena) together; so the caller has to
+ * drive it separately, one family at a time.  Everything else is a no-op in
+ * this mode, and these functions are no-ops in the others.
+ */
+
+/*
+ * Starts the metric family jemalloc_<name>, to which the following samples
+ * belong.  The name must not have the "_total" suffix of counter samples.
+ */
+static inline void
+emitter_metric_begin(emitter_t *emitter, const char *name,
+    emitter_metric_t type, const char *help) {
+	if (emitter->output != emitter_output_openmetrics) {
+		return;
+	}
+	emitter->metric_name = name;
+	emitter->metric_type = type;
+	emitter_printf(emitter, "# TYPE jemalloc_%s %s\n", name,
+	    type == emitter_metric_counter ? "counter" : "gauge");
+	if (help != NULL) {
+		emitter_printf(emitter, "# HELP jemalloc_%s %s\n", name, help);
+	}
+}
+
+/*
+ * Emits a sample of the current metric family.  labels is either NULL or a
+ * comma separated list of name="value" pairs, e.g. arena="0",bin="3".
+ */
+static inline void
+emitter_metric_sample(emitter_t *emitter, const char *labels,
+    emitter_type_t value_type, const void *value) {
+	if (emitter->output != emitter_output_openmetrics) {
+		return;
+	}
+	assert(emitter->metric_name != NULL);
+	emitter_printf(emitter, "jemalloc_%s%s", emitter->metric_name,
+	    emitter->metric_type == emitter_metric_counter ? "_total" : "");
+	if (labels != NULL && labels[0] != '\0') {
+		emitter_printf(emitter, "{%s}", labels);
+	}
+	emitter_printf(emitter, " ");
+	if (value_type == emitter_type_bool) {
+		emitter_printf(emitter, "%d", *(const bool *)value ? 1 : 0);
+	} else {
+		/* Only numbers make sense here. */
+		assert(value_type != emitter_type_string &&
+		    value_type != emitter_type_title);
+		emitter_print_value(emitter, emitter_justify_none, -1,
+		    value_type, value);
+	}
+	emitter_printf(emitter, "\n");
+}
+
 /******************************************************************************/
 /*
  * Generalized public API. Emits using either JSON or table, according to
@@ -528,6 +597,8 @@ emitter_end(emitter_t *emitter) {
 		emitter_nest_dec(emitter);
 		emitter_printf(emitter, "%s", emitter->output ==
 		    emitter_output_json_compact ? "}" : "\n}\n");
+	} else if (emitter->output == emitter_output_openmetrics) {
+		emitter_printf(emitter, "# EOF\n");
 	}
 }
 
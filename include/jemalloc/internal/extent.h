@@ -27,6 +27,9 @@ edata_t *ecache_alloc(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 edata_t *ecache_alloc_grow(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
     ecache_t *ecache, edata_t *expand_edata, size_t size, size_t alignment,
     bool zero, bool guarded);
+/* Like ecache_alloc, but only from the extents of slab regions. */
+edata_t *ecache_alloc_slab_region(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
+    ecache_t *ecache, size_t size, bool zero);
 void ecache_dalloc(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
     ecache_t *ecache, edata_t *edata);
 edata_t *ecache_evict(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
@@ -40,6 +43,12 @@ void extent_dalloc_gap(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 edata_t *extent_alloc_wrapper(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
     void *new_addr, size_t size, size_t alignment, bool zero, bool *commit,
     bool growing_retained);
+/*
+ * Allocates from the retained extents of slab regions, or else from a newly
+ * mapped slab region.
+ */
+edata_t *extent_alloc_slab_region(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
+    size_t size, bool zero);
 void extent_dalloc_wrapper(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
     edata_t *edata);
 void extent_destroy_wrapper(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
@@ -130,6 +139,10 @@ extent_can_acquire_neighbor(edata_t *edata, rtree_contents_t contents,
 		}
 	}
 	assert(!edata_guarded_get(edata) && !edata_guarded_get(neighbor));
+	/* Keep the slab regions apart from everything else. */
+	if (edata_slab_region_get(edata) != edata_slab_region_get(neighbor)) {
+		return false;
+	}
 
 	return true;
 }
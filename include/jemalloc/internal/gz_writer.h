@@ -0,0 +1,62 @@
+#ifndef JEMALLOC_INTERNAL_GZ_WRITER_H
+#define JEMALLOC_INTERNAL_GZ_WRITER_H
+
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/jemalloc_internal_types.h"
+#include "jemalloc/internal/tsd_types.h"
+
+/*
+ * A streaming gzip (RFC 1952) writer, e.g. for heap profile dumps.  Bytes
+ * written through gz_writer_write() (or strings, through gz_writer_cb()) are
+ * compressed into a single DEFLATE stream, using greedy LZ77 matching over a
+ * 32 KiB window and the fixed Huffman codes.  That compresses worse than zlib,
+ * but it's small and has no dependencies, and still shrinks the repetitive
+ * profile dumps by an order of magnitude.  The compressed bytes are passed to
+ * write_cb in chunks of at most GZ_WRITER_OUT_BUFSIZE bytes.
+ */
+
+#define GZ_WRITER_LG_WINDOW	15
+#define GZ_WRITER_WINDOW	((size_t)1 << GZ_WRITER_LG_WINDOW)
+#define GZ_WRITER_LG_HASH	13
+#define GZ_WRITER_OUT_BUFSIZE	4096
+
+typedef void (gz_write_cb_t)(void *cbopaque, const void *buf, size_t len);
+
+/* Allocated internally, so that a gz_writer_t can live on the stack. */
+typedef struct gz_writer_bufs_s gz_writer_bufs_t;
+struct gz_writer_bufs_s {
+	uint32_t crc_table[256];
+	/* 1 + the stream offset of the last position with each hash, or 0. */
+	uint64_t head[1U << GZ_WRITER_LG_HASH];
+	/* The last window of compressed input, and then the new input. */
+	unsigned char win[2 * GZ_WRITER_WINDOW];
+	unsigned char out[GZ_WRITER_OUT_BUFSIZE];
+};
+
+typedef struct {
+	gz_write_cb_t *write_cb;
+	void *cbopaque;
+	/* NULL if the allocation failed. */
+	gz_writer_bufs_t *bufs;
+	uint32_t crc;
+	uint32_t isize;
+	/* Pending output bits, least significant first. */
+	uint64_t bits;
+	unsigned nbits;
+	/* Stream offset of win[0]. */
+	uint64_t win_base;
+	/* Bytes in win, and how many of them have been compressed. */
+	size_t win_end;
+	size_t win_cur;
+	size_t out_end;
+} gz_writer_t;
+
+/* Returns true (and drops all output) if the buffers can't be allocated. */
+bool gz_writer_init(tsdn_t *tsdn, gz_writer_t *gz_writer,
+    gz_write_cb_t *write_cb, void *cbopaque);
+gz_write_cb_t gz_writer_write;
+write_cb_t gz_writer_cb;
+/* Finishes the stream, and frees the buffers. */
+void gz_writer_terminate(tsdn_t *tsdn, gz_writer_t *gz_writer);
+
+#endif /* JEMALLOC_INTERNAL_GZ_WRITER_H */
@@ -9,6 +9,7 @@
 #include "jemalloc/internal/hpa_hooks.h"
 #include "jemalloc/internal/hpa_opts.h"
 #include "jemalloc/internal/mutex.h"
+#include "jemalloc/internal/numa.h"
 #include "jemalloc/internal/pai.h"
 #include "jemalloc/internal/psset.h"
 
@@ -69,6 +70,15 @@ struct hpa_shard_nonderived_stats_s {
 	 */
 	uint64_t nhugify_failures;
 
+	/*
+	 * Of the above, those that re-collapsed a previously dehugified
+	 * pageslab (see hpa_shard_opts_t::rehugify_max_nhp).
+	 *
+	 * Guarded by mtx.
+	 */
+	uint64_t nrehugifies;
+	uint64_t nrehugify_failures;
+
 	/*
 	 * The number of times we've dehugified a pageslab.
 	 *
@@ -114,6 +124,14 @@ struct hpa_shard_s {
 
 	psset_t psset;
 
+	/*
+	 * The runs of consecutive pageslabs we've grown by for allocations
+	 * larger than a hugepage.  Their pageslabs live in the psset like any
+	 * other; this just lets later such allocations find consecutive ones
+	 * again.  Guarded by mtx.
+	 */
+	hpdata_run_list_t runs;
+
 	/*
 	 * How many grow operations have occurred.
 	 *
@@ -124,6 +142,9 @@ struct hpa_shard_s {
 	/* The arena ind we're associated with. */
 	unsigned ind;
 
+	/* Preferred node of the pageslabs we grow by, or NUMA_NODE_NONE. */
+	int numa_node;
+
 	/*
 	 * Our emap.  This is just a cache of the emap pointer in the associated
 	 * hpa_central.
@@ -132,6 +153,11 @@ struct hpa_shard_s {
 
 	/* The configuration choices for this hpa shard. */
 	hpa_shard_opts_t opts;
+	/*
+	 * While under memory pressure, opts.dirty_mult is divided by
+	 * 2^pressure_lg_div.  Guarded by mtx.
+	 */
+	unsigned pressure_lg_div;
 
 	/*
 	 * How many pages have we started but not yet finished purging in this
@@ -149,6 +175,13 @@ struct hpa_shard_s {
 	 * Last time we performed purge on this shard.
 	 */
 	nstime_t last_purge;
+
+	/*
+	 * When the current rehugify interval started, and how many pageslabs
+	 * we've rehugified in it.  Guarded by mtx.
+	 */
+	nstime_t rehugify_interval_start;
+	size_t nrehugifies_in_interval;
 };
 
 bool hpa_hugepage_size_exceeds_limit();
@@ -178,6 +211,10 @@ void hpa_shard_destroy(tsdn_t *tsdn, hpa_shard_t *shard);
 void hpa_shard_set_deferral_allowed(tsdn_t *tsdn, hpa_shard_t *shard,
     bool deferral_allowed);
 void hpa_shard_do_deferred_work(tsdn_t *tsdn, hpa_shard_t *shard);
+/* Purges all the dirty pages, regardless of the purging thresholds. */
+void hpa_shard_purge_all(tsdn_t *tsdn, hpa_shard_t *shard);
+void hpa_shard_pressure_set(tsdn_t *tsdn, hpa_shard_t *shard,
+    unsigned lg_div);
 
 /*
  * We share the fork ordering with the PA and arena prefork handling; that's why
@@ -59,6 +59,24 @@ struct hpa_shard_opts_s {
 	 * Maximum number of hugepages to purge on each purging attempt.
 	 */
 	ssize_t experimental_max_purge_nhp;
+
+	/*
+	 * Sizes above slab_max_alloc, up to this, are served out of the shard
+	 * too; those above a hugepage get a run of consecutive hugepages (see
+	 * hpa_central_extract).  0 (or anything <= slab_max_alloc) leaves them
+	 * all to the PAC.
+	 */
+	size_t large_max_alloc;
+
+	/*
+	 * Hugepages that were dehugified (to purge them) and have become
+	 * hugification candidates again get collapsed synchronously
+	 * (MADV_COLLAPSE) by the background deferred work, rather than left to
+	 * khugepaged; at most rehugify_max_nhp of them per rehugify_interval_ms.
+	 * 0 disables this.
+	 */
+	size_t rehugify_max_nhp;
+	uint64_t rehugify_interval_ms;
 };
 
 #define HPA_SHARD_OPTS_DEFAULT {					\
@@ -83,7 +101,13 @@ struct hpa_shard_opts_s {
 	/* min_purge_interval_ms */					\
 	5 * 1000,							\
 	/* experimental_max_purge_nhp */				\
-	-1								\
+	-1,								\
+	/* large_max_alloc */						\
+	0,								\
+	/* rehugify_max_nhp */						\
+	4,								\
+	/* rehugify_interval_ms */					\
+	1000								\
 }
 
 #endif /* JEMALLOC_INTERNAL_HPA_OPTS_H */
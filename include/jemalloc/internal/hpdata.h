@@ -38,6 +38,8 @@ struct hpdata_s {
 	uint64_t h_age;
 	/* Whether or not we think the hugepage is mapped that way by the OS. */
 	bool h_huge;
+	/* Whether it's been dehugified, and not hugified again since. */
+	bool h_dehugified;
 
 	/*
 	 * For some properties, we keep parallel sets of bools; h_foo_allowed
@@ -100,6 +102,14 @@ struct hpdata_s {
 	ql_elm(hpdata_t) ql_link_purge;
 	ql_elm(hpdata_t) ql_link_hugify;
 
+	/*
+	 * Linkage for the HPA shard's list of runs (see hpa_central_extract),
+	 * which is threaded through the first hpdata of each run; that one also
+	 * records how many hpdatas the run has.  Zero for the others.
+	 */
+	ql_elm(hpdata_t) ql_link_run;
+	size_t h_run_nhp;
+
 	/* The length of the largest contiguous sequence of inactive pages. */
 	size_t h_longest_free_range;
 
@@ -123,6 +133,7 @@ struct hpdata_s {
 TYPED_LIST(hpdata_empty_list, hpdata_t, ql_link_empty)
 TYPED_LIST(hpdata_purge_list, hpdata_t, ql_link_purge)
 TYPED_LIST(hpdata_hugify_list, hpdata_t, ql_link_hugify)
+TYPED_LIST(hpdata_run_list, hpdata_t, ql_link_run)
 
 ph_proto(, hpdata_age_heap, hpdata_t);
 
@@ -152,6 +163,11 @@ hpdata_huge_get(const hpdata_t *hpdata) {
 	return hpdata->h_huge;
 }
 
+static inline bool
+hpdata_dehugified_get(const hpdata_t *hpdata) {
+	return hpdata->h_dehugified;
+}
+
 static inline bool
 hpdata_alloc_allowed_get(const hpdata_t *hpdata) {
 	return hpdata->h_alloc_allowed;
@@ -278,11 +294,27 @@ hpdata_longest_free_range_set(hpdata_t *hpdata, size_t longest_free_range) {
 	hpdata->h_longest_free_range = longest_free_range;
 }
 
+static inline size_t
+hpdata_run_nhp_get(const hpdata_t *hpdata) {
+	return hpdata->h_run_nhp;
+}
+
+static inline void
+hpdata_run_nhp_set(hpdata_t *hpdata, size_t run_nhp) {
+	hpdata->h_run_nhp = run_nhp;
+}
+
 static inline size_t
 hpdata_nactive_get(hpdata_t *hpdata) {
 	return hpdata->h_nactive;
 }
 
+/* The number of inactive pages at the start of the hugepage. */
+static inline size_t
+hpdata_nfree_prefix_get(hpdata_t *hpdata) {
+	return fb_ffs(hpdata->active_pages, HUGEPAGE_PAGES, 0);
+}
+
 static inline size_t
 hpdata_ntouched_get(hpdata_t *hpdata) {
 	return hpdata->h_ntouched;
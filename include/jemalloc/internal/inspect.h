@@ -34,10 +34,61 @@ struct inspect_extent_util_stats_verbose_s {
 	size_t bin_nregs;
 };
 
+/*
+ * Heap walk records, see experimental_heap_walk_ctl in src/ctl.c.  A slab is
+ * followed by the records of its allocated regions.  The kind values and the
+ * layouts of the record and walker structs are documented in the manual (see
+ * experimental.heap_walk), for applications to declare their own copies; keep
+ * them stable.
+ */
+typedef enum {
+	inspect_heap_walk_slab = 0,
+	inspect_heap_walk_region = 1,
+	inspect_heap_walk_large = 2,
+	inspect_heap_walk_dirty = 3,
+	inspect_heap_walk_muzzy = 4,
+	inspect_heap_walk_retained = 5
+} inspect_heap_walk_kind_t;
+
+typedef struct inspect_heap_walk_record_s inspect_heap_walk_record_t;
+struct inspect_heap_walk_record_s {
+	/* An inspect_heap_walk_kind_t, with a fixed size. */
+	unsigned kind;
+	const void *addr;
+	/* The usable size for regions and large allocations. */
+	size_t size;
+	unsigned arena_ind;
+	/* Slabs only (0 otherwise). */
+	unsigned nregs;
+	unsigned nfree;
+};
+
+typedef void (*inspect_heap_walk_cb_t)(void *ctx,
+    const inspect_heap_walk_record_t *record);
+
+typedef struct inspect_heap_walker_s inspect_heap_walker_t;
+struct inspect_heap_walker_s {
+	inspect_heap_walk_cb_t cb;
+	void *ctx;
+};
+
 void inspect_extent_util_stats_get(tsdn_t *tsdn, const void *ptr,
     size_t *nfree, size_t *nregs, size_t *size);
+/*
+ * Same as inspect_extent_util_stats_get, for n pointers at once (and tolerating
+ * NULL ones).  The pointers are looked up in address order.
+ */
+void inspect_extent_util_stats_batch_get(tsdn_t *tsdn, void *const *ptrs,
+    size_t n, inspect_extent_util_stats_t *util_stats);
 void inspect_extent_util_stats_verbose_get(tsdn_t *tsdn, const void *ptr,
     size_t *nfree, size_t *nregs, size_t *size,
     size_t *bin_nfree, size_t *bin_nregs, void **slabcur_addr);
+/*
+ * Whether ptr sits in a slab that is sparser than its bin shard on average, so
+ * that moving it with MALLOCX_DEFRAG helps to empty the slab.
+ */
+bool inspect_defrag_hint_get(tsdn_t *tsdn, const void *ptr);
+/* Calls the walker on every extent in the emap. */
+void inspect_heap_walk(tsdn_t *tsdn, const inspect_heap_walker_t *walker);
 
 #endif /* JEMALLOC_INTERNAL_INSPECT_H */
@@ -52,6 +52,9 @@
 #  ifdef JEMALLOC_HAVE_MACH_ABSOLUTE_TIME
 #    include <mach/mach_time.h>
 #  endif
+#  ifdef JEMALLOC_HAVE_RSEQ
+#    include <sys/rseq.h>
+#  endif
 #endif
 #include <sys/types.h>
 
@@ -32,6 +32,8 @@ extern bool opt_experimental_infallible_new;
 extern bool opt_experimental_tcache_gc;
 extern bool opt_zero;
 extern unsigned opt_narenas;
+extern int64_t opt_arena_rebalance_interval;
+extern unsigned opt_arena_rebalance_threshold;
 extern zero_realloc_action_t opt_zero_realloc_action;
 extern malloc_init_t malloc_init_state;
 extern const char *const zero_realloc_mode_names[];
@@ -71,6 +73,14 @@ unsigned narenas_total_get(void);
 arena_t *arena_init(tsdn_t *tsdn, unsigned ind, const arena_config_t *config);
 arena_t *arena_choose_hard(tsd_t *tsd, bool internal);
 void arena_migrate(tsd_t *tsd, arena_t *oldarena, arena_t *newarena);
+uint64_t arena_rebalance_new_event_wait(tsd_t *tsd);
+uint64_t arena_rebalance_postponed_event_wait(tsd_t *tsd);
+void arena_rebalance_event_handler(tsd_t *tsd, uint64_t elapsed);
+/*
+ * Subtracts up to nbytes from the rebalancing load, stopping at 0; returns the
+ * amount actually subtracted.
+ */
+size_t arena_rebalance_load_sub(atomic_zu_t *load, size_t nbytes);
 void iarena_cleanup(tsd_t *tsd);
 void arena_cleanup(tsd_t *tsd);
 size_t batch_alloc(void **ptrs, size_t num, size_t size, int flags);
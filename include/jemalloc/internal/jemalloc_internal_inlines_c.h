@@ -8,6 +8,7 @@
 #include "jemalloc/internal/hook.h"
 #include "jemalloc/internal/jemalloc_internal_types.h"
 #include "jemalloc/internal/log.h"
+#include "jemalloc/internal/percpu_cache.h"
 #include "jemalloc/internal/sz.h"
 #include "jemalloc/internal/thread_event.h"
 #include "jemalloc/internal/witness.h"
@@ -276,6 +277,7 @@ fastpath_success_finish(tsd_t *tsd, uint64_t allocated_after,
     cache_bin_t *bin, void *ret) {
 	thread_allocated_set(tsd, allocated_after);
 	if (config_stats) {
+		(*tsd_thread_nmallocp_get(tsd))++;
 		bin->tstats.nrequests++;
 	}
 }
@@ -382,6 +384,17 @@ imalloc_fastpath(size_t size, void *(fallback_alloc)(size_t)) {
 		fastpath_success_finish(tsd, allocated_after, bin, ret);
 		return ret;
 	}
+	/* The small bins are disabled when cached per CPU. */
+	if (tcache_percpu_cache_get(tcache->tcache_slow, ind)) {
+		ret = percpu_cache_alloc_easy(ind);
+		if (ret != NULL) {
+			thread_allocated_set(tsd, allocated_after);
+			if (config_stats) {
+				(*tsd_thread_nmallocp_get(tsd))++;
+			}
+			return ret;
+		}
+	}
 
 	return fallback_alloc(size);
 }
@@ -511,27 +524,36 @@ bool free_fastpath(void *ptr, size_t size, bool size_hint) {
 		usize = sz_index2size(alloc_ctx.szind);
         } else {
                 /*
-                 * Check for both sizes that are too large, and for sampled /
-                 * special aligned objects.  The alignment check will also check
-                 * for null ptr.
+                 * Check for both sizes that can never be cached, and for
+                 * sampled / special aligned objects.  The alignment check will
+                 * also check for null ptr.  Note that sampled objects are
+                 * always page aligned, which is what allows trusting the size
+                 * (rather than the rtree) for large size classes as well.
                  */
-                if (unlikely(size > SC_LOOKUP_MAXCLASS ||
+                if (unlikely(size > TCACHE_MAXCLASS_LIMIT ||
                     free_fastpath_nonfast_aligned(ptr,
                     /* check_prof */ true))) {
                         return false;
                 }
-		sz_size2index_usize_fastpath(size, &alloc_ctx.szind, &usize);
-                /* Max lookup class must be small. */
-                assert(alloc_ctx.szind < SC_NBINS);
+                if (likely(size <= SC_LOOKUP_MAXCLASS)) {
+                        sz_size2index_usize_fastpath(size, &alloc_ctx.szind,
+                            &usize);
+                } else {
+                        alloc_ctx.szind = sz_size2index_compute_inline(size);
+                        usize = sz_index2size_lookup_impl(alloc_ctx.szind);
+                }
+                assert(alloc_ctx.szind < TCACHE_NBINS_MAX);
                 /* This is a dead store, except when opt size checking is on. */
-                alloc_ctx.slab = true;
+                alloc_ctx.slab = (alloc_ctx.szind < SC_NBINS);
         }
         /*
-         * Currently the fastpath only handles small sizes.  The branch on
-         * SC_LOOKUP_MAXCLASS makes sure of it.  This lets us avoid checking
-         * tcache szind upper limit (i.e. tcache_max) as well.
+         * The unsized fastpath only handles small sizes (slab is checked
+         * above), while the sized one handles all the size classes up to
+         * TCACHE_MAXCLASS_LIMIT.  Either way there is no need to check the
+         * tcache szind upper limit (i.e. tcache_max): bins beyond tcache_nbins
+         * are disabled, so that pushing to them always fails.
          */
-        assert(alloc_ctx.slab);
+        assert(alloc_ctx.slab || size_hint);
 
         uint64_t deallocated, threshold;
         te_free_fastpath_ctx(tsd, &deallocated, &threshold);
@@ -566,10 +588,19 @@ bool free_fastpath(void *ptr, size_t size, bool size_hint) {
         assert(!opt_junk_free);
 
         if (!cache_bin_dalloc_easy(bin, ptr)) {
-                return false;
+                /* The small bins are disabled when cached per CPU. */
+                if (!alloc_ctx.slab ||
+                    !tcache_percpu_cache_get(tcache->tcache_slow,
+                    alloc_ctx.szind) ||
+                    !percpu_cache_dalloc_easy(alloc_ctx.szind, ptr)) {
+                        return false;
+                }
         }
 
         *tsd_thread_deallocatedp_get(tsd) = deallocated_after;
+        if (config_stats) {
+                (*tsd_thread_ndallocp_get(tsd))++;
+        }
 
         return true;
 }
@@ -583,9 +614,23 @@ je_sdallocx_noflags(void *ptr, size_t size) {
 
 JEMALLOC_ALWAYS_INLINE void JEMALLOC_NOTHROW
 je_sdallocx_impl(void *ptr, size_t size, int flags) {
-        if (flags != 0 || !free_fastpath(ptr, size, true)) {
-                sdallocx_default(ptr, size, flags);
+        if (flags == 0) {
+                je_sdallocx_noflags(ptr, size);
+                return;
+        }
+        /*
+         * Alignment is the only flag that doesn't affect where the object
+         * goes (e.g. free_aligned_sized() and aligned operator delete); the
+         * aligned usize is enough for the fastpath.
+         */
+        if ((flags & ~MALLOCX_LG_ALIGN_MASK) == 0) {
+                size_t usize = sz_sa2u(size,
+                    MALLOCX_ALIGN_GET_SPECIFIED(flags));
+                if (likely(usize != 0) && free_fastpath(ptr, usize, true)) {
+                        return;
+                }
         }
+        sdallocx_default(ptr, size, flags);
 }
 
 JEMALLOC_ALWAYS_INLINE void JEMALLOC_NOTHROW
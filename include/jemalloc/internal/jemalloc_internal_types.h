@@ -33,11 +33,11 @@ typedef enum malloc_init_e malloc_init_t;
  *
  * a: arena
  * t: tcache
- * 0: unused
+ * d: defrag
  * z: zero
  * n: alignment
  *
- * aaaaaaaa aaaatttt tttttttt 0znnnnnn
+ * aaaaaaaa aaaatttt tttttttt dznnnnnn
  */
 #define MALLOCX_ARENA_BITS	12
 #define MALLOCX_TCACHE_BITS	12
@@ -59,6 +59,8 @@ typedef enum malloc_init_e malloc_init_t;
     (MALLOCX_ALIGN_GET_SPECIFIED(flags) & (SIZE_T_MAX-1))
 #define MALLOCX_ZERO_GET(flags)						\
     ((bool)(flags & MALLOCX_ZERO))
+#define MALLOCX_DEFRAG_GET(flags)					\
+    ((bool)(flags & MALLOCX_DEFRAG))
 
 #define MALLOCX_TCACHE_GET(flags)					\
     (((unsigned)((flags & MALLOCX_TCACHE_MASK) >> MALLOCX_TCACHE_SHIFT)) - 2)
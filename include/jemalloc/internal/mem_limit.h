@@ -0,0 +1,73 @@
+#ifndef JEMALLOC_INTERNAL_MEM_LIMIT_H
+#define JEMALLOC_INTERNAL_MEM_LIMIT_H
+
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/atomic.h"
+#include "jemalloc/internal/tsd_types.h"
+
+/*
+ * A process-wide limit on the memory held by the arenas.
+ *
+ * Before an arena maps (or grows into) new pages, the estimated usage -- the
+ * active, dirty and muzzy pages of all arenas -- is checked against the limit.
+ * Reusing dirty or muzzy pages leaves the usage unchanged, so the PAC and HPA
+ * only check once their caches can't serve an allocation.
+ * If the new pages would exceed it, the cached memory is reclaimed on the spot:
+ * the SECs are flushed, and the dirty and muzzy pages of every arena (including
+ * those in HPA pageslabs) are purged.  Thread caches can't be flushed from
+ * outside their thread, so the reclaim only asks them to; each one flushes
+ * itself entirely at its next GC event.  If that still doesn't bring the usage
+ * under the limit, the mem_limit hook gets called, and with opt_mem_limit_fail
+ * the allocation fails.
+ */
+
+/* Called (reentrantly) with the limit and the usage that would exceed it. */
+typedef void (*mem_limit_hook_t)(size_t limit, size_t usage);
+
+extern size_t opt_mem_limit;
+extern bool opt_mem_limit_fail;
+
+/* The current limit in bytes, or 0 if there is none. */
+extern atomic_zu_t mem_limit;
+
+bool mem_limit_boot(void);
+void mem_limit_set(size_t limit);
+mem_limit_hook_t mem_limit_hook_get(void);
+void mem_limit_hook_set(mem_limit_hook_t hook);
+/* The usage the limit is enforced against, in bytes. */
+size_t mem_limit_usage(tsdn_t *tsdn);
+bool mem_limit_alloc_check_hard(tsdn_t *tsdn, size_t size);
+/*
+ * Returns the current cache flush epoch, which is advanced by every reclaim.
+ */
+unsigned mem_limit_flush_epoch_get(void);
+/*
+ * Returns whether a reclaim happened since *epoch was last updated, in which
+ * case it's updated and the calling thread should flush its cache.  *shared is
+ * set for the first thread to notice, which should also flush the caches that
+ * are shared between threads.
+ */
+bool mem_limit_flush_check(unsigned *epoch, bool *shared);
+
+void mem_limit_prefork(tsdn_t *tsdn);
+void mem_limit_postfork_parent(tsdn_t *tsdn);
+void mem_limit_postfork_child(tsdn_t *tsdn);
+
+static inline size_t
+mem_limit_get(void) {
+	return atomic_load_zu(&mem_limit, ATOMIC_RELAXED);
+}
+
+/*
+ * Called before allocating size bytes of new pages, without any core locks
+ * held.  Returns true if the allocation should fail.
+ */
+static inline bool
+mem_limit_alloc_check(tsdn_t *tsdn, size_t size) {
+	if (likely(mem_limit_get() == 0)) {
+		return false;
+	}
+	return mem_limit_alloc_check_hard(tsdn, size);
+}
+
+#endif /* JEMALLOC_INTERNAL_MEM_LIMIT_H */
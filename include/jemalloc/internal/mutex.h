@@ -48,6 +48,22 @@ struct malloc_mutex_s {
 #  endif
 #elif (defined(JEMALLOC_OS_UNFAIR_LOCK))
 			os_unfair_lock		lock;
+#elif (defined(JEMALLOC_FUTEX_LOCK))
+			/* One of the malloc_mutex_futex_state_t values. */
+			atomic_u32_t		lock;
+			/*
+			 * Number of waiters that have been woken up too many
+			 * times without getting the lock.  While nonzero,
+			 * unlocking hands the lock off to a waiter instead of
+			 * letting spinners barge in.
+			 */
+			atomic_u32_t		nstarving;
+			/*
+			 * Moving average of the number of spins it took to get
+			 * the lock, counting 0 whenever spinning failed; sizes
+			 * the spin budget of malloc_mutex_lock_slow().
+			 */
+			atomic_u32_t		spin_avg;
 #elif (defined(JEMALLOC_MUTEX_INIT_CB))
 			pthread_mutex_t		lock;
 			malloc_mutex_t		*postponed_next;
@@ -87,6 +103,10 @@ struct malloc_mutex_s {
 #    define MALLOC_MUTEX_LOCK(m)    os_unfair_lock_lock(&(m)->lock)
 #    define MALLOC_MUTEX_UNLOCK(m)  os_unfair_lock_unlock(&(m)->lock)
 #    define MALLOC_MUTEX_TRYLOCK(m) (!os_unfair_lock_trylock(&(m)->lock))
+#elif (defined(JEMALLOC_FUTEX_LOCK))
+#    define MALLOC_MUTEX_LOCK(m)    malloc_mutex_futex_lock(m)
+#    define MALLOC_MUTEX_UNLOCK(m)  malloc_mutex_futex_unlock(m)
+#    define MALLOC_MUTEX_TRYLOCK(m) malloc_mutex_futex_trylock(m)
 #else
 #    define MALLOC_MUTEX_LOCK(m)    pthread_mutex_lock(&(m)->lock)
 #    define MALLOC_MUTEX_UNLOCK(m)  pthread_mutex_unlock(&(m)->lock)
@@ -109,6 +129,18 @@ struct malloc_mutex_s {
   {{{LOCK_PROF_DATA_INITIALIZER, ATOMIC_INIT(false), OS_UNFAIR_LOCK_INIT}},  \
       WITNESS_INITIALIZER("mutex", WITNESS_RANK_OMIT)}
 #  endif
+#elif (defined(JEMALLOC_FUTEX_LOCK))
+#  if defined(JEMALLOC_DEBUG)
+#    define MALLOC_MUTEX_INITIALIZER					\
+  {{{LOCK_PROF_DATA_INITIALIZER, ATOMIC_INIT(false), ATOMIC_INIT(0),	\
+      ATOMIC_INIT(0), ATOMIC_INIT(0)}},					\
+         WITNESS_INITIALIZER("mutex", WITNESS_RANK_OMIT), 0}
+#  else
+#    define MALLOC_MUTEX_INITIALIZER					\
+  {{{LOCK_PROF_DATA_INITIALIZER, ATOMIC_INIT(false), ATOMIC_INIT(0),	\
+      ATOMIC_INIT(0), ATOMIC_INIT(0)}},					\
+      WITNESS_INITIALIZER("mutex", WITNESS_RANK_OMIT)}
+#  endif
 #elif (defined(JEMALLOC_MUTEX_INIT_CB))
 #  if (defined(JEMALLOC_DEBUG))
 #     define MALLOC_MUTEX_INITIALIZER					\
@@ -150,6 +182,70 @@ void malloc_mutex_prof_data_reset(tsdn_t *tsdn, malloc_mutex_t *mutex);
 
 void malloc_mutex_lock_slow(malloc_mutex_t *mutex);
 
+#ifdef JEMALLOC_FUTEX_LOCK
+typedef enum {
+	malloc_mutex_futex_unlocked = 0,
+	malloc_mutex_futex_locked = 1,
+	/* Locked, and there may be waiters to wake up on unlock. */
+	malloc_mutex_futex_contended = 2,
+	/*
+	 * Released directly to the starving waiters: spinners, trylock and the
+	 * other waiters can't take it, only a thread that has been marked
+	 * starving in malloc_mutex_futex_lock() can.
+	 */
+	malloc_mutex_futex_handoff = 3
+} malloc_mutex_futex_state_t;
+
+/*
+ * Thin futex(2) wrappers.  malloc_futex_wait() sleeps while *addr == val, until
+ * woken up or (if abstime isn't NULL) the CLOCK_REALTIME time abstime.  It
+ * returns ETIMEDOUT in the latter case, and 0 otherwise (including spurious
+ * wakeups).
+ */
+int malloc_futex_wait(atomic_u32_t *addr, uint32_t val,
+    const struct timespec *abstime);
+void malloc_futex_wake(atomic_u32_t *addr, int nwake);
+
+void malloc_mutex_futex_lock(malloc_mutex_t *mutex);
+
+static inline bool
+malloc_mutex_futex_trylock(malloc_mutex_t *mutex) {
+	uint32_t expected = malloc_mutex_futex_unlocked;
+	return !atomic_compare_exchange_strong_u32(&mutex->lock, &expected,
+	    malloc_mutex_futex_locked, ATOMIC_ACQUIRE, ATOMIC_RELAXED);
+}
+
+/* Takes a handed off lock, for starving waiters only; false on success. */
+static inline bool
+malloc_mutex_futex_handoff_take(malloc_mutex_t *mutex) {
+	uint32_t expected = malloc_mutex_futex_handoff;
+	/* Leave the lock contended, for the waiters that lost the handoff. */
+	return !atomic_compare_exchange_strong_u32(&mutex->lock, &expected,
+	    malloc_mutex_futex_contended, ATOMIC_ACQUIRE, ATOMIC_RELAXED);
+}
+
+static inline void
+malloc_mutex_futex_unlock(malloc_mutex_t *mutex) {
+	/*
+	 * A starving waiter keeps the lock contended until it gets it, so
+	 * there's always someone to take the handoff.  Wake up every waiter,
+	 * since waking up only one could pick one that can't take it.
+	 * Starvation is rare enough for that herd not to matter.
+	 */
+	if (unlikely(atomic_load_u32(&mutex->nstarving, ATOMIC_RELAXED)
+	    != 0)) {
+		atomic_store_u32(&mutex->lock, malloc_mutex_futex_handoff,
+		    ATOMIC_RELEASE);
+		malloc_futex_wake(&mutex->lock, INT_MAX);
+		return;
+	}
+	if (atomic_exchange_u32(&mutex->lock, malloc_mutex_futex_unlocked,
+	    ATOMIC_RELEASE) == malloc_mutex_futex_contended) {
+		malloc_futex_wake(&mutex->lock, 1);
+	}
+}
+#endif
+
 static inline void
 malloc_mutex_lock_final(malloc_mutex_t *mutex) {
 	MALLOC_MUTEX_LOCK(mutex);
@@ -0,0 +1,40 @@
+#ifndef JEMALLOC_INTERNAL_NUMA_H
+#define JEMALLOC_INTERNAL_NUMA_H
+
+#include "jemalloc/internal/jemalloc_preamble.h"
+
+/*
+ * NUMA-aware arenas.
+ *
+ * With opt_numa_arena, each automatic arena is bound to a NUMA node: the
+ * extents backing it (from both the PAC and the HPA) get an MPOL_PREFERRED
+ * memory policy for that node when first mapped, and threads are assigned
+ * arenas of the node they are running on.  With percpu_arena, arena i is bound
+ * to the node of CPU i (so that following the current CPU also follows the
+ * current node); otherwise the automatic arenas are striped across the nodes,
+ * and threads pick the least loaded arena of their node on first use.
+ */
+
+/* Returned for arenas that aren't bound to any node. */
+#define NUMA_NODE_NONE (-1)
+/* Node ids must fit a single unsigned long nodemask. */
+#define NUMA_NNODES_MAX ((int)(sizeof(unsigned long) * 8))
+/* CPUs beyond this are treated as belonging to no particular node. */
+#define NUMA_NCPUS_MAX 4096
+
+extern bool opt_numa_arena;
+
+void numa_boot(void);
+/* Number of nodes the automatic arenas are spread over. */
+unsigned numa_nnodes_get(void);
+/* The node automatic arena ind is bound to, or NUMA_NODE_NONE. */
+int numa_arena_node(unsigned ind);
+/*
+ * The index (in [0, numa_nnodes_get())) of the node of the current CPU, or -1
+ * if unknown.
+ */
+int numa_current_node_ind(void);
+/* Sets the preferred node of the pages in [addr, addr + size). */
+void numa_bind(void *addr, size_t size, int node);
+
+#endif /* JEMALLOC_INTERNAL_NUMA_H */
@@ -204,6 +204,17 @@ void pa_shard_set_deferral_allowed(tsdn_t *tsdn, pa_shard_t *shard,
 void pa_shard_do_deferred_work(tsdn_t *tsdn, pa_shard_t *shard);
 void pa_shard_try_deferred_work(tsdn_t *tsdn, pa_shard_t *shard);
 uint64_t pa_shard_time_until_deferred_work(tsdn_t *tsdn, pa_shard_t *shard);
+/*
+ * Shortens the PAC decay times and the HPA dirty_mult by a factor of 2^lg_div
+ * while under memory pressure; 0 restores them.
+ */
+void pa_shard_pressure_set(tsdn_t *tsdn, pa_shard_t *shard, unsigned lg_div,
+    pac_purge_eagerness_t eagerness);
+/*
+ * Purges the dirty pages of the HPA shard.  As with the deferred work, the PAC
+ * side is left to arena_decay().
+ */
+void pa_shard_purge_all(tsdn_t *tsdn, pa_shard_t *shard);
 
 /******************************************************************************/
 /*
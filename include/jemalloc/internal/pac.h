@@ -7,6 +7,8 @@
 #include "jemalloc/internal/edata_cache.h"
 #include "jemalloc/internal/exp_grow.h"
 #include "jemalloc/internal/lockedint.h"
+#include "jemalloc/internal/numa.h"
+#include "jemalloc/internal/pages.h"
 #include "jemalloc/internal/pai.h"
 #include "san_bump.h"
 
@@ -123,8 +125,27 @@ struct pac_s {
 
 	/* Extent serial number generator state. */
 	atomic_zu_t extent_sn_next;
+
+	/* Preferred node of newly mapped extents, or NUMA_NODE_NONE. */
+	int numa_node;
 };
 
+/*
+ * Whether slabs come from HUGEPAGE-aligned regions dedicated to them, advised
+ * to be backed by huge pages.  Their extents never merge with the others, so
+ * that neither slabs nor large extents fragment the huge pages of the other.
+ */
+extern bool opt_huge_slabs;
+
+/*
+ * Slab regions are split up, and kept around for good once mapped; this
+ * requires retaining virtual memory.
+ */
+static inline bool
+pac_huge_slabs_supported(void) {
+	return pages_can_hugify && maps_coalesce && opt_retain;
+}
+
 bool pac_init(tsdn_t *tsdn, pac_t *pac, base_t *base, emap_t *emap,
     edata_cache_t *edata_cache, nstime_t *cur_time, size_t oversize_threshold,
     ssize_t dirty_decay_ms, ssize_t muzzy_decay_ms, pac_stats_t *pac_stats,
@@ -176,6 +197,12 @@ bool pac_retain_grow_limit_get_set(tsdn_t *tsdn, pac_t *pac, size_t *old_limit,
 bool pac_decay_ms_set(tsdn_t *tsdn, pac_t *pac, extent_state_t state,
     ssize_t decay_ms, pac_purge_eagerness_t eagerness);
 ssize_t pac_decay_ms_get(pac_t *pac, extent_state_t state);
+/*
+ * Divides the (gradual) decay times by 2^lg_div while under memory pressure; 0
+ * restores them.
+ */
+void pac_pressure_set(tsdn_t *tsdn, pac_t *pac, unsigned lg_div,
+    pac_purge_eagerness_t eagerness);
 
 void pac_reset(tsdn_t *tsdn, pac_t *pac);
 void pac_destroy(tsdn_t *tsdn, pac_t *pac);
@@ -0,0 +1,186 @@
+#ifndef JEMALLOC_INTERNAL_PERCPU_CACHE_H
+#define JEMALLOC_INTERNAL_PERCPU_CACHE_H
+
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/arena_types.h"
+#include "jemalloc/internal/assert.h"
+#include "jemalloc/internal/atomic.h"
+#include "jemalloc/internal/cache_bin.h"
+#include "jemalloc/internal/sc.h"
+#include "jemalloc/internal/tcache_types.h"
+#include "jemalloc/internal/tsd_types.h"
+
+/*
+ * Per-CPU object caches for small size classes.
+ *
+ * With opt_percpu_tcache, the small bins of the automatic tcaches are
+ * disabled, and small objects are instead cached in one set of bins per CPU.
+ * Threads running on the same CPU share the cached objects, which bounds the
+ * memory held in caches by the number of CPUs rather than the number of
+ * threads, and lets objects freed by one thread be reused by the next one
+ * scheduled on that CPU.
+ *
+ * The push / pop operations on the per-CPU bins are restartable sequences
+ * (rseq): the kernel aborts and restarts them if the thread is preempted or
+ * migrated before the single committing store, so no atomic instructions are
+ * needed.  The slow paths (fill, flush) are built from the same primitives,
+ * one object at a time, and so never need exclusive access to a CPU.
+ *
+ * Remote access (see percpu_cache_flush_all()) marks the caches as draining,
+ * then uses membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ) to restart any
+ * in-flight sequence; afterwards all sequences observe the flag and fall back
+ * to the arena, and the caches may be accessed with plain loads and stores.
+ */
+
+/* CPU ids beyond this are served by the arenas directly. */
+#define PERCPU_CACHE_NCPUS_MAX 4096
+
+typedef struct percpu_cache_bin_s percpu_cache_bin_t;
+struct percpu_cache_bin_s {
+	/* Most recently cached object; grows down towards full. */
+	void		**head;
+	/* head == empty when nothing is cached. */
+	void		**empty;
+	/* head == full when no more objects fit. */
+	void		**full;
+};
+
+typedef struct percpu_cache_s percpu_cache_t;
+struct percpu_cache_s {
+	/* Nonzero while owned by percpu_cache_flush_all(). */
+	atomic_u32_t		draining;
+	percpu_cache_bin_t	bins[SC_NBINS];
+	/* The stacks of all the bins follow. */
+};
+
+extern bool opt_percpu_tcache;
+/* Whether opt_percpu_tcache was requested and is usable on this system. */
+extern bool percpu_cache_enabled;
+/*
+ * Lazily created on the first slow path taken on each CPU.  Holds
+ * percpu_cache_t pointers; read directly by the rseq critical sections.
+ */
+extern atomic_p_t percpu_caches[PERCPU_CACHE_NCPUS_MAX];
+
+bool percpu_cache_boot(tsdn_t *tsdn,
+    const cache_bin_info_t tcache_bin_info[TCACHE_NBINS_MAX],
+    unsigned tcache_nbins);
+void *percpu_cache_alloc_hard(tsd_t *tsd, arena_t *arena, szind_t binind);
+void percpu_cache_dalloc_hard(tsd_t *tsd, tcache_t *tcache, void *ptr,
+    szind_t binind);
+void percpu_cache_flush_all(tsd_t *tsd, tcache_t *tcache);
+void percpu_cache_prefork(tsdn_t *tsdn);
+void percpu_cache_postfork_parent(tsdn_t *tsdn);
+void percpu_cache_postfork_child(tsdn_t *tsdn);
+
+#ifdef JEMALLOC_HAVE_RSEQ
+/*
+ * The critical section descriptor (struct rseq_cs) and the abort handler.  The
+ * abort handler must be preceded by the signature glibc registered with, and
+ * simply restarts the sequence from the top.
+ */
+#define PERCPU_CACHE_RSEQ_PROLOGUE					\
+	".pushsection __rseq_cs, \"aw\"\n\t"				\
+	".balign 32\n\t"						\
+	"3:\n\t"							\
+	".long 0x0, 0x0\n\t"						\
+	".quad 1f, 2f - 1f, 4f\n\t"					\
+	".popsection\n\t"						\
+	".pushsection __rseq_failure, \"ax\"\n\t"			\
+	".byte 0x0f, 0xb9, 0x3d\n\t"					\
+	".long 0x53053053\n\t"						\
+	"4:\n\t"							\
+	"jmp 0f\n\t"							\
+	".popsection\n\t"						\
+	"0:\n\t"							\
+	"leaq 3b(%%rip), %%rax\n\t"					\
+	"movq %%rax, %%fs:8(%[rseq_offset])\n\t"			\
+	"1:\n\t"							\
+	/* Locate this CPU's bin, or bail out. */			\
+	"movl %%fs:4(%[rseq_offset]), %k[bin]\n\t"			\
+	"cmpl %[ncpus_max], %k[bin]\n\t"				\
+	"jae 5f\n\t"							\
+	"movq (%[caches], %q[bin], 8), %q[bin]\n\t"			\
+	"testq %q[bin], %q[bin]\n\t"					\
+	"jz 5f\n\t"							\
+	"cmpl $0, %c[draining_offset](%q[bin])\n\t"			\
+	"jne 5f\n\t"							\
+	"addq %[bin_offset], %q[bin]\n\t"				\
+	"movq %c[head_offset](%q[bin]), %[head]\n\t"
+
+#define PERCPU_CACHE_RSEQ_OPERANDS(binind)				\
+	[rseq_offset] "r" (__rseq_offset),				\
+	[ncpus_max] "i" (PERCPU_CACHE_NCPUS_MAX),			\
+	[caches] "r" (percpu_caches),					\
+	[bin_offset] "r" (offsetof(percpu_cache_t, bins) +		\
+	    (size_t)(binind) * sizeof(percpu_cache_bin_t)),		\
+	[draining_offset] "i" (offsetof(percpu_cache_t, draining)),	\
+	[head_offset] "i" (offsetof(percpu_cache_bin_t, head)),		\
+	[empty_offset] "i" (offsetof(percpu_cache_bin_t, empty)),	\
+	[full_offset] "i" (offsetof(percpu_cache_bin_t, full))
+#endif
+
+/* Pops an object off the current CPU's bin; returns NULL on failure. */
+JEMALLOC_ALWAYS_INLINE void *
+percpu_cache_alloc_easy(szind_t binind) {
+#ifdef JEMALLOC_HAVE_RSEQ
+	assert(binind < SC_NBINS);
+	void *ret;
+	uintptr_t bin;
+	void **head;
+	__asm__ __volatile__(
+	    PERCPU_CACHE_RSEQ_PROLOGUE
+	    "cmpq %[head], %c[empty_offset](%q[bin])\n\t"
+	    "je 5f\n\t"
+	    "movq (%[head]), %[ret]\n\t"
+	    "addq $8, %[head]\n\t"
+	    /* Commit. */
+	    "movq %[head], %c[head_offset](%q[bin])\n\t"
+	    "2:\n\t"
+	    "jmp 6f\n\t"
+	    "5:\n\t"
+	    "xorl %k[ret], %k[ret]\n\t"
+	    "6:\n\t"
+	    : [ret] "=&r" (ret), [bin] "=&r" (bin), [head] "=&r" (head)
+	    : PERCPU_CACHE_RSEQ_OPERANDS(binind)
+	    : "rax", "cc", "memory");
+	return ret;
+#else
+	not_reached();
+	return NULL;
+#endif
+}
+
+/* Pushes ptr onto the current CPU's bin; returns false on failure. */
+JEMALLOC_ALWAYS_INLINE bool
+percpu_cache_dalloc_easy(szind_t binind, void *ptr) {
+#ifdef JEMALLOC_HAVE_RSEQ
+	assert(binind < SC_NBINS);
+	uint32_t ret;
+	uintptr_t bin;
+	void **head;
+	__asm__ __volatile__(
+	    PERCPU_CACHE_RSEQ_PROLOGUE
+	    "cmpq %[head], %c[full_offset](%q[bin])\n\t"
+	    "je 5f\n\t"
+	    "movq %[ptr], -8(%[head])\n\t"
+	    "subq $8, %[head]\n\t"
+	    /* Commit. */
+	    "movq %[head], %c[head_offset](%q[bin])\n\t"
+	    "2:\n\t"
+	    "movl $1, %k[ret]\n\t"
+	    "jmp 6f\n\t"
+	    "5:\n\t"
+	    "xorl %k[ret], %k[ret]\n\t"
+	    "6:\n\t"
+	    : [ret] "=&r" (ret), [bin] "=&r" (bin), [head] "=&r" (head)
+	    : [ptr] "r" (ptr), PERCPU_CACHE_RSEQ_OPERANDS(binind)
+	    : "rax", "cc", "memory");
+	return ret != 0;
+#else
+	not_reached();
+	return false;
+#endif
+}
+
+#endif /* JEMALLOC_INTERNAL_PERCPU_CACHE_H */
@@ -0,0 +1,58 @@
+#ifndef JEMALLOC_INTERNAL_PRESSURE_H
+#define JEMALLOC_INTERNAL_PRESSURE_H
+
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/atomic.h"
+#include "jemalloc/internal/tsd_types.h"
+
+/*
+ * Memory pressure aware purging.
+ *
+ * With opt_pressure_purge, background thread 0 samples the memory pressure of
+ * the process' cgroup about once a second: the PSI "some avg10" figure of its
+ * memory.pressure (or of the system-wide /proc/pressure/memory, without cgroup
+ * v2), and whether the high or max counters of its memory.events went up.
+ * While under pressure, the decay times of all arenas and the HPA dirty_mult
+ * are divided by 2^PRESSURE_LG_DIV, so that unused dirty pages get returned to
+ * the kernel before it has to reclaim anything else; they are restored once
+ * the pressure subsides (with some hysteresis).
+ */
+
+#define PRESSURE_LG_DIV 3
+#define PRESSURE_POLL_INTERVAL_NS KQU(1000000000)
+/* In percent of PSI "some avg10". */
+#define PRESSURE_PURGE_THRESHOLD_DEFAULT 10
+
+typedef struct pressure_sample_s pressure_sample_t;
+struct pressure_sample_s {
+	/* PSI "some avg10", in hundredths of a percent. */
+	uint64_t some_avg10;
+	/* Sum of the memory.events high and max counters, or 0. */
+	uint64_t nevents;
+};
+
+extern bool opt_pressure_purge;
+extern unsigned opt_pressure_purge_threshold;
+
+void pressure_boot(void);
+/* Whether the arenas are currently in the shortened decay mode. */
+bool pressure_active(void);
+/* The number of times the shortened decay mode has been entered. */
+uint64_t pressure_nperiods_get(void);
+/* Called by background thread 0 on each run; rate limits itself. */
+void pressure_background_work(tsdn_t *tsdn);
+/* Called by background thread 0 when stopping, to restore the decay times. */
+void pressure_background_stop(tsdn_t *tsdn);
+/* Updates the pressure state (and the arenas) with a new sample. */
+void pressure_update(tsdn_t *tsdn, const pressure_sample_t *sample);
+/* Parsers for the PSI and memory.events formats.  Return true on error. */
+bool pressure_psi_parse(const char *buf, uint64_t *some_avg10);
+bool pressure_events_parse(const char *buf, uint64_t *nevents);
+/*
+ * Finds our cgroup v2 path (empty for the root) in the contents of
+ * /proc/self/cgroup.  Returns true if there is none, or if its line is
+ * incomplete, as in a truncated read.
+ */
+bool pressure_cgroup_parse(const char *buf, const char **cgroup, size_t *len);
+
+#endif /* JEMALLOC_INTERNAL_PRESSURE_H */
@@ -4,7 +4,6 @@
 #include "jemalloc/internal/jemalloc_preamble.h"
 #include "jemalloc/internal/mutex.h"
 
-extern malloc_mutex_t bt2gctx_mtx;
 extern malloc_mutex_t tdatas_mtx;
 extern malloc_mutex_t prof_dump_mtx;
 
@@ -17,12 +16,27 @@ extern size_t prof_shifted_unbiased_cnt[PROF_SC_NSIZES];
 void prof_bt_hash(const void *key, size_t r_hash[2]);
 bool prof_bt_keycomp(const void *k1, const void *k2);
 
+bool prof_bt2gctx_mutexes_init(void);
+void prof_bt2gctx_prefork(tsdn_t *tsdn);
+void prof_bt2gctx_postfork_parent(tsdn_t *tsdn);
+void prof_bt2gctx_postfork_child(tsdn_t *tsdn);
+void prof_bt2gctx_mutex_prof_read(tsdn_t *tsdn, mutex_prof_data_t *data);
+void prof_bt2gctx_mutex_prof_reset(tsdn_t *tsdn);
 bool prof_data_init(tsd_t *tsd);
 prof_tctx_t *prof_lookup(tsd_t *tsd, prof_bt_t *bt);
 int prof_thread_name_set_impl(tsd_t *tsd, const char *thread_name);
 void prof_unbias_map_init(void);
 void prof_dump_impl(tsd_t *tsd, write_cb_t *prof_dump_write, void *cbopaque,
     prof_tdata_t *tdata, bool leakcheck);
+/*
+ * Calls visit on each backtrace that prof_dump_impl() would dump, with its
+ * summed counters, instead of formatting them.  Returning true from visit stops
+ * the iteration.
+ */
+typedef bool (prof_dump_visit_cb_t)(void *opaque, const prof_bt_t *bt,
+    const prof_cnt_t *cnts);
+void prof_dump_visit(tsd_t *tsd, prof_dump_visit_cb_t *visit, void *opaque,
+    prof_tdata_t *tdata, bool leakcheck);
 prof_tdata_t * prof_tdata_init_impl(tsd_t *tsd, uint64_t thr_uid,
     uint64_t thr_discrim, char *thread_name, bool active);
 void prof_tdata_detach(tsd_t *tsd, prof_tdata_t *tdata);
@@ -16,6 +16,10 @@ extern bool opt_prof_gdump;          /* High-water memory dumping. */
 extern bool opt_prof_final;          /* Final profile dumping. */
 extern bool opt_prof_leak;           /* Dump leak summary at exit. */
 extern bool opt_prof_leak_error;     /* Exit with error code if memory leaked */
+extern bool opt_prof_dump_incremental; /* Dump without stopping sampling. */
+extern bool opt_prof_dump_gzip;      /* Compress the dump files. */
+extern prof_dump_format_t opt_prof_dump_format;
+extern const char *const prof_dump_format_names[];
 extern bool opt_prof_accum;          /* Report cumulative bytes. */
 extern bool opt_prof_log;            /* Turn logging on at boot. */
 extern char opt_prof_prefix[
@@ -34,6 +38,7 @@ extern ssize_t opt_prof_recent_alloc_max;
 
 /* Whether to use thread name provided by the system or by mallctl. */
 extern bool opt_prof_sys_thread_name;
+extern bool opt_prof_fast_unwind;
 
 /* Whether to record per size class counts and request size totals. */
 extern bool opt_prof_stats;
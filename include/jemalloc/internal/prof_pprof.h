@@ -0,0 +1,25 @@
+#ifndef JEMALLOC_INTERNAL_PROF_PPROF_H
+#define JEMALLOC_INTERNAL_PROF_PPROF_H
+
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/buf_writer.h"
+#include "jemalloc/internal/gz_writer.h"
+
+/*
+ * Heap profile dumps in the format of pprof, i.e. a serialized
+ * perftools.profiles.Profile message, as defined by profile.proto.  Each dumped
+ * backtrace becomes a sample, whose values are the unbiased estimates of the
+ * allocated objects and bytes (alloc_objects and alloc_space, only if
+ * opt.prof_accum is on), and of the live objects and bytes (inuse_objects and
+ * inuse_space).  Locations carry addresses only, and the mappings (parsed from
+ * the /proc/<pid>/maps style text read through maps_read_cb, if not NULL) let
+ * pprof symbolize them.
+ *
+ * The message is streamed to write_cb through buf, in pieces of at most
+ * buf_size bytes.  Returns true if it couldn't be completed due to OOM.
+ */
+bool prof_pprof_dump(tsd_t *tsd, gz_write_cb_t *write_cb, void *cbopaque,
+    unsigned char *buf, size_t buf_size, read_cb_t *maps_read_cb,
+    void *maps_cbopaque, prof_tdata_t *tdata, bool leakcheck);
+
+#endif /* JEMALLOC_INTERNAL_PROF_PPROF_H */
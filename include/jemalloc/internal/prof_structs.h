@@ -6,6 +6,7 @@
 #include "jemalloc/internal/edata.h"
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/prng.h"
+#include "jemalloc/internal/ql.h"
 #include "jemalloc/internal/rb.h"
 
 struct prof_bt_s {
@@ -134,6 +135,19 @@ struct prof_gctx_s {
 	/* Linkage for tree of contexts to be dumped. */
 	rb_node(prof_gctx_t)	dump_link;
 
+	/*
+	 * Index of the bt2gctx shard holding this gctx, and linkage for the
+	 * shard's list of contexts, protected by the shard mutex.
+	 */
+	unsigned		shard_ind;
+	ql_elm(prof_gctx_t)	link;
+
+	/*
+	 * Whether the dump in progress includes this gctx, i.e. whether it may
+	 * snapshot the counters of its tctxs.
+	 */
+	bool			dumping;
+
 	/* Temporary storage for summation during dump. */
 	prof_cnt_t		cnt_summed;
 
@@ -9,6 +9,15 @@ typedef struct prof_gctx_s prof_gctx_t;
 typedef struct prof_tdata_s prof_tdata_t;
 typedef struct prof_recent_s prof_recent_t;
 
+/* Format of the heap profile dump files. */
+enum prof_dump_format_e {
+	/* The text format that jeprof reads. */
+	prof_dump_format_heap_v2 = 0,
+	/* The profile.proto protocol buffer that pprof reads. */
+	prof_dump_format_pprof = 1
+};
+typedef enum prof_dump_format_e prof_dump_format_t;
+
 /* Option defaults. */
 #ifdef JEMALLOC_PROF
 #  define PROF_PREFIX_DEFAULT		"jeprof"
@@ -33,6 +42,20 @@ typedef struct prof_recent_s prof_recent_t;
 /* Initial hash table size. */
 #define PROF_CKH_MINITEMS		64
 
+/*
+ * Number of shards of the global backtrace hash table, each with its own mutex
+ * and initial hash table size.
+ */
+#ifdef JEMALLOC_PROF
+#  define PROF_LG_BT2GCTX_NSHARDS	6
+#  define PROF_BT2GCTX_CKH_MINITEMS	8
+#else
+/* Minimize memory bloat for non-prof builds. */
+#  define PROF_LG_BT2GCTX_NSHARDS	0
+#  define PROF_BT2GCTX_CKH_MINITEMS	1
+#endif
+#define PROF_BT2GCTX_NSHARDS		(1U << PROF_LG_BT2GCTX_NSHARDS)
+
 /* Size of memory buffer to use when writing dump files. */
 #ifndef JEMALLOC_PROF
 /* Minimize memory bloat for non-prof builds. */
@@ -9,6 +9,7 @@
 #include "jemalloc/internal/rtree_tsd.h"
 #include "jemalloc/internal/sc.h"
 #include "jemalloc/internal/tsd.h"
+#include "jemalloc/internal/util.h"
 
 /*
  * This radix tree implementation is tailored to the singular purpose of
@@ -137,6 +138,18 @@ bool rtree_new(rtree_t *rtree, base_t *base, bool zeroed);
 rtree_leaf_elm_t *rtree_leaf_elm_lookup_hard(tsdn_t *tsdn, rtree_t *rtree,
     rtree_ctx_t *rtree_ctx, uintptr_t key, bool dependent, bool init_missing);
 
+/*
+ * Called on each leaf with the key of its first element; element i covers the
+ * page at key + (i << LG_PAGE).  Leaves are never freed, so visitors can read
+ * them without synchronization (other than by the atomic element reads).
+ */
+typedef void rtree_leaf_visitor_t(void *ctx, uintptr_t key,
+    rtree_leaf_elm_t *leaf);
+/* Visits all the leaves that exist, in key order. */
+void rtree_leaves_iter(rtree_t *rtree, rtree_leaf_visitor_t *visitor,
+    void *ctx);
+#define RTREE_LEAF_NELMS (ZU(1) << rtree_levels[RTREE_HEIGHT-1].bits)
+
 JEMALLOC_ALWAYS_INLINE unsigned
 rtree_leaf_maskbits(void) {
 	unsigned ptrbits = ZU(1) << (LG_SIZEOF_PTR+3);
@@ -423,6 +436,41 @@ rtree_leaf_elm_lookup(tsdn_t *tsdn, rtree_t *rtree, rtree_ctx_t *rtree_ctx,
 	    dependent, init_missing);
 }
 
+/*
+ * Looks up the elements of n arbitrary keys, setting those of the keys without
+ * a leaf (or of 0) to NULL.  Consecutive keys that share a leaf reuse it
+ * without going through the cache, so this works best on keys sorted by
+ * address.  The elements found are prefetched, for the caller to read next.
+ */
+JEMALLOC_ALWAYS_INLINE void
+rtree_leaf_elm_lookup_batch(tsdn_t *tsdn, rtree_t *rtree,
+    rtree_ctx_t *rtree_ctx, size_t n, const uintptr_t *keys,
+    rtree_leaf_elm_t **r_elms) {
+	uintptr_t leafkey = RTREE_LEAFKEY_INVALID;
+	rtree_leaf_elm_t *leaf = NULL;
+	for (size_t i = 0; i < n; i++) {
+		uintptr_t key = keys[i];
+		if (unlikely(key == 0)) {
+			r_elms[i] = NULL;
+			continue;
+		}
+		uintptr_t subkey = rtree_subkey(key, RTREE_HEIGHT-1);
+		if (rtree_leafkey(key) == leafkey) {
+			r_elms[i] = &leaf[subkey];
+		} else {
+			r_elms[i] = rtree_leaf_elm_lookup(tsdn, rtree, rtree_ctx,
+			    key, /* dependent */ false, /* init_missing */ false);
+			if (r_elms[i] == NULL) {
+				leafkey = RTREE_LEAFKEY_INVALID;
+				continue;
+			}
+			leafkey = rtree_leafkey(key);
+			leaf = r_elms[i] - subkey;
+		}
+		util_prefetch_read(r_elms[i]);
+	}
+}
+
 /*
  * Returns true on lookup failure.
  */
@@ -0,0 +1,124 @@
+#ifndef JEMALLOC_INTERNAL_STATS_SNAPSHOT_H
+#define JEMALLOC_INTERNAL_STATS_SNAPSHOT_H
+
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/sc.h"
+#include "jemalloc/internal/tsd_types.h"
+
+/*
+ * Lightweight statistics snapshots, for frequent scraping.
+ *
+ * Unlike a stats refresh through the "epoch" mallctl, which merges every arena
+ * (and bin, and mutex) under the corresponding locks into the ctl module's own
+ * copies, a snapshot sums the counters of all arenas straight into a flat,
+ * caller-provided array of uint64_t, using relaxed reads and no locks.  The
+ * values are therefore only approximately consistent with each other, and
+ * those of destroyed arenas are not included.
+ *
+ * The array consists of the global fields, then the bin fields of each of the
+ * SC_NBINS bins, then the large fields of each of the SC_NSIZES - SC_NBINS
+ * large size classes, all in the order listed below.  Counters only ever
+ * increase; in delta mode, they are reported relative to a previous snapshot,
+ * while the gauges stay absolute.  Applications find the fields through the
+ * experimental.stats_snapshot_layout mallctls, which are generated from these
+ * lists, rather than by hardcoding their order.
+ */
+
+#define STATS_SNAPSHOT_GLOBAL_FIELDS					\
+    OP(narenas,			gauge)					\
+    OP(allocated,		gauge)					\
+    OP(allocated_small,		gauge)					\
+    OP(allocated_large,		gauge)					\
+    OP(active,			gauge)					\
+    OP(mapped,			gauge)					\
+    OP(retained,		gauge)					\
+    OP(dirty,			gauge)					\
+    OP(muzzy,			gauge)					\
+    OP(internal,		gauge)					\
+    OP(nmalloc_small,		counter)				\
+    OP(ndalloc_small,		counter)				\
+    OP(nrequests_small,		counter)				\
+    OP(nfills_small,		counter)				\
+    OP(nflushes_small,		counter)				\
+    OP(nmalloc_large,		counter)				\
+    OP(ndalloc_large,		counter)				\
+    OP(nrequests_large,		counter)				\
+    OP(nflushes_large,		counter)				\
+    OP(dirty_npurge,		counter)				\
+    OP(dirty_nmadvise,		counter)				\
+    OP(dirty_purged,		counter)				\
+    OP(muzzy_npurge,		counter)				\
+    OP(muzzy_nmadvise,		counter)				\
+    OP(muzzy_purged,		counter)
+
+#define STATS_SNAPSHOT_BIN_FIELDS					\
+    OP(nmalloc,			counter)				\
+    OP(ndalloc,			counter)				\
+    OP(nrequests,		counter)				\
+    OP(curregs,			gauge)					\
+    OP(nfills,			counter)				\
+    OP(nflushes,		counter)				\
+    OP(nslabs,			counter)				\
+    OP(reslabs,			counter)				\
+    OP(curslabs,		gauge)					\
+    OP(nonfull_slabs,		gauge)
+
+#define STATS_SNAPSHOT_LEXTENT_FIELDS					\
+    OP(nmalloc,			counter)				\
+    OP(ndalloc,			counter)				\
+    OP(nrequests,		counter)				\
+    OP(nflushes,		counter)				\
+    OP(curlextents,		gauge)
+
+typedef enum {
+#define OP(name, kind) stats_snapshot_global_##name,
+	STATS_SNAPSHOT_GLOBAL_FIELDS
+#undef OP
+	stats_snapshot_num_global_fields
+} stats_snapshot_global_ind_t;
+
+typedef enum {
+#define OP(name, kind) stats_snapshot_bin_##name,
+	STATS_SNAPSHOT_BIN_FIELDS
+#undef OP
+	stats_snapshot_num_bin_fields
+} stats_snapshot_bin_ind_t;
+
+typedef enum {
+#define OP(name, kind) stats_snapshot_lextent_##name,
+	STATS_SNAPSHOT_LEXTENT_FIELDS
+#undef OP
+	stats_snapshot_num_lextent_fields
+} stats_snapshot_lextent_ind_t;
+
+#define STATS_SNAPSHOT_BINS_OFFSET stats_snapshot_num_global_fields
+#define STATS_SNAPSHOT_LEXTENTS_OFFSET					\
+    (STATS_SNAPSHOT_BINS_OFFSET + SC_NBINS * stats_snapshot_num_bin_fields)
+/* The number of uint64_t in a snapshot. */
+#define STATS_SNAPSHOT_LEN						\
+    (STATS_SNAPSHOT_LEXTENTS_OFFSET +					\
+    (SC_NSIZES - SC_NBINS) * stats_snapshot_num_lextent_fields)
+
+static inline size_t
+stats_snapshot_bin_ind(szind_t binind, stats_snapshot_bin_ind_t field) {
+	return STATS_SNAPSHOT_BINS_OFFSET +
+	    binind * stats_snapshot_num_bin_fields + field;
+}
+
+static inline size_t
+stats_snapshot_lextent_ind(szind_t lextent_ind,
+    stats_snapshot_lextent_ind_t field) {
+	return STATS_SNAPSHOT_LEXTENTS_OFFSET +
+	    lextent_ind * stats_snapshot_num_lextent_fields + field;
+}
+
+/* Fills snap (of STATS_SNAPSHOT_LEN elements) with the current stats. */
+void stats_snapshot_read(tsdn_t *tsdn, uint64_t *snap);
+/*
+ * Fills delta with the increase of the counters of cur since prev, and the
+ * gauges of cur as they are.  Decreases (i.e. destroyed arenas) read as 0.
+ */
+void stats_snapshot_delta(uint64_t *delta, const uint64_t *cur,
+    const uint64_t *prev);
+
+#endif /* JEMALLOC_INTERNAL_STATS_SNAPSHOT_H */
@@ -18,6 +18,8 @@ extern size_t opt_tcache_gc_incr_bytes;
 extern size_t opt_tcache_gc_delay_bytes;
 extern unsigned opt_lg_tcache_flush_small_div;
 extern unsigned opt_lg_tcache_flush_large_div;
+extern bool opt_tcache_adaptive;
+extern size_t opt_tcache_adaptive_max_bytes;
 
 /*
  * Number of tcache bins.  There are SC_NBINS small-object bins, plus 0 or more
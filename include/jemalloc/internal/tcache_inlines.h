@@ -7,6 +7,7 @@
 #include "jemalloc/internal/jemalloc_internal_inlines_b.h"
 #include "jemalloc/internal/jemalloc_internal_types.h"
 #include "jemalloc/internal/large_externs.h"
+#include "jemalloc/internal/percpu_cache.h"
 #include "jemalloc/internal/san.h"
 #include "jemalloc/internal/sc.h"
 #include "jemalloc/internal/sz.h"
@@ -44,8 +45,12 @@ tcache_max_set(tcache_slow_t *tcache_slow, size_t tcache_max) {
 static inline void
 tcache_bin_settings_backup(tcache_t *tcache,
     cache_bin_info_t tcache_bin_info[TCACHE_NBINS_MAX]) {
+	tcache_slow_t *tcache_slow = tcache->tcache_slow;
 	for (unsigned i = 0; i < TCACHE_NBINS_MAX; i++) {
+		/* The enabled bins may have been shrunk by tcache_adaptive. */
 		cache_bin_info_init(&tcache_bin_info[i],
+		    i < tcache_nbins_get(tcache_slow) ?
+		    tcache_slow->bin_ncached_capacity[i] :
 		    cache_bin_ncached_max_get_unsafe(&tcache->bins[i]));
 	}
 }
@@ -87,6 +92,29 @@ tcache_bin_disabled(szind_t ind, cache_bin_t *bin,
 	return disabled;
 }
 
+/*
+ * Whether binind is cached per CPU rather than in the (disabled) tcache bin.
+ * Size classes beyond the tcache's tcache_max are not cached at all.
+ */
+JEMALLOC_ALWAYS_INLINE bool
+tcache_percpu_cache_get(tcache_slow_t *tcache_slow, szind_t binind) {
+	assert(binind < SC_NBINS);
+	return tcache_slow->percpu_cache &&
+	    binind < tcache_nbins_get(tcache_slow);
+}
+
+/*
+ * Records that a bin had to go to the arena, either to fill or to flush
+ * because it was full; see tcache_adaptive.
+ */
+JEMALLOC_ALWAYS_INLINE void
+tcache_bin_miss_record(tcache_slow_t *tcache_slow, szind_t binind) {
+	assert(binind < TCACHE_NBINS_MAX);
+	if (tcache_slow->bin_nmisses[binind] < UINT8_MAX) {
+		tcache_slow->bin_nmisses[binind]++;
+	}
+}
+
 JEMALLOC_ALWAYS_INLINE void *
 tcache_alloc_small(tsd_t *tsd, arena_t *arena, tcache_t *tcache,
     size_t size, szind_t binind, bool zero, bool slow_path) {
@@ -105,17 +133,32 @@ tcache_alloc_small(tsd_t *tsd, arena_t *arena, tcache_t *tcache,
 		}
 		if (unlikely(tcache_bin_disabled(binind, bin,
 		    tcache->tcache_slow))) {
-			/* stats and zero are handled directly by the arena. */
-			return arena_malloc_hard(tsd_tsdn(tsd), arena, size,
-			    binind, zero, /* slab */ true);
-		}
-		tcache_bin_flush_stashed(tsd, tcache, bin, binind,
-		    /* is_small */ true);
+			if (!tcache_percpu_cache_get(tcache->tcache_slow,
+			    binind) || !arena_is_auto(arena)) {
+				/*
+				 * stats and zero are handled directly by the
+				 * arena.
+				 */
+				return arena_malloc_hard(tsd_tsdn(tsd), arena,
+				    size, binind, zero, /* slab */ true);
+			}
+			ret = percpu_cache_alloc_easy(binind);
+			if (ret == NULL) {
+				ret = percpu_cache_alloc_hard(tsd, arena,
+				    binind);
+				if (ret == NULL) {
+					return NULL;
+				}
+			}
+		} else {
+			tcache_bin_flush_stashed(tsd, tcache, bin, binind,
+			    /* is_small */ true);
 
-		ret = tcache_alloc_small_hard(tsd_tsdn(tsd), arena, tcache,
-		    bin, binind, &tcache_hard_success);
-		if (tcache_hard_success == false) {
-			return NULL;
+			ret = tcache_alloc_small_hard(tsd_tsdn(tsd), arena,
+			    tcache, bin, binind, &tcache_hard_success);
+			if (tcache_hard_success == false) {
+				return NULL;
+			}
 		}
 	}
 
@@ -143,6 +186,7 @@ tcache_alloc_large(tsd_t *tsd, arena_t *arena, tcache_t *tcache, size_t size,
 	ret = cache_bin_alloc(bin, &tcache_success);
 	assert(tcache_success == (ret != NULL));
 	if (unlikely(!tcache_success)) {
+		tcache_bin_miss_record(tcache->tcache_slow, binind);
 		/*
 		 * Only allocate one large object at a time, because it's quite
 		 * expensive to create one and not use it.
@@ -197,9 +241,21 @@ tcache_dalloc_small(tsd_t *tsd, tcache_t *tcache, void *ptr, szind_t binind,
 	if (unlikely(!cache_bin_dalloc_easy(bin, ptr))) {
 		if (unlikely(tcache_bin_disabled(binind, bin,
 		    tcache->tcache_slow))) {
-			arena_dalloc_small(tsd_tsdn(tsd), ptr);
+			/*
+			 * Objects with special alignments are junked / stashed
+			 * for use-after-free detection, which the per-CPU
+			 * caches don't support.
+			 */
+			if (!tcache_percpu_cache_get(tcache->tcache_slow,
+			    binind) || cache_bin_nonfast_aligned(ptr)) {
+				arena_dalloc_small(tsd_tsdn(tsd), ptr);
+			} else if (!percpu_cache_dalloc_easy(binind, ptr)) {
+				percpu_cache_dalloc_hard(tsd, tcache, ptr,
+				    binind);
+			}
 			return;
 		}
+		tcache_bin_miss_record(tcache->tcache_slow, binind);
 		cache_bin_sz_t max = cache_bin_ncached_max_get(bin);
 		unsigned remain = max >> opt_lg_tcache_flush_small_div;
 		tcache_bin_flush_small(tsd, tcache, bin, binind, remain);
@@ -220,6 +276,7 @@ tcache_dalloc_large(tsd_t *tsd, tcache_t *tcache, void *ptr, szind_t binind,
 
 	cache_bin_t *bin = &tcache->bins[binind];
 	if (unlikely(!cache_bin_dalloc_easy(bin, ptr))) {
+		tcache_bin_miss_record(tcache->tcache_slow, binind);
 		unsigned remain = cache_bin_ncached_max_get(bin) >>
 		    opt_lg_tcache_flush_large_div;
 		tcache_bin_flush_large(tsd, tcache, bin, binind, remain);
@@ -33,6 +33,12 @@ struct tcache_slow_s {
 	arena_t		*arena;
 	/* The number of bins activated in the tcache. */
 	unsigned	tcache_nbins;
+	/*
+	 * Whether small size classes are cached in the per-CPU caches instead
+	 * of in our (disabled) small bins; see percpu_cache.h.  Only set for
+	 * the automatic tcache, while associated with an automatic arena.
+	 */
+	bool		percpu_cache;
 	/* Last time GC has been performed.  */
 	nstime_t	last_gc_time;
 	/* Next bin to GC. */
@@ -48,6 +54,20 @@ struct tcache_slow_s {
 	 * actually flushing.
 	 */
 	uint8_t		bin_flush_delay_items[SC_NBINS];
+	/*
+	 * For tcache_adaptive: the ncached_max each bin was initialized with
+	 * (the most its stack has room for), and the number of misses (fills,
+	 * or flushes of a full bin) since the bin was last GCed, saturating.
+	 */
+	cache_bin_sz_t	bin_ncached_capacity[TCACHE_NBINS_MAX];
+	uint8_t		bin_nmisses[TCACHE_NBINS_MAX];
+	/*
+	 * Sum of ncached_max * usize over the enabled bins; kept within
+	 * opt_tcache_adaptive_max_bytes when growing bins.
+	 */
+	size_t		ncached_max_bytes;
+	/* The last mem_limit flush epoch this tcache was flushed for. */
+	unsigned	mem_limit_flush_epoch;
 	/*
 	 * The start of the allocation containing the dynamic allocation for
 	 * either the cache bins alone, or the cache bin memory as well as this
@@ -28,4 +28,9 @@ typedef struct tcaches_s tcaches_t;
 #define TCACHE_GC_SMALL_NBINS_MAX ((SC_NBINS > 8) ? (SC_NBINS >> 3) : 1)
 #define TCACHE_GC_LARGE_NBINS_MAX 1
 
+/* Parameters of tcache_adaptive; see tcache.c. */
+#define TCACHE_ADAPTIVE_GROW_NMISSES 2
+#define TCACHE_ADAPTIVE_NCACHED_MIN 1
+#define TCACHE_ADAPTIVE_INIT_BYTES ((size_t)4 << 10)
+
 #endif /* JEMALLOC_INTERNAL_TCACHE_TYPES_H */
@@ -57,6 +57,7 @@ void tsd_te_init(tsd_t *tsd);
     E(tcache_gc,		(opt_tcache_gc_incr_bytes > 0), true)	\
     E(prof_sample,		(config_prof && opt_prof), true)  	\
     E(stats_interval,		(opt_stats_interval >= 0), true)   	\
+    E(arena_rebalance,		(opt_arena_rebalance_interval > 0), true)	\
     E(tcache_gc_dalloc,		(opt_tcache_gc_incr_bytes > 0), false)	\
     E(peak_alloc,		config_stats, true)			\
     E(peak_dalloc,		config_stats, false)
@@ -70,7 +71,8 @@ void tsd_te_init(tsd_t *tsd);
     C(thread_allocated_last_event)					\
     ITERATE_OVER_ALL_EVENTS						\
     C(prof_sample_last_event)						\
-    C(stats_interval_last_event)
+    C(stats_interval_last_event)					\
+    C(arena_rebalance_last_event)
 
 /* Getters directly wrap TSD getters. */
 #define C(counter)							\
@@ -289,14 +291,34 @@ te_event_advance(tsd_t *tsd, size_t usize, bool is_alloc) {
 	}
 }
 
+/*
+ * The batch variants account for n operations at once, totalling usize bytes.
+ * The operation counts are only needed for the allocation tags stats.
+ */
 JEMALLOC_ALWAYS_INLINE void
-thread_dalloc_event(tsd_t *tsd, size_t usize) {
+thread_dalloc_batch_event(tsd_t *tsd, size_t n, size_t usize) {
+	if (config_stats) {
+		*tsd_thread_ndallocp_get(tsd) += n;
+	}
 	te_event_advance(tsd, usize, false);
 }
 
 JEMALLOC_ALWAYS_INLINE void
-thread_alloc_event(tsd_t *tsd, size_t usize) {
+thread_alloc_batch_event(tsd_t *tsd, size_t n, size_t usize) {
+	if (config_stats) {
+		*tsd_thread_nmallocp_get(tsd) += n;
+	}
 	te_event_advance(tsd, usize, true);
 }
 
+JEMALLOC_ALWAYS_INLINE void
+thread_dalloc_event(tsd_t *tsd, size_t usize) {
+	thread_dalloc_batch_event(tsd, 1, usize);
+}
+
+JEMALLOC_ALWAYS_INLINE void
+thread_alloc_event(tsd_t *tsd, size_t usize) {
+	thread_alloc_batch_event(tsd, 1, usize);
+}
+
 #endif /* JEMALLOC_INTERNAL_THREAD_EVENT_H */
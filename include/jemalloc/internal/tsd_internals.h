@@ -5,6 +5,7 @@
 
 #include "jemalloc/internal/jemalloc_preamble.h"
 #include "jemalloc/internal/activity_callback.h"
+#include "jemalloc/internal/alloc_tag.h"
 #include "jemalloc/internal/arena_types.h"
 #include "jemalloc/internal/assert.h"
 #include "jemalloc/internal/bin_types.h"
@@ -74,6 +75,10 @@ typedef ql_elm(tsd_t) tsd_link_t;
     O(prof_sample_last_event,	uint64_t,		uint64_t)	\
     O(stats_interval_event_wait,	uint64_t,	uint64_t)	\
     O(stats_interval_last_event,	uint64_t,	uint64_t)	\
+    O(arena_rebalance_event_wait,	uint64_t,	uint64_t)	\
+    O(arena_rebalance_last_event,	uint64_t,	uint64_t)	\
+    O(arena_rebalance_nbytes,	uint64_t,		uint64_t)	\
+    O(arena_rebalance_epoch,	size_t,			size_t)		\
     O(peak_alloc_event_wait,	uint64_t,		uint64_t)	\
     O(peak_dalloc_event_wait,	uint64_t,	uint64_t)		\
     O(prof_tdata,		prof_tdata_t *,		prof_tdata_t *)	\
@@ -88,6 +93,7 @@ typedef ql_elm(tsd_t) tsd_link_t;
     O(tsd_link,			tsd_link_t,		tsd_link_t)	\
     O(in_hook,			bool,			bool)		\
     O(peak,			peak_t,			peak_t)		\
+    O(alloc_tag,		alloc_tag_tsd_t,	alloc_tag_tsd_t)\
     O(activity_callback_thunk,	activity_callback_thunk_t,		\
 	activity_callback_thunk_t)					\
     O(tcache_slow,		tcache_slow_t,		tcache_slow_t)	\
@@ -107,6 +113,10 @@ typedef ql_elm(tsd_t) tsd_link_t;
     /* prof_sample_last_event */	0,				\
     /* stats_interval_event_wait */	0,				\
     /* stats_interval_last_event */	0,				\
+    /* arena_rebalance_event_wait */	0,				\
+    /* arena_rebalance_last_event */	0,				\
+    /* arena_rebalance_nbytes */	0,				\
+    /* arena_rebalance_epoch */	0,				\
     /* peak_alloc_event_wait */		0,				\
     /* peak_dalloc_event_wait */	0,				\
     /* prof_tdata */		NULL,					\
@@ -122,6 +132,7 @@ typedef ql_elm(tsd_t) tsd_link_t;
     /* tsd_link */		{NULL},					\
     /* in_hook */		false,					\
     /* peak */			PEAK_INITIALIZER,			\
+    /* alloc_tag */		ALLOC_TAG_TSD_INITIALIZER,		\
     /* activity_callback_thunk */					\
 	ACTIVITY_CALLBACK_THUNK_INITIALIZER,				\
     /* tcache_slow */		TCACHE_SLOW_ZERO_INITIALIZER,		\
@@ -133,6 +144,8 @@ typedef ql_elm(tsd_t) tsd_link_t;
     O(thread_allocated_next_event_fast,	uint64_t,	uint64_t)	\
     O(thread_deallocated,	uint64_t,		uint64_t)	\
     O(thread_deallocated_next_event_fast, uint64_t,	uint64_t)	\
+    O(thread_nmalloc,		uint64_t,		uint64_t)	\
+    O(thread_ndalloc,		uint64_t,		uint64_t)	\
     O(tcache,			tcache_t,		tcache_t)
 
 #define TSD_DATA_FAST_INITIALIZER					\
@@ -140,6 +153,8 @@ typedef ql_elm(tsd_t) tsd_link_t;
     /* thread_allocated_next_event_fast */ 0, 				\
     /* thread_deallocated */	0,					\
     /* thread_deallocated_next_event_fast */	0,			\
+    /* thread_nmalloc */	0,					\
+    /* thread_ndalloc */	0,					\
     /* tcache */		TCACHE_ZERO_INITIALIZER,
 
 /*  O(name,			type,			nullable type) */
@@ -174,6 +189,12 @@ void tsd_slow_update(tsd_t *tsd);
 void tsd_prefork(tsd_t *tsd);
 void tsd_postfork_parent(tsd_t *tsd);
 void tsd_postfork_child(tsd_t *tsd);
+/*
+ * Calls visitor on the tsd of every thread in the nominal state, which can be
+ * running concurrently.
+ */
+void tsd_nominal_foreach(tsdn_t *tsdn, void (*visitor)(tsd_t *, void *),
+    void *arg);
 
 /*
  * Call ..._inc when your module wants to take all threads down the slow paths,
@@ -25,6 +25,7 @@ enum witness_rank_e {
 	WITNESS_RANK_INIT = WITNESS_RANK_MIN,
 	WITNESS_RANK_CTL,
 	WITNESS_RANK_TCACHES,
+	WITNESS_RANK_PERCPU_CACHE,
 	WITNESS_RANK_ARENAS,
 	WITNESS_RANK_BACKGROUND_THREAD_GLOBAL,
 	WITNESS_RANK_PROF_DUMP,
@@ -35,6 +36,7 @@ enum witness_rank_e {
 	WITNESS_RANK_PROF_GCTX,
 	WITNESS_RANK_PROF_RECENT_DUMP,
 	WITNESS_RANK_BACKGROUND_THREAD,
+	WITNESS_RANK_MEM_LIMIT,
 	/*
 	 * Used as an argument to witness_assert_depth_to_rank() in order to
 	 * validate depth excluding non-core locks with lower ranks.  Since the
@@ -67,7 +69,7 @@ enum witness_rank_e {
 	WITNESS_RANK_BIN,
 
 	WITNESS_RANK_LEAF=0x1000,
-	WITNESS_RANK_BATCHER=WITNESS_RANK_LEAF,
+	WITNESS_RANK_ALLOC_TAG = WITNESS_RANK_LEAF,
 	WITNESS_RANK_ARENA_STATS = WITNESS_RANK_LEAF,
 	WITNESS_RANK_COUNTER_ACCUM = WITNESS_RANK_LEAF,
 	WITNESS_RANK_DSS = WITNESS_RANK_LEAF,
@@ -0,0 +1,125 @@
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/jemalloc_internal_includes.h"
+
+#include "jemalloc/internal/alloc_tag.h"
+
+#include "jemalloc/internal/mutex.h"
+
+/*
+ * The activity of the exited threads, per tag.  alloc_tag_mtx also serializes
+ * the readers with the exiting threads moving their counts here, so that those
+ * are neither missed nor counted twice.
+ */
+static alloc_tag_counts_t alloc_tag_exited[ALLOC_TAG_NTAGS];
+static malloc_mutex_t alloc_tag_mtx;
+
+bool
+alloc_tag_boot(void) {
+	return malloc_mutex_init(&alloc_tag_mtx, "alloc_tag",
+	    WITNESS_RANK_ALLOC_TAG, malloc_mutex_rank_exclusive);
+}
+
+static void
+alloc_tag_thread_counts_get(tsd_t *tsd, alloc_tag_counts_t *counts) {
+	counts->allocated = *tsd_thread_allocatedp_get_unsafe(tsd);
+	counts->deallocated = *tsd_thread_deallocatedp_get_unsafe(tsd);
+	counts->nmalloc = *tsd_thread_nmallocp_get_unsafe(tsd);
+	counts->ndalloc = *tsd_thread_ndallocp_get_unsafe(tsd);
+}
+
+/* The activity of the thread since its current tag was set. */
+static void
+alloc_tag_pending_get(tsd_t *tsd, alloc_tag_counts_t *pending) {
+	alloc_tag_tsd_t *tag_tsd = tsd_alloc_tagp_get_unsafe(tsd);
+	alloc_tag_thread_counts_get(tsd, pending);
+	/* The subtractions are intentionally susceptible to underflow. */
+	pending->allocated -= tag_tsd->base.allocated;
+	pending->deallocated -= tag_tsd->base.deallocated;
+	pending->nmalloc -= tag_tsd->base.nmalloc;
+	pending->ndalloc -= tag_tsd->base.ndalloc;
+}
+
+/* Credits the pending activity to the current tag. */
+static void
+alloc_tag_flush(tsd_t *tsd) {
+	alloc_tag_tsd_t *tag_tsd = tsd_alloc_tagp_get_unsafe(tsd);
+	alloc_tag_counts_t pending;
+	alloc_tag_pending_get(tsd, &pending);
+	alloc_tag_counts_add(&tag_tsd->counts[tag_tsd->tag], &pending);
+	alloc_tag_thread_counts_get(tsd, &tag_tsd->base);
+}
+
+unsigned
+alloc_tag_get(tsd_t *tsd) {
+	return tsd_alloc_tagp_get(tsd)->tag;
+}
+
+void
+alloc_tag_set(tsd_t *tsd, unsigned tag) {
+	assert(tag < ALLOC_TAG_NTAGS);
+	alloc_tag_flush(tsd);
+	tsd_alloc_tagp_get(tsd)->tag = tag;
+}
+
+typedef struct alloc_tag_read_arg_s alloc_tag_read_arg_t;
+struct alloc_tag_read_arg_s {
+	unsigned tag;
+	alloc_tag_counts_t *counts;
+};
+
+static void
+alloc_tag_read_visitor(tsd_t *tsd, void *arg) {
+	alloc_tag_read_arg_t *read_arg = (alloc_tag_read_arg_t *)arg;
+	/*
+	 * Racy reads, like for the tcache stats; the thread may be switching
+	 * tags concurrently, in which case its activity can be momentarily
+	 * missed or counted twice.
+	 */
+	alloc_tag_tsd_t *tag_tsd = tsd_alloc_tagp_get_unsafe(tsd);
+	alloc_tag_counts_add(read_arg->counts,
+	    &tag_tsd->counts[read_arg->tag]);
+	if (tag_tsd->tag == read_arg->tag) {
+		alloc_tag_counts_t pending;
+		alloc_tag_pending_get(tsd, &pending);
+		alloc_tag_counts_add(read_arg->counts, &pending);
+	}
+}
+
+void
+alloc_tag_read(tsdn_t *tsdn, unsigned tag, alloc_tag_counts_t *counts) {
+	assert(tag < ALLOC_TAG_NTAGS);
+	alloc_tag_read_arg_t arg = {tag, counts};
+
+	malloc_mutex_lock(tsdn, &alloc_tag_mtx);
+	*counts = alloc_tag_exited[tag];
+	tsd_nominal_foreach(tsdn, alloc_tag_read_visitor, &arg);
+	malloc_mutex_unlock(tsdn, &alloc_tag_mtx);
+}
+
+void
+alloc_tag_cleanup(tsd_t *tsd) {
+	alloc_tag_tsd_t *tag_tsd = tsd_alloc_tagp_get_unsafe(tsd);
+
+	malloc_mutex_lock(tsd_tsdn(tsd), &alloc_tag_mtx);
+	alloc_tag_flush(tsd);
+	for (unsigned i = 0; i < ALLOC_TAG_NTAGS; i++) {
+		alloc_tag_counts_add(&alloc_tag_exited[i], &tag_tsd->counts[i]);
+		memset(&tag_tsd->counts[i], 0, sizeof(alloc_tag_counts_t));
+	}
+	malloc_mutex_unlock(tsd_tsdn(tsd), &alloc_tag_mtx);
+}
+
+void
+alloc_tag_prefork(tsdn_t *tsdn) {
+	malloc_mutex_prefork(tsdn, &alloc_tag_mtx);
+}
+
+void
+alloc_tag_postfork_parent(tsdn_t *tsdn) {
+	malloc_mutex_postfork_parent(tsdn, &alloc_tag_mtx);
+}
+
+void
+alloc_tag_postfork_child(tsdn_t *tsdn) {
+	malloc_mutex_postfork_child(tsdn, &alloc_tag_mtx);
+}
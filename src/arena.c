@@ -6,6 +6,7 @@
 #include "jemalloc/internal/ehooks.h"
 #include "jemalloc/internal/extent_dss.h"
 #include "jemalloc/internal/extent_mmap.h"
+#include "jemalloc/internal/pressure.h"
 #include "jemalloc/internal/san.h"
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/rtree.h"
@@ -201,6 +202,8 @@ arena_stats_merge(tsdn_t *tsdn, arena_t *arena, unsigned *nthreads,
 			bin_stats_merge(tsdn, &bstats[i],
 			    arena_get_bin(arena, i, j));
 		}
+		bstats[i].nshards += atomic_load_u(
+		    &arena->bin_nshards_active[i], ATOMIC_RELAXED);
 	}
 }
 
@@ -225,6 +228,7 @@ void arena_handle_deferred_work(tsdn_t *tsdn, arena_t *arena) {
 	witness_assert_depth_to_rank(tsdn_witness_tsdp_get(tsdn),
 	    WITNESS_RANK_CORE, 0);
 
+	arena = arena->pa_arena;
 	if (decay_immediately(&arena->pa_shard.pac.decay_dirty)) {
 		arena_decay_dirty(tsdn, arena, false, true);
 	}
@@ -367,13 +371,14 @@ arena_extent_alloc_large(tsdn_t *tsdn, arena_t *arena, size_t usize,
 	 *     - use memset() to zero out memory if zero == true.
 	 */
 	bool zero_override = zero && (usize >= opt_calloc_madvise_threshold);
-	edata_t *edata = pa_alloc(tsdn, &arena->pa_shard, esize, alignment,
-	    /* slab */ false, szind, zero_override, guarded,
+	edata_t *edata = pa_alloc(tsdn, arena_pa_shard_get(arena), esize,
+	    alignment, /* slab */ false, szind, zero_override, guarded,
 	    &deferred_work_generated);
 
 	if (edata == NULL) {
 		return NULL;
 	}
+	arena_edata_adopt(arena, edata);
 
 	if (config_stats) {
 		arena_large_malloc_stats_update(tsdn, arena, usize);
@@ -444,13 +449,13 @@ arena_decay_ms_set(tsdn_t *tsdn, arena_t *arena, extent_state_t state,
     ssize_t decay_ms) {
 	pac_purge_eagerness_t eagerness = arena_decide_unforced_purge_eagerness(
 	    /* is_background_thread */ false);
-	return pa_decay_ms_set(tsdn, &arena->pa_shard, state, decay_ms,
-	    eagerness);
+	return pa_decay_ms_set(tsdn, arena_pa_shard_get(arena), state,
+	    decay_ms, eagerness);
 }
 
 ssize_t
 arena_decay_ms_get(arena_t *arena, extent_state_t state) {
-	return pa_decay_ms_get(&arena->pa_shard, state);
+	return pa_decay_ms_get(arena_pa_shard_get(arena), state);
 }
 
 static bool
@@ -509,6 +514,8 @@ arena_decay_muzzy(tsdn_t *tsdn, arena_t *arena, bool is_background_thread,
 
 void
 arena_decay(tsdn_t *tsdn, arena_t *arena, bool is_background_thread, bool all) {
+	/* The decay state lives with the pages, i.e. is shared by the group. */
+	arena = arena->pa_arena;
 	if (all) {
 		/*
 		 * We should take a purge of "all" to mean "save as much memory
@@ -599,10 +606,19 @@ arena_do_deferred_work(tsdn_t *tsdn, arena_t *arena) {
 	pa_shard_do_deferred_work(tsdn, &arena->pa_shard);
 }
 
+void
+arena_pressure_set(tsdn_t *tsdn, arena_t *arena, unsigned lg_div) {
+	pac_purge_eagerness_t eagerness = arena_decide_unforced_purge_eagerness(
+	    /* is_background_thread */ true);
+	pa_shard_pressure_set(tsdn, &arena->pa_shard, lg_div, eagerness);
+}
+
 void
 arena_slab_dalloc(tsdn_t *tsdn, arena_t *arena, edata_t *slab) {
 	bool deferred_work_generated = false;
-	pa_dalloc(tsdn, &arena->pa_shard, slab, &deferred_work_generated);
+	arena_edata_release(arena, slab);
+	pa_dalloc(tsdn, arena_pa_shard_get(arena), slab,
+	    &deferred_work_generated);
 	if (deferred_work_generated) {
 		arena_handle_deferred_work(tsdn, arena);
 	}
@@ -667,9 +683,8 @@ arena_bin_reset(tsd_t *tsd, arena_t *arena, bin_t *bin, unsigned binind) {
 	malloc_mutex_lock(tsd_tsdn(tsd), &bin->lock);
 
 	if (arena_bin_has_batch(binind)) {
-		bin_with_batch_t *batched_bin = (bin_with_batch_t *)bin;
-		batcher_init(&batched_bin->remote_frees,
-		    BIN_REMOTE_FREE_ELEMS_MAX);
+		/* Pending remote frees belong to the slabs discarded below. */
+		bin_remote_free_init((bin_with_batch_t *)bin);
 	}
 
 	if (bin->slabcur != NULL) {
@@ -918,6 +933,12 @@ arena_destroy(tsd_t *tsd, arena_t *arena) {
 	assert(base_ind_get(arena->base) >= narenas_auto);
 	assert(arena_nthreads_get(arena, false) == 0);
 	assert(arena_nthreads_get(arena, true) == 0);
+	assert(atomic_load_u(&arena->ngroup_members, ATOMIC_RELAXED) == 0);
+
+	if (arena->pa_arena != arena) {
+		atomic_fetch_sub_u(&arena->pa_arena->ngroup_members, 1,
+		    ATOMIC_RELAXED);
+	}
 
 	/*
 	 * No allocations have occurred since arena_reset() was called.
@@ -957,9 +978,10 @@ arena_slab_alloc(tsdn_t *tsdn, arena_t *arena, szind_t binind, unsigned binshard
 
 	bool guarded = san_slab_extent_decide_guard(tsdn,
 	    arena_get_ehooks(arena));
-	edata_t *slab = pa_alloc(tsdn, &arena->pa_shard, bin_info->slab_size,
-	    /* alignment */ PAGE, /* slab */ true, /* szind */ binind,
-	     /* zero */ false, guarded, &deferred_work_generated);
+	edata_t *slab = pa_alloc(tsdn, arena_pa_shard_get(arena),
+	    bin_info->slab_size, /* alignment */ PAGE, /* slab */ true,
+	    /* szind */ binind, /* zero */ false, guarded,
+	    &deferred_work_generated);
 
 	if (deferred_work_generated) {
 		arena_handle_deferred_work(tsdn, arena);
@@ -969,6 +991,7 @@ arena_slab_alloc(tsdn_t *tsdn, arena_t *arena, szind_t binind, unsigned binshard
 		return NULL;
 	}
 	assert(edata_slab_get(slab));
+	arena_edata_adopt(arena, slab);
 
 	/* Initialize slab internals. */
 	slab_data_t *slab_data = edata_slab_data_get(slab);
@@ -1036,7 +1059,8 @@ arena_bin_choose(tsdn_t *tsdn, arena_t *arena, szind_t binind,
 	if (tsdn_null(tsdn) || tsd_arena_get(tsdn_tsd(tsdn)) == NULL) {
 		binshard = 0;
 	} else {
-		binshard = tsd_binshardsp_get(tsdn_tsd(tsdn))->binshard[binind];
+		binshard = arena_binshard_active_get(arena, binind,
+		    tsd_binshardsp_get(tsdn_tsd(tsdn))->binshard[binind]);
 	}
 	assert(binshard < bin_infos[binind].n_shards);
 	if (binshard_p != NULL) {
@@ -1045,6 +1069,25 @@ arena_bin_choose(tsdn_t *tsdn, arena_t *arena, szind_t binind,
 	return arena_get_bin(arena, binind, binshard);
 }
 
+/*
+ * Activates one more shard of the bin when its lock is contended, which
+ * arena_bin_choose() then spreads the threads over.  Shards are never
+ * deactivated; the slabs remember their shard anyway.
+ */
+static void
+arena_bin_shards_maybe_grow(tsdn_t *tsdn, arena_t *arena, szind_t binind,
+    bin_t *bin) {
+	malloc_mutex_assert_owner(tsdn, &bin->lock);
+	unsigned nshards = atomic_load_u(&arena->bin_nshards_active[binind],
+	    ATOMIC_RELAXED);
+	if (nshards == bin_infos[binind].n_shards || !bin_lock_contended(bin)) {
+		return;
+	}
+	/* Someone else growing it at the same time is just as good. */
+	atomic_compare_exchange_strong_u(&arena->bin_nshards_active[binind],
+	    &nshards, nshards + 1, ATOMIC_RELAXED, ATOMIC_RELAXED);
+}
+
 void
 arena_cache_bin_fill_small(tsdn_t *tsdn, arena_t *arena,
     cache_bin_t *cache_bin, szind_t binind, const cache_bin_sz_t nfill_min,
@@ -1101,6 +1144,7 @@ arena_cache_bin_fill_small(tsdn_t *tsdn, arena_t *arena,
 	    JEMALLOC_CLANG_ANALYZER_SILENCE_INIT({0});
 label_refill:
 	malloc_mutex_lock(tsdn, &bin->lock);
+	arena_bin_shards_maybe_grow(tsdn, arena, binind, bin);
 	arena_bin_flush_batch_after_lock(tsdn, arena, bin, binind, &batch_flush_state);
 
 	while (filled < nfill_min) {
@@ -1290,6 +1334,7 @@ arena_malloc_small(tsdn_t *tsdn, arena_t *arena, szind_t binind, bool zero) {
 	bin_t *bin = arena_bin_choose(tsdn, arena, binind, &binshard);
 
 	malloc_mutex_lock(tsdn, &bin->lock);
+	arena_bin_shards_maybe_grow(tsdn, arena, binind, bin);
 	edata_t *fresh_slab = NULL;
 	void *ret = arena_bin_malloc_no_fresh_slab(tsdn, arena, bin, binind);
 	if (ret == NULL) {
@@ -1598,9 +1643,69 @@ arena_ralloc(tsdn_t *tsdn, arena_t *arena, void *ptr, size_t oldsize,
 	return ret;
 }
 
+/*
+ * Picks a slab of the bin that is strictly fuller than slab, preferring slabcur
+ * over the lowest nonfull one.  Returns NULL if there is none.
+ */
+static edata_t *
+arena_bin_defrag_slab_get(bin_t *bin, edata_t *slab) {
+	size_t nfree = edata_nfree_get(slab);
+	edata_t *cur = bin->slabcur;
+	if (cur != NULL && cur != slab && edata_nfree_get(cur) > 0
+	    && edata_nfree_get(cur) < nfree) {
+		return cur;
+	}
+	edata_t *first = edata_heap_first(&bin->slabs_nonfull);
+	if (first != NULL && first != slab && edata_nfree_get(first) < nfree) {
+		return first;
+	}
+	return NULL;
+}
+
+void *
+arena_ralloc_defrag(tsdn_t *tsdn, void *ptr, size_t usize,
+    hook_ralloc_args_t *hook_args) {
+	edata_t *edata = emap_edata_lookup(tsdn, &arena_emap_global, ptr);
+	assert(edata_slab_get(edata));
+	szind_t binind = edata_szind_get(edata);
+	assert(usize == sz_index2size(binind));
+	arena_t *arena = arena_get_from_edata(edata);
+	bin_t *bin = arena_get_bin(arena, binind, edata_binshard_get(edata));
+
+	malloc_mutex_lock(tsdn, &bin->lock);
+	edata_t *slab = arena_bin_defrag_slab_get(bin, edata);
+	if (slab == NULL) {
+		malloc_mutex_unlock(tsdn, &bin->lock);
+		return ptr;
+	}
+	void *ret = arena_slab_reg_alloc(slab, &bin_infos[binind]);
+	if (slab != bin->slabcur && edata_nfree_get(slab) == 0) {
+		arena_bin_slabs_nonfull_remove(bin, slab);
+		arena_bin_slabs_full_insert(arena, bin, slab);
+	}
+	if (config_stats) {
+		bin->stats.nmalloc++;
+		bin->stats.nrequests++;
+		bin->stats.curregs++;
+	}
+	malloc_mutex_unlock(tsdn, &bin->lock);
+
+	hook_invoke_alloc(hook_args->is_realloc
+	    ? hook_alloc_realloc : hook_alloc_rallocx, ret, (uintptr_t)ret,
+	    hook_args->args);
+	hook_invoke_dalloc(hook_args->is_realloc
+	    ? hook_dalloc_realloc : hook_dalloc_rallocx, ptr, hook_args->args);
+
+	memcpy(ret, ptr, usize);
+	isdalloct(tsdn, ptr, usize, NULL, NULL, true);
+	arena_decay_tick(tsdn, arena);
+	return ret;
+}
+
 ehooks_t *
 arena_get_ehooks(arena_t *arena) {
-	return base_ehooks_get(arena->base);
+	/* The pages of a group come from the base of its first arena. */
+	return base_ehooks_get(arena->pa_arena->base);
 }
 
 extent_hooks_t *
@@ -1684,7 +1789,7 @@ arena_retain_grow_limit_get_set(tsd_t *tsd, arena_t *arena, size_t *old_limit,
     size_t *new_limit) {
 	assert(opt_retain);
 	return pac_retain_grow_limit_get_set(tsd_tsdn(tsd),
-	    &arena->pa_shard.pac, old_limit, new_limit);
+	    &arena_pa_shard_get(arena)->pac, old_limit, new_limit);
 }
 
 unsigned
@@ -1761,8 +1866,18 @@ arena_new(tsdn_t *tsdn, unsigned ind, const arena_config_t *config) {
 		goto label_error;
 	}
 
+	arena->pa_arena = arena;
+	atomic_store_u(&arena->ngroup_members, 0, ATOMIC_RELAXED);
+
 	/* Initialize bins. */
 	atomic_store_u(&arena->binshard_next, 0, ATOMIC_RELEASE);
+	atomic_store_zu(&arena->rebalance_nbytes, 0, ATOMIC_RELAXED);
+	atomic_store_zu(&arena->rebalance_nbytes_prev, 0, ATOMIC_RELAXED);
+	atomic_store_zu(&arena->rebalance_load, 0, ATOMIC_RELAXED);
+	for (unsigned i = 0; i < SC_NBINS; i++) {
+		atomic_store_u(&arena->bin_nshards_active[i],
+		    bin_infos[i].n_shards_init, ATOMIC_RELAXED);
+	}
 	for (unsigned i = 0; i < SC_NBINS; i++) {
 		for (unsigned j = 0; j < bin_infos[i].n_shards; j++) {
 			bin_t *bin = arena_get_bin(arena, i, j);
@@ -1785,6 +1900,15 @@ arena_new(tsdn_t *tsdn, unsigned ind, const arena_config_t *config) {
 
 	nstime_init_update(&arena->create_time);
 
+	/*
+	 * Bind the automatic arenas to their node (the HPA shard, if any,
+	 * inherits the binding from the pac below).  Arenas with custom extent
+	 * hooks own their placement.
+	 */
+	if (ind < narenas_auto && ehooks_are_default(base_ehooks_get(base))) {
+		arena->pa_shard.pac.numa_node = numa_arena_node(ind);
+	}
+
 	/*
 	 * We turn on the HPA if set to.  There are two exceptions:
 	 * - Custom extent hooks (we should only return memory allocated from
@@ -1800,6 +1924,9 @@ arena_new(tsdn_t *tsdn, unsigned ind, const arena_config_t *config) {
 			goto label_error;
 		}
 	}
+	if (pressure_active()) {
+		arena_pressure_set(tsdn, arena, PRESSURE_LG_DIV);
+	}
 
 	/* We don't support reentrancy for arena 0 bootstrapping. */
 	if (ind != 0) {
@@ -1823,6 +1950,22 @@ label_error:
 	return NULL;
 }
 
+/*
+ * Makes a newly created arena get its pages from the pa_shard of the group
+ * arena belongs to, instead of its own.  Must happen before the arena is handed
+ * out.
+ */
+void
+arena_group_join(arena_t *arena, arena_t *group) {
+	assert(!arena_is_auto(arena));
+	assert(arena->pa_arena == arena);
+	assert(atomic_load_u(&arena->ngroup_members, ATOMIC_RELAXED) == 0);
+
+	arena_t *pa_arena = group->pa_arena;
+	atomic_fetch_add_u(&pa_arena->ngroup_members, 1, ATOMIC_RELAXED);
+	arena->pa_arena = pa_arena;
+}
+
 static arena_t *
 arena_create_huge_arena(tsd_t *tsd, unsigned ind) {
 	assert(ind != 0);
@@ -1968,7 +2111,7 @@ arena_prefork8(tsdn_t *tsdn, arena_t *arena) {
 	for (szind_t i = 0; i < SC_NBINS; i++) {
 		for (unsigned j = 0; j < bin_infos[i].n_shards; j++) {
 			bin_t *bin = arena_get_bin(arena, i, j);
-			bin_prefork(tsdn, bin, arena_bin_has_batch(i));
+			bin_prefork(tsdn, bin);
 		}
 	}
 }
@@ -1978,7 +2121,7 @@ arena_postfork_parent(tsdn_t *tsdn, arena_t *arena) {
 	for (szind_t i = 0; i < SC_NBINS; i++) {
 		for (unsigned j = 0; j < bin_infos[i].n_shards; j++) {
 			bin_t *bin = arena_get_bin(arena, i, j);
-			bin_postfork_parent(tsdn, bin, arena_bin_has_batch(i));
+			bin_postfork_parent(tsdn, bin);
 		}
 	}
 
@@ -2019,7 +2162,7 @@ arena_postfork_child(tsdn_t *tsdn, arena_t *arena) {
 	for (szind_t i = 0; i < SC_NBINS; i++) {
 		for (unsigned j = 0; j < bin_infos[i].n_shards; j++) {
 			bin_t *bin = arena_get_bin(arena, i, j);
-			bin_postfork_child(tsdn, bin, arena_bin_has_batch(i));
+			bin_postfork_child(tsdn, bin);
 		}
 	}
 
@@ -2,6 +2,7 @@
 #include "jemalloc/internal/jemalloc_internal_includes.h"
 
 #include "jemalloc/internal/assert.h"
+#include "jemalloc/internal/pressure.h"
 
 JEMALLOC_DIAGNOSTIC_DISABLE_SPURIOUS
 
@@ -153,6 +154,27 @@ set_current_thread_affinity(int cpu) {
 /* Minimal sleep interval 100 ms. */
 #define BACKGROUND_THREAD_MIN_INTERVAL_NS (BILLION / 10)
 
+static int
+background_thread_cond_init(background_thread_info_t *info) {
+#ifdef JEMALLOC_FUTEX_LOCK
+	atomic_store_u32(&info->cond, 0, ATOMIC_RELAXED);
+	return 0;
+#else
+	return pthread_cond_init(&info->cond, NULL);
+#endif
+}
+
+/* Called with info->mtx held. */
+static void
+background_thread_cond_signal(background_thread_info_t *info) {
+#ifdef JEMALLOC_FUTEX_LOCK
+	atomic_fetch_add_u32(&info->cond, 1, ATOMIC_RELAXED);
+	malloc_futex_wake(&info->cond, 1);
+#else
+	pthread_cond_signal(&info->cond);
+#endif
+}
+
 static int
 background_thread_cond_wait(background_thread_info_t *info,
     struct timespec *ts) {
@@ -163,11 +185,22 @@ background_thread_cond_wait(background_thread_info_t *info,
 	 * going through our wrapper.  Update the locked state explicitly.
 	 */
 	atomic_store_b(&info->mtx.locked, false, ATOMIC_RELAXED);
+#ifdef JEMALLOC_FUTEX_LOCK
+	/*
+	 * Signals happen under the mutex, so any after the unlock below change
+	 * the value, and make the wait return right away.
+	 */
+	uint32_t seq = atomic_load_u32(&info->cond, ATOMIC_RELAXED);
+	MALLOC_MUTEX_UNLOCK(&info->mtx);
+	ret = malloc_futex_wait(&info->cond, seq, ts);
+	MALLOC_MUTEX_LOCK(&info->mtx);
+#else
 	if (ts == NULL) {
 		ret = pthread_cond_wait(&info->cond, &info->mtx.lock);
 	} else {
 		ret = pthread_cond_timedwait(&info->cond, &info->mtx.lock, ts);
 	}
+#endif
 	atomic_store_b(&info->mtx.locked, true, ATOMIC_RELAXED);
 
 	return ret;
@@ -282,6 +315,11 @@ background_work_sleep_once(tsdn_t *tsdn, background_thread_info_t *info,
 		    : ns_until_deferred;
 
 	}
+	if (ind == 0 && opt_pressure_purge &&
+	    sleep_ns > PRESSURE_POLL_INTERVAL_NS) {
+		/* Keep watching the memory pressure. */
+		sleep_ns = PRESSURE_POLL_INTERVAL_NS;
+	}
 
 	background_thread_sleep(tsdn, info, sleep_ns);
 }
@@ -303,7 +341,7 @@ background_threads_disable_single(tsd_t *tsd, background_thread_info_t *info) {
 	if (info->state == background_thread_started) {
 		has_thread = true;
 		info->state = background_thread_stopped;
-		pthread_cond_signal(&info->cond);
+		background_thread_cond_signal(info);
 	} else {
 		has_thread = false;
 	}
@@ -439,9 +477,11 @@ background_thread0_work(tsd_t *tsd) {
 		    &n_created, (bool *)&created_threads)) {
 			continue;
 		}
+		pressure_background_work(tsd_tsdn(tsd));
 		background_work_sleep_once(tsd_tsdn(tsd),
 		    &background_thread_info[0], 0);
 	}
+	pressure_background_stop(tsd_tsdn(tsd));
 
 	/*
 	 * Shut down other threads at exit.  Note that the ctl thread is holding
@@ -549,7 +589,7 @@ background_thread_create_locked(tsd_t *tsd, unsigned arena_ind) {
 		background_thread_info_t *t0 = &background_thread_info[0];
 		malloc_mutex_lock(tsd_tsdn(tsd), &t0->mtx);
 		assert(t0->state == background_thread_started);
-		pthread_cond_signal(&t0->cond);
+		background_thread_cond_signal(t0);
 		malloc_mutex_unlock(tsd_tsdn(tsd), &t0->mtx);
 
 		return false;
@@ -679,7 +719,7 @@ background_thread_wakeup_early(background_thread_info_t *info,
 	    BACKGROUND_THREAD_MIN_INTERVAL_NS) {
 		return;
 	}
-	pthread_cond_signal(&info->cond);
+	background_thread_cond_signal(info);
 }
 
 void
@@ -723,7 +763,7 @@ background_thread_postfork_child(tsdn_t *tsdn) {
 		background_thread_info_t *info = &background_thread_info[i];
 		malloc_mutex_lock(tsdn, &info->mtx);
 		info->state = background_thread_stopped;
-		int ret = pthread_cond_init(&info->cond, NULL);
+		int ret = background_thread_cond_init(info);
 		assert(ret == 0);
 		background_thread_info_init(tsdn, info);
 		malloc_mutex_unlock(tsdn, &info->mtx);
@@ -763,6 +803,7 @@ background_thread_stats_read(tsdn_t *tsdn, background_thread_stats_t *stats) {
 		malloc_mutex_unlock(tsdn, &info->mtx);
 	}
 	stats->num_runs = num_runs;
+	stats->num_pressure_periods = pressure_nperiods_get();
 	if (num_runs > 0) {
 		nstime_idivide(&stats->run_interval, num_runs);
 	}
@@ -841,7 +882,7 @@ background_thread_boot1(tsdn_t *tsdn, base_t *base) {
 		    malloc_mutex_address_ordered)) {
 			return true;
 		}
-		if (pthread_cond_init(&info->cond, NULL)) {
+		if (background_thread_cond_init(info)) {
 			return true;
 		}
 		malloc_mutex_lock(tsdn, &info->mtx);
@@ -7,15 +7,15 @@
  * We leave bin-batching disabled by default, with other settings chosen mostly
  * empirically; across the test programs I looked at they provided the most bang
  * for the buck.  With other default settings, these choices for bin batching
- * result in them consuming far less memory (even in the worst case) than the
- * tcaches themselves, the arena, etc.
+ * result in them consuming far less memory than the tcaches themselves, the
+ * arena, etc.
  * Note that we always try to pop all bins on every arena cache bin lock
- * operation, so the typical memory waste is far less than this (and only on
- * hot bins, which tend to be large anyways).
+ * operation, so the pending remote frees (which are unbounded) are typically
+ * few (and only on hot bins, which tend to be large anyways).
  */
 size_t opt_bin_info_max_batched_size = 0; /* 192 is a good default. */
 size_t opt_bin_info_remote_free_max_batch = 4;
-size_t opt_bin_info_remote_free_max = BIN_REMOTE_FREE_ELEMS_MAX;
+unsigned opt_bin_info_shards_max = 0;
 
 bin_info_t bin_infos[SC_NBINS];
 
@@ -34,7 +34,10 @@ bin_infos_init(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 		bin_info->slab_size = (sc->pgs << LG_PAGE);
 		bin_info->nregs =
 		    (uint32_t)(bin_info->slab_size / bin_info->reg_size);
-		bin_info->n_shards = bin_shard_sizes[i];
+		bin_info->n_shards_init = bin_shard_sizes[i];
+		bin_info->n_shards = (opt_bin_info_shards_max >
+		    bin_shard_sizes[i]) ? opt_bin_info_shards_max :
+		    bin_shard_sizes[i];
 		bitmap_info_t bitmap_info = BITMAP_INFO_INITIALIZER(
 		    bin_info->nregs);
 		bin_info->bitmap_info = bitmap_info;
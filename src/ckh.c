@@ -392,6 +392,7 @@ ckh_new(tsd_t *tsd, ckh_t *ckh, size_t minitems, ckh_hash_t *ckh_hash,
 	}
 	ckh->lg_minbuckets = lg_mincells - LG_CKH_BUCKET_CELLS;
 	ckh->lg_curbuckets = lg_mincells - LG_CKH_BUCKET_CELLS;
+	ckh->shrinkable = true;
 	ckh->hash = ckh_hash;
 	ckh->keycomp = keycomp;
 
@@ -434,6 +435,13 @@ ckh_delete(tsd_t *tsd, ckh_t *ckh) {
 	}
 }
 
+void
+ckh_shrink_disable(ckh_t *ckh) {
+	assert(ckh != NULL);
+
+	ckh->shrinkable = false;
+}
+
 size_t
 ckh_count(ckh_t *ckh) {
 	assert(ckh != NULL);
@@ -505,9 +513,9 @@ ckh_remove(tsd_t *tsd, ckh_t *ckh, const void *searchkey, void **key,
 
 		ckh->count--;
 		/* Try to halve the table if it is less than 1/4 full. */
-		if (ckh->count < (ZU(1) << (ckh->lg_curbuckets
-		    + LG_CKH_BUCKET_CELLS - 2)) && ckh->lg_curbuckets
-		    > ckh->lg_minbuckets) {
+		if (ckh->shrinkable && ckh->count < (ZU(1) <<
+		    (ckh->lg_curbuckets + LG_CKH_BUCKET_CELLS - 2)) &&
+		    ckh->lg_curbuckets > ckh->lg_minbuckets) {
 			/* Ignore error due to OOM. */
 			ckh_shrink(tsd, ckh);
 		}
@@ -1,11 +1,13 @@
 #include "jemalloc/internal/jemalloc_preamble.h"
 #include "jemalloc/internal/jemalloc_internal_includes.h"
 
+#include "jemalloc/internal/alloc_tag.h"
 #include "jemalloc/internal/assert.h"
 #include "jemalloc/internal/ctl.h"
 #include "jemalloc/internal/extent_dss.h"
 #include "jemalloc/internal/extent_mmap.h"
 #include "jemalloc/internal/inspect.h"
+#include "jemalloc/internal/mem_limit.h"
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/nstime.h"
 #include "jemalloc/internal/peak_event.h"
@@ -14,8 +16,10 @@
 #include "jemalloc/internal/prof_recent.h"
 #include "jemalloc/internal/prof_stats.h"
 #include "jemalloc/internal/prof_sys.h"
+#include "jemalloc/internal/pressure.h"
 #include "jemalloc/internal/safety_check.h"
 #include "jemalloc/internal/sc.h"
+#include "jemalloc/internal/stats_snapshot.h"
 #include "jemalloc/internal/util.h"
 
 /******************************************************************************/
@@ -65,6 +69,7 @@ CTL_PROTO(version)
 CTL_PROTO(epoch)
 CTL_PROTO(background_thread)
 CTL_PROTO(max_background_threads)
+CTL_PROTO(mem_limit)
 CTL_PROTO(thread_tcache_enabled)
 CTL_PROTO(thread_tcache_max)
 CTL_PROTO(thread_tcache_flush)
@@ -80,6 +85,7 @@ CTL_PROTO(thread_allocatedp)
 CTL_PROTO(thread_deallocated)
 CTL_PROTO(thread_deallocatedp)
 CTL_PROTO(thread_idle)
+CTL_PROTO(thread_tag)
 CTL_PROTO(config_cache_oblivious)
 CTL_PROTO(config_debug)
 CTL_PROTO(config_fill)
@@ -101,6 +107,9 @@ CTL_PROTO(opt_trust_madvise)
 CTL_PROTO(opt_confirm_conf)
 CTL_PROTO(opt_hpa)
 CTL_PROTO(opt_hpa_slab_max_alloc)
+CTL_PROTO(opt_hpa_large_max_alloc)
+CTL_PROTO(opt_hpa_rehugify_max_nhp)
+CTL_PROTO(opt_hpa_rehugify_interval_ms)
 CTL_PROTO(opt_hpa_hugification_threshold)
 CTL_PROTO(opt_hpa_hugify_delay_ms)
 CTL_PROTO(opt_hpa_hugify_sync)
@@ -114,6 +123,7 @@ CTL_PROTO(opt_hpa_sec_bytes_after_flush)
 CTL_PROTO(opt_hpa_sec_batch_fill_extra)
 CTL_PROTO(opt_metadata_thp)
 CTL_PROTO(opt_retain)
+CTL_PROTO(opt_huge_slabs)
 CTL_PROTO(opt_dss)
 CTL_PROTO(opt_narenas)
 CTL_PROTO(opt_percpu_arena)
@@ -121,6 +131,8 @@ CTL_PROTO(opt_oversize_threshold)
 CTL_PROTO(opt_background_thread)
 CTL_PROTO(opt_mutex_max_spin)
 CTL_PROTO(opt_max_background_threads)
+CTL_PROTO(opt_pressure_purge)
+CTL_PROTO(opt_pressure_purge_threshold)
 CTL_PROTO(opt_dirty_decay_ms)
 CTL_PROTO(opt_muzzy_decay_ms)
 CTL_PROTO(opt_stats_print)
@@ -134,10 +146,14 @@ CTL_PROTO(opt_xmalloc)
 CTL_PROTO(opt_experimental_infallible_new)
 CTL_PROTO(opt_experimental_tcache_gc)
 CTL_PROTO(opt_max_batched_size)
-CTL_PROTO(opt_remote_free_max)
 CTL_PROTO(opt_remote_free_max_batch)
+CTL_PROTO(opt_bin_shards_max)
 CTL_PROTO(opt_tcache)
 CTL_PROTO(opt_tcache_max)
+CTL_PROTO(opt_percpu_tcache)
+CTL_PROTO(opt_numa_arena)
+CTL_PROTO(opt_arena_rebalance_interval)
+CTL_PROTO(opt_arena_rebalance_threshold)
 CTL_PROTO(opt_tcache_nslots_small_min)
 CTL_PROTO(opt_tcache_nslots_small_max)
 CTL_PROTO(opt_tcache_nslots_large)
@@ -146,8 +162,12 @@ CTL_PROTO(opt_tcache_gc_incr_bytes)
 CTL_PROTO(opt_tcache_gc_delay_bytes)
 CTL_PROTO(opt_lg_tcache_flush_small_div)
 CTL_PROTO(opt_lg_tcache_flush_large_div)
+CTL_PROTO(opt_tcache_adaptive)
+CTL_PROTO(opt_tcache_adaptive_max_bytes)
 CTL_PROTO(opt_thp)
 CTL_PROTO(opt_lg_extent_max_active_fit)
+CTL_PROTO(opt_mem_limit)
+CTL_PROTO(opt_mem_limit_fail)
 CTL_PROTO(opt_prof)
 CTL_PROTO(opt_prof_prefix)
 CTL_PROTO(opt_prof_active)
@@ -159,11 +179,15 @@ CTL_PROTO(opt_prof_gdump)
 CTL_PROTO(opt_prof_final)
 CTL_PROTO(opt_prof_leak)
 CTL_PROTO(opt_prof_leak_error)
+CTL_PROTO(opt_prof_dump_incremental)
+CTL_PROTO(opt_prof_dump_gzip)
+CTL_PROTO(opt_prof_dump_format)
 CTL_PROTO(opt_prof_accum)
 CTL_PROTO(opt_prof_pid_namespace)
 CTL_PROTO(opt_prof_recent_alloc_max)
 CTL_PROTO(opt_prof_stats)
 CTL_PROTO(opt_prof_sys_thread_name)
+CTL_PROTO(opt_prof_fast_unwind)
 CTL_PROTO(opt_prof_time_res)
 CTL_PROTO(opt_lg_san_uaf_align)
 CTL_PROTO(opt_zero_realloc)
@@ -186,6 +210,7 @@ CTL_PROTO(arena_i_muzzy_decay_ms)
 CTL_PROTO(arena_i_extent_hooks)
 CTL_PROTO(arena_i_retain_grow_limit)
 CTL_PROTO(arena_i_name)
+CTL_PROTO(arena_i_group)
 INDEX_PROTO(arena_i)
 CTL_PROTO(arenas_bin_i_size)
 CTL_PROTO(arenas_bin_i_nregs)
@@ -205,7 +230,14 @@ CTL_PROTO(arenas_nbins)
 CTL_PROTO(arenas_nhbins)
 CTL_PROTO(arenas_nlextents)
 CTL_PROTO(arenas_create)
+CTL_PROTO(arenas_create_grouped)
 CTL_PROTO(arenas_lookup)
+CTL_PROTO(tags_ntags)
+CTL_PROTO(tags_tag_i_thread_allocated)
+CTL_PROTO(tags_tag_i_thread_deallocated)
+CTL_PROTO(tags_tag_i_thread_nmalloc)
+CTL_PROTO(tags_tag_i_thread_ndalloc)
+INDEX_PROTO(tags_tag_i)
 CTL_PROTO(prof_thread_active_init)
 CTL_PROTO(prof_active)
 CTL_PROTO(prof_dump)
@@ -244,8 +276,8 @@ CTL_PROTO(stats_arenas_i_bins_j_nslabs)
 CTL_PROTO(stats_arenas_i_bins_j_nreslabs)
 CTL_PROTO(stats_arenas_i_bins_j_curslabs)
 CTL_PROTO(stats_arenas_i_bins_j_nonfull_slabs)
+CTL_PROTO(stats_arenas_i_bins_j_nshards)
 CTL_PROTO(stats_arenas_i_bins_j_batch_pops)
-CTL_PROTO(stats_arenas_i_bins_j_batch_failed_pushes)
 CTL_PROTO(stats_arenas_i_bins_j_batch_pushes)
 CTL_PROTO(stats_arenas_i_bins_j_batch_pushed_elems)
 INDEX_PROTO(stats_arenas_i_bins_j)
@@ -271,6 +303,8 @@ CTL_PROTO(stats_arenas_i_hpa_shard_npurge_passes)
 CTL_PROTO(stats_arenas_i_hpa_shard_npurges)
 CTL_PROTO(stats_arenas_i_hpa_shard_nhugifies)
 CTL_PROTO(stats_arenas_i_hpa_shard_nhugify_failures)
+CTL_PROTO(stats_arenas_i_hpa_shard_nrehugifies)
+CTL_PROTO(stats_arenas_i_hpa_shard_nrehugify_failures)
 CTL_PROTO(stats_arenas_i_hpa_shard_ndehugifies)
 
 /* Set of stats for non-hugified and hugified slabs. */
@@ -313,6 +347,7 @@ INDEX_PROTO(stats_arenas_i_hpa_shard_nonfull_slabs_j)
 CTL_PROTO(stats_arenas_i_nthreads)
 CTL_PROTO(stats_arenas_i_uptime)
 CTL_PROTO(stats_arenas_i_dss)
+CTL_PROTO(stats_arenas_i_numa_node)
 CTL_PROTO(stats_arenas_i_dirty_decay_ms)
 CTL_PROTO(stats_arenas_i_muzzy_decay_ms)
 CTL_PROTO(stats_arenas_i_pactive)
@@ -343,6 +378,7 @@ CTL_PROTO(stats_active)
 CTL_PROTO(stats_background_thread_num_threads)
 CTL_PROTO(stats_background_thread_num_runs)
 CTL_PROTO(stats_background_thread_run_interval)
+CTL_PROTO(stats_background_thread_num_pressure_periods)
 CTL_PROTO(stats_metadata)
 CTL_PROTO(stats_metadata_edata)
 CTL_PROTO(stats_metadata_rtree)
@@ -358,14 +394,34 @@ CTL_PROTO(experimental_hooks_prof_dump)
 CTL_PROTO(experimental_hooks_prof_sample)
 CTL_PROTO(experimental_hooks_prof_sample_free)
 CTL_PROTO(experimental_hooks_safety_check_abort)
+CTL_PROTO(experimental_hooks_mem_limit)
 CTL_PROTO(experimental_thread_activity_callback)
 CTL_PROTO(experimental_utilization_query)
 CTL_PROTO(experimental_utilization_batch_query)
+CTL_PROTO(experimental_utilization_defrag_hints)
 CTL_PROTO(experimental_arenas_i_pactivep)
 INDEX_PROTO(experimental_arenas_i)
 CTL_PROTO(experimental_prof_recent_alloc_max)
 CTL_PROTO(experimental_prof_recent_alloc_dump)
 CTL_PROTO(experimental_batch_alloc)
+CTL_PROTO(experimental_heap_walk)
+CTL_PROTO(experimental_stats_snapshot)
+CTL_PROTO(experimental_stats_snapshot_layout_bins_offset)
+CTL_PROTO(experimental_stats_snapshot_layout_bin_nfields)
+CTL_PROTO(experimental_stats_snapshot_layout_lextents_offset)
+CTL_PROTO(experimental_stats_snapshot_layout_lextent_nfields)
+#define OP(name, kind)							\
+    CTL_PROTO(experimental_stats_snapshot_layout_global_##name)
+STATS_SNAPSHOT_GLOBAL_FIELDS
+#undef OP
+#define OP(name, kind)							\
+    CTL_PROTO(experimental_stats_snapshot_layout_bin_##name)
+STATS_SNAPSHOT_BIN_FIELDS
+#undef OP
+#define OP(name, kind)							\
+    CTL_PROTO(experimental_stats_snapshot_layout_lextent_##name)
+STATS_SNAPSHOT_LEXTENT_FIELDS
+#undef OP
 CTL_PROTO(experimental_arenas_create_ext)
 
 #define MUTEX_STATS_CTL_PROTO_GEN(n)					\
@@ -441,7 +497,8 @@ static const ctl_named_node_t	thread_node[] = {
 	{NAME("tcache"),	CHILD(named, thread_tcache)},
 	{NAME("peak"),		CHILD(named, thread_peak)},
 	{NAME("prof"),		CHILD(named, thread_prof)},
-	{NAME("idle"),		CTL(thread_idle)}
+	{NAME("idle"),		CTL(thread_idle)},
+	{NAME("tag"),		CTL(thread_tag)}
 };
 
 static const ctl_named_node_t	config_node[] = {
@@ -476,10 +533,13 @@ static const ctl_named_node_t opt_node[] = {
 	{NAME("confirm_conf"),	CTL(opt_confirm_conf)},
 	{NAME("hpa"),		CTL(opt_hpa)},
 	{NAME("hpa_slab_max_alloc"),	CTL(opt_hpa_slab_max_alloc)},
+	{NAME("hpa_large_max_alloc"),	CTL(opt_hpa_large_max_alloc)},
 	{NAME("hpa_hugification_threshold"),
 		CTL(opt_hpa_hugification_threshold)},
 	{NAME("hpa_hugify_delay_ms"), CTL(opt_hpa_hugify_delay_ms)},
 	{NAME("hpa_hugify_sync"), CTL(opt_hpa_hugify_sync)},
+	{NAME("hpa_rehugify_max_nhp"), CTL(opt_hpa_rehugify_max_nhp)},
+	{NAME("hpa_rehugify_interval_ms"), CTL(opt_hpa_rehugify_interval_ms)},
 	{NAME("hpa_min_purge_interval_ms"), CTL(opt_hpa_min_purge_interval_ms)},
 	{NAME("experimental_hpa_max_purge_nhp"),
 		CTL(opt_experimental_hpa_max_purge_nhp)},
@@ -493,6 +553,7 @@ static const ctl_named_node_t opt_node[] = {
 		CTL(opt_hpa_sec_batch_fill_extra)},
 	{NAME("metadata_thp"),	CTL(opt_metadata_thp)},
 	{NAME("retain"),	CTL(opt_retain)},
+	{NAME("huge_slabs"),	CTL(opt_huge_slabs)},
 	{NAME("dss"),		CTL(opt_dss)},
 	{NAME("narenas"),	CTL(opt_narenas)},
 	{NAME("percpu_arena"),	CTL(opt_percpu_arena)},
@@ -500,6 +561,9 @@ static const ctl_named_node_t opt_node[] = {
 	{NAME("mutex_max_spin"),	CTL(opt_mutex_max_spin)},
 	{NAME("background_thread"),	CTL(opt_background_thread)},
 	{NAME("max_background_threads"),	CTL(opt_max_background_threads)},
+	{NAME("pressure_purge"),	CTL(opt_pressure_purge)},
+	{NAME("pressure_purge_threshold"),
+		CTL(opt_pressure_purge_threshold)},
 	{NAME("dirty_decay_ms"), CTL(opt_dirty_decay_ms)},
 	{NAME("muzzy_decay_ms"), CTL(opt_muzzy_decay_ms)},
 	{NAME("stats_print"),	CTL(opt_stats_print)},
@@ -515,10 +579,16 @@ static const ctl_named_node_t opt_node[] = {
 	{NAME("experimental_tcache_gc"),
 		CTL(opt_experimental_tcache_gc)},
 	{NAME("max_batched_size"),	CTL(opt_max_batched_size)},
-	{NAME("remote_free_max"),	CTL(opt_remote_free_max)},
 	{NAME("remote_free_max_batch"),	CTL(opt_remote_free_max_batch)},
+	{NAME("bin_shards_max"),	CTL(opt_bin_shards_max)},
 	{NAME("tcache"),	CTL(opt_tcache)},
 	{NAME("tcache_max"),	CTL(opt_tcache_max)},
+	{NAME("percpu_tcache"),	CTL(opt_percpu_tcache)},
+	{NAME("numa_arena"),	CTL(opt_numa_arena)},
+	{NAME("arena_rebalance_interval"),
+		CTL(opt_arena_rebalance_interval)},
+	{NAME("arena_rebalance_threshold"),
+		CTL(opt_arena_rebalance_threshold)},
 	{NAME("tcache_nslots_small_min"),
 		CTL(opt_tcache_nslots_small_min)},
 	{NAME("tcache_nslots_small_max"),
@@ -531,8 +601,13 @@ static const ctl_named_node_t opt_node[] = {
 		CTL(opt_lg_tcache_flush_small_div)},
 	{NAME("lg_tcache_flush_large_div"),
 		CTL(opt_lg_tcache_flush_large_div)},
+	{NAME("tcache_adaptive"),	CTL(opt_tcache_adaptive)},
+	{NAME("tcache_adaptive_max_bytes"),
+		CTL(opt_tcache_adaptive_max_bytes)},
 	{NAME("thp"),		CTL(opt_thp)},
 	{NAME("lg_extent_max_active_fit"), CTL(opt_lg_extent_max_active_fit)},
+	{NAME("mem_limit"),	CTL(opt_mem_limit)},
+	{NAME("mem_limit_fail"),	CTL(opt_mem_limit_fail)},
 	{NAME("prof"),		CTL(opt_prof)},
 	{NAME("prof_prefix"),	CTL(opt_prof_prefix)},
 	{NAME("prof_active"),	CTL(opt_prof_active)},
@@ -544,11 +619,15 @@ static const ctl_named_node_t opt_node[] = {
 	{NAME("prof_final"),	CTL(opt_prof_final)},
 	{NAME("prof_leak"),	CTL(opt_prof_leak)},
 	{NAME("prof_leak_error"),	CTL(opt_prof_leak_error)},
+	{NAME("prof_dump_incremental"),	CTL(opt_prof_dump_incremental)},
+	{NAME("prof_dump_gzip"),	CTL(opt_prof_dump_gzip)},
+	{NAME("prof_dump_format"),	CTL(opt_prof_dump_format)},
 	{NAME("prof_accum"),	CTL(opt_prof_accum)},
 	{NAME("prof_pid_namespace"),	CTL(opt_prof_pid_namespace)},
 	{NAME("prof_recent_alloc_max"),	CTL(opt_prof_recent_alloc_max)},
 	{NAME("prof_stats"),	CTL(opt_prof_stats)},
 	{NAME("prof_sys_thread_name"),	CTL(opt_prof_sys_thread_name)},
+	{NAME("prof_fast_unwind"),	CTL(opt_prof_fast_unwind)},
 	{NAME("prof_time_resolution"),	CTL(opt_prof_time_res)},
 	{NAME("lg_san_uaf_align"),	CTL(opt_lg_san_uaf_align)},
 	{NAME("zero_realloc"),	CTL(opt_zero_realloc)},
@@ -579,7 +658,8 @@ static const ctl_named_node_t arena_i_node[] = {
 	{NAME("muzzy_decay_ms"),	CTL(arena_i_muzzy_decay_ms)},
 	{NAME("extent_hooks"),		CTL(arena_i_extent_hooks)},
 	{NAME("retain_grow_limit"),	CTL(arena_i_retain_grow_limit)},
-	{NAME("name"),			CTL(arena_i_name)}
+	{NAME("name"),			CTL(arena_i_name)},
+	{NAME("group"),			CTL(arena_i_group)}
 };
 static const ctl_named_node_t super_arena_i_node[] = {
 	{NAME(""),		CHILD(named, arena_i)}
@@ -628,9 +708,29 @@ static const ctl_named_node_t arenas_node[] = {
 	{NAME("nlextents"),	CTL(arenas_nlextents)},
 	{NAME("lextent"),	CHILD(indexed, arenas_lextent)},
 	{NAME("create"),	CTL(arenas_create)},
+	{NAME("create_grouped"),	CTL(arenas_create_grouped)},
 	{NAME("lookup"),	CTL(arenas_lookup)}
 };
 
+static const ctl_named_node_t tags_tag_i_node[] = {
+	{NAME("thread_allocated"),	CTL(tags_tag_i_thread_allocated)},
+	{NAME("thread_deallocated"),	CTL(tags_tag_i_thread_deallocated)},
+	{NAME("thread_nmalloc"),	CTL(tags_tag_i_thread_nmalloc)},
+	{NAME("thread_ndalloc"),	CTL(tags_tag_i_thread_ndalloc)}
+};
+static const ctl_named_node_t super_tags_tag_i_node[] = {
+	{NAME(""),		CHILD(named, tags_tag_i)}
+};
+
+static const ctl_indexed_node_t tags_tag_node[] = {
+	{INDEX(tags_tag_i)}
+};
+
+static const ctl_named_node_t tags_node[] = {
+	{NAME("ntags"),		CTL(tags_ntags)},
+	{NAME("tag"),		CHILD(indexed, tags_tag)}
+};
+
 static const ctl_named_node_t prof_stats_bins_i_node[] = {
 	{NAME("live"),		CTL(prof_stats_bins_i_live)},
 	{NAME("accum"),		CTL(prof_stats_bins_i_accum)}
@@ -726,10 +826,9 @@ static const ctl_named_node_t stats_arenas_i_bins_j_node[] = {
 	{NAME("nreslabs"),	CTL(stats_arenas_i_bins_j_nreslabs)},
 	{NAME("curslabs"),	CTL(stats_arenas_i_bins_j_curslabs)},
 	{NAME("nonfull_slabs"),	CTL(stats_arenas_i_bins_j_nonfull_slabs)},
+	{NAME("nshards"),	CTL(stats_arenas_i_bins_j_nshards)},
 	{NAME("batch_pops"),
 		CTL(stats_arenas_i_bins_j_batch_pops)},
-	{NAME("batch_failed_pushes"),
-		CTL(stats_arenas_i_bins_j_batch_failed_pushes)},
 	{NAME("batch_pushes"),
 		CTL(stats_arenas_i_bins_j_batch_pushes)},
 	{NAME("batch_pushed_elems"),
@@ -868,6 +967,9 @@ static const ctl_named_node_t stats_arenas_i_hpa_shard_node[] = {
 	{NAME("nhugifies"),	CTL(stats_arenas_i_hpa_shard_nhugifies)},
 	{NAME("nhugify_failures"),
 	    CTL(stats_arenas_i_hpa_shard_nhugify_failures)},
+	{NAME("nrehugifies"),	CTL(stats_arenas_i_hpa_shard_nrehugifies)},
+	{NAME("nrehugify_failures"),
+	    CTL(stats_arenas_i_hpa_shard_nrehugify_failures)},
 	{NAME("ndehugifies"),	CTL(stats_arenas_i_hpa_shard_ndehugifies)},
 
 	{NAME("full_slabs"),	CHILD(named,
@@ -882,6 +984,7 @@ static const ctl_named_node_t stats_arenas_i_node[] = {
 	{NAME("nthreads"),	CTL(stats_arenas_i_nthreads)},
 	{NAME("uptime"),	CTL(stats_arenas_i_uptime)},
 	{NAME("dss"),		CTL(stats_arenas_i_dss)},
+	{NAME("numa_node"),	CTL(stats_arenas_i_numa_node)},
 	{NAME("dirty_decay_ms"), CTL(stats_arenas_i_dirty_decay_ms)},
 	{NAME("muzzy_decay_ms"), CTL(stats_arenas_i_muzzy_decay_ms)},
 	{NAME("pactive"),	CTL(stats_arenas_i_pactive)},
@@ -926,7 +1029,9 @@ static const ctl_indexed_node_t stats_arenas_node[] = {
 static const ctl_named_node_t stats_background_thread_node[] = {
 	{NAME("num_threads"),	CTL(stats_background_thread_num_threads)},
 	{NAME("num_runs"),	CTL(stats_background_thread_num_runs)},
-	{NAME("run_interval"),	CTL(stats_background_thread_run_interval)}
+	{NAME("run_interval"),	CTL(stats_background_thread_run_interval)},
+	{NAME("num_pressure_periods"),
+	    CTL(stats_background_thread_num_pressure_periods)}
 };
 
 #define OP(mtx) MUTEX_PROF_DATA_NODE(mutexes_##mtx)
@@ -966,6 +1071,7 @@ static const ctl_named_node_t experimental_hooks_node[] = {
 	{NAME("prof_sample"),	CTL(experimental_hooks_prof_sample)},
 	{NAME("prof_sample_free"),	CTL(experimental_hooks_prof_sample_free)},
 	{NAME("safety_check_abort"),	CTL(experimental_hooks_safety_check_abort)},
+	{NAME("mem_limit"),	CTL(experimental_hooks_mem_limit)},
 };
 
 static const ctl_named_node_t experimental_thread_node[] = {
@@ -975,7 +1081,8 @@ static const ctl_named_node_t experimental_thread_node[] = {
 
 static const ctl_named_node_t experimental_utilization_node[] = {
 	{NAME("query"),		CTL(experimental_utilization_query)},
-	{NAME("batch_query"),	CTL(experimental_utilization_batch_query)}
+	{NAME("batch_query"),	CTL(experimental_utilization_batch_query)},
+	{NAME("defrag_hints"),	CTL(experimental_utilization_defrag_hints)}
 };
 
 static const ctl_named_node_t experimental_arenas_i_node[] = {
@@ -994,6 +1101,45 @@ static const ctl_named_node_t experimental_prof_recent_node[] = {
 	{NAME("alloc_dump"),	CTL(experimental_prof_recent_alloc_dump)},
 };
 
+static const ctl_named_node_t
+    experimental_stats_snapshot_layout_global_node[] = {
+#define OP(name, kind)							\
+	{NAME(#name),	CTL(experimental_stats_snapshot_layout_global_##name)},
+	STATS_SNAPSHOT_GLOBAL_FIELDS
+#undef OP
+};
+
+static const ctl_named_node_t experimental_stats_snapshot_layout_bin_node[] = {
+#define OP(name, kind)							\
+	{NAME(#name),	CTL(experimental_stats_snapshot_layout_bin_##name)},
+	STATS_SNAPSHOT_BIN_FIELDS
+#undef OP
+};
+
+static const ctl_named_node_t
+    experimental_stats_snapshot_layout_lextent_node[] = {
+#define OP(name, kind)							\
+	{NAME(#name),	CTL(experimental_stats_snapshot_layout_lextent_##name)},
+	STATS_SNAPSHOT_LEXTENT_FIELDS
+#undef OP
+};
+
+static const ctl_named_node_t experimental_stats_snapshot_layout_node[] = {
+	{NAME("global"),
+	    CHILD(named, experimental_stats_snapshot_layout_global)},
+	{NAME("bins_offset"),
+	    CTL(experimental_stats_snapshot_layout_bins_offset)},
+	{NAME("bin_nfields"),
+	    CTL(experimental_stats_snapshot_layout_bin_nfields)},
+	{NAME("bin"),	CHILD(named, experimental_stats_snapshot_layout_bin)},
+	{NAME("lextents_offset"),
+	    CTL(experimental_stats_snapshot_layout_lextents_offset)},
+	{NAME("lextent_nfields"),
+	    CTL(experimental_stats_snapshot_layout_lextent_nfields)},
+	{NAME("lextent"),
+	    CHILD(named, experimental_stats_snapshot_layout_lextent)}
+};
+
 static const ctl_named_node_t experimental_node[] = {
 	{NAME("hooks"),		CHILD(named, experimental_hooks)},
 	{NAME("utilization"),	CHILD(named, experimental_utilization)},
@@ -1001,6 +1147,10 @@ static const ctl_named_node_t experimental_node[] = {
 	{NAME("arenas_create_ext"),	CTL(experimental_arenas_create_ext)},
 	{NAME("prof_recent"),	CHILD(named, experimental_prof_recent)},
 	{NAME("batch_alloc"),	CTL(experimental_batch_alloc)},
+	{NAME("heap_walk"),	CTL(experimental_heap_walk)},
+	{NAME("stats_snapshot"),	CTL(experimental_stats_snapshot)},
+	{NAME("stats_snapshot_layout"),
+	    CHILD(named, experimental_stats_snapshot_layout)},
 	{NAME("thread"),	CHILD(named, experimental_thread)}
 };
 
@@ -1009,12 +1159,14 @@ static const ctl_named_node_t	root_node[] = {
 	{NAME("epoch"),		CTL(epoch)},
 	{NAME("background_thread"),	CTL(background_thread)},
 	{NAME("max_background_threads"),	CTL(max_background_threads)},
+	{NAME("mem_limit"),	CTL(mem_limit)},
 	{NAME("thread"),	CHILD(named, thread)},
 	{NAME("config"),	CHILD(named, config)},
 	{NAME("opt"),		CHILD(named, opt)},
 	{NAME("tcache"),	CHILD(named, tcache)},
 	{NAME("arena"),		CHILD(indexed, arena)},
 	{NAME("arenas"),	CHILD(named, arenas)},
+	{NAME("tags"),		CHILD(named, tags)},
 	{NAME("prof"),		CHILD(named, prof)},
 	{NAME("stats"),		CHILD(named, stats)},
 	{NAME("experimental"),	CHILD(named, experimental)}
@@ -1144,6 +1296,7 @@ ctl_arena_clear(ctl_arena_t *ctl_arena) {
 	ctl_arena->pactive = 0;
 	ctl_arena->pdirty = 0;
 	ctl_arena->pmuzzy = 0;
+	ctl_arena->numa_node = NUMA_NODE_NONE;
 	if (config_stats) {
 		memset(ctl_arena->astats, 0, sizeof(*(ctl_arena->astats)));
 	}
@@ -1153,6 +1306,7 @@ static void
 ctl_arena_stats_amerge(tsdn_t *tsdn, ctl_arena_t *ctl_arena, arena_t *arena) {
 	unsigned i;
 
+	ctl_arena->numa_node = arena->pa_shard.pac.numa_node;
 	if (config_stats) {
 		arena_stats_merge(tsdn, arena, &ctl_arena->nthreads,
 		    &ctl_arena->dss, &ctl_arena->dirty_decay_ms,
@@ -1312,8 +1466,6 @@ MUTEX_PROF_ARENA_MUTEXES
 
 			merged->batch_pops
 			    += bstats->batch_pops;
-			merged->batch_failed_pushes
-			    += bstats->batch_failed_pushes;
 			merged->batch_pushes
 			    += bstats->batch_pushes;
 			merged->batch_pushed_elems
@@ -1321,6 +1473,10 @@ MUTEX_PROF_ARENA_MUTEXES
 
 			malloc_mutex_prof_merge(&sdstats->bstats[i].mutex_data,
 			    &astats->bstats[i].mutex_data);
+			if (!destroyed) {
+				sdstats->bstats[i].nshards +=
+				    astats->bstats[i].nshards;
+			}
 		}
 
 		/* Merge stats for large allocations. */
@@ -1475,8 +1631,8 @@ ctl_refresh(tsdn_t *tsdn) {
     malloc_mutex_unlock(tsdn, &mtx);
 
 		if (config_prof && opt_prof) {
-			READ_GLOBAL_MUTEX_PROF_DATA(
-			    global_prof_mutex_prof, bt2gctx_mtx);
+			prof_bt2gctx_mutex_prof_read(tsdn,
+			    &ctl_stats->mutex_prof_data[global_prof_mutex_prof]);
 			READ_GLOBAL_MUTEX_PROF_DATA(
 			    global_prof_mutex_prof_thds_data, tdatas_mtx);
 			READ_GLOBAL_MUTEX_PROF_DATA(
@@ -2210,6 +2366,23 @@ label_return:
 	return ret;
 }
 
+static int
+mem_limit_ctl(tsd_t *tsd, const size_t *mib, size_t miblen, void *oldp,
+    size_t *oldlenp, void *newp, size_t newlen) {
+	int ret;
+
+	size_t oldval = mem_limit_get();
+	READ(oldval, size_t);
+	if (newp != NULL) {
+		size_t newval JEMALLOC_CC_SILENCE_INIT(0);
+		WRITE(newval, size_t);
+		mem_limit_set(newval);
+	}
+	ret = 0;
+label_return:
+	return ret;
+}
+
 /******************************************************************************/
 
 CTL_RO_CONFIG_GEN(config_cache_oblivious, bool)
@@ -2242,6 +2415,9 @@ CTL_RO_NL_GEN(opt_hpa_hugification_threshold,
     opt_hpa_opts.hugification_threshold, size_t)
 CTL_RO_NL_GEN(opt_hpa_hugify_delay_ms, opt_hpa_opts.hugify_delay_ms, uint64_t)
 CTL_RO_NL_GEN(opt_hpa_hugify_sync, opt_hpa_opts.hugify_sync, bool)
+CTL_RO_NL_GEN(opt_hpa_rehugify_max_nhp, opt_hpa_opts.rehugify_max_nhp, size_t)
+CTL_RO_NL_GEN(opt_hpa_rehugify_interval_ms, opt_hpa_opts.rehugify_interval_ms,
+    uint64_t)
 CTL_RO_NL_GEN(opt_hpa_min_purge_interval_ms, opt_hpa_opts.min_purge_interval_ms,
     uint64_t)
 CTL_RO_NL_GEN(opt_experimental_hpa_max_purge_nhp,
@@ -2253,6 +2429,7 @@ CTL_RO_NL_GEN(opt_experimental_hpa_max_purge_nhp,
  */
 CTL_RO_NL_GEN(opt_hpa_dirty_mult, opt_hpa_opts.dirty_mult, fxp_t)
 CTL_RO_NL_GEN(opt_hpa_slab_max_alloc, opt_hpa_opts.slab_max_alloc, size_t)
+CTL_RO_NL_GEN(opt_hpa_large_max_alloc, opt_hpa_opts.large_max_alloc, size_t)
 
 /* HPA SEC options */
 CTL_RO_NL_GEN(opt_hpa_sec_nshards, opt_hpa_sec_opts.nshards, size_t)
@@ -2266,6 +2443,7 @@ CTL_RO_NL_GEN(opt_hpa_sec_batch_fill_extra, opt_hpa_sec_opts.batch_fill_extra,
 CTL_RO_NL_GEN(opt_metadata_thp, metadata_thp_mode_names[opt_metadata_thp],
     const char *)
 CTL_RO_NL_GEN(opt_retain, opt_retain, bool)
+CTL_RO_NL_GEN(opt_huge_slabs, opt_huge_slabs, bool)
 CTL_RO_NL_GEN(opt_dss, opt_dss, const char *)
 CTL_RO_NL_GEN(opt_narenas, opt_narenas, unsigned)
 CTL_RO_NL_GEN(opt_percpu_arena, percpu_arena_mode_names[opt_percpu_arena],
@@ -2274,6 +2452,9 @@ CTL_RO_NL_GEN(opt_mutex_max_spin, opt_mutex_max_spin, int64_t)
 CTL_RO_NL_GEN(opt_oversize_threshold, opt_oversize_threshold, size_t)
 CTL_RO_NL_GEN(opt_background_thread, opt_background_thread, bool)
 CTL_RO_NL_GEN(opt_max_background_threads, opt_max_background_threads, size_t)
+CTL_RO_NL_GEN(opt_pressure_purge, opt_pressure_purge, bool)
+CTL_RO_NL_GEN(opt_pressure_purge_threshold, opt_pressure_purge_threshold,
+    unsigned)
 CTL_RO_NL_GEN(opt_dirty_decay_ms, opt_dirty_decay_ms, ssize_t)
 CTL_RO_NL_GEN(opt_muzzy_decay_ms, opt_muzzy_decay_ms, ssize_t)
 CTL_RO_NL_GEN(opt_stats_print, opt_stats_print, bool)
@@ -2288,12 +2469,17 @@ CTL_RO_NL_CGEN(config_enable_cxx, opt_experimental_infallible_new,
     opt_experimental_infallible_new, bool)
 CTL_RO_NL_GEN(opt_experimental_tcache_gc, opt_experimental_tcache_gc, bool)
 CTL_RO_NL_GEN(opt_max_batched_size, opt_bin_info_max_batched_size, size_t)
-CTL_RO_NL_GEN(opt_remote_free_max, opt_bin_info_remote_free_max,
-    size_t)
 CTL_RO_NL_GEN(opt_remote_free_max_batch, opt_bin_info_remote_free_max_batch,
     size_t)
+CTL_RO_NL_GEN(opt_bin_shards_max, opt_bin_info_shards_max, unsigned)
 CTL_RO_NL_GEN(opt_tcache, opt_tcache, bool)
 CTL_RO_NL_GEN(opt_tcache_max, opt_tcache_max, size_t)
+CTL_RO_NL_GEN(opt_percpu_tcache, opt_percpu_tcache, bool)
+CTL_RO_NL_GEN(opt_numa_arena, opt_numa_arena, bool)
+CTL_RO_NL_GEN(opt_arena_rebalance_interval, opt_arena_rebalance_interval,
+    int64_t)
+CTL_RO_NL_GEN(opt_arena_rebalance_threshold, opt_arena_rebalance_threshold,
+    unsigned)
 CTL_RO_NL_GEN(opt_tcache_nslots_small_min, opt_tcache_nslots_small_min,
     unsigned)
 CTL_RO_NL_GEN(opt_tcache_nslots_small_max, opt_tcache_nslots_small_max,
@@ -2306,9 +2492,14 @@ CTL_RO_NL_GEN(opt_lg_tcache_flush_small_div, opt_lg_tcache_flush_small_div,
     unsigned)
 CTL_RO_NL_GEN(opt_lg_tcache_flush_large_div, opt_lg_tcache_flush_large_div,
     unsigned)
+CTL_RO_NL_GEN(opt_tcache_adaptive, opt_tcache_adaptive, bool)
+CTL_RO_NL_GEN(opt_tcache_adaptive_max_bytes, opt_tcache_adaptive_max_bytes,
+    size_t)
 CTL_RO_NL_GEN(opt_thp, thp_mode_names[opt_thp], const char *)
 CTL_RO_NL_GEN(opt_lg_extent_max_active_fit, opt_lg_extent_max_active_fit,
     size_t)
+CTL_RO_NL_GEN(opt_mem_limit, opt_mem_limit, size_t)
+CTL_RO_NL_GEN(opt_mem_limit_fail, opt_mem_limit_fail, bool)
 CTL_RO_NL_CGEN(config_prof, opt_prof, opt_prof, bool)
 CTL_RO_NL_CGEN(config_prof, opt_prof_prefix, opt_prof_prefix, const char *)
 CTL_RO_NL_CGEN(config_prof, opt_prof_active, opt_prof_active, bool)
@@ -2324,11 +2515,17 @@ CTL_RO_NL_CGEN(config_prof, opt_prof_gdump, opt_prof_gdump, bool)
 CTL_RO_NL_CGEN(config_prof, opt_prof_final, opt_prof_final, bool)
 CTL_RO_NL_CGEN(config_prof, opt_prof_leak, opt_prof_leak, bool)
 CTL_RO_NL_CGEN(config_prof, opt_prof_leak_error, opt_prof_leak_error, bool)
+CTL_RO_NL_CGEN(config_prof, opt_prof_dump_incremental,
+    opt_prof_dump_incremental, bool)
+CTL_RO_NL_CGEN(config_prof, opt_prof_dump_gzip, opt_prof_dump_gzip, bool)
+CTL_RO_NL_CGEN(config_prof, opt_prof_dump_format,
+    prof_dump_format_names[opt_prof_dump_format], const char *)
 CTL_RO_NL_CGEN(config_prof, opt_prof_recent_alloc_max,
     opt_prof_recent_alloc_max, ssize_t)
 CTL_RO_NL_CGEN(config_prof, opt_prof_stats, opt_prof_stats, bool)
 CTL_RO_NL_CGEN(config_prof, opt_prof_sys_thread_name, opt_prof_sys_thread_name,
     bool)
+CTL_RO_NL_CGEN(config_prof, opt_prof_fast_unwind, opt_prof_fast_unwind, bool)
 CTL_RO_NL_CGEN(config_prof, opt_prof_time_res,
     prof_time_res_mode_names[opt_prof_time_res], const char *)
 CTL_RO_NL_CGEN(config_uaf_detection, opt_lg_san_uaf_align,
@@ -2689,6 +2886,28 @@ label_return:
 	return ret;
 }
 
+static int
+thread_tag_ctl(tsd_t *tsd, const size_t *mib, size_t miblen,
+    void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+	int ret;
+	unsigned oldval, newval;
+
+	newval = oldval = alloc_tag_get(tsd);
+	WRITE(newval, unsigned);
+	if (newval >= ALLOC_TAG_NTAGS) {
+		ret = EINVAL;
+		goto label_return;
+	}
+	READ(oldval, unsigned);
+	if (newval != oldval) {
+		alloc_tag_set(tsd, newval);
+	}
+
+	ret = 0;
+label_return:
+	return ret;
+}
+
 /******************************************************************************/
 
 static int
@@ -2855,6 +3074,11 @@ arena_i_reset_destroy_helper(tsd_t *tsd, const size_t *mib, size_t miblen,
 		ret = EFAULT;
 		goto label_return;
 	}
+	/* The other arenas of the group still use its pages. */
+	if (atomic_load_u(&(*arena)->ngroup_members, ATOMIC_RELAXED) != 0) {
+		ret = EFAULT;
+		goto label_return;
+	}
 
 	ret = 0;
 label_return:
@@ -3138,6 +3362,11 @@ arena_i_extent_hooks_ctl(tsd_t *tsd, const size_t *mib, size_t miblen,
 			}
 		} else {
 			if (newp != NULL) {
+				/* Only the group's first arena has pages. */
+				if (arena->pa_arena != arena) {
+					ret = EFAULT;
+					goto label_return;
+				}
 				extent_hooks_t *new_extent_hooks
 				    JEMALLOC_CC_SILENCE_INIT(NULL);
 				WRITE(new_extent_hooks, extent_hooks_t *);
@@ -3253,6 +3482,34 @@ label_return:
 	return ret;
 }
 
+static int
+arena_i_group_ctl(tsd_t *tsd, const size_t *mib, size_t miblen,
+    void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+	int ret;
+	unsigned arena_ind;
+
+	malloc_mutex_lock(tsd_tsdn(tsd), &ctl_mtx);
+	READONLY();
+	MIB_UNSIGNED(arena_ind, 1);
+	if (arena_ind == MALLCTL_ARENAS_ALL || arena_ind >=
+	    ctl_arenas->narenas) {
+		ret = EINVAL;
+		goto label_return;
+	}
+	arena_t *arena = arena_get(tsd_tsdn(tsd), arena_ind, false);
+	if (arena == NULL) {
+		ret = EFAULT;
+		goto label_return;
+	}
+	unsigned group_ind = arena_ind_get(arena->pa_arena);
+	READ(group_ind, unsigned);
+
+	ret = 0;
+label_return:
+	malloc_mutex_unlock(tsd_tsdn(tsd), &ctl_mtx);
+	return ret;
+}
+
 static const ctl_named_node_t *
 arena_i_index(tsdn_t *tsdn, const size_t *mib, size_t miblen,
     size_t i) {
@@ -3392,6 +3649,41 @@ label_return:
 	return ret;
 }
 
+static int
+arenas_create_grouped_ctl(tsd_t *tsd, const size_t *mib, size_t miblen,
+    void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+	int ret;
+	unsigned arena_ind;
+	unsigned group_ind JEMALLOC_CC_SILENCE_INIT(UINT_MAX);
+
+	malloc_mutex_lock(tsd_tsdn(tsd), &ctl_mtx);
+
+	VERIFY_READ(unsigned);
+	ASSURED_WRITE(group_ind, unsigned);
+	arena_t *group = (group_ind < narenas_total_get()) ?
+	    arena_get(tsd_tsdn(tsd), group_ind, false) : NULL;
+	if (group == NULL) {
+		ret = EFAULT;
+		goto label_return;
+	}
+
+	/* The pages come with the extent hooks of the group. */
+	arena_config_t config = arena_config_default;
+	config.extent_hooks = ehooks_get_extent_hooks_ptr(
+	    arena_get_ehooks(group));
+	if ((arena_ind = ctl_arena_init(tsd, &config)) == UINT_MAX) {
+		ret = EAGAIN;
+		goto label_return;
+	}
+	arena_group_join(arena_get(tsd_tsdn(tsd), arena_ind, false), group);
+	READ(arena_ind, unsigned);
+
+	ret = 0;
+label_return:
+	malloc_mutex_unlock(tsd_tsdn(tsd), &ctl_mtx);
+	return ret;
+}
+
 static int
 experimental_arenas_create_ext_ctl(tsd_t *tsd,
     const size_t *mib, size_t miblen,
@@ -3453,6 +3745,73 @@ label_return:
 
 /******************************************************************************/
 
+CTL_RO_NL_GEN(tags_ntags, ALLOC_TAG_NTAGS, unsigned)
+
+static int
+tags_tag_i_read(tsd_t *tsd, const size_t *mib, alloc_tag_counts_t *counts) {
+	int ret;
+	unsigned tag;
+
+	MIB_UNSIGNED(tag, 2);
+	if (tag >= ALLOC_TAG_NTAGS) {
+		ret = ENOENT;
+		goto label_return;
+	}
+	alloc_tag_read(tsd_tsdn(tsd), tag, counts);
+
+	ret = 0;
+label_return:
+	return ret;
+}
+
+#define TAGS_TAG_I_GEN(c, n)						\
+static int								\
+tags_tag_i_thread_##n##_ctl(tsd_t *tsd, const size_t *mib,		\
+    size_t miblen, void *oldp, size_t *oldlenp, void *newp,		\
+    size_t newlen) {							\
+	int ret;							\
+	alloc_tag_counts_t counts;					\
+	uint64_t oldval;						\
+									\
+	if (!(c)) {							\
+		return ENOENT;						\
+	}								\
+	READONLY();							\
+	ret = tags_tag_i_read(tsd, mib, &counts);			\
+	if (ret != 0) {							\
+		goto label_return;					\
+	}								\
+	oldval = counts.n;						\
+	READ(oldval, uint64_t);						\
+									\
+	ret = 0;							\
+label_return:								\
+	return ret;							\
+}
+
+/*
+ * These are the sums of the thread counters over the periods each thread had
+ * the tag set; frees are credited to the tag of the freeing thread, which need
+ * not be the one the memory was allocated under.
+ */
+TAGS_TAG_I_GEN(true, allocated)
+TAGS_TAG_I_GEN(true, deallocated)
+/* The operation counts are only maintained along with the stats. */
+TAGS_TAG_I_GEN(config_stats, nmalloc)
+TAGS_TAG_I_GEN(config_stats, ndalloc)
+
+#undef TAGS_TAG_I_GEN
+
+static const ctl_named_node_t *
+tags_tag_i_index(tsdn_t *tsdn, const size_t *mib, size_t miblen, size_t i) {
+	if (i >= ALLOC_TAG_NTAGS) {
+		return NULL;
+	}
+	return super_tags_tag_i_node;
+}
+
+/******************************************************************************/
+
 static int
 prof_thread_active_init_ctl(tsd_t *tsd, const size_t *mib,
     size_t miblen, void *oldp, size_t *oldlenp, void *newp,
@@ -3798,6 +4157,29 @@ label_return:
 	return ret;
 }
 
+static int
+experimental_hooks_mem_limit_ctl(tsd_t *tsd, const size_t *mib,
+    size_t miblen, void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+	int ret;
+
+	if (oldp == NULL && newp == NULL) {
+		ret = EINVAL;
+		goto label_return;
+	}
+	if (oldp != NULL) {
+		mem_limit_hook_t old_hook = mem_limit_hook_get();
+		READ(old_hook, mem_limit_hook_t);
+	}
+	if (newp != NULL) {
+		mem_limit_hook_t new_hook JEMALLOC_CC_SILENCE_INIT(NULL);
+		WRITE(new_hook, mem_limit_hook_t);
+		mem_limit_hook_set(new_hook);
+	}
+	ret = 0;
+label_return:
+	return ret;
+}
+
 /******************************************************************************/
 
 CTL_RO_CGEN(config_stats, stats_allocated, ctl_stats->allocated, size_t)
@@ -3818,11 +4200,14 @@ CTL_RO_CGEN(config_stats, stats_background_thread_num_runs,
     ctl_stats->background_thread.num_runs, uint64_t)
 CTL_RO_CGEN(config_stats, stats_background_thread_run_interval,
     nstime_ns(&ctl_stats->background_thread.run_interval), uint64_t)
+CTL_RO_CGEN(config_stats, stats_background_thread_num_pressure_periods,
+    ctl_stats->background_thread.num_pressure_periods, uint64_t)
 
 CTL_RO_CGEN(config_stats, stats_zero_reallocs,
     atomic_load_zu(&zero_realloc_count, ATOMIC_RELAXED), size_t)
 
 CTL_RO_GEN(stats_arenas_i_dss, arenas_i(mib[2])->dss, const char *)
+CTL_RO_GEN(stats_arenas_i_numa_node, arenas_i(mib[2])->numa_node, int)
 CTL_RO_GEN(stats_arenas_i_dirty_decay_ms, arenas_i(mib[2])->dirty_decay_ms,
     ssize_t)
 CTL_RO_GEN(stats_arenas_i_muzzy_decay_ms, arenas_i(mib[2])->muzzy_decay_ms,
@@ -3979,7 +4364,7 @@ stats_mutexes_reset_ctl(tsd_t *tsd, const size_t *mib,
 		MUTEX_PROF_RESET(background_thread_lock);
 	}
 	if (config_prof && opt_prof) {
-		MUTEX_PROF_RESET(bt2gctx_mtx);
+		prof_bt2gctx_mutex_prof_reset(tsdn);
 		MUTEX_PROF_RESET(tdatas_mtx);
 		MUTEX_PROF_RESET(prof_dump_mtx);
 		MUTEX_PROF_RESET(prof_recent_alloc_mtx);
@@ -4036,10 +4421,10 @@ CTL_RO_CGEN(config_stats, stats_arenas_i_bins_j_curslabs,
     arenas_i(mib[2])->astats->bstats[mib[4]].stats_data.curslabs, size_t)
 CTL_RO_CGEN(config_stats, stats_arenas_i_bins_j_nonfull_slabs,
     arenas_i(mib[2])->astats->bstats[mib[4]].stats_data.nonfull_slabs, size_t)
+CTL_RO_CGEN(config_stats, stats_arenas_i_bins_j_nshards,
+    arenas_i(mib[2])->astats->bstats[mib[4]].nshards, uint32_t)
 CTL_RO_CGEN(config_stats, stats_arenas_i_bins_j_batch_pops,
     arenas_i(mib[2])->astats->bstats[mib[4]].stats_data.batch_pops, uint64_t)
-CTL_RO_CGEN(config_stats, stats_arenas_i_bins_j_batch_failed_pushes,
-    arenas_i(mib[2])->astats->bstats[mib[4]].stats_data.batch_failed_pushes, uint64_t)
 CTL_RO_CGEN(config_stats, stats_arenas_i_bins_j_batch_pushes,
     arenas_i(mib[2])->astats->bstats[mib[4]].stats_data.batch_pushes, uint64_t)
 CTL_RO_CGEN(config_stats, stats_arenas_i_bins_j_batch_pushed_elems,
@@ -4129,6 +4514,11 @@ CTL_RO_CGEN(config_stats, stats_arenas_i_hpa_shard_nhugifies,
 CTL_RO_CGEN(config_stats, stats_arenas_i_hpa_shard_nhugify_failures,
     arenas_i(mib[2])->astats->hpastats.nonderived_stats.nhugify_failures,
     uint64_t);
+CTL_RO_CGEN(config_stats, stats_arenas_i_hpa_shard_nrehugifies,
+    arenas_i(mib[2])->astats->hpastats.nonderived_stats.nrehugifies, uint64_t);
+CTL_RO_CGEN(config_stats, stats_arenas_i_hpa_shard_nrehugify_failures,
+    arenas_i(mib[2])->astats->hpastats.nonderived_stats.nrehugify_failures,
+    uint64_t);
 CTL_RO_CGEN(config_stats, stats_arenas_i_hpa_shard_ndehugifies,
     arenas_i(mib[2])->astats->hpastats.nonderived_stats.ndehugifies, uint64_t);
 
@@ -4458,6 +4848,10 @@ label_return:
  * (b) whether memory consumption is above certain threshold, or
  * (c) some combination of the two.
  *
+ * The pointers are looked up in address order, so that neighbouring ones share
+ * the rtree leaf and extent lookups.  Querying many pointers (e.g. all of a
+ * heap) in one call is thus much cheaper than querying them in small batches.
+ *
  * The caller needs to make sure that the input/output arrays are valid and
  * their sizes are proper as well as matched, meaning:
  *
@@ -4504,14 +4898,64 @@ experimental_utilization_batch_query_ctl(tsd_t *tsd, const size_t *mib,
 		goto label_return;
 	}
 
+	inspect_extent_util_stats_batch_get(tsd_tsdn(tsd), (void **)newp, len,
+	    (inspect_extent_util_stats_t *)oldp);
+	ret = 0;
+
+label_return:
+	return ret;
+}
+
+/*
+ * Given an input array of pointers, output one bool for each of them telling
+ * whether it's worth moving with rallocx(ptr, size, MALLOCX_DEFRAG), i.e.
+ * whether it is a small allocation in a slab that
+ *
+ * (a) is not the one the bin shard currently allocates from,
+ * (b) is not full, and
+ * (c) is less utilized than the slabs of its bin shard on average (or, without
+ *     config_stats, less than half full).
+ *
+ * Moving all the flagged allocations away empties the sparsest slabs, so that
+ * their pages can be purged.  A typical workflow would be:
+ *
+ * (1) flush tcache: mallctl("thread.tcache.flush", ...)
+ * (2) query hints: mallctl("experimental.utilization.defrag_hints", ...)
+ * (3) for each flagged allocation {
+ *         q = rallocx(p, size, MALLOCX_DEFRAG);
+ *         if (q != p) { update the references to p }
+ *     }
+ *
+ * rallocx() with MALLOCX_DEFRAG returns the original pointer when the bin shard
+ * has no fuller slab to move the allocation to.  As with batch_query, unknown
+ * pointers are not an error, they just don't get flagged.
+ *
+ * The caller needs to make sure that:
+ *
+ * (a) newlen = n_pointers * sizeof(const void *)
+ * (b) *oldlenp = n_pointers * sizeof(bool)
+ * (c) n_pointers > 0
+ *
+ * Otherwise, the function immediately returns EINVAL without touching anything.
+ */
+static int
+experimental_utilization_defrag_hints_ctl(tsd_t *tsd, const size_t *mib,
+    size_t miblen, void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+	int ret;
+
+	const size_t len = newlen / sizeof(const void *);
+	if (oldp == NULL || oldlenp == NULL || newp == NULL || newlen == 0
+	    || newlen != len * sizeof(const void *)
+	    || *oldlenp != len * sizeof(bool)) {
+		ret = EINVAL;
+		goto label_return;
+	}
+
 	void **ptrs = (void **)newp;
-	inspect_extent_util_stats_t *util_stats =
-	    (inspect_extent_util_stats_t *)oldp;
-	size_t i;
-	for (i = 0; i < len; ++i) {
-		inspect_extent_util_stats_get(tsd_tsdn(tsd), ptrs[i],
-		    &util_stats[i].nfree, &util_stats[i].nregs,
-		    &util_stats[i].size);
+	bool *hints = (bool *)oldp;
+	for (size_t i = 0; i < len; ++i) {
+		hints[i] = ptrs[i] != NULL
+		    && inspect_defrag_hint_get(tsd_tsdn(tsd), ptrs[i]);
 	}
 	ret = 0;
 
@@ -4636,6 +5080,64 @@ label_return:
 	return ret;
 }
 
+/*
+ * Walks the whole heap, calling a callback on every extent known to the arenas
+ * (through the extent map, so including those of auto arenas, which aren't
+ * otherwise tracked).  The input is an inspect_heap_walker_t (see
+ * include/jemalloc/internal/inspect.h); applications declare their own copy of
+ * it and of the record, as documented in the manual:
+ *
+ * struct walker {
+ *	void (*cb)(void *ctx, const struct record *record);
+ *	void *ctx;
+ * };
+ *
+ * struct record {
+ *	unsigned kind;		// See below.
+ *	const void *addr;
+ *	size_t size;		// Usable size of regions and large allocations,
+ *				// extent size otherwise.
+ *	unsigned arena_ind;
+ *	unsigned nregs;		// Slabs only, 0 otherwise.
+ *	unsigned nfree;		// Slabs only, 0 otherwise.
+ * };
+ *
+ * Each record describes one of (by kind):
+ *
+ * (0) a slab (addr, slab size, nregs, nfree), followed by
+ * (1) a record for each of its allocated regions (addr, usable size),
+ * (2) a large allocation (addr, usable size), or
+ * (3, 4, 5) an unused dirty, muzzy or retained extent (addr, size),
+ *
+ * along with the index of the arena it belongs to.  Regions cached in thread
+ * caches count as allocated; flush them first for an exact picture.
+ *
+ * The walk holds no locks while scanning the extent map or calling back, and
+ * only one bin lock at a time, while copying the bitmap of one slab.  It is
+ * thus safe to run concurrently with the application, at the price of the
+ * result not being an atomic snapshot: extents allocated or freed during the
+ * walk may or may not be reported.  The callback may allocate and free; its
+ * own allocations may show up in the walk.
+ */
+static int
+experimental_heap_walk_ctl(tsd_t *tsd, const size_t *mib, size_t miblen,
+    void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+	int ret;
+
+	WRITEONLY();
+	inspect_heap_walker_t walker;
+	ASSURED_WRITE(walker, inspect_heap_walker_t);
+	if (walker.cb == NULL) {
+		ret = EINVAL;
+		goto label_return;
+	}
+	inspect_heap_walk(tsd_tsdn(tsd), &walker);
+	ret = 0;
+
+label_return:
+	return ret;
+}
+
 typedef struct batch_alloc_packet_s batch_alloc_packet_t;
 struct batch_alloc_packet_s {
 	void **ptrs;
@@ -4664,6 +5166,132 @@ label_return:
 	return ret;
 }
 
+/*
+ * Output format for experimental.stats_snapshot: a flat array of uint64_t,
+ * laid out as described in stats_snapshot.h.  Applications shouldn't assume
+ * the field order; the index of each field is available through
+ * experimental.stats_snapshot_layout:
+ *
+ *     global.<name>     index of a global field
+ *     bins_offset       index of the first field of the first bin
+ *     bin_nfields       number of fields per bin
+ *     bin.<name>        index of a field within the fields of a bin
+ *     lextents_offset   index of the first field of the first large size class
+ *     lextent_nfields   number of fields per large size class
+ *     lextent.<name>    index of a field within the fields of a large size
+ *                       class
+ *
+ * so that e.g. the nmalloc of bin i (in [0, arenas.nbins)) is at
+ * bins_offset + i * bin_nfields + bin.nmalloc.  All of these are size_t.
+ *
+ * The counters of all arenas are read without locks (and without allocating),
+ * so this is cheap enough to be called many times a second, at the price of
+ * slightly inconsistent values.  It doesn't need (nor interact with) an
+ * "epoch" refresh.
+ *
+ * The caller provides the output array:
+ *
+ *     mallctl("experimental.stats_snapshot", NULL, &len, NULL, 0);
+ *     uint64_t *snap = malloc(len);
+ *     mallctl("experimental.stats_snapshot", snap, &len, NULL, 0);
+ *
+ * i.e. a call with a NULL oldp only reports the required size in *oldlenp;
+ * otherwise *oldlenp has to match it exactly.
+ *
+ * In delta mode, newp points to a previous snapshot (of len bytes), which is
+ * only read.  The output then has to be twice as large: its first half gets
+ * the counters as their increase since the previous snapshot and the gauges
+ * as they are, and its second half the current snapshot, to pass as the
+ * previous one to the next call:
+ *
+ *     uint64_t *out = malloc(2 * len);
+ *     size_t outlen = 2 * len;
+ *     mallctl("experimental.stats_snapshot", prev, &len, NULL, 0);
+ *     ...
+ *     mallctl("experimental.stats_snapshot", out, &outlen, prev, len);
+ *     // out[0..] is the delta; memcpy(prev, &out[len / 8], len) to go on.
+ */
+static int
+experimental_stats_snapshot_ctl(tsd_t *tsd, const size_t *mib,
+    size_t miblen, void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
+	int ret;
+	const size_t len = STATS_SNAPSHOT_LEN * sizeof(uint64_t);
+
+	if (!config_stats) {
+		ret = ENOENT;
+		goto label_return;
+	}
+	if (oldp == NULL) {
+		if (newp != NULL) {
+			ret = EINVAL;
+			goto label_return;
+		}
+		if (oldlenp != NULL) {
+			*oldlenp = len;
+		}
+		ret = 0;
+		goto label_return;
+	}
+	if (newp == NULL) {
+		if (oldlenp == NULL || *oldlenp != len) {
+			ret = EINVAL;
+			goto label_return;
+		}
+		stats_snapshot_read(tsd_tsdn(tsd), (uint64_t *)oldp);
+		ret = 0;
+		goto label_return;
+	}
+
+	/* Delta mode. */
+	if (newlen != len || oldlenp == NULL || *oldlenp != 2 * len) {
+		ret = EINVAL;
+		goto label_return;
+	}
+	uintptr_t out_begin = (uintptr_t)oldp;
+	uintptr_t prev_begin = (uintptr_t)newp;
+	if (prev_begin < out_begin + 2 * len && out_begin < prev_begin + len) {
+		/* The previous snapshot must not be overwritten. */
+		ret = EINVAL;
+		goto label_return;
+	}
+	uint64_t *delta = (uint64_t *)oldp;
+	uint64_t *cur = &delta[STATS_SNAPSHOT_LEN];
+	stats_snapshot_read(tsd_tsdn(tsd), cur);
+	stats_snapshot_delta(delta, cur, (const uint64_t *)newp);
+	ret = 0;
+
+label_return:
+	return ret;
+}
+
+CTL_RO_NL_CGEN(config_stats, experimental_stats_snapshot_layout_bins_offset,
+    (size_t)STATS_SNAPSHOT_BINS_OFFSET, size_t)
+CTL_RO_NL_CGEN(config_stats, experimental_stats_snapshot_layout_bin_nfields,
+    (size_t)stats_snapshot_num_bin_fields, size_t)
+CTL_RO_NL_CGEN(config_stats,
+    experimental_stats_snapshot_layout_lextents_offset,
+    (size_t)STATS_SNAPSHOT_LEXTENTS_OFFSET, size_t)
+CTL_RO_NL_CGEN(config_stats,
+    experimental_stats_snapshot_layout_lextent_nfields,
+    (size_t)stats_snapshot_num_lextent_fields, size_t)
+#define OP(name, kind)							\
+CTL_RO_NL_CGEN(config_stats,						\
+    experimental_stats_snapshot_layout_global_##name,			\
+    (size_t)stats_snapshot_global_##name, size_t)
+STATS_SNAPSHOT_GLOBAL_FIELDS
+#undef OP
+#define OP(name, kind)							\
+CTL_RO_NL_CGEN(config_stats, experimental_stats_snapshot_layout_bin_##name,\
+    (size_t)stats_snapshot_bin_##name, size_t)
+STATS_SNAPSHOT_BIN_FIELDS
+#undef OP
+#define OP(name, kind)							\
+CTL_RO_NL_CGEN(config_stats,						\
+    experimental_stats_snapshot_layout_lextent_##name,			\
+    (size_t)stats_snapshot_lextent_##name, size_t)
+STATS_SNAPSHOT_LEXTENT_FIELDS
+#undef OP
+
 static int
 prof_stats_bins_i_live_ctl(tsd_t *tsd, const size_t *mib, size_t miblen,
     void *oldp, size_t *oldlenp, void *newp, size_t newlen) {
@@ -27,8 +27,18 @@ decay_deadline_init(decay_t *decay) {
 	}
 }
 
-void
-decay_reinit(decay_t *decay, nstime_t *cur_time, ssize_t decay_ms) {
+static ssize_t
+decay_ms_effective(ssize_t decay_ms, unsigned lg_div) {
+	if (decay_ms <= 0) {
+		return decay_ms;
+	}
+	/* Stay gradual. */
+	ssize_t shortened = decay_ms >> lg_div;
+	return shortened > 0 ? shortened : 1;
+}
+
+static void
+decay_reinit_impl(decay_t *decay, nstime_t *cur_time, ssize_t decay_ms) {
 	atomic_store_zd(&decay->time_ms, decay_ms, ATOMIC_RELAXED);
 	if (decay_ms > 0) {
 		nstime_init(&decay->interval, (uint64_t)decay_ms *
@@ -43,6 +53,28 @@ decay_reinit(decay_t *decay, nstime_t *cur_time, ssize_t decay_ms) {
 	memset(decay->backlog, 0, SMOOTHSTEP_NSTEPS * sizeof(size_t));
 }
 
+void
+decay_reinit(decay_t *decay, nstime_t *cur_time, ssize_t decay_ms) {
+	atomic_store_zd(&decay->configured_ms, decay_ms, ATOMIC_RELAXED);
+	decay_reinit_impl(decay, cur_time, decay_ms_effective(decay_ms,
+	    decay->pressure_lg_div));
+}
+
+bool
+decay_pressure_set(decay_t *decay, nstime_t *cur_time, unsigned lg_div) {
+	if (decay->pressure_lg_div == lg_div) {
+		return false;
+	}
+	decay->pressure_lg_div = lg_div;
+	ssize_t decay_ms = decay_ms_configured_read(decay);
+	if (decay_ms <= 0) {
+		return false;
+	}
+	decay_reinit_impl(decay, cur_time, decay_ms_effective(decay_ms,
+	    lg_div));
+	return true;
+}
+
 bool
 decay_init(decay_t *decay, nstime_t *cur_time, ssize_t decay_ms) {
 	if (config_debug) {
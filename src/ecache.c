@@ -15,6 +15,7 @@ ecache_init(tsdn_t *tsdn, ecache_t *ecache, extent_state_t state, unsigned ind,
 	ecache->delay_coalesce = delay_coalesce;
 	eset_init(&ecache->eset, state);
 	eset_init(&ecache->guarded_eset, state);
+	eset_init(&ecache->slab_region_eset, state);
 
 	return false;
 }
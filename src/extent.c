@@ -37,7 +37,8 @@ static atomic_zu_t highpages;
 static void extent_deregister(tsdn_t *tsdn, pac_t *pac, edata_t *edata);
 static edata_t *extent_recycle(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
     ecache_t *ecache, edata_t *expand_edata, size_t usize, size_t alignment,
-    bool zero, bool *commit, bool growing_retained, bool guarded);
+    bool zero, bool *commit, bool growing_retained, bool guarded,
+    bool slab_region);
 static edata_t *extent_try_coalesce(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
     ecache_t *ecache, edata_t *edata, bool *coalesced);
 static edata_t *extent_alloc_retained(tsdn_t *tsdn, pac_t *pac,
@@ -53,6 +54,14 @@ extent_sn_next(pac_t *pac) {
 	return atomic_fetch_add_zu(&pac->extent_sn_next, 1, ATOMIC_RELAXED);
 }
 
+/* Applies the pac's node preference to freshly mapped (untouched) pages. */
+static inline void
+extent_numa_bind(pac_t *pac, void *addr, size_t size) {
+	if (pac->numa_node != NUMA_NODE_NONE) {
+		numa_bind(addr, size, pac->numa_node);
+	}
+}
+
 static inline bool
 extent_may_force_decay(pac_t *pac) {
 	return !(pac_decay_ms_get(pac, extent_state_dirty) == -1
@@ -72,7 +81,7 @@ extent_try_delayed_coalesce(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 	if (!coalesced) {
 		return true;
 	}
-	eset_insert(&ecache->eset, edata);
+	eset_insert(ecache_eset_get(ecache, edata), edata);
 	return false;
 }
 
@@ -87,12 +96,28 @@ ecache_alloc(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks, ecache_t *ecache,
 
 	bool commit = true;
 	edata_t *edata = extent_recycle(tsdn, pac, ehooks, ecache, expand_edata,
-	    size, alignment, zero, &commit, false, guarded);
+	    size, alignment, zero, &commit, false, guarded,
+	    /* slab_region */ false);
 	assert(edata == NULL || edata_pai_get(edata) == EXTENT_PAI_PAC);
 	assert(edata == NULL || edata_guarded_get(edata) == guarded);
 	return edata;
 }
 
+edata_t *
+ecache_alloc_slab_region(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
+    ecache_t *ecache, size_t size, bool zero) {
+	assert(size != 0);
+	witness_assert_depth_to_rank(tsdn_witness_tsdp_get(tsdn),
+	    WITNESS_RANK_CORE, 0);
+
+	bool commit = true;
+	edata_t *edata = extent_recycle(tsdn, pac, ehooks, ecache, NULL, size,
+	    PAGE, zero, &commit, false, /* guarded */ false,
+	    /* slab_region */ true);
+	assert(edata == NULL || edata_slab_region_get(edata));
+	return edata;
+}
+
 edata_t *
 ecache_alloc_grow(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks, ecache_t *ecache,
     edata_t *expand_edata, size_t size, size_t alignment, bool zero,
@@ -163,6 +188,14 @@ ecache_evict(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 		/* Get the LRU extent, if any. */
 		eset_t *eset = &ecache->eset;
 		edata = edata_list_inactive_first(&eset->lru);
+		if (edata == NULL) {
+			/*
+			 * Then the slab region extents, whose purging breaks
+			 * up huge pages.
+			 */
+			eset = &ecache->slab_region_eset;
+			edata = edata_list_inactive_first(&eset->lru);
+		}
 		if (edata == NULL) {
 			/*
 			 * Next check if there are guarded extents.  They are
@@ -254,9 +287,7 @@ extent_deactivate_locked_impl(tsdn_t *tsdn, pac_t *pac, ecache_t *ecache,
 	assert(edata_arena_ind_get(edata) == ecache_ind_get(ecache));
 
 	emap_update_edata_state(tsdn, pac->emap, edata, ecache->state);
-	eset_t *eset = edata_guarded_get(edata) ? &ecache->guarded_eset :
-	    &ecache->eset;
-	eset_insert(eset, edata);
+	eset_insert(ecache_eset_get(ecache, edata), edata);
 }
 
 static void
@@ -387,7 +418,7 @@ extent_deregister_no_gdump_sub(tsdn_t *tsdn, pac_t *pac,
 static edata_t *
 extent_recycle_extract(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
     ecache_t *ecache, edata_t *expand_edata, size_t size, size_t alignment,
-    bool guarded) {
+    bool guarded, bool slab_region) {
 	malloc_mutex_assert_owner(tsdn, &ecache->mtx);
 	assert(alignment > 0);
 	if (config_debug && expand_edata != NULL) {
@@ -403,7 +434,8 @@ extent_recycle_extract(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 	}
 
 	edata_t *edata;
-	eset_t *eset = guarded ? &ecache->guarded_eset : &ecache->eset;
+	eset_t *eset = guarded ? &ecache->guarded_eset : (slab_region ?
+	    &ecache->slab_region_eset : &ecache->eset);
 	if (expand_edata != NULL) {
 		edata = emap_try_acquire_edata_neighbor_expand(tsdn, pac->emap,
 		    expand_edata, EXTENT_PAI_PAC, ecache->state);
@@ -425,8 +457,9 @@ extent_recycle_extract(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 		 * then no longer satify a request for its original size.  To
 		 * limit this effect, when delayed coalescing is enabled, we
 		 * put a cap on how big an extent we can split for a request.
+		 * Slab regions only ever hold slabs, so there's no such issue.
 		 */
-		unsigned lg_max_fit = ecache->delay_coalesce
+		unsigned lg_max_fit = (ecache->delay_coalesce && !slab_region)
 		    ? (unsigned)opt_lg_extent_max_active_fit : SC_PTR_BITS;
 
 		/*
@@ -445,6 +478,7 @@ extent_recycle_extract(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 		return NULL;
 	}
 	assert(!guarded || edata_guarded_get(edata));
+	assert(edata_slab_region_get(edata) == slab_region);
 	extent_activate_locked(tsdn, pac, ecache, eset, edata);
 
 	return edata;
@@ -599,16 +633,17 @@ extent_recycle_split(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 static edata_t *
 extent_recycle(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks, ecache_t *ecache,
     edata_t *expand_edata, size_t size, size_t alignment, bool zero,
-    bool *commit, bool growing_retained, bool guarded) {
+    bool *commit, bool growing_retained, bool guarded, bool slab_region) {
 	witness_assert_depth_to_rank(tsdn_witness_tsdp_get(tsdn),
 	    WITNESS_RANK_CORE, growing_retained ? 1 : 0);
 	assert(!guarded || expand_edata == NULL);
 	assert(!guarded || alignment <= PAGE);
+	assert(!slab_region || (expand_edata == NULL && !guarded));
 
 	malloc_mutex_lock(tsdn, &ecache->mtx);
 
 	edata_t *edata = extent_recycle_extract(tsdn, pac, ehooks, ecache,
-	    expand_edata, size, alignment, guarded);
+	    expand_edata, size, alignment, guarded, slab_region);
 	if (edata == NULL) {
 		malloc_mutex_unlock(tsdn, &ecache->mtx);
 		return NULL;
@@ -680,6 +715,7 @@ extent_grow_retained(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 		edata_cache_put(tsdn, pac->edata_cache, edata);
 		goto label_err;
 	}
+	extent_numa_bind(pac, ptr, alloc_size);
 
 	edata_init(edata, ecache_ind_get(&pac->ecache_retained), ptr,
 	    alloc_size, false, SC_NSIZES, extent_sn_next(pac),
@@ -785,7 +821,7 @@ extent_alloc_retained(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 
 	edata_t *edata = extent_recycle(tsdn, pac, ehooks,
 	    &pac->ecache_retained, expand_edata, size, alignment, zero, commit,
-	    /* growing_retained */ true, guarded);
+	    /* growing_retained */ true, guarded, /* slab_region */ false);
 	if (edata != NULL) {
 		malloc_mutex_unlock(tsdn, &pac->grow_mtx);
 		if (config_prof) {
@@ -803,11 +839,94 @@ extent_alloc_retained(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 	return edata;
 }
 
+/*
+ * Maps a new huge page region dedicated to slabs, and splits an extent of the
+ * given size off it.  The rest of the region is left retained, for the slabs to
+ * come.
+ */
+static edata_t *
+extent_slab_region_grow(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
+    size_t size, bool zero) {
+	malloc_mutex_assert_owner(tsdn, &pac->grow_mtx);
+
+	size_t region_size = HUGEPAGE_CEILING(size);
+	edata_t *edata = edata_cache_get(tsdn, pac->edata_cache);
+	if (edata == NULL) {
+		return NULL;
+	}
+	bool zeroed = false;
+	bool committed = false;
+	void *ptr = ehooks_alloc(tsdn, ehooks, NULL, region_size, HUGEPAGE,
+	    &zeroed, &committed);
+	if (ptr == NULL) {
+		edata_cache_put(tsdn, pac->edata_cache, edata);
+		return NULL;
+	}
+	extent_numa_bind(pac, ptr, region_size);
+	if (ehooks_are_default(ehooks)) {
+		/* Overrides whatever opt_thp applied to the mapping. */
+		pages_huge(ptr, region_size);
+	}
+
+	edata_init(edata, ecache_ind_get(&pac->ecache_retained), ptr,
+	    region_size, false, SC_NSIZES, extent_sn_next(pac),
+	    extent_state_active, zeroed, committed, EXTENT_PAI_PAC,
+	    EXTENT_IS_HEAD);
+	edata_slab_region_set(edata, true);
+	if (extent_register_no_gdump_add(tsdn, pac, edata)) {
+		edata_cache_put(tsdn, pac->edata_cache, edata);
+		return NULL;
+	}
+
+	if (region_size > size) {
+		edata_t *trail = extent_split_wrapper(tsdn, pac, ehooks, edata,
+		    size, region_size - size, /* holding_core_locks */ true);
+		if (trail == NULL) {
+			extent_record(tsdn, pac, ehooks, &pac->ecache_retained,
+			    edata);
+			return NULL;
+		}
+		extent_record(tsdn, pac, ehooks, &pac->ecache_retained, trail);
+	}
+	if (extent_commit_zero(tsdn, ehooks, edata, /* commit */ true, zero,
+	    /* growing_retained */ true)) {
+		extent_record(tsdn, pac, ehooks, &pac->ecache_retained, edata);
+		return NULL;
+	}
+	return edata;
+}
+
+edata_t *
+extent_alloc_slab_region(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
+    size_t size, bool zero) {
+	assert(size != 0);
+	assert(size == PAGE_CEILING(size));
+	witness_assert_depth_to_rank(tsdn_witness_tsdp_get(tsdn),
+	    WITNESS_RANK_CORE, 0);
+
+	malloc_mutex_lock(tsdn, &pac->grow_mtx);
+	bool commit = true;
+	edata_t *edata = extent_recycle(tsdn, pac, ehooks,
+	    &pac->ecache_retained, NULL, size, PAGE, zero, &commit,
+	    /* growing_retained */ true, /* guarded */ false,
+	    /* slab_region */ true);
+	if (edata == NULL) {
+		edata = extent_slab_region_grow(tsdn, pac, ehooks, size, zero);
+	}
+	malloc_mutex_unlock(tsdn, &pac->grow_mtx);
+
+	if (config_prof && edata != NULL) {
+		extent_gdump_add(tsdn, edata);
+	}
+	assert(edata == NULL || edata_slab_region_get(edata));
+	return edata;
+}
+
 static bool
 extent_coalesce(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks, ecache_t *ecache,
     edata_t *inner, edata_t *outer, bool forward) {
 	extent_assert_can_coalesce(inner, outer);
-	eset_remove(&ecache->eset, outer);
+	eset_remove(ecache_eset_get(ecache, outer), outer);
 
 	bool err = extent_merge_impl(tsdn, pac, ehooks,
 	    forward ? inner : outer, forward ? outer : inner,
@@ -1014,6 +1133,7 @@ extent_alloc_wrapper(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 		edata_cache_put(tsdn, pac->edata_cache, edata);
 		return NULL;
 	}
+	extent_numa_bind(pac, addr, size);
 	edata_init(edata, ecache_ind_get(&pac->ecache_dirty), addr,
 	    size, /* slab */ false, SC_NSIZES, extent_sn_next(pac),
 	    extent_state_active, zero, *commit, EXTENT_PAI_PAC,
@@ -1205,6 +1325,7 @@ extent_split_impl(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks,
 	    /* slab */ false, SC_NSIZES, edata_sn_get(edata),
 	    edata_state_get(edata), edata_zeroed_get(edata),
 	    edata_committed_get(edata), EXTENT_PAI_PAC, EXTENT_NOT_HEAD);
+	edata_slab_region_set(trail, edata_slab_region_get(edata));
 	emap_prepare_t prepare;
 	bool err = emap_split_prepare(tsdn, pac->emap, &prepare, edata,
 	    size_a, trail, size_b);
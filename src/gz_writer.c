@@ -0,0 +1,268 @@
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/jemalloc_internal_includes.h"
+
+#include "jemalloc/internal/gz_writer.h"
+
+#define GZ_WRITER_MIN_MATCH	3
+#define GZ_WRITER_MAX_MATCH	258
+
+/* The length and distance codes of DEFLATE (RFC 1951, 3.2.5). */
+static const uint16_t gz_writer_len_base[] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51,
+	59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t gz_writer_len_extra[] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+	5, 5, 5, 5, 0
+};
+static const uint16_t gz_writer_dist_base[] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+	513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t gz_writer_dist_extra[] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10,
+	10, 11, 11, 12, 12, 13, 13
+};
+
+static void
+gz_writer_out_flush(gz_writer_t *gz_writer) {
+	if (gz_writer->out_end > 0) {
+		gz_writer->write_cb(gz_writer->cbopaque, gz_writer->bufs->out,
+		    gz_writer->out_end);
+		gz_writer->out_end = 0;
+	}
+}
+
+static void
+gz_writer_out_byte(gz_writer_t *gz_writer, unsigned char byte) {
+	gz_writer->bufs->out[gz_writer->out_end++] = byte;
+	if (gz_writer->out_end == GZ_WRITER_OUT_BUFSIZE) {
+		gz_writer_out_flush(gz_writer);
+	}
+}
+
+static void
+gz_writer_out_u32(gz_writer_t *gz_writer, uint32_t x) {
+	for (unsigned i = 0; i < 4; i++) {
+		gz_writer_out_byte(gz_writer, (unsigned char)(x >> (i * 8)));
+	}
+}
+
+/* Writes the n low bits of x, least significant first. */
+static void
+gz_writer_bits(gz_writer_t *gz_writer, uint32_t x, unsigned n) {
+	assert(n <= 16);
+	gz_writer->bits |= (uint64_t)x << gz_writer->nbits;
+	gz_writer->nbits += n;
+	while (gz_writer->nbits >= 8) {
+		gz_writer_out_byte(gz_writer, (unsigned char)gz_writer->bits);
+		gz_writer->bits >>= 8;
+		gz_writer->nbits -= 8;
+	}
+}
+
+/* Huffman codes are written most significant bit first. */
+static void
+gz_writer_code(gz_writer_t *gz_writer, uint32_t code, unsigned n) {
+	uint32_t reversed = 0;
+	for (unsigned i = 0; i < n; i++) {
+		reversed = (reversed << 1) | ((code >> i) & 1U);
+	}
+	gz_writer_bits(gz_writer, reversed, n);
+}
+
+/* Writes a literal/length symbol with the fixed Huffman code. */
+static void
+gz_writer_sym(gz_writer_t *gz_writer, unsigned sym) {
+	assert(sym < 288);
+	if (sym < 144) {
+		gz_writer_code(gz_writer, 0x30 + sym, 8);
+	} else if (sym < 256) {
+		gz_writer_code(gz_writer, 0x190 + sym - 144, 9);
+	} else if (sym < 280) {
+		gz_writer_code(gz_writer, sym - 256, 7);
+	} else {
+		gz_writer_code(gz_writer, 0xc0 + sym - 280, 8);
+	}
+}
+
+static void
+gz_writer_match(gz_writer_t *gz_writer, size_t len, size_t dist) {
+	assert(len >= GZ_WRITER_MIN_MATCH && len <= GZ_WRITER_MAX_MATCH);
+	assert(dist >= 1 && dist <= GZ_WRITER_WINDOW);
+	unsigned c = sizeof(gz_writer_len_base) / sizeof(uint16_t) - 1;
+	while (gz_writer_len_base[c] > len) {
+		c--;
+	}
+	gz_writer_sym(gz_writer, 257 + c);
+	gz_writer_bits(gz_writer, (uint32_t)(len - gz_writer_len_base[c]),
+	    gz_writer_len_extra[c]);
+
+	c = sizeof(gz_writer_dist_base) / sizeof(uint16_t) - 1;
+	while (gz_writer_dist_base[c] > dist) {
+		c--;
+	}
+	gz_writer_code(gz_writer, c, 5);
+	gz_writer_bits(gz_writer, (uint32_t)(dist - gz_writer_dist_base[c]),
+	    gz_writer_dist_extra[c]);
+}
+
+static inline uint32_t
+gz_writer_hash(const unsigned char *p) {
+	uint32_t x = (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	    ((uint32_t)p[2] << 16);
+	return (x * UINT32_C(2654435761)) >> (32 - GZ_WRITER_LG_HASH);
+}
+
+/*
+ * Compresses the window up to its end if final, or else only as far as a match
+ * can't be cut short by the end of the input seen so far.
+ */
+static void
+gz_writer_compress(gz_writer_t *gz_writer, bool final) {
+	unsigned char *win = gz_writer->bufs->win;
+	uint64_t *head = gz_writer->bufs->head;
+	size_t end = gz_writer->win_end;
+	size_t limit = final ? end : (end > GZ_WRITER_MAX_MATCH ? end -
+	    GZ_WRITER_MAX_MATCH : 0);
+	size_t i;
+	for (i = gz_writer->win_cur; i < limit;) {
+		size_t avail = end - i;
+		if (avail < GZ_WRITER_MIN_MATCH) {
+			gz_writer_sym(gz_writer, win[i]);
+			i++;
+			continue;
+		}
+		uint64_t pos = gz_writer->win_base + i;
+		uint64_t *slot = &head[gz_writer_hash(&win[i])];
+		uint64_t cand = *slot;
+		*slot = pos + 1;
+		size_t len = 0;
+		/* cand is 1 + the offset of an earlier position, if any. */
+		if (cand > gz_writer->win_base && pos + 1 - cand <=
+		    GZ_WRITER_WINDOW) {
+			const unsigned char *prev =
+			    &win[cand - 1 - gz_writer->win_base];
+			size_t max = avail < GZ_WRITER_MAX_MATCH ? avail :
+			    GZ_WRITER_MAX_MATCH;
+			while (len < max && prev[len] == win[i + len]) {
+				len++;
+			}
+		}
+		if (len < GZ_WRITER_MIN_MATCH) {
+			gz_writer_sym(gz_writer, win[i]);
+			i++;
+			continue;
+		}
+		gz_writer_match(gz_writer, len, (size_t)(pos + 1 - cand));
+		/* Index the positions inside the match as well. */
+		for (size_t k = 1; k < len && k + GZ_WRITER_MIN_MATCH <= avail;
+		    k++) {
+			head[gz_writer_hash(&win[i + k])] = pos + k + 1;
+		}
+		i += len;
+	}
+	gz_writer->win_cur = i;
+}
+
+bool
+gz_writer_init(tsdn_t *tsdn, gz_writer_t *gz_writer, gz_write_cb_t *write_cb,
+    void *cbopaque) {
+	gz_writer->write_cb = write_cb;
+	gz_writer->cbopaque = cbopaque;
+	gz_writer->bufs = (gz_writer_bufs_t *)iallocztm(tsdn,
+	    sizeof(gz_writer_bufs_t), sz_size2index(sizeof(gz_writer_bufs_t)),
+	    false, NULL, true, arena_get(tsdn, 0, false), true);
+	if (gz_writer->bufs == NULL) {
+		return true;
+	}
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (unsigned k = 0; k < 8; k++) {
+			c = (c & 1U) ? (UINT32_C(0xedb88320) ^ (c >> 1)) :
+			    (c >> 1);
+		}
+		gz_writer->bufs->crc_table[i] = c;
+	}
+	memset(gz_writer->bufs->head, 0, sizeof(gz_writer->bufs->head));
+	gz_writer->crc = UINT32_C(0xffffffff);
+	gz_writer->isize = 0;
+	gz_writer->bits = 0;
+	gz_writer->nbits = 0;
+	gz_writer->win_base = 0;
+	gz_writer->win_end = 0;
+	gz_writer->win_cur = 0;
+	gz_writer->out_end = 0;
+
+	/* Member header: deflate, no flags, no mtime, Unix. */
+	static const unsigned char header[] = {
+		0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3
+	};
+	for (unsigned i = 0; i < sizeof(header); i++) {
+		gz_writer_out_byte(gz_writer, header[i]);
+	}
+	/* A single (non-final) fixed Huffman block holds all the data. */
+	gz_writer_bits(gz_writer, 0, 1);
+	gz_writer_bits(gz_writer, 1, 2);
+	return false;
+}
+
+void
+gz_writer_write(void *gz_writer_arg, const void *buf, size_t len) {
+	gz_writer_t *gz_writer = (gz_writer_t *)gz_writer_arg;
+	if (gz_writer->bufs == NULL) {
+		return;
+	}
+	const unsigned char *s = (const unsigned char *)buf;
+	unsigned char *win = gz_writer->bufs->win;
+	size_t i, n;
+	for (i = 0; i < len; i += n) {
+		if (gz_writer->win_end == 2 * GZ_WRITER_WINDOW) {
+			/* Only the last window can still be matched against. */
+			assert(gz_writer->win_cur >= GZ_WRITER_WINDOW);
+			memmove(win, win + GZ_WRITER_WINDOW, GZ_WRITER_WINDOW);
+			gz_writer->win_base += GZ_WRITER_WINDOW;
+			gz_writer->win_end -= GZ_WRITER_WINDOW;
+			gz_writer->win_cur -= GZ_WRITER_WINDOW;
+		}
+		size_t remain = 2 * GZ_WRITER_WINDOW - gz_writer->win_end;
+		n = len - i < remain ? len - i : remain;
+		unsigned char *dst = win + gz_writer->win_end;
+		memcpy(dst, s + i, n);
+		uint32_t crc = gz_writer->crc;
+		const uint32_t *crc_table = gz_writer->bufs->crc_table;
+		for (size_t k = 0; k < n; k++) {
+			crc = crc_table[(crc ^ dst[k]) & 0xff] ^ (crc >> 8);
+		}
+		gz_writer->crc = crc;
+		gz_writer->isize += (uint32_t)n;
+		gz_writer->win_end += n;
+		gz_writer_compress(gz_writer, false);
+	}
+}
+
+void
+gz_writer_cb(void *gz_writer_arg, const char *s) {
+	gz_writer_write(gz_writer_arg, s, strlen(s));
+}
+
+void
+gz_writer_terminate(tsdn_t *tsdn, gz_writer_t *gz_writer) {
+	if (gz_writer->bufs == NULL) {
+		return;
+	}
+	gz_writer_compress(gz_writer, true);
+	/* End the data block, then add an empty final one. */
+	gz_writer_sym(gz_writer, 256);
+	gz_writer_bits(gz_writer, 1, 1);
+	gz_writer_bits(gz_writer, 1, 2);
+	gz_writer_sym(gz_writer, 256);
+	if (gz_writer->nbits > 0) {
+		gz_writer_bits(gz_writer, 0, 8 - gz_writer->nbits);
+	}
+	gz_writer_out_u32(gz_writer, gz_writer->crc ^ UINT32_C(0xffffffff));
+	gz_writer_out_u32(gz_writer, gz_writer->isize);
+	gz_writer_out_flush(gz_writer);
+	idalloctm(tsdn, gz_writer->bufs, NULL, NULL, true, true);
+	gz_writer->bufs = NULL;
+}
@@ -4,6 +4,7 @@
 #include "jemalloc/internal/hpa.h"
 
 #include "jemalloc/internal/fb.h"
+#include "jemalloc/internal/mem_limit.h"
 #include "jemalloc/internal/witness.h"
 
 #define HPA_EDEN_SIZE (128 * HUGEPAGE)
@@ -88,16 +89,22 @@ hpa_central_init(hpa_central_t *central, base_t *base, const hpa_hooks_t *hooks)
 }
 
 static hpdata_t *
-hpa_alloc_ps(tsdn_t *tsdn, hpa_central_t *central) {
-	return (hpdata_t *)base_alloc(tsdn, central->base, sizeof(hpdata_t),
-	    CACHELINE);
+hpa_alloc_ps(tsdn_t *tsdn, hpa_central_t *central, size_t nhp) {
+	return (hpdata_t *)base_alloc(tsdn, central->base,
+	    nhp * sizeof(hpdata_t), CACHELINE);
 }
 
+/*
+ * Extracts HUGEPAGE_CEILING(size) / HUGEPAGE pageslabs.  For sizes above a
+ * hugepage, that's a run of them: consecutive in the address space, and with
+ * their hpdatas consecutive in one array, so that ps[i] covers the i-th
+ * hugepage of the run.
+ */
 static hpdata_t *
 hpa_central_extract(tsdn_t *tsdn, hpa_central_t *central, size_t size,
     bool *oom) {
-	/* Don't yet support big allocations; these should get filtered out. */
-	assert(size <= HUGEPAGE);
+	size_t run_size = HUGEPAGE_CEILING(size);
+	size_t nhp = run_size >> LG_HUGEPAGE;
 	/*
 	 * Should only try to extract from the central allocator if the local
 	 * shard is exhausted.  We should hold the grow_mtx on that shard.
@@ -108,72 +115,64 @@ hpa_central_extract(tsdn_t *tsdn, hpa_central_t *central, size_t size,
 	malloc_mutex_lock(tsdn, &central->grow_mtx);
 	*oom = false;
 
-	hpdata_t *ps = NULL;
-
-	/* Is eden a perfect fit? */
-	if (central->eden != NULL && central->eden_len == HUGEPAGE) {
-		ps = hpa_alloc_ps(tsdn, central);
-		if (ps == NULL) {
-			*oom = true;
-			malloc_mutex_unlock(tsdn, &central->grow_mtx);
-			return NULL;
-		}
-		hpdata_init(ps, central->eden, central->age_counter++);
-		central->eden = NULL;
-		central->eden_len = 0;
-		malloc_mutex_unlock(tsdn, &central->grow_mtx);
-		return ps;
-	}
-
 	/*
-	 * We're about to try to allocate from eden by splitting.  If eden is
-	 * NULL, we have to allocate it too.  Otherwise, we just have to
-	 * allocate an edata_t for the new psset.
+	 * If eden can't serve the request, we have to map something new.
+	 * Usually that's a new eden, but runs that wouldn't fit in one get
+	 * mapped on their own, and so do runs that don't fit in what's left of
+	 * the current eden (which later, smaller requests can still use).
 	 */
-	if (central->eden == NULL) {
+	void *new_map = NULL;
+	size_t new_map_size = 0;
+	if (central->eden == NULL || central->eden_len < run_size) {
+		new_map_size = (central->eden == NULL
+		    && run_size < HPA_EDEN_SIZE) ? HPA_EDEN_SIZE : run_size;
 		/*
 		 * During development, we're primarily concerned with systems
 		 * with overcommit.  Eventually, we should be more careful here.
 		 */
 		bool commit = true;
 		/* Allocate address space, bailing if we fail. */
-		void *new_eden = pages_map(NULL, HPA_EDEN_SIZE, HUGEPAGE,
-		    &commit);
-		if (new_eden == NULL) {
+		new_map = pages_map(NULL, new_map_size, HUGEPAGE, &commit);
+		if (new_map == NULL) {
 			*oom = true;
 			malloc_mutex_unlock(tsdn, &central->grow_mtx);
 			return NULL;
 		}
-		ps = hpa_alloc_ps(tsdn, central);
-		if (ps == NULL) {
-			pages_unmap(new_eden, HPA_EDEN_SIZE);
-			*oom = true;
-			malloc_mutex_unlock(tsdn, &central->grow_mtx);
-			return NULL;
+	}
+	hpdata_t *ps = hpa_alloc_ps(tsdn, central, nhp);
+	if (ps == NULL) {
+		if (new_map != NULL) {
+			pages_unmap(new_map, new_map_size);
 		}
-		central->eden = new_eden;
-		central->eden_len = HPA_EDEN_SIZE;
+		*oom = true;
+		malloc_mutex_unlock(tsdn, &central->grow_mtx);
+		return NULL;
+	}
+
+	char *addr;
+	if (new_map == NULL) {
+		addr = (char *)central->eden;
+		central->eden_len -= run_size;
+		central->eden = (central->eden_len == 0) ? NULL
+		    : (void *)(addr + run_size);
 	} else {
-		/* Eden is already nonempty; only need an edata for ps. */
-		ps = hpa_alloc_ps(tsdn, central);
-		if (ps == NULL) {
-			*oom = true;
-			malloc_mutex_unlock(tsdn, &central->grow_mtx);
-			return NULL;
+		addr = (char *)new_map;
+		if (new_map_size > run_size) {
+			assert(central->eden == NULL);
+			central->eden = (void *)(addr + run_size);
+			central->eden_len = new_map_size - run_size;
 		}
 	}
-	assert(ps != NULL);
-	assert(central->eden != NULL);
-	assert(central->eden_len > HUGEPAGE);
+	assert(HUGEPAGE_ADDR2BASE(addr) == addr);
 	assert(central->eden_len % HUGEPAGE == 0);
-	assert(HUGEPAGE_ADDR2BASE(central->eden) == central->eden);
 
-	hpdata_init(ps, central->eden, central->age_counter++);
-
-	char *eden_char = (char *)central->eden;
-	eden_char += HUGEPAGE;
-	central->eden = (void *)eden_char;
-	central->eden_len -= HUGEPAGE;
+	for (size_t i = 0; i < nhp; i++) {
+		hpdata_init(&ps[i], addr + i * HUGEPAGE,
+		    central->age_counter++);
+	}
+	if (nhp > 1) {
+		hpdata_run_nhp_set(ps, nhp);
+	}
 
 	malloc_mutex_unlock(tsdn, &central->grow_mtx);
 
@@ -203,11 +202,14 @@ hpa_shard_init(hpa_shard_t *shard, hpa_central_t *central, emap_t *emap,
 	shard->base = base;
 	edata_cache_fast_init(&shard->ecf, edata_cache);
 	psset_init(&shard->psset);
+	hpdata_run_list_init(&shard->runs);
 	shard->age_counter = 0;
 	shard->ind = ind;
+	shard->numa_node = NUMA_NODE_NONE;
 	shard->emap = emap;
 
 	shard->opts = *opts;
+	shard->pressure_lg_div = 0;
 
 	shard->npending_purge = 0;
 	nstime_init_zero(&shard->last_purge);
@@ -216,8 +218,13 @@ hpa_shard_init(hpa_shard_t *shard, hpa_central_t *central, emap_t *emap,
 	shard->stats.npurges = 0;
 	shard->stats.nhugifies = 0;
 	shard->stats.nhugify_failures = 0;
+	shard->stats.nrehugifies = 0;
+	shard->stats.nrehugify_failures = 0;
 	shard->stats.ndehugifies = 0;
 
+	nstime_init_zero(&shard->rehugify_interval_start);
+	shard->nrehugifies_in_interval = 0;
+
 	/*
 	 * Fill these in last, so that if an hpa_shard gets used despite
 	 * initialization failing, we'll at least crash instead of just
@@ -249,6 +256,8 @@ hpa_shard_nonderived_stats_accum(hpa_shard_nonderived_stats_t *dst,
 	dst->npurges += src->npurges;
 	dst->nhugifies += src->nhugifies;
 	dst->nhugify_failures += src->nhugify_failures;
+	dst->nrehugifies += src->nrehugifies;
+	dst->nrehugify_failures += src->nrehugify_failures;
 	dst->ndehugifies += src->ndehugifies;
 }
 
@@ -296,7 +305,7 @@ hpa_ndirty_max(tsdn_t *tsdn, hpa_shard_t *shard) {
 		return (size_t)-1;
 	}
 	return fxp_mul_frac(psset_nactive(&shard->psset),
-	    shard->opts.dirty_mult);
+	    shard->opts.dirty_mult >> shard->pressure_lg_div);
 }
 
 static bool
@@ -469,9 +478,33 @@ hpa_try_purge(tsdn_t *tsdn, hpa_shard_t *shard) {
 	return true;
 }
 
-/* Returns whether or not we hugified anything. */
+/*
+ * Whether we may rehugify another pageslab in the current rehugify interval
+ * (starting a new one if it's over).
+ */
+static bool
+hpa_rehugify_budget_left(tsdn_t *tsdn, hpa_shard_t *shard) {
+	malloc_mutex_assert_owner(tsdn, &shard->mtx);
+	if (shard->opts.rehugify_max_nhp == 0) {
+		return false;
+	}
+	uint64_t since_interval_start_ms = shard->central->hooks.ms_since(
+	    &shard->rehugify_interval_start);
+	if (since_interval_start_ms >= shard->opts.rehugify_interval_ms) {
+		shard->central->hooks.curtime(&shard->rehugify_interval_start,
+		    /* first_reading */ false);
+		shard->nrehugifies_in_interval = 0;
+	}
+	return shard->nrehugifies_in_interval < shard->opts.rehugify_max_nhp;
+}
+
+/*
+ * Returns whether or not we hugified anything.  If allow_rehugify, a pageslab
+ * that was dehugified before gets collapsed synchronously (budget permitting),
+ * since khugepaged may take a long time to get back to it.
+ */
 static bool
-hpa_try_hugify(tsdn_t *tsdn, hpa_shard_t *shard) {
+hpa_try_hugify(tsdn_t *tsdn, hpa_shard_t *shard, bool allow_rehugify) {
 	malloc_mutex_assert_owner(tsdn, &shard->mtx);
 
 	if (hpa_hugify_blocked_by_ndirty(tsdn, shard)) {
@@ -504,13 +537,26 @@ hpa_try_hugify(tsdn_t *tsdn, hpa_shard_t *shard) {
 	assert(hpdata_alloc_allowed_get(to_hugify));
 	psset_update_end(&shard->psset, to_hugify);
 
+	bool rehugify = allow_rehugify && !shard->opts.hugify_sync
+	    && hpdata_dehugified_get(to_hugify)
+	    && hpa_rehugify_budget_left(tsdn, shard);
+	if (rehugify) {
+		shard->nrehugifies_in_interval++;
+	}
+
 	malloc_mutex_unlock(tsdn, &shard->mtx);
 
 	bool err = shard->central->hooks.hugify(hpdata_addr_get(to_hugify),
-	    HUGEPAGE, shard->opts.hugify_sync);
+	    HUGEPAGE, shard->opts.hugify_sync || rehugify);
 
 	malloc_mutex_lock(tsdn, &shard->mtx);
 	shard->stats.nhugifies++;
+	if (rehugify) {
+		shard->stats.nrehugifies++;
+		if (err) {
+			shard->stats.nrehugify_failures++;
+		}
+	}
 	if (err) {
 		/*
 		 * When asynchronious hugification is used
@@ -603,9 +649,12 @@ hpa_shard_maybe_do_deferred_work(tsdn_t *tsdn, hpa_shard_t *shard,
 
 	/*
 	 * Try to hugify at least once, even if we out of operations to make at
-	 * least some progress on hugification even at worst case.
+	 * least some progress on hugification even at worst case.  Only forced
+	 * (i.e. background) deferred work rehugifies; the synchronous collapse
+	 * is too slow to do on an application thread.
 	 */
-	while (hpa_try_hugify(tsdn, shard) && nops < max_ops) {
+	while (hpa_try_hugify(tsdn, shard, /* allow_rehugify */ forced)
+	    && nops < max_ops) {
 		malloc_mutex_assert_owner(tsdn, &shard->mtx);
 		nops++;
 	}
@@ -707,6 +756,7 @@ hpa_alloc_batch_psset(tsdn_t *tsdn, hpa_shard_t *shard, size_t size,
     bool *deferred_work_generated) {
 	assert(size <= HUGEPAGE);
 	assert(size <= shard->opts.slab_max_alloc ||
+	    size <= shard->opts.large_max_alloc ||
 	    size == sz_index2size(sz_size2index(size)));
 	bool oom = false;
 
@@ -716,6 +766,13 @@ hpa_alloc_batch_psset(tsdn_t *tsdn, hpa_shard_t *shard, size_t size,
 	if (nsuccess == nallocs || oom) {
 		return nsuccess;
 	}
+	/*
+	 * Pages reused within the existing pageslabs aren't charged against the
+	 * mem_limit, only the ones that make the shard grow.
+	 */
+	if (mem_limit_alloc_check(tsdn, (nallocs - nsuccess) * size)) {
+		return nsuccess;
+	}
 
 	/*
 	 * We didn't OOM, but weren't able to fill everything requested of us;
@@ -743,6 +800,13 @@ hpa_alloc_batch_psset(tsdn_t *tsdn, hpa_shard_t *shard, size_t size,
 		malloc_mutex_unlock(tsdn, &shard->grow_mtx);
 		return nsuccess;
 	}
+	/*
+	 * Pageslabs never go back to the central allocator, so this is the one
+	 * time they need binding (and they haven't been touched yet).
+	 */
+	if (shard->numa_node != NUMA_NODE_NONE) {
+		numa_bind(hpdata_addr_get(ps), HUGEPAGE, shard->numa_node);
+	}
 
 	/*
 	 * We got the pageslab; allocate from it.  This does an unlock followed
@@ -765,6 +829,202 @@ hpa_alloc_batch_psset(tsdn_t *tsdn, hpa_shard_t *shard, size_t size,
 	return nsuccess;
 }
 
+/*
+ * Unreserves [addr, addr + size) from ps, and, for extents larger than a
+ * hugepage, the pageslabs following it in its run.
+ */
+static void
+hpa_unreserve_locked(tsdn_t *tsdn, hpa_shard_t *shard, hpdata_t *ps,
+    void *addr, size_t size) {
+	malloc_mutex_assert_owner(tsdn, &shard->mtx);
+	char *cur_addr = (char *)addr;
+	do {
+		assert(HUGEPAGE_ADDR2BASE(cur_addr) == hpdata_addr_get(ps));
+		size_t cur_size = (size < HUGEPAGE) ? size : HUGEPAGE;
+		psset_update_begin(&shard->psset, ps);
+		hpdata_unreserve(ps, cur_addr, cur_size);
+		hpa_update_purge_hugify_eligibility(tsdn, shard, ps);
+		psset_update_end(&shard->psset, ps);
+		cur_addr += cur_size;
+		size -= cur_size;
+		ps++;
+	} while (size > 0);
+}
+
+/*
+ * Whether the pageslab can serve the first size bytes of an allocation larger
+ * than a hugepage (which has to start at its beginning).
+ */
+static bool
+hpa_run_ps_fits(hpdata_t *ps, size_t size) {
+	return hpdata_in_psset_get(ps) && hpdata_alloc_allowed_get(ps)
+	    && hpdata_nfree_prefix_get(ps) >= (size >> LG_PAGE);
+}
+
+/*
+ * Finds room for an allocation larger than a hugepage in the runs we already
+ * have: size / HUGEPAGE consecutive empty pageslabs, followed (if size isn't a
+ * multiple of HUGEPAGE) by one with enough free pages at its start for the
+ * rest.  Returns the first of them, or NULL.
+ */
+static hpdata_t *
+hpa_pick_run(tsdn_t *tsdn, hpa_shard_t *shard, size_t size) {
+	malloc_mutex_assert_owner(tsdn, &shard->mtx);
+	size_t nfull = size >> LG_HUGEPAGE;
+	size_t tail = size & HUGEPAGE_MASK;
+	assert(nfull > 0);
+
+	hpdata_t *head;
+	ql_foreach(head, &shard->runs.head, ql_link_run) {
+		size_t run_nhp = hpdata_run_nhp_get(head);
+		/* The number of fitting empty pageslabs just before head[i]. */
+		size_t nempty = 0;
+		for (size_t i = 0; i < run_nhp; i++) {
+			hpdata_t *ps = &head[i];
+			if (tail != 0 && nempty >= nfull
+			    && hpa_run_ps_fits(ps, tail)) {
+				return ps - nfull;
+			}
+			if (!hpa_run_ps_fits(ps, HUGEPAGE)) {
+				nempty = 0;
+				continue;
+			}
+			nempty++;
+			if (tail == 0 && nempty == nfull) {
+				return ps + 1 - nfull;
+			}
+		}
+	}
+	return NULL;
+}
+
+static edata_t *
+hpa_reserve_run(tsdn_t *tsdn, hpa_shard_t *shard, hpdata_t *ps, size_t size,
+    bool *oom) {
+	malloc_mutex_assert_owner(tsdn, &shard->mtx);
+	edata_t *edata = edata_cache_fast_get(tsdn, &shard->ecf);
+	if (edata == NULL) {
+		*oom = true;
+		return NULL;
+	}
+
+	hpdata_t *cur = ps;
+	size_t remaining = size;
+	do {
+		size_t cur_size = (remaining < HUGEPAGE) ? remaining : HUGEPAGE;
+		psset_update_begin(&shard->psset, cur);
+		if (hpdata_empty(cur)) {
+			/* See hpa_try_alloc_one_no_grow. */
+			hpdata_age_set(cur, shard->age_counter++);
+		}
+		UNUSED void *addr = hpdata_reserve_alloc(cur, cur_size);
+		assert(addr == hpdata_addr_get(cur));
+		hpa_update_purge_hugify_eligibility(tsdn, shard, cur);
+		psset_update_end(&shard->psset, cur);
+		remaining -= cur_size;
+		cur++;
+	} while (remaining > 0);
+
+	edata_init(edata, shard->ind, hpdata_addr_get(ps), size,
+	    /* slab */ false, SC_NSIZES, /* sn */ hpdata_age_get(ps),
+	    extent_state_active, /* zeroed */ false, /* committed */ true,
+	    EXTENT_PAI_HPA, EXTENT_NOT_HEAD);
+	edata_ps_set(edata, ps);
+
+	/* As in hpa_try_alloc_one_no_grow, register before dropping the lock. */
+	if (emap_register_boundary(tsdn, shard->emap, edata, SC_NSIZES,
+	    /* slab */ false)) {
+		hpa_unreserve_locked(tsdn, shard, ps, edata_addr_get(edata),
+		    size);
+		edata_cache_fast_put(tsdn, &shard->ecf, edata);
+		*oom = true;
+		return NULL;
+	}
+	return edata;
+}
+
+/*
+ * Tries to allocate from the runs we have, or, if grown isn't NULL, from that
+ * newly extracted run (after adding it to the shard).
+ */
+static edata_t *
+hpa_try_alloc_run(tsdn_t *tsdn, hpa_shard_t *shard, size_t size,
+    hpdata_t *grown, bool *oom, bool *deferred_work_generated) {
+	malloc_mutex_lock(tsdn, &shard->mtx);
+	hpdata_t *ps;
+	if (grown != NULL) {
+		for (size_t i = 0; i < hpdata_run_nhp_get(grown); i++) {
+			psset_insert(&shard->psset, &grown[i]);
+		}
+		hpdata_run_list_append(&shard->runs, grown);
+		ps = grown;
+	} else {
+		ps = hpa_pick_run(tsdn, shard, size);
+	}
+	edata_t *edata = NULL;
+	if (ps != NULL) {
+		edata = hpa_reserve_run(tsdn, shard, ps, size, oom);
+	}
+
+	hpa_shard_maybe_do_deferred_work(tsdn, shard, /* forced */ false);
+	*deferred_work_generated = hpa_shard_has_deferred_work(tsdn, shard);
+	malloc_mutex_unlock(tsdn, &shard->mtx);
+	return edata;
+}
+
+/*
+ * Allocations larger than a hugepage are carved out of runs of consecutive
+ * pageslabs: they take over whole hugepages, which (being full) get hugified
+ * like any other full pageslab, plus the start of one more for the remainder,
+ * the rest of which gets packed with other allocations as usual.  Once freed,
+ * those are just empty pageslabs, purged (or reused, by allocations of any
+ * size) a hugepage at a time.
+ */
+static size_t
+hpa_alloc_batch_run(tsdn_t *tsdn, hpa_shard_t *shard, size_t size,
+    size_t nallocs, edata_list_active_t *results,
+    bool *deferred_work_generated) {
+	assert(size > HUGEPAGE);
+	assert(size <= shard->opts.large_max_alloc);
+	bool oom = false;
+
+	size_t nsuccess = 0;
+	for (; nsuccess < nallocs; nsuccess++) {
+		edata_t *edata = hpa_try_alloc_run(tsdn, shard, size,
+		    /* grown */ NULL, &oom, deferred_work_generated);
+		if (edata == NULL && !oom) {
+			/* Same as in hpa_alloc_batch_psset. */
+			if (mem_limit_alloc_check(tsdn, size)) {
+				break;
+			}
+			malloc_mutex_lock(tsdn, &shard->grow_mtx);
+			edata = hpa_try_alloc_run(tsdn, shard, size,
+			    /* grown */ NULL, &oom, deferred_work_generated);
+			if (edata == NULL && !oom) {
+				hpdata_t *ps = hpa_central_extract(tsdn,
+				    shard->central, size, &oom);
+				if (ps != NULL && shard->numa_node
+				    != NUMA_NODE_NONE) {
+					numa_bind(hpdata_addr_get(ps),
+					    HUGEPAGE_CEILING(size),
+					    shard->numa_node);
+				}
+				if (ps != NULL) {
+					edata = hpa_try_alloc_run(tsdn, shard,
+					    size, ps, &oom,
+					    deferred_work_generated);
+				}
+			}
+			malloc_mutex_unlock(tsdn, &shard->grow_mtx);
+		}
+		if (edata == NULL) {
+			break;
+		}
+		edata_list_active_append(results, edata);
+	}
+	return nsuccess;
+}
+
 static hpa_shard_t *
 hpa_from_pai(pai_t *self) {
 	assert(self->alloc == &hpa_alloc);
@@ -795,12 +1055,19 @@ hpa_alloc_batch(tsdn_t *tsdn, pai_t *self, size_t size, size_t nallocs,
 	 * fragmentation with huge pages (again, the full size will be used).
 	 */
 	if (!(frequent_reuse && size <= HUGEPAGE) &&
-	    (size > shard->opts.slab_max_alloc)) {
+	    (size > shard->opts.slab_max_alloc) &&
+	    (size > shard->opts.large_max_alloc)) {
 		return 0;
 	}
 
-	size_t nsuccess = hpa_alloc_batch_psset(tsdn, shard, size, nallocs,
-	    results, deferred_work_generated);
+	size_t nsuccess;
+	if (size > HUGEPAGE) {
+		nsuccess = hpa_alloc_batch_run(tsdn, shard, size, nallocs,
+		    results, deferred_work_generated);
+	} else {
+		nsuccess = hpa_alloc_batch_psset(tsdn, shard, size, nallocs,
+		    results, deferred_work_generated);
+	}
 
 	witness_assert_depth_to_rank(tsdn_witness_tsdp_get(tsdn),
 	    WITNESS_RANK_CORE, 0);
@@ -905,16 +1172,16 @@ hpa_dalloc_locked(tsdn_t *tsdn, hpa_shard_t *shard, edata_t *edata) {
 	 * correct to try to read most information out of it without the lock.
 	 */
 	hpdata_t *ps = edata_ps_get(edata);
-	/* Currently, all edatas come from pageslabs. */
+	/*
+	 * Currently, all edatas come from pageslabs (the first of a run, for
+	 * those larger than a hugepage).
+	 */
 	assert(ps != NULL);
 	void *unreserve_addr = edata_addr_get(edata);
 	size_t unreserve_size = edata_size_get(edata);
 	edata_cache_fast_put(tsdn, &shard->ecf, edata);
 
-	psset_update_begin(&shard->psset, ps);
-	hpdata_unreserve(ps, unreserve_addr, unreserve_size);
-	hpa_update_purge_hugify_eligibility(tsdn, shard, ps);
-	psset_update_end(&shard->psset, ps);
+	hpa_unreserve_locked(tsdn, shard, ps, unreserve_addr, unreserve_size);
 }
 
 static void
@@ -1085,6 +1352,32 @@ hpa_shard_do_deferred_work(tsdn_t *tsdn, hpa_shard_t *shard) {
 	malloc_mutex_unlock(tsdn, &shard->mtx);
 }
 
+void
+hpa_shard_purge_all(tsdn_t *tsdn, hpa_shard_t *shard) {
+	hpa_do_consistency_checks(shard);
+
+	malloc_mutex_lock(tsdn, &shard->mtx);
+	while (hpa_try_purge(tsdn, shard)) {
+		/* Purge until no pageslab has any dirty pages left. */
+	}
+	malloc_mutex_unlock(tsdn, &shard->mtx);
+}
+
+void
+hpa_shard_pressure_set(tsdn_t *tsdn, hpa_shard_t *shard, unsigned lg_div) {
+	hpa_do_consistency_checks(shard);
+
+	malloc_mutex_lock(tsdn, &shard->mtx);
+	bool lowered = lg_div > shard->pressure_lg_div;
+	shard->pressure_lg_div = lg_div;
+	if (lowered) {
+		/* Don't wait for the next deferred work to get under it. */
+		hpa_shard_maybe_do_deferred_work(tsdn, shard,
+		    /* forced */ true);
+	}
+	malloc_mutex_unlock(tsdn, &shard->mtx);
+}
+
 void
 hpa_shard_prefork3(tsdn_t *tsdn, hpa_shard_t *shard) {
 	hpa_do_consistency_checks(shard);
@@ -22,6 +22,7 @@ hpdata_init(hpdata_t *hpdata, void *addr, uint64_t age) {
 	hpdata_addr_set(hpdata, addr);
 	hpdata_age_set(hpdata, age);
 	hpdata->h_huge = false;
+	hpdata->h_dehugified = false;
 	hpdata->h_alloc_allowed = true;
 	hpdata->h_in_psset_alloc_container = false;
 	hpdata->h_purge_allowed = false;
@@ -31,6 +32,7 @@ hpdata_init(hpdata_t *hpdata, void *addr, uint64_t age) {
 	hpdata->h_mid_hugify = false;
 	hpdata->h_updating = false;
 	hpdata->h_in_psset = false;
+	hpdata->h_run_nhp = 0;
 	hpdata_longest_free_range_set(hpdata, HUGEPAGE_PAGES);
 	hpdata->h_nactive = 0;
 	fb_init(hpdata->active_pages, HUGEPAGE_PAGES);
@@ -312,6 +314,7 @@ void
 hpdata_hugify(hpdata_t *hpdata) {
 	hpdata_assert_consistent(hpdata);
 	hpdata->h_huge = true;
+	hpdata->h_dehugified = false;
 	fb_set_range(hpdata->touched_pages, HUGEPAGE_PAGES, 0, HUGEPAGE_PAGES);
 	hpdata->h_ntouched = HUGEPAGE_PAGES;
 	hpdata_assert_consistent(hpdata);
@@ -321,5 +324,6 @@ void
 hpdata_dehugify(hpdata_t *hpdata) {
 	hpdata_assert_consistent(hpdata);
 	hpdata->h_huge = false;
+	hpdata->h_dehugified = true;
 	hpdata_assert_consistent(hpdata);
 }
@@ -2,12 +2,18 @@
 #include "jemalloc/internal/jemalloc_internal_includes.h"
 #include "jemalloc/internal/inspect.h"
 
-void
-inspect_extent_util_stats_get(tsdn_t *tsdn, const void *ptr, size_t *nfree,
-    size_t *nregs, size_t *size) {
-	assert(ptr != NULL && nfree != NULL && nregs != NULL && size != NULL);
+/* The number of pointers the batch query looks up at a time. */
+#define INSPECT_BATCH_NPTRS 64
 
-	const edata_t *edata = emap_edata_lookup(tsdn, &arena_emap_global, ptr);
+typedef struct inspect_batch_key_s inspect_batch_key_t;
+struct inspect_batch_key_s {
+	uintptr_t key;
+	size_t ind;
+};
+
+static void
+inspect_extent_util_stats_fill(const edata_t *edata, size_t *nfree,
+    size_t *nregs, size_t *size) {
 	if (unlikely(edata == NULL)) {
 		*nfree = *nregs = *size = 0;
 		return;
@@ -25,6 +31,112 @@ inspect_extent_util_stats_get(tsdn_t *tsdn, const void *ptr, size_t *nfree,
 	}
 }
 
+void
+inspect_extent_util_stats_get(tsdn_t *tsdn, const void *ptr, size_t *nfree,
+    size_t *nregs, size_t *size) {
+	assert(ptr != NULL && nfree != NULL && nregs != NULL && size != NULL);
+
+	const edata_t *edata = emap_edata_lookup(tsdn, &arena_emap_global, ptr);
+	inspect_extent_util_stats_fill(edata, nfree, nregs, size);
+}
+
+static void
+inspect_batch_keys_sift_down(inspect_batch_key_t *keys, size_t i, size_t n) {
+	while (2 * i + 1 < n) {
+		size_t child = 2 * i + 1;
+		if (child + 1 < n && keys[child + 1].key > keys[child].key) {
+			child++;
+		}
+		if (keys[i].key >= keys[child].key) {
+			return;
+		}
+		inspect_batch_key_t tmp = keys[i];
+		keys[i] = keys[child];
+		keys[child] = tmp;
+		i = child;
+	}
+}
+
+/* Heapsort, to bound both the time and the stack used. */
+static void
+inspect_batch_keys_sort(inspect_batch_key_t *keys, size_t n) {
+	for (size_t i = n / 2; i > 0; i--) {
+		inspect_batch_keys_sift_down(keys, i - 1, n);
+	}
+	for (size_t i = n; i > 1; i--) {
+		inspect_batch_key_t tmp = keys[0];
+		keys[0] = keys[i - 1];
+		keys[i - 1] = tmp;
+		inspect_batch_keys_sift_down(keys, 0, i - 1);
+	}
+}
+
+void
+inspect_extent_util_stats_batch_get(tsdn_t *tsdn, void *const *ptrs,
+    size_t n, inspect_extent_util_stats_t *util_stats) {
+	/*
+	 * Look the pointers up in address order, so that neighbours share the
+	 * rtree leaf and the edata.  The order of all of them needs a buffer,
+	 * which is only worth it (and only kept out of the slabs being queried)
+	 * if it is large; otherwise, or if it can't be allocated, each batch
+	 * gets sorted on its own.
+	 */
+	inspect_batch_key_t *sorted = NULL;
+	size_t sorted_size = n * sizeof(inspect_batch_key_t);
+	if (sorted_size / sizeof(inspect_batch_key_t) == n
+	    && sorted_size >= SC_LARGE_MINCLASS
+	    && sorted_size <= SC_LARGE_MAXCLASS) {
+		sorted = (inspect_batch_key_t *)iallocztm(tsdn, sorted_size,
+		    sz_size2index(sorted_size), false, NULL, true,
+		    arena_get(tsdn, 0, false), true);
+	}
+	if (sorted != NULL) {
+		for (size_t i = 0; i < n; i++) {
+			sorted[i].key = (uintptr_t)ptrs[i];
+			sorted[i].ind = i;
+		}
+		inspect_batch_keys_sort(sorted, n);
+	}
+
+	inspect_batch_key_t batch[INSPECT_BATCH_NPTRS];
+	uintptr_t keys[INSPECT_BATCH_NPTRS];
+	rtree_leaf_elm_t *elms[INSPECT_BATCH_NPTRS];
+	edata_t *edatas[INSPECT_BATCH_NPTRS];
+	for (size_t start = 0; start < n; start += INSPECT_BATCH_NPTRS) {
+		size_t nbatch = n - start < INSPECT_BATCH_NPTRS ? n - start :
+		    INSPECT_BATCH_NPTRS;
+		if (sorted != NULL) {
+			memcpy(batch, &sorted[start],
+			    nbatch * sizeof(inspect_batch_key_t));
+		} else {
+			for (size_t i = 0; i < nbatch; i++) {
+				batch[i].key = (uintptr_t)ptrs[start + i];
+				batch[i].ind = start + i;
+			}
+			inspect_batch_keys_sort(batch, nbatch);
+		}
+		for (size_t i = 0; i < nbatch; i++) {
+			keys[i] = batch[i].key;
+		}
+		emap_edata_lookup_independent_batch(tsdn, &arena_emap_global,
+		    nbatch, keys, elms, edatas);
+		for (size_t i = 0; i < nbatch; i++) {
+			inspect_extent_util_stats_t *stats =
+			    &util_stats[batch[i].ind];
+			if (i > 0 && edatas[i] == edatas[i - 1]) {
+				*stats = util_stats[batch[i - 1].ind];
+				continue;
+			}
+			inspect_extent_util_stats_fill(edatas[i], &stats->nfree,
+			    &stats->nregs, &stats->size);
+		}
+	}
+
+	if (sorted != NULL) {
+		idalloctm(tsdn, sorted, NULL, NULL, true, true);
+	}
+}
+
 void
 inspect_extent_util_stats_verbose_get(tsdn_t *tsdn, const void *ptr,
     size_t *nfree, size_t *nregs, size_t *size, size_t *bin_nfree,
@@ -76,3 +188,207 @@ inspect_extent_util_stats_verbose_get(tsdn_t *tsdn, const void *ptr,
 	*slabcur_addr = slab != NULL ? edata_addr_get(slab) : NULL;
 	malloc_mutex_unlock(tsdn, &bin->lock);
 }
+
+bool
+inspect_defrag_hint_get(tsdn_t *tsdn, const void *ptr) {
+	assert(ptr != NULL);
+
+	const edata_t *edata = emap_edata_lookup(tsdn, &arena_emap_global, ptr);
+	if (unlikely(edata == NULL) || !edata_slab_get(edata)) {
+		return false;
+	}
+
+	const szind_t szind = edata_szind_get(edata);
+	const size_t nregs = bin_infos[szind].nregs;
+	arena_t *arena = (arena_t *)atomic_load_p(
+	    &arenas[edata_arena_ind_get(edata)], ATOMIC_RELAXED);
+	assert(arena != NULL);
+	bin_t *bin = arena_get_bin(arena, szind, edata_binshard_get(edata));
+
+	malloc_mutex_lock(tsdn, &bin->lock);
+	bool hint;
+	size_t nfree = edata_nfree_get(edata);
+	if (edata == bin->slabcur || nfree == 0) {
+		/* Allocations go there anyway, or it can't take any more. */
+		hint = false;
+	} else if (config_stats) {
+		/* Whether the slab is less utilized than the bin shard. */
+		size_t nalloced = nregs - nfree;
+		hint = nalloced * bin->stats.curslabs < bin->stats.curregs;
+	} else {
+		hint = nfree * 2 > nregs;
+	}
+	malloc_mutex_unlock(tsdn, &bin->lock);
+
+	return hint;
+}
+
+/*
+ * The heap walk reads the edatas of extents that may be changing under it, so
+ * it reads their fields without the consistency assertions of the getters.
+ */
+static void *
+inspect_edata_addr_racy(const edata_t *edata) {
+	return edata->e_addr;
+}
+
+static unsigned
+inspect_edata_arena_ind_racy(const edata_t *edata) {
+	return (unsigned)((edata->e_bits & EDATA_BITS_ARENA_MASK) >>
+	    EDATA_BITS_ARENA_SHIFT);
+}
+
+static unsigned
+inspect_edata_binshard_racy(const edata_t *edata) {
+	return (unsigned)((edata->e_bits & EDATA_BITS_BINSHARD_MASK) >>
+	    EDATA_BITS_BINSHARD_SHIFT);
+}
+
+typedef struct inspect_heap_walk_ctx_s inspect_heap_walk_ctx_t;
+struct inspect_heap_walk_ctx_s {
+	tsdn_t *tsdn;
+	const inspect_heap_walker_t *walker;
+};
+
+/*
+ * Reports the allocated regions of a slab, as of a copy of its bitmap taken
+ * under the bin lock.  The walker itself is called without any lock held.
+ */
+static void
+inspect_heap_walk_slab_visit(tsdn_t *tsdn, const inspect_heap_walker_t *walker,
+    rtree_leaf_elm_t *elm, rtree_contents_t contents) {
+	edata_t *edata = contents.edata;
+	szind_t szind = contents.metadata.szind;
+	if (szind >= SC_NBINS) {
+		return;
+	}
+	const bin_info_t *bin_info = &bin_infos[szind];
+	unsigned arena_ind = inspect_edata_arena_ind_racy(edata);
+	unsigned binshard = inspect_edata_binshard_racy(edata);
+	if (arena_ind >= narenas_total_get() ||
+	    binshard >= bin_info->n_shards) {
+		/* The slab went away since the rtree was read. */
+		return;
+	}
+	arena_t *arena = arena_get(tsdn, arena_ind, false);
+	if (arena == NULL) {
+		return;
+	}
+	bin_t *bin = arena_get_bin(arena, szind, binshard);
+
+	bitmap_t bitmap[BITMAP_GROUPS_MAX];
+	malloc_mutex_lock(tsdn, &bin->lock);
+	/* Only trust the slab if it still belongs to this bin. */
+	rtree_contents_t cur = rtree_leaf_elm_read(tsdn,
+	    &arena_emap_global.rtree, elm, /* dependent */ false);
+	bool valid = cur.edata == edata && cur.metadata.slab
+	    && cur.metadata.state == extent_state_active
+	    && cur.metadata.szind == szind
+	    && inspect_edata_arena_ind_racy(edata) == arena_ind
+	    && inspect_edata_binshard_racy(edata) == binshard;
+	unsigned nfree = 0;
+	byte_t *addr = NULL;
+	if (valid) {
+		nfree = edata_nfree_get(edata);
+		addr = (byte_t *)edata_addr_get(edata);
+		memcpy(bitmap, edata_slab_data_get(edata)->bitmap,
+		    bin_info->bitmap_info.ngroups * sizeof(bitmap_t));
+	}
+	malloc_mutex_unlock(tsdn, &bin->lock);
+	if (!valid) {
+		return;
+	}
+
+	inspect_heap_walk_record_t record = {inspect_heap_walk_slab, addr,
+	    bin_info->slab_size, arena_ind,
+	    bin_info->nregs, nfree};
+	walker->cb(walker->ctx, &record);
+	record.kind = inspect_heap_walk_region;
+	record.size = bin_info->reg_size;
+	record.nregs = record.nfree = 0;
+	for (size_t i = 0; i < bin_info->nregs; i++) {
+		if (bitmap_get(bitmap, &bin_info->bitmap_info, i)) {
+			record.addr = addr + i * bin_info->reg_size;
+			walker->cb(walker->ctx, &record);
+		}
+	}
+}
+
+static void
+inspect_heap_walk_leaf(void *ctx, uintptr_t key, rtree_leaf_elm_t *leaf) {
+	inspect_heap_walk_ctx_t *walk_ctx = (inspect_heap_walk_ctx_t *)ctx;
+	tsdn_t *tsdn = walk_ctx->tsdn;
+	rtree_t *rtree = &arena_emap_global.rtree;
+	for (size_t i = 0; i < RTREE_LEAF_NELMS; i++) {
+		rtree_contents_t contents = rtree_leaf_elm_read(tsdn, rtree,
+		    &leaf[i], /* dependent */ false);
+		edata_t *edata = contents.edata;
+		uintptr_t page = key + ((uintptr_t)i << LG_PAGE);
+		/*
+		 * Extents are registered on (at least) their first and last
+		 * pages; only report them from the first one.
+		 */
+		if (edata == NULL || (uintptr_t)PAGE_ADDR2BASE(
+		    inspect_edata_addr_racy(edata)) != page) {
+			continue;
+		}
+		if (contents.metadata.slab) {
+			if (contents.metadata.state == extent_state_active) {
+				inspect_heap_walk_slab_visit(tsdn,
+				    walk_ctx->walker, &leaf[i], contents);
+			}
+			continue;
+		}
+
+		/*
+		 * Large and unused extents aren't protected by any lock; make
+		 * sure that the fields read go with the rtree contents.
+		 */
+		inspect_heap_walk_record_t record = {inspect_heap_walk_large,
+		    inspect_edata_addr_racy(edata), 0,
+		    inspect_edata_arena_ind_racy(edata), 0, 0};
+		switch (contents.metadata.state) {
+		case extent_state_active:
+			/*
+			 * Extents are registered as active before they get
+			 * their size class (see emap_remap()); such in flight
+			 * ones aren't allocations yet.
+			 */
+			if (contents.metadata.szind >= SC_NSIZES) {
+				continue;
+			}
+			record.size = sz_index2size(contents.metadata.szind);
+			break;
+		case extent_state_dirty:
+			record.kind = inspect_heap_walk_dirty;
+			break;
+		case extent_state_muzzy:
+			record.kind = inspect_heap_walk_muzzy;
+			break;
+		case extent_state_retained:
+			record.kind = inspect_heap_walk_retained;
+			break;
+		default:
+			continue;
+		}
+		if (record.kind != inspect_heap_walk_large) {
+			record.size = edata_size_get(edata);
+		}
+		rtree_contents_t cur = rtree_leaf_elm_read(tsdn, rtree,
+		    &leaf[i], /* dependent */ false);
+		if (cur.edata != edata || cur.metadata.state
+		    != contents.metadata.state || cur.metadata.szind
+		    != contents.metadata.szind) {
+			continue;
+		}
+		walk_ctx->walker->cb(walk_ctx->walker->ctx, &record);
+	}
+}
+
+void
+inspect_heap_walk(tsdn_t *tsdn, const inspect_heap_walker_t *walker) {
+	assert(walker != NULL && walker->cb != NULL);
+	inspect_heap_walk_ctx_t ctx = {tsdn, walker};
+	rtree_leaves_iter(&arena_emap_global.rtree, inspect_heap_walk_leaf,
+	    &ctx);
+}
@@ -1,6 +1,7 @@
 #include "jemalloc/internal/jemalloc_preamble.h"
 #include "jemalloc/internal/jemalloc_internal_includes.h"
 
+#include "jemalloc/internal/alloc_tag.h"
 #include "jemalloc/internal/assert.h"
 #include "jemalloc/internal/atomic.h"
 #include "jemalloc/internal/buf_writer.h"
@@ -11,11 +12,14 @@
 #include "jemalloc/internal/fxp.h"
 #include "jemalloc/internal/san.h"
 #include "jemalloc/internal/hook.h"
+#include "jemalloc/internal/mem_limit.h"
 #include "jemalloc/internal/jemalloc_internal_types.h"
 #include "jemalloc/internal/log.h"
 #include "jemalloc/internal/malloc_io.h"
 #include "jemalloc/internal/mutex.h"
 #include "jemalloc/internal/nstime.h"
+#include "jemalloc/internal/numa.h"
+#include "jemalloc/internal/pressure.h"
 #include "jemalloc/internal/rtree.h"
 #include "jemalloc/internal/safety_check.h"
 #include "jemalloc/internal/sc.h"
@@ -155,6 +159,20 @@ bool	opt_experimental_tcache_gc = false;
 bool	opt_zero = false;
 unsigned	opt_narenas = 0;
 static fxp_t		opt_narenas_ratio = FXP_INIT_INT(4);
+int64_t		opt_arena_rebalance_interval = -1;
+unsigned	opt_arena_rebalance_threshold = 50;
+
+/* Same batching as for stats_interval. */
+#define ARENA_REBALANCE_LG_BATCH_SIZE 6
+#define ARENA_REBALANCE_BATCH_MAX (4 << 20)
+/* Per thread batch of allocated bytes between arena_rebalance events. */
+static uint64_t		arena_rebalance_batch;
+/* Bytes allocated by all threads, as reported through the event. */
+static atomic_zu_t	arena_rebalance_accumulated;
+/* Bumped whenever the loads of a rebalancing window are published. */
+static atomic_zu_t	arena_rebalance_epoch;
+/* Held while publishing the loads, so that windows don't overlap. */
+static atomic_b_t	arena_rebalance_publishing;
 
 unsigned	ncpus;
 
@@ -526,6 +544,18 @@ arena_choose_hard(tsd_t *tsd, bool internal) {
 	if (narenas_auto > 1) {
 		unsigned i, j, choose[2], first_null;
 		bool is_new_arena[2];
+		/*
+		 * The arenas to pick from; with numa_arena, only those bound to
+		 * the current node (see numa_arena_node()).
+		 */
+		unsigned first = 0, stride = 1;
+		if (opt_numa_arena) {
+			int node_ind = numa_current_node_ind();
+			if (node_ind >= 0 && (unsigned)node_ind < narenas_auto) {
+				first = (unsigned)node_ind;
+				stride = numa_nnodes_get();
+			}
+		}
 
 		/*
 		 * Determine binding for both non-internal and internal
@@ -533,24 +563,27 @@ arena_choose_hard(tsd_t *tsd, bool internal) {
 		 *
 		 *   choose[0]: For application allocation.
 		 *   choose[1]: For internal metadata allocation.
+		 *
+		 * narenas_auto stands for "no extant arena found yet".
 		 */
 
 		for (j = 0; j < 2; j++) {
-			choose[j] = 0;
+			choose[j] = narenas_auto;
 			is_new_arena[j] = false;
 		}
 
 		first_null = narenas_auto;
 		malloc_mutex_lock(tsd_tsdn(tsd), &arenas_lock);
 		assert(arena_get(tsd_tsdn(tsd), 0, false) != NULL);
-		for (i = 1; i < narenas_auto; i++) {
+		for (i = first; i < narenas_auto; i += stride) {
 			if (arena_get(tsd_tsdn(tsd), i, false) != NULL) {
 				/*
 				 * Choose the first arena that has the lowest
 				 * number of threads assigned to it.
 				 */
 				for (j = 0; j < 2; j++) {
-					if (arena_nthreads_get(arena_get(
+					if (choose[j] == narenas_auto ||
+					    arena_nthreads_get(arena_get(
 					    tsd_tsdn(tsd), i, false), !!j) <
 					    arena_nthreads_get(arena_get(
 					    tsd_tsdn(tsd), choose[j], false),
@@ -573,9 +606,12 @@ arena_choose_hard(tsd_t *tsd, bool internal) {
 		}
 
 		for (j = 0; j < 2; j++) {
-			if (arena_nthreads_get(arena_get(tsd_tsdn(tsd),
-			    choose[j], false), !!j) == 0 || first_null ==
-			    narenas_auto) {
+			/* Arena 0 exists, so this only happens with numa_arena. */
+			assert(choose[j] != narenas_auto || first_null !=
+			    narenas_auto);
+			if (choose[j] != narenas_auto && (arena_nthreads_get(
+			    arena_get(tsd_tsdn(tsd), choose[j], false), !!j) == 0
+			    || first_null == narenas_auto)) {
 				/*
 				 * Use an unloaded arena, or the least loaded
 				 * arena if all arenas are already initialized.
@@ -622,6 +658,173 @@ arena_choose_hard(tsd_t *tsd, bool internal) {
 	return ret;
 }
 
+uint64_t
+arena_rebalance_new_event_wait(tsd_t *tsd) {
+	return arena_rebalance_batch;
+}
+
+uint64_t
+arena_rebalance_postponed_event_wait(tsd_t *tsd) {
+	return TE_MIN_START_WAIT;
+}
+
+/*
+ * Ends a rebalancing window: publishes the number of bytes allocated from each
+ * automatic arena since the end of the previous one.
+ */
+static void
+arena_rebalance_window_end(tsdn_t *tsdn) {
+	if (atomic_exchange_b(&arena_rebalance_publishing, true,
+	    ATOMIC_ACQUIRE)) {
+		/* Another thread is at it; merge into the next window. */
+		return;
+	}
+	for (unsigned i = 0; i < narenas_auto; i++) {
+		arena_t *arena = arena_get(tsdn, i, false);
+		if (arena == NULL) {
+			continue;
+		}
+		size_t nbytes = atomic_load_zu(&arena->rebalance_nbytes,
+		    ATOMIC_RELAXED);
+		size_t prev = atomic_exchange_zu(&arena->rebalance_nbytes_prev,
+		    nbytes, ATOMIC_RELAXED);
+		atomic_store_zu(&arena->rebalance_load, nbytes - prev,
+		    ATOMIC_RELAXED);
+	}
+	atomic_fetch_add_zu(&arena_rebalance_epoch, 1, ATOMIC_RELEASE);
+	atomic_store_b(&arena_rebalance_publishing, false, ATOMIC_RELEASE);
+}
+
+size_t
+arena_rebalance_load_sub(atomic_zu_t *load, size_t nbytes) {
+	size_t cur = atomic_load_zu(load, ATOMIC_RELAXED);
+	size_t sub;
+	do {
+		sub = cur < nbytes ? cur : nbytes;
+	} while (!atomic_compare_exchange_weak_zu(load, &cur, cur - sub,
+	    ATOMIC_RELAXED, ATOMIC_RELAXED));
+	return sub;
+}
+
+/*
+ * Moves the thread to the least loaded arena (on the same NUMA node, with
+ * numa_arena), if its current one got more than opt.arena_rebalance_threshold
+ * percent more load in the last window, and taking the thread's own share of
+ * that load along doesn't just reverse the imbalance.
+ */
+static void
+arena_rebalance_maybe_migrate(tsd_t *tsd, arena_t *arena, size_t share) {
+	tsdn_t *tsdn = tsd_tsdn(tsd);
+	unsigned ind = arena_ind_get(arena);
+	if (share == 0 || !arena_is_auto(arena)) {
+		return;
+	}
+	int node = numa_arena_node(ind);
+
+	size_t load = atomic_load_zu(&arena->rebalance_load, ATOMIC_RELAXED);
+	arena_t *target = NULL;
+	size_t target_load = 0;
+	unsigned first_null = narenas_auto;
+	for (unsigned i = 0; i < narenas_auto; i++) {
+		if (i == ind || numa_arena_node(i) != node) {
+			continue;
+		}
+		arena_t *cand = arena_get(tsdn, i, false);
+		if (cand == NULL) {
+			if (first_null == narenas_auto) {
+				first_null = i;
+			}
+			continue;
+		}
+		size_t cand_load = atomic_load_zu(&cand->rebalance_load,
+		    ATOMIC_RELAXED);
+		if (target == NULL || cand_load < target_load) {
+			target = cand;
+			target_load = cand_load;
+		}
+	}
+	/* Unused arenas have no load; prefer the extant ones on ties though. */
+	bool init = first_null != narenas_auto && (target == NULL ||
+	    target_load > 0);
+	if (init) {
+		target_load = 0;
+	}
+	if ((target == NULL && !init) || (uint64_t)load * 100 <=
+	    (uint64_t)target_load * (100 +
+	    (uint64_t)opt_arena_rebalance_threshold) ||
+	    load - target_load < 2 * (uint64_t)share) {
+		return;
+	}
+	if (init) {
+		target = arena_get(tsdn, first_null, true);
+		if (target == NULL) {
+			return;
+		}
+	}
+
+	/*
+	 * Account for the move right away, so that the threads deciding in the
+	 * same window don't all pile onto the same arena.  The load read above
+	 * may be stale by now (other threads leaving concurrently, or the
+	 * window ending), hence the saturation.
+	 */
+	size_t moved = arena_rebalance_load_sub(&arena->rebalance_load, share);
+	atomic_fetch_add_zu(&target->rebalance_load, moved, ATOMIC_RELAXED);
+	arena_migrate(tsd, arena, target);
+	if (tcache_available(tsd)) {
+		tcache_arena_reassociate(tsdn, tsd_tcache_slowp_get(tsd),
+		    tsd_tcachep_get(tsd), target);
+	}
+}
+
+void
+arena_rebalance_event_handler(tsd_t *tsd, uint64_t elapsed) {
+	assert(opt_arena_rebalance_interval > 0);
+	assert(elapsed > 0 && elapsed != TE_INVALID_ELAPSED);
+
+	arena_t *arena = tsd_arena_get(tsd);
+	if (arena == NULL || (have_percpu_arena &&
+	    PERCPU_ARENA_ENABLED(opt_percpu_arena))) {
+		return;
+	}
+	atomic_fetch_add_zu(&arena->rebalance_nbytes, (size_t)elapsed,
+	    ATOMIC_RELAXED);
+	*tsd_arena_rebalance_nbytesp_get(tsd) += elapsed;
+
+	uint64_t interval = (uint64_t)opt_arena_rebalance_interval;
+	uint64_t before = atomic_fetch_add_zu(&arena_rebalance_accumulated,
+	    (size_t)elapsed, ATOMIC_RELAXED);
+	if (before / interval != (before + elapsed) / interval) {
+		arena_rebalance_window_end(tsd_tsdn(tsd));
+	}
+
+	/* Each thread decides once per window, based on its latest share. */
+	size_t epoch = atomic_load_zu(&arena_rebalance_epoch, ATOMIC_ACQUIRE);
+	if (tsd_arena_rebalance_epoch_get(tsd) == epoch) {
+		return;
+	}
+	tsd_arena_rebalance_epoch_set(tsd, epoch);
+	uint64_t share = tsd_arena_rebalance_nbytes_get(tsd);
+	tsd_arena_rebalance_nbytes_set(tsd, 0);
+	arena_rebalance_maybe_migrate(tsd, arena, (size_t)share);
+}
+
+static void
+arena_rebalance_boot(void) {
+	if (opt_arena_rebalance_interval <= 0) {
+		arena_rebalance_batch = 0;
+		return;
+	}
+	uint64_t batch = (uint64_t)opt_arena_rebalance_interval >>
+	    ARENA_REBALANCE_LG_BATCH_SIZE;
+	if (batch > ARENA_REBALANCE_BATCH_MAX) {
+		batch = ARENA_REBALANCE_BATCH_MAX;
+	} else if (batch == 0) {
+		batch = 1;
+	}
+	arena_rebalance_batch = batch;
+}
+
 void
 iarena_cleanup(tsd_t *tsd) {
 	arena_t *iarena;
@@ -1241,6 +1444,7 @@ malloc_conf_init_helper(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 				CONF_CONTINUE;
 			}
 			CONF_HANDLE_BOOL(opt_retain, "retain")
+			CONF_HANDLE_BOOL(opt_huge_slabs, "huge_slabs")
 			if (strncmp("dss", k, klen) == 0) {
 				int m;
 				bool match = false;
@@ -1313,13 +1517,11 @@ malloc_conf_init_helper(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 			    CONF_DONT_CHECK_MIN, CONF_DONT_CHECK_MAX,
 			    /* clip */ true)
 			CONF_HANDLE_SIZE_T(opt_bin_info_remote_free_max_batch,
-			    "remote_free_max_batch", 0,
-			    BIN_REMOTE_FREE_ELEMS_MAX,
-			    CONF_DONT_CHECK_MIN, CONF_CHECK_MAX,
+			    "remote_free_max_batch", 0, SIZE_T_MAX,
+			    CONF_DONT_CHECK_MIN, CONF_DONT_CHECK_MAX,
 			    /* clip */ true)
-			CONF_HANDLE_SIZE_T(opt_bin_info_remote_free_max,
-			    "remote_free_max", 0,
-			    BIN_REMOTE_FREE_ELEMS_MAX,
+			CONF_HANDLE_UNSIGNED(opt_bin_info_shards_max,
+			    "bin_shards_max", 0, BIN_SHARDS_MAX,
 			    CONF_DONT_CHECK_MIN, CONF_CHECK_MAX,
 			    /* clip */ true)
 
@@ -1400,6 +1602,14 @@ malloc_conf_init_helper(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 			CONF_HANDLE_BOOL(opt_experimental_tcache_gc,
 			    "experimental_tcache_gc")
 			CONF_HANDLE_BOOL(opt_tcache, "tcache")
+			CONF_HANDLE_BOOL(opt_percpu_tcache, "percpu_tcache")
+			CONF_HANDLE_BOOL(opt_numa_arena, "numa_arena")
+			CONF_HANDLE_INT64_T(opt_arena_rebalance_interval,
+			    "arena_rebalance_interval", -1, INT64_MAX,
+			    CONF_CHECK_MIN, CONF_DONT_CHECK_MAX, false)
+			CONF_HANDLE_UNSIGNED(opt_arena_rebalance_threshold,
+			    "arena_rebalance_threshold", 0, UINT_MAX,
+			    CONF_DONT_CHECK_MIN, CONF_DONT_CHECK_MAX, false)
 			CONF_HANDLE_SIZE_T(opt_tcache_max, "tcache_max",
 			    0, TCACHE_MAXCLASS_LIMIT, CONF_DONT_CHECK_MIN,
 			    CONF_CHECK_MAX, /* clip */ true)
@@ -1448,6 +1658,11 @@ malloc_conf_init_helper(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 			CONF_HANDLE_UNSIGNED(opt_lg_tcache_flush_large_div,
 			    "lg_tcache_flush_large_div", 1, 16,
 			    CONF_CHECK_MIN, CONF_CHECK_MAX, /* clip */ true)
+			CONF_HANDLE_BOOL(opt_tcache_adaptive, "tcache_adaptive")
+			CONF_HANDLE_SIZE_T(opt_tcache_adaptive_max_bytes,
+			    "tcache_adaptive_max_bytes", 0, SIZE_T_MAX,
+			    CONF_DONT_CHECK_MIN, CONF_DONT_CHECK_MAX,
+			    /* clip */ false)
 			CONF_HANDLE_UNSIGNED(opt_debug_double_free_max_scan,
 			    "debug_double_free_max_scan", 0, UINT_MAX,
 			    CONF_DONT_CHECK_MIN, CONF_DONT_CHECK_MAX,
@@ -1471,6 +1686,10 @@ malloc_conf_init_helper(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 			    "lg_extent_max_active_fit", 0,
 			    (sizeof(size_t) << 3), CONF_DONT_CHECK_MIN,
 			    CONF_CHECK_MAX, false)
+			CONF_HANDLE_SIZE_T(opt_mem_limit, "mem_limit", 0,
+			    SIZE_T_MAX, CONF_DONT_CHECK_MIN, CONF_DONT_CHECK_MAX,
+			    false)
+			CONF_HANDLE_BOOL(opt_mem_limit_fail, "mem_limit_fail")
 
 			if (strncmp("percpu_arena", k, klen) == 0) {
 				bool match = false;
@@ -1501,10 +1720,17 @@ malloc_conf_init_helper(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 					   opt_max_background_threads,
 					   CONF_CHECK_MIN, CONF_CHECK_MAX,
 					   true);
+			CONF_HANDLE_BOOL(opt_pressure_purge, "pressure_purge")
+			CONF_HANDLE_UNSIGNED(opt_pressure_purge_threshold,
+			    "pressure_purge_threshold", 1, 100, CONF_CHECK_MIN,
+			    CONF_CHECK_MAX, /* clip */ true)
 			CONF_HANDLE_BOOL(opt_hpa, "hpa")
 			CONF_HANDLE_SIZE_T(opt_hpa_opts.slab_max_alloc,
 			    "hpa_slab_max_alloc", PAGE, HUGEPAGE,
 			    CONF_CHECK_MIN, CONF_CHECK_MAX, true);
+			CONF_HANDLE_SIZE_T(opt_hpa_opts.large_max_alloc,
+			    "hpa_large_max_alloc", 0, SC_LARGE_MAXCLASS,
+			    CONF_DONT_CHECK_MIN, CONF_CHECK_MAX, true);
 
 			/*
 			 * Accept either a ratio-based or an exact hugification
@@ -1537,6 +1763,13 @@ malloc_conf_init_helper(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 			CONF_HANDLE_BOOL(
 			    opt_hpa_opts.hugify_sync, "hpa_hugify_sync");
 
+			CONF_HANDLE_SIZE_T(opt_hpa_opts.rehugify_max_nhp,
+			    "hpa_rehugify_max_nhp", 0, 0, CONF_DONT_CHECK_MIN,
+			    CONF_DONT_CHECK_MAX, false);
+			CONF_HANDLE_UINT64_T(opt_hpa_opts.rehugify_interval_ms,
+			    "hpa_rehugify_interval_ms", 0, 0, CONF_DONT_CHECK_MIN,
+			    CONF_DONT_CHECK_MAX, false);
+
 			CONF_HANDLE_UINT64_T(
 			    opt_hpa_opts.min_purge_interval_ms,
 			    "hpa_min_purge_interval_ms", 0, 0,
@@ -1631,6 +1864,23 @@ malloc_conf_init_helper(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 				CONF_HANDLE_BOOL(opt_prof_leak, "prof_leak")
 				CONF_HANDLE_BOOL(opt_prof_leak_error,
 				    "prof_leak_error")
+				CONF_HANDLE_BOOL(opt_prof_dump_incremental,
+				    "prof_dump_incremental")
+				CONF_HANDLE_BOOL(opt_prof_dump_gzip,
+				    "prof_dump_gzip")
+				if (CONF_MATCH("prof_dump_format")) {
+					if (CONF_MATCH_VALUE("heap_v2")) {
+						opt_prof_dump_format =
+						    prof_dump_format_heap_v2;
+					} else if (CONF_MATCH_VALUE("pprof")) {
+						opt_prof_dump_format =
+						    prof_dump_format_pprof;
+					} else {
+						CONF_ERROR("Invalid conf value",
+						    k, klen, v, vlen);
+					}
+					CONF_CONTINUE;
+				}
 				CONF_HANDLE_BOOL(opt_prof_log, "prof_log")
 				CONF_HANDLE_BOOL(opt_prof_pid_namespace, "prof_pid_namespace")
 				CONF_HANDLE_SSIZE_T(opt_prof_recent_alloc_max,
@@ -1638,6 +1888,8 @@ malloc_conf_init_helper(sc_data_t *sc_data, unsigned bin_shard_sizes[SC_NBINS],
 				CONF_HANDLE_BOOL(opt_prof_stats, "prof_stats")
 				CONF_HANDLE_BOOL(opt_prof_sys_thread_name,
 				    "prof_sys_thread_name")
+				CONF_HANDLE_BOOL(opt_prof_fast_unwind,
+				    "prof_fast_unwind")
 				if (CONF_MATCH("prof_time_resolution")) {
 					if (CONF_MATCH_VALUE("default")) {
 						opt_prof_time_res =
@@ -1885,9 +2137,15 @@ malloc_init_hard_a0_locked(void) {
 	if (stats_boot()) {
 		return true;
 	}
+	if (alloc_tag_boot()) {
+		return true;
+	}
+	arena_rebalance_boot();
 	if (pages_boot()) {
 		return true;
 	}
+	numa_boot();
+	pressure_boot();
 	if (base_boot(TSDN_NULL)) {
 		return true;
 	}
@@ -1914,6 +2172,16 @@ malloc_init_hard_a0_locked(void) {
 			opt_hpa = false;
 		}
 	}
+	if (opt_huge_slabs && !pac_huge_slabs_supported()) {
+		malloc_printf("<jemalloc>: huge_slabs not supported in the "
+		    "current configuration; %s.",
+		    opt_abort_conf ? "aborting" : "disabling");
+		if (opt_abort_conf) {
+			malloc_abort_invalid_conf();
+		} else {
+			opt_huge_slabs = false;
+		}
+	}
 	if (arena_boot(&sc_data, b0get(), opt_hpa)) {
 		return true;
 	}
@@ -1925,6 +2193,9 @@ malloc_init_hard_a0_locked(void) {
 		return true;
 	}
 	hook_boot();
+	if (mem_limit_boot()) {
+		return true;
+	}
 	/*
 	 * Create enough scaffolding to allow recursive allocation in
 	 * malloc_ncpus().
@@ -2885,8 +3156,9 @@ je_calloc(size_t num, size_t size) {
 	return ret;
 }
 
-JEMALLOC_ALWAYS_INLINE void
-ifree(tsd_t *tsd, void *ptr, tcache_t *tcache, bool slow_path) {
+/* Returns the usize freed; triggering the dalloc event is up to the caller. */
+JEMALLOC_ALWAYS_INLINE size_t
+ifree_no_event(tsd_t *tsd, void *ptr, tcache_t *tcache, bool slow_path) {
 	if (!slow_path) {
 		tsd_assert_fast(tsd);
 	}
@@ -2918,6 +3190,12 @@ ifree(tsd_t *tsd, void *ptr, tcache_t *tcache, bool slow_path) {
 		idalloctm(tsd_tsdn(tsd), ptr, tcache, &alloc_ctx, false,
 		    true);
 	}
+	return usize;
+}
+
+JEMALLOC_ALWAYS_INLINE void
+ifree(tsd_t *tsd, void *ptr, tcache_t *tcache, bool slow_path) {
+	size_t usize = ifree_no_event(tsd, ptr, tcache, slow_path);
 	thread_dalloc_event(tsd, usize);
 }
 
@@ -3473,7 +3751,21 @@ do_rallocx(void *ptr, size_t size, int flags, bool is_realloc) {
 
 	hook_ralloc_args_t hook_args = {is_realloc, {(uintptr_t)ptr, size,
 		flags, 0}};
-	if (config_prof && opt_prof) {
+	if (unlikely(MALLOCX_DEFRAG_GET(flags)) && alloc_ctx.slab
+	    && sz_size2index(usize) == alloc_ctx.szind) {
+		/*
+		 * Moves within the bin shard of ptr (bypassing the tcache and
+		 * ignoring any arena in flags), or not at all.  Slab regions
+		 * are never sampled, so there's no profiling to update.
+		 */
+		p = arena_ralloc_defrag(tsd_tsdn(tsd), ptr, usize, &hook_args);
+		if (p == ptr) {
+			/* Nothing was allocated or freed. */
+			UTRACE(ptr, size, p);
+			check_entry_exit_locking(tsd_tsdn(tsd));
+			return p;
+		}
+	} else if (config_prof && opt_prof) {
 		p = irallocx_prof(tsd, ptr, old_usize, size, alignment, usize,
 		    zero, tcache, arena, &alloc_ctx, &hook_args);
 		if (unlikely(p == NULL)) {
@@ -4073,7 +4365,18 @@ batch_alloc(void **ptrs, size_t num, size_t size, int flags) {
 
 	size_t filled = 0;
 
-	if (unlikely(tsd == NULL || tsd_reentrancy_level_get(tsd) > 0)) {
+	if (unlikely(tsd == NULL)) {
+		goto label_done;
+	}
+	if (unlikely(tsd_reentrancy_level_get(tsd) > 0)) {
+		/* E.g. called from a hook; no bulk filling then. */
+		while (filled < num) {
+			void *p = je_mallocx(size, flags);
+			if (p == NULL) {
+				break;
+			}
+			ptrs[filled++] = p;
+		}
 		goto label_done;
 	}
 
@@ -4198,6 +4501,29 @@ batch_alloc(void **ptrs, size_t num, size_t size, int flags) {
 			}
 		}
 
+		if (unlikely(ind >= SC_NBINS) && progress < batch) {
+			/*
+			 * The tcache holds few large regions, if any; allocate
+			 * the rest of the batch from the arena in one go.
+			 */
+			arena_t *large_arena;
+			if (arena_get_from_ind(tsd, mallocx_arena_get(flags),
+			    &large_arena)) {
+				goto label_done;
+			}
+			size_t n = large_palloc_batch(tsd_tsdn(tsd), large_arena,
+			    usize, alignment <= CACHELINE ? CACHELINE :
+			    alignment, zero, ptrs + filled, batch - progress);
+			if (config_prof && opt_prof) {
+				for (size_t i = 0; i < n; ++i) {
+					prof_tctx_reset_sampled(tsd,
+					    ptrs[filled + i]);
+				}
+			}
+			progress += n;
+			filled += n;
+		}
+
 		/*
 		 * For thread events other than prof sampling, trigger them as
 		 * if there's a single allocation of size (n * usize).  This is
@@ -4208,7 +4534,7 @@ batch_alloc(void **ptrs, size_t num, size_t size, int flags) {
 		 *     were handled individually, but it would do no harm (or
 		 *     even be beneficial) to coalesce the triggerings.
 		 */
-		thread_alloc_event(tsd, progress * usize);
+		thread_alloc_batch_event(tsd, progress, progress * usize);
 
 		if (progress < batch || prof_sample_event) {
 			void *p = je_mallocx(size, flags);
@@ -4228,6 +4554,63 @@ label_done:
 	return filled;
 }
 
+JEMALLOC_EXPORT size_t JEMALLOC_NOTHROW
+je_mallocx_batch(void **ptrs, size_t num, size_t size, int flags) {
+	LOG("core.mallocx_batch.entry",
+	    "ptrs: %p, num: %zu, size: %zu, flags: %d", ptrs, num, size, flags);
+
+	size_t filled = 0;
+	if (likely(!malloc_init())) {
+		filled = batch_alloc(ptrs, num, size, flags);
+	}
+
+	LOG("core.mallocx_batch.exit", "result: %zu", filled);
+	return filled;
+}
+
+JEMALLOC_EXPORT void JEMALLOC_NOTHROW
+je_dallocx_batch(void **ptrs, size_t num, int flags) {
+	LOG("core.dallocx_batch.entry", "ptrs: %p, num: %zu, flags: %d", ptrs,
+	    num, flags);
+
+	if (num == 0) {
+		LOG("core.dallocx_batch.exit", "");
+		return;
+	}
+	assert(malloc_initialized() || IS_INITIALIZER);
+
+	tsd_t *tsd = tsd_fetch_min();
+	bool fast = tsd_fast(tsd);
+	check_entry_exit_locking(tsd_tsdn(tsd));
+
+	unsigned tcache_ind = mallocx_tcache_get(flags);
+	tcache_t *tcache = tcache_get_from_ind(tsd, tcache_ind, !fast,
+	    /* is_alloc */ false);
+
+	/*
+	 * The tcache bins fill up and get flushed in bulk as usual; only the
+	 * entry overhead and the thread event are shared by the whole batch.
+	 */
+	size_t usize = 0;
+	for (size_t i = 0; i < num; i++) {
+		void *ptr = ptrs[i];
+		assert(ptr != NULL);
+		UTRACE(ptr, 0, 0);
+		if (likely(fast)) {
+			tsd_assert_fast(tsd);
+			usize += ifree_no_event(tsd, ptr, tcache, false);
+		} else {
+			uintptr_t args_raw[3] = {(uintptr_t)ptr, flags};
+			hook_invoke_dalloc(hook_dalloc_dallocx, ptr, args_raw);
+			usize += ifree_no_event(tsd, ptr, tcache, true);
+		}
+	}
+	thread_dalloc_batch_event(tsd, num, usize);
+	check_entry_exit_locking(tsd_tsdn(tsd));
+
+	LOG("core.dallocx_batch.exit", "");
+}
+
 /*
  * End non-standard functions.
  */
@@ -4293,6 +4676,7 @@ _malloc_prefork(void)
 	if (have_background_thread) {
 		background_thread_prefork1(tsd_tsdn(tsd));
 	}
+	mem_limit_prefork(tsd_tsdn(tsd));
 	/* Break arena prefork into stages to preserve lock order. */
 	for (i = 0; i < 9; i++) {
 		for (j = 0; j < narenas; j++) {
@@ -4334,6 +4718,7 @@ _malloc_prefork(void)
 	}
 	prof_prefork1(tsd_tsdn(tsd));
 	stats_prefork(tsd_tsdn(tsd));
+	alloc_tag_prefork(tsd_tsdn(tsd));
 	tsd_prefork(tsd);
 }
 
@@ -4361,6 +4746,7 @@ _malloc_postfork(void)
 
 	witness_postfork_parent(tsd_witness_tsdp_get(tsd));
 	/* Release all mutexes, now that fork() has completed. */
+	alloc_tag_postfork_parent(tsd_tsdn(tsd));
 	stats_postfork_parent(tsd_tsdn(tsd));
 	for (i = 0, narenas = narenas_total_get(); i < narenas; i++) {
 		arena_t *arena;
@@ -4369,6 +4755,7 @@ _malloc_postfork(void)
 			arena_postfork_parent(tsd_tsdn(tsd), arena);
 		}
 	}
+	mem_limit_postfork_parent(tsd_tsdn(tsd));
 	prof_postfork_parent(tsd_tsdn(tsd));
 	if (have_background_thread) {
 		background_thread_postfork_parent(tsd_tsdn(tsd));
@@ -4391,6 +4778,7 @@ jemalloc_postfork_child(void) {
 
 	witness_postfork_child(tsd_witness_tsdp_get(tsd));
 	/* Release all mutexes, now that fork() has completed. */
+	alloc_tag_postfork_child(tsd_tsdn(tsd));
 	stats_postfork_child(tsd_tsdn(tsd));
 	for (i = 0, narenas = narenas_total_get(); i < narenas; i++) {
 		arena_t *arena;
@@ -4399,6 +4787,7 @@ jemalloc_postfork_child(void) {
 			arena_postfork_child(tsd_tsdn(tsd), arena);
 		}
 	}
+	mem_limit_postfork_child(tsd_tsdn(tsd));
 	prof_postfork_child(tsd_tsdn(tsd));
 	if (have_background_thread) {
 		background_thread_postfork_child(tsd_tsdn(tsd));
@@ -51,6 +51,52 @@ large_palloc(tsdn_t *tsdn, arena_t *arena, size_t usize, size_t alignment,
 	return edata_addr_get(edata);
 }
 
+/*
+ * Allocates up to num large regions of the same size, and returns how many it
+ * did.  The arena choice and the bookkeeping are done once for all of them.
+ */
+size_t
+large_palloc_batch(tsdn_t *tsdn, arena_t *arena, size_t usize,
+    size_t alignment, bool zero, void **ptrs, size_t num) {
+	assert(!tsdn_null(tsdn));
+
+	size_t ausize = sz_sa2u(usize, alignment);
+	if (unlikely(ausize == 0 || ausize > SC_LARGE_MAXCLASS)) {
+		return 0;
+	}
+	arena = arena_choose_maybe_huge(tsdn_tsd(tsdn), arena, usize);
+	if (unlikely(arena == NULL)) {
+		return 0;
+	}
+
+	edata_list_active_t edatas;
+	edata_list_active_init(&edatas);
+	size_t filled;
+	for (filled = 0; filled < num; filled++) {
+		edata_t *edata = arena_extent_alloc_large(tsdn, arena, usize,
+		    alignment, zero);
+		if (edata == NULL) {
+			break;
+		}
+		ptrs[filled] = edata_addr_get(edata);
+		if (!arena_is_auto(arena)) {
+			edata_list_active_append(&edatas, edata);
+		}
+	}
+
+	if (filled == 0) {
+		return 0;
+	}
+	/* See comments in arena_bin_slabs_full_insert(). */
+	if (!arena_is_auto(arena)) {
+		malloc_mutex_lock(tsdn, &arena->large_mtx);
+		edata_list_active_concat(&arena->large, &edatas);
+		malloc_mutex_unlock(tsdn, &arena->large_mtx);
+	}
+	arena_decay_ticks(tsdn, arena, (unsigned)filled);
+	return filled;
+}
+
 static bool
 large_ralloc_no_move_shrink(tsdn_t *tsdn, edata_t *edata, size_t usize) {
 	arena_t *arena = arena_get_from_edata(edata);
@@ -65,9 +111,11 @@ large_ralloc_no_move_shrink(tsdn_t *tsdn, edata_t *edata, size_t usize) {
 	}
 
 	bool deferred_work_generated = false;
-	bool err = pa_shrink(tsdn, &arena->pa_shard, edata, old_size,
+	arena_edata_release(arena, edata);
+	bool err = pa_shrink(tsdn, arena_pa_shard_get(arena), edata, old_size,
 	    usize + sz_large_pad, sz_size2index(usize),
 	    &deferred_work_generated);
+	arena_edata_adopt(arena, edata);
 	if (err) {
 		return true;
 	}
@@ -91,8 +139,10 @@ large_ralloc_no_move_expand(tsdn_t *tsdn, edata_t *edata, size_t usize,
 	szind_t szind = sz_size2index(usize);
 
 	bool deferred_work_generated = false;
-	bool err = pa_expand(tsdn, &arena->pa_shard, edata, old_size, new_size,
-	    szind, zero, &deferred_work_generated);
+	arena_edata_release(arena, edata);
+	bool err = pa_expand(tsdn, arena_pa_shard_get(arena), edata, old_size,
+	    new_size, szind, zero, &deferred_work_generated);
+	arena_edata_adopt(arena, edata);
 
 	if (deferred_work_generated) {
 		arena_handle_deferred_work(tsdn, arena);
@@ -250,7 +300,9 @@ large_dalloc_prep_impl(tsdn_t *tsdn, arena_t *arena, edata_t *edata,
 static void
 large_dalloc_finish_impl(tsdn_t *tsdn, arena_t *arena, edata_t *edata) {
 	bool deferred_work_generated = false;
-	pa_dalloc(tsdn, &arena->pa_shard, edata, &deferred_work_generated);
+	arena_edata_release(arena, edata);
+	pa_dalloc(tsdn, arena_pa_shard_get(arena), edata,
+	    &deferred_work_generated);
 	if (deferred_work_generated) {
 		arena_handle_deferred_work(tsdn, arena);
 	}
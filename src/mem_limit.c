@@ -0,0 +1,202 @@
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/jemalloc_internal_includes.h"
+
+#include "jemalloc/internal/assert.h"
+#include "jemalloc/internal/mem_limit.h"
+#include "jemalloc/internal/mutex.h"
+
+size_t opt_mem_limit = 0;
+bool opt_mem_limit_fail = false;
+
+atomic_zu_t mem_limit;
+
+/* Logically a mem_limit_hook_t. */
+static atomic_p_t mem_limit_hook;
+
+/* Serializes the reclaims, so that threads under pressure don't all purge. */
+static malloc_mutex_t mem_limit_mtx;
+
+/*
+ * The usage as of the last time it was computed, and the bytes of new pages
+ * checked since.  Frees aren't accounted for, so their sum can only overstate
+ * the usage; that's enough to skip computing it while far from the limit.
+ */
+static atomic_zu_t mem_limit_usage_last;
+static atomic_zu_t mem_limit_nbytes_since;
+
+/*
+ * Advanced by every reclaim; the thread caches flush themselves when they see
+ * it change.  The second one tracks the last epoch whose shared caches have
+ * been flushed.
+ */
+static atomic_u_t mem_limit_flush_epoch;
+static atomic_u_t mem_limit_flush_epoch_shared;
+
+bool
+mem_limit_boot(void) {
+	if (malloc_mutex_init(&mem_limit_mtx, "mem_limit",
+	    WITNESS_RANK_MEM_LIMIT, malloc_mutex_rank_exclusive)) {
+		return true;
+	}
+	atomic_store_p(&mem_limit_hook, NULL, ATOMIC_RELAXED);
+	atomic_store_zu(&mem_limit_usage_last, 0, ATOMIC_RELAXED);
+	atomic_store_zu(&mem_limit_nbytes_since, 0, ATOMIC_RELAXED);
+	atomic_store_u(&mem_limit_flush_epoch, 0, ATOMIC_RELAXED);
+	atomic_store_u(&mem_limit_flush_epoch_shared, 0, ATOMIC_RELAXED);
+	atomic_store_zu(&mem_limit, opt_mem_limit, ATOMIC_RELAXED);
+	return false;
+}
+
+void
+mem_limit_set(size_t limit) {
+	/* Force the next check to compute the usage. */
+	atomic_store_zu(&mem_limit_usage_last, SIZE_MAX / 2, ATOMIC_RELAXED);
+	atomic_store_zu(&mem_limit, limit, ATOMIC_RELAXED);
+}
+
+mem_limit_hook_t
+mem_limit_hook_get(void) {
+	return (mem_limit_hook_t)atomic_load_p(&mem_limit_hook,
+	    ATOMIC_ACQUIRE);
+}
+
+void
+mem_limit_hook_set(mem_limit_hook_t hook) {
+	atomic_store_p(&mem_limit_hook, hook, ATOMIC_RELEASE);
+}
+
+/* Also returns the number of those bytes that a reclaim could free. */
+static size_t
+mem_limit_usage_compute(tsdn_t *tsdn, size_t *reclaimable) {
+	size_t nactive = 0;
+	size_t ndirty = 0;
+	size_t nmuzzy = 0;
+	unsigned narenas = narenas_total_get();
+	for (unsigned i = 0; i < narenas; i++) {
+		arena_t *arena = arena_get(tsdn, i, false);
+		if (arena != NULL) {
+			pa_shard_basic_stats_merge(&arena->pa_shard, &nactive,
+			    &ndirty, &nmuzzy);
+		}
+	}
+	if (reclaimable != NULL) {
+		*reclaimable = (ndirty + nmuzzy) << LG_PAGE;
+	}
+	return (nactive + ndirty + nmuzzy) << LG_PAGE;
+}
+
+size_t
+mem_limit_usage(tsdn_t *tsdn) {
+	return mem_limit_usage_compute(tsdn, NULL);
+}
+
+static size_t
+mem_limit_usage_update(tsdn_t *tsdn, size_t *reclaimable) {
+	size_t usage = mem_limit_usage_compute(tsdn, reclaimable);
+	atomic_store_zu(&mem_limit_nbytes_since, 0, ATOMIC_RELAXED);
+	atomic_store_zu(&mem_limit_usage_last, usage, ATOMIC_RELAXED);
+	return usage;
+}
+
+static void
+mem_limit_reclaim(tsdn_t *tsdn) {
+	malloc_mutex_assert_owner(tsdn, &mem_limit_mtx);
+
+	atomic_fetch_add_u(&mem_limit_flush_epoch, 1, ATOMIC_RELEASE);
+	unsigned narenas = narenas_total_get();
+	for (unsigned i = 0; i < narenas; i++) {
+		arena_t *arena = arena_get(tsdn, i, false);
+		if (arena != NULL) {
+			/* Flushes the SEC too. */
+			arena_decay(tsdn, arena, /* is_background_thread */ false,
+			    /* all */ true);
+			pa_shard_purge_all(tsdn, &arena->pa_shard);
+		}
+	}
+}
+
+bool
+mem_limit_alloc_check_hard(tsdn_t *tsdn, size_t size) {
+	witness_assert_depth_to_rank(tsdn_witness_tsdp_get(tsdn),
+	    WITNESS_RANK_CORE, 0);
+	/*
+	 * Nothing to do during bootstrapping, or for the allocations made
+	 * while already reclaiming (e.g. by extent hooks) or running the hook.
+	 */
+	if (tsdn_null(tsdn) || tsd_reentrancy_level_get(tsdn_tsd(tsdn)) > 0) {
+		return false;
+	}
+	size_t limit = mem_limit_get();
+	if (limit == 0) {
+		return false;
+	}
+	size_t nbytes_since = atomic_fetch_add_zu(&mem_limit_nbytes_since,
+	    size, ATOMIC_RELAXED) + size;
+	if (atomic_load_zu(&mem_limit_usage_last, ATOMIC_RELAXED) +
+	    nbytes_since <= limit) {
+		return false;
+	}
+	size_t reclaimable;
+	size_t usage = mem_limit_usage_update(tsdn, &reclaimable);
+	if (usage + size <= limit) {
+		return false;
+	}
+
+	if (reclaimable > 0) {
+		malloc_mutex_lock(tsdn, &mem_limit_mtx);
+		/* Another thread may have reclaimed while we waited. */
+		usage = mem_limit_usage_update(tsdn, &reclaimable);
+		if (usage + size > limit && reclaimable > 0) {
+			mem_limit_reclaim(tsdn);
+			usage = mem_limit_usage_update(tsdn, NULL);
+		}
+		malloc_mutex_unlock(tsdn, &mem_limit_mtx);
+		if (usage + size <= limit) {
+			return false;
+		}
+	}
+
+	mem_limit_hook_t hook = mem_limit_hook_get();
+	if (hook != NULL) {
+		tsd_t *tsd = tsdn_tsd(tsdn);
+		pre_reentrancy(tsd, NULL);
+		hook(limit, usage + size);
+		post_reentrancy(tsd);
+	}
+	return opt_mem_limit_fail;
+}
+
+unsigned
+mem_limit_flush_epoch_get(void) {
+	return atomic_load_u(&mem_limit_flush_epoch, ATOMIC_ACQUIRE);
+}
+
+bool
+mem_limit_flush_check(unsigned *epoch, bool *shared) {
+	unsigned cur = mem_limit_flush_epoch_get();
+	if (*epoch == cur) {
+		return false;
+	}
+	*epoch = cur;
+	unsigned flushed = atomic_load_u(&mem_limit_flush_epoch_shared,
+	    ATOMIC_RELAXED);
+	*shared = (flushed != cur && atomic_compare_exchange_strong_u(
+	    &mem_limit_flush_epoch_shared, &flushed, cur, ATOMIC_RELAXED,
+	    ATOMIC_RELAXED));
+	return true;
+}
+
+void
+mem_limit_prefork(tsdn_t *tsdn) {
+	malloc_mutex_prefork(tsdn, &mem_limit_mtx);
+}
+
+void
+mem_limit_postfork_parent(tsdn_t *tsdn) {
+	malloc_mutex_postfork_parent(tsdn, &mem_limit_mtx);
+}
+
+void
+mem_limit_postfork_child(tsdn_t *tsdn) {
+	malloc_mutex_postfork_child(tsdn, &mem_limit_mtx);
+}
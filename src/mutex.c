@@ -9,6 +9,20 @@
 #define _CRT_SPINCOUNT 4000
 #endif
 
+#ifdef JEMALLOC_FUTEX_LOCK
+#include <linux/futex.h>
+
+/*
+ * Spin budget bounds of malloc_mutex_lock_slow(); the budget is twice the
+ * recent average number of spins that got the lock, plus the minimum.
+ */
+#define MUTEX_SPIN_MIN 16
+/* The average moves by 1/2^MUTEX_SPIN_AVG_LG_WEIGHT of each sample. */
+#define MUTEX_SPIN_AVG_LG_WEIGHT 3
+/* Futex wakeups without getting the lock before asking for a handoff. */
+#define MUTEX_FUTEX_STARVE_WAKEUPS 4
+#endif
+
 /*
  * Based on benchmark results, a fixed spin with this amount of retries works
  * well for our critical sections.
@@ -48,6 +62,134 @@ JEMALLOC_EXPORT int	_pthread_mutex_init_calloc_cb(pthread_mutex_t *mutex,
     void *(calloc_cb)(size_t, size_t));
 #endif
 
+#ifdef JEMALLOC_FUTEX_LOCK
+int
+malloc_futex_wait(atomic_u32_t *addr, uint32_t val,
+    const struct timespec *abstime) {
+	long ret;
+	if (abstime == NULL) {
+		ret = syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT_PRIVATE,
+		    val, NULL, NULL, 0);
+	} else {
+		ret = syscall(SYS_futex, (uint32_t *)addr,
+		    FUTEX_WAIT_BITSET_PRIVATE | FUTEX_CLOCK_REALTIME, val,
+		    abstime, NULL, FUTEX_BITSET_MATCH_ANY);
+	}
+	if (ret != 0 && errno == ETIMEDOUT) {
+		return ETIMEDOUT;
+	}
+	/* Woken up, interrupted, or *addr != val to begin with. */
+	return 0;
+}
+
+void
+malloc_futex_wake(atomic_u32_t *addr, int nwake) {
+	syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE_PRIVATE, nwake, NULL,
+	    NULL, 0);
+}
+
+void
+malloc_mutex_futex_lock(malloc_mutex_t *mutex) {
+	uint32_t expected = malloc_mutex_futex_unlocked;
+	if (atomic_compare_exchange_strong_u32(&mutex->lock, &expected,
+	    malloc_mutex_futex_locked, ATOMIC_ACQUIRE, ATOMIC_RELAXED)) {
+		return;
+	}
+
+	unsigned nwakeups = 0;
+	bool starving = false;
+	while (true) {
+		uint32_t cur = atomic_load_u32(&mutex->lock, ATOMIC_RELAXED);
+		if (cur == malloc_mutex_futex_unlocked) {
+			/*
+			 * Others may be asleep still, so leave the lock marked
+			 * contended for our unlock to wake them up.
+			 */
+			if (atomic_compare_exchange_weak_u32(&mutex->lock, &cur,
+			    malloc_mutex_futex_contended, ATOMIC_ACQUIRE,
+			    ATOMIC_RELAXED)) {
+				break;
+			}
+			continue;
+		}
+		if (cur == malloc_mutex_futex_handoff) {
+			if (starving) {
+				if (!malloc_mutex_futex_handoff_take(mutex)) {
+					break;
+				}
+				continue;
+			}
+			/* The handoff is for the starving; wait it out. */
+		} else if (cur == malloc_mutex_futex_locked) {
+			if (!atomic_compare_exchange_weak_u32(&mutex->lock,
+			    &cur, malloc_mutex_futex_contended, ATOMIC_RELAXED,
+			    ATOMIC_RELAXED)) {
+				continue;
+			}
+			cur = malloc_mutex_futex_contended;
+		}
+		malloc_futex_wait(&mutex->lock, cur, NULL);
+		if (!starving && ++nwakeups >= MUTEX_FUTEX_STARVE_WAKEUPS) {
+			/* Stop losing the lock to spinners. */
+			starving = true;
+			atomic_fetch_add_u32(&mutex->nstarving, 1,
+			    ATOMIC_RELAXED);
+		}
+	}
+	if (starving) {
+		atomic_fetch_sub_u32(&mutex->nstarving, 1, ATOMIC_RELAXED);
+	}
+}
+
+static int64_t
+mutex_spin_budget(malloc_mutex_t *mutex) {
+	if (opt_mutex_max_spin == -1) {
+		return -1;
+	}
+	int64_t budget = 2 * (int64_t)atomic_load_u32(&mutex->spin_avg,
+	    ATOMIC_RELAXED) + MUTEX_SPIN_MIN;
+	return budget < opt_mutex_max_spin ? budget : opt_mutex_max_spin;
+}
+
+/*
+ * Lock-free and racy, since losing an update only makes the average a bit
+ * off.
+ */
+static void
+mutex_spin_avg_update(malloc_mutex_t *mutex, uint32_t nspins) {
+	uint32_t avg = atomic_load_u32(&mutex->spin_avg, ATOMIC_RELAXED);
+	int64_t delta = ((int64_t)nspins - (int64_t)avg) /
+	    (1 << MUTEX_SPIN_AVG_LG_WEIGHT);
+	if (delta != 0) {
+		atomic_store_u32(&mutex->spin_avg, (uint32_t)(avg + delta),
+		    ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * With starving waiters, unlock hands the lock off to them rather than
+ * releasing it, so there is nothing left to spin for.
+ */
+static bool
+mutex_spin_futile(malloc_mutex_t *mutex) {
+	return atomic_load_u32(&mutex->nstarving, ATOMIC_RELAXED) != 0;
+}
+#else
+static int64_t
+mutex_spin_budget(malloc_mutex_t *mutex) {
+	return opt_mutex_max_spin;
+}
+
+static void
+mutex_spin_avg_update(malloc_mutex_t *mutex, uint32_t nspins) {
+}
+
+static bool
+mutex_spin_futile(malloc_mutex_t *mutex) {
+	return false;
+}
+#endif
+
 void
 malloc_mutex_lock_slow(malloc_mutex_t *mutex) {
 	mutex_prof_data_t *data = &mutex->prof_data;
@@ -57,15 +199,26 @@ malloc_mutex_lock_slow(malloc_mutex_t *mutex) {
 		goto label_spin_done;
 	}
 
+	int64_t spin_budget = mutex_spin_budget(mutex);
 	int cnt = 0;
+	bool futile = false;
 	do {
 		spin_cpu_spinwait();
 		if (!atomic_load_b(&mutex->locked, ATOMIC_RELAXED)
                     && !malloc_mutex_trylock_final(mutex)) {
 			data->n_spin_acquired++;
+			mutex_spin_avg_update(mutex, (uint32_t)cnt);
 			return;
 		}
-	} while (cnt++ < opt_mutex_max_spin || opt_mutex_max_spin == -1);
+		futile = mutex_spin_futile(mutex);
+	} while (!futile && (cnt++ < spin_budget || spin_budget == -1));
+	/*
+	 * Spinning didn't pay off this time; spin less next time.  Spinning cut
+	 * short by a handoff says nothing about that, so leave the average be.
+	 */
+	if (!futile) {
+		mutex_spin_avg_update(mutex, 0);
+	}
 
 	if (!config_stats) {
 		/* Only spin is useful when stats is off. */
@@ -151,6 +304,11 @@ malloc_mutex_init(malloc_mutex_t *mutex, const char *name,
 #  endif
 #elif (defined(JEMALLOC_OS_UNFAIR_LOCK))
        mutex->lock = OS_UNFAIR_LOCK_INIT;
+#elif (defined(JEMALLOC_FUTEX_LOCK))
+	atomic_store_u32(&mutex->lock, malloc_mutex_futex_unlocked,
+	    ATOMIC_RELAXED);
+	atomic_store_u32(&mutex->nstarving, 0, ATOMIC_RELAXED);
+	atomic_store_u32(&mutex->spin_avg, 0, ATOMIC_RELAXED);
 #elif (defined(JEMALLOC_MUTEX_INIT_CB))
 	if (postpone_init) {
 		mutex->postponed_next = postponed_mutexes;
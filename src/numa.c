@@ -0,0 +1,187 @@
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/jemalloc_internal_includes.h"
+
+#include "jemalloc/internal/assert.h"
+#include "jemalloc/internal/malloc_io.h"
+#include "jemalloc/internal/numa.h"
+
+/* From <numaif.h>, which we don't want to depend on. */
+#define NUMA_MPOL_PREFERRED 1
+
+#define NUMA_SYSFS_NODE_DIR "/sys/devices/system/node/"
+
+bool opt_numa_arena = false;
+
+/* Ids of the online nodes, in increasing order. */
+static int numa_nodes[NUMA_NNODES_MAX];
+static unsigned numa_nnodes;
+/* Index into numa_nodes of the node of each CPU; -1 if unknown. */
+static int8_t numa_cpu_node_inds[NUMA_NCPUS_MAX];
+
+/* Reads a (small) sysfs file as a string.  Returns true on error. */
+static bool
+numa_sysfs_read(const char *path, char *buf, size_t buf_size) {
+#if defined(O_CLOEXEC)
+	int fd = malloc_open(path, O_RDONLY | O_CLOEXEC);
+#else
+	int fd = malloc_open(path, O_RDONLY);
+#endif
+	if (fd == -1) {
+		return true;
+	}
+	ssize_t nread = malloc_read_fd(fd, buf, buf_size - 1);
+	malloc_close(fd);
+	/* Treat truncation as an error too. */
+	if (nread <= 0 || (size_t)nread == buf_size - 1) {
+		return true;
+	}
+	buf[nread] = '\0';
+	return false;
+}
+
+/*
+ * Parses the next element of a sysfs list such as "0-3,8-11" into [*first,
+ * *last].  Returns true on error or at the end of the list.
+ */
+static bool
+numa_list_next(const char **list, unsigned *first, unsigned *last) {
+	const char *s = *list;
+	if (*s == ',') {
+		s++;
+	}
+	if (*s < '0' || *s > '9') {
+		return true;
+	}
+	char *end;
+	uintmax_t a = malloc_strtoumax(s, &end, 10);
+	uintmax_t b = a;
+	if (*end == '-') {
+		b = malloc_strtoumax(end + 1, &end, 10);
+	}
+	if (b < a || b > UINT_MAX) {
+		return true;
+	}
+	*first = (unsigned)a;
+	*last = (unsigned)b;
+	*list = end;
+	return false;
+}
+
+static bool
+numa_topology_read(void) {
+	char buf[4096];
+	unsigned first, last;
+
+	if (numa_sysfs_read(NUMA_SYSFS_NODE_DIR "online", buf, sizeof(buf))) {
+		return true;
+	}
+	numa_nnodes = 0;
+	for (const char *list = buf; !numa_list_next(&list, &first, &last);) {
+		if (last >= (unsigned)NUMA_NNODES_MAX) {
+			return true;
+		}
+		for (unsigned node = first; node <= last; node++) {
+			numa_nodes[numa_nnodes++] = (int)node;
+		}
+	}
+	if (numa_nnodes == 0) {
+		return true;
+	}
+
+	memset(numa_cpu_node_inds, -1, sizeof(numa_cpu_node_inds));
+	for (unsigned i = 0; i < numa_nnodes; i++) {
+		char path[64];
+		malloc_snprintf(path, sizeof(path), NUMA_SYSFS_NODE_DIR
+		    "node%d/cpulist", numa_nodes[i]);
+		if (numa_sysfs_read(path, buf, sizeof(buf))) {
+			return true;
+		}
+		/* Memory-only nodes have an empty CPU list. */
+		for (const char *list = buf; !numa_list_next(&list, &first,
+		    &last);) {
+			for (unsigned cpu = first; cpu <= last &&
+			    cpu < NUMA_NCPUS_MAX; cpu++) {
+				numa_cpu_node_inds[cpu] = (int8_t)i;
+			}
+		}
+	}
+	return false;
+}
+
+void
+numa_boot(void) {
+	if (!opt_numa_arena) {
+		return;
+	}
+	if (!have_numa_arena || numa_topology_read()) {
+		malloc_write("<jemalloc>: numa_arena not supported on this "
+		    "system (requires mbind and the sysfs node topology)\n");
+		if (opt_abort) {
+			abort();
+		}
+		opt_numa_arena = false;
+	}
+}
+
+unsigned
+numa_nnodes_get(void) {
+	assert(opt_numa_arena);
+	return numa_nnodes;
+}
+
+int
+numa_arena_node(unsigned ind) {
+	if (!opt_numa_arena) {
+		return NUMA_NODE_NONE;
+	}
+	int node_ind;
+	if (opt_percpu_arena != percpu_arena_disabled) {
+		/*
+		 * Arena ind serves CPU ind (and with per_phycpu_arena, its
+		 * hyper thread sibling, which is on the same node).  Note that
+		 * this may run before opt_percpu_arena is fully initialized.
+		 */
+		node_ind = (ind < NUMA_NCPUS_MAX) ? numa_cpu_node_inds[ind] :
+		    -1;
+		if (node_ind < 0) {
+			return NUMA_NODE_NONE;
+		}
+	} else {
+		node_ind = (int)(ind % numa_nnodes);
+	}
+	return numa_nodes[node_ind];
+}
+
+int
+numa_current_node_ind(void) {
+	assert(opt_numa_arena);
+#ifdef JEMALLOC_NUMA_ARENA
+	malloc_cpuid_t cpu = malloc_getcpu();
+	if (cpu < 0 || cpu >= NUMA_NCPUS_MAX) {
+		return -1;
+	}
+	return numa_cpu_node_inds[cpu];
+#else
+	not_reached();
+	return -1;
+#endif
+}
+
+void
+numa_bind(void *addr, size_t size, int node) {
+	assert(opt_numa_arena);
+	assert(node >= 0 && node < NUMA_NNODES_MAX);
+	assert(PAGE_ADDR2BASE(addr) == addr);
+#ifdef JEMALLOC_NUMA_ARENA
+	unsigned long nodemask = 1UL << node;
+	/*
+	 * The policy is only a preference, so there's nothing to do on failure
+	 * (e.g. if mbind is disallowed by a seccomp filter); the pages then
+	 * simply follow the default (local) policy.
+	 */
+	syscall(SYS_mbind, addr, size, NUMA_MPOL_PREFERRED, &nodemask,
+	    NUMA_NNODES_MAX + 1, 0);
+#else
+	not_reached();
+#endif
+}
@@ -71,6 +71,7 @@ pa_shard_enable_hpa(tsdn_t *tsdn, pa_shard_t *shard,
 	    shard->base, &shard->edata_cache, shard->ind, hpa_opts)) {
 		return true;
 	}
+	shard->hpa_shard.numa_node = shard->pac.numa_node;
 	if (sec_init(tsdn, &shard->hpa_sec, shard->base, &shard->hpa_shard.pai,
 	    hpa_sec_opts)) {
 		return true;
@@ -247,6 +248,22 @@ pa_shard_do_deferred_work(tsdn_t *tsdn, pa_shard_t *shard) {
 	}
 }
 
+void
+pa_shard_pressure_set(tsdn_t *tsdn, pa_shard_t *shard, unsigned lg_div,
+    pac_purge_eagerness_t eagerness) {
+	pac_pressure_set(tsdn, &shard->pac, lg_div, eagerness);
+	if (shard->ever_used_hpa) {
+		hpa_shard_pressure_set(tsdn, &shard->hpa_shard, lg_div);
+	}
+}
+
+void
+pa_shard_purge_all(tsdn_t *tsdn, pa_shard_t *shard) {
+	if (shard->ever_used_hpa) {
+		hpa_shard_purge_all(tsdn, &shard->hpa_shard);
+	}
+}
+
 /*
  * Get time until next deferred work ought to happen. If there are multiple
  * things that have been deferred, this function calculates the time until
@@ -1,6 +1,7 @@
 #include "jemalloc/internal/jemalloc_preamble.h"
 #include "jemalloc/internal/jemalloc_internal_includes.h"
 
+#include "jemalloc/internal/mem_limit.h"
 #include "jemalloc/internal/pac.h"
 #include "jemalloc/internal/san.h"
 
@@ -15,6 +16,8 @@ static void pac_dalloc_impl(tsdn_t *tsdn, pai_t *self, edata_t *edata,
     bool *deferred_work_generated);
 static uint64_t pac_time_until_deferred_work(tsdn_t *tsdn, pai_t *self);
 
+bool opt_huge_slabs = false;
+
 static inline void
 pac_decay_data_get(pac_t *pac, extent_state_t state,
     decay_t **r_decay, pac_decay_stats_t **r_decay_stats, ecache_t **r_ecache) {
@@ -95,6 +98,7 @@ pac_init(tsdn_t *tsdn, pac_t *pac, base_t *base, emap_t *emap,
 	pac->stats = pac_stats;
 	pac->stats_mtx = stats_mtx;
 	atomic_store_zu(&pac->extent_sn_next, 0, ATOMIC_RELAXED);
+	pac->numa_node = NUMA_NODE_NONE;
 
 	pac->pai.alloc = &pac_alloc_impl;
 	pac->pai.alloc_batch = &pai_alloc_batch_default;
@@ -125,6 +129,15 @@ pac_alloc_real(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks, size_t size,
 		    NULL, size, alignment, zero, guarded);
 	}
 	if (edata == NULL) {
+		/*
+		 * Dirty and muzzy pages already count against the limit, only
+		 * the ones from retained (or newly mapped) are new.  Guarded
+		 * extents are charged in pac_alloc_new_guarded, as this never
+		 * grows for them.
+		 */
+		if (!guarded && mem_limit_alloc_check(tsdn, size)) {
+			return NULL;
+		}
 		edata = ecache_alloc_grow(tsdn, pac, ehooks,
 		    &pac->ecache_retained, NULL, size, alignment, zero,
 		    guarded);
@@ -137,6 +150,32 @@ pac_alloc_real(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks, size_t size,
 	return edata;
 }
 
+/* Sets *over_limit if no new region can be mapped under the mem_limit. */
+static edata_t *
+pac_alloc_slab_region(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks, size_t size,
+    bool zero, bool *over_limit) {
+	edata_t *edata = ecache_alloc_slab_region(tsdn, pac, ehooks,
+	    &pac->ecache_dirty, size, zero);
+	if (edata == NULL && pac_may_have_muzzy(pac)) {
+		edata = ecache_alloc_slab_region(tsdn, pac, ehooks,
+		    &pac->ecache_muzzy, size, zero);
+	}
+	if (edata == NULL) {
+		*over_limit = mem_limit_alloc_check(tsdn, size);
+		if (*over_limit) {
+			return NULL;
+		}
+		edata = extent_alloc_slab_region(tsdn, pac, ehooks, size,
+		    zero);
+		if (config_stats && edata != NULL) {
+			atomic_fetch_add_zu(&pac->stats->pac_mapped, size,
+			    ATOMIC_RELAXED);
+		}
+	}
+
+	return edata;
+}
+
 static edata_t *
 pac_alloc_new_guarded(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks, size_t size,
     size_t alignment, bool zero, bool frequent_reuse) {
@@ -144,6 +183,10 @@ pac_alloc_new_guarded(tsdn_t *tsdn, pac_t *pac, ehooks_t *ehooks, size_t size,
 
 	edata_t *edata;
 	if (san_bump_enabled() && frequent_reuse) {
+		/* Bump allocated extents are always new pages. */
+		if (mem_limit_alloc_check(tsdn, size)) {
+			return NULL;
+		}
 		edata = san_bump_alloc(tsdn, &pac->sba, pac, ehooks, size,
 		    zero);
 	} else {
@@ -172,13 +215,24 @@ pac_alloc_impl(tsdn_t *tsdn, pai_t *self, size_t size, size_t alignment,
 	ehooks_t *ehooks = pac_ehooks_get(pac);
 
 	edata_t *edata = NULL;
+	/* Frequently reused unguarded allocations are slabs. */
+	if (opt_huge_slabs && frequent_reuse && !guarded &&
+	    alignment <= PAGE) {
+		/* Falls back to regular extents if no region can be mapped. */
+		bool over_limit = false;
+		edata = pac_alloc_slab_region(tsdn, pac, ehooks, size, zero,
+		    &over_limit);
+		if (over_limit) {
+			return NULL;
+		}
+	}
 	/*
 	 * The condition is an optimization - not frequently reused guarded
 	 * allocations are never put in the ecache.  pac_alloc_real also
 	 * doesn't grow retained for guarded allocations.  So pac_alloc_real
 	 * for such allocations would always return NULL.
 	 * */
-	if (!guarded || frequent_reuse) {
+	if (edata == NULL && (!guarded || frequent_reuse)) {
 		edata =	pac_alloc_real(tsdn, pac, ehooks, size, alignment,
 		    zero, guarded);
 	}
@@ -210,6 +264,9 @@ pac_expand_impl(tsdn_t *tsdn, pai_t *self, edata_t *edata, size_t old_size,
 		    edata, expand_amount, PAGE, zero, /* guarded*/ false);
 	}
 	if (trail == NULL) {
+		if (mem_limit_alloc_check(tsdn, expand_amount)) {
+			return true;
+		}
 		trail = ecache_alloc_grow(tsdn, pac, ehooks,
 		    &pac->ecache_retained, edata, expand_amount, PAGE, zero,
 		    /* guarded */ false);
@@ -557,7 +614,28 @@ pac_decay_ms_get(pac_t *pac, extent_state_t state) {
 	pac_decay_stats_t *decay_stats;
 	ecache_t *ecache;
 	pac_decay_data_get(pac, state, &decay, &decay_stats, &ecache);
-	return decay_ms_read(decay);
+	return decay_ms_configured_read(decay);
+}
+
+void
+pac_pressure_set(tsdn_t *tsdn, pac_t *pac, unsigned lg_div,
+    pac_purge_eagerness_t eagerness) {
+	extent_state_t states[] = {extent_state_dirty, extent_state_muzzy};
+	nstime_t cur_time;
+	nstime_init_update(&cur_time);
+	for (unsigned i = 0; i < sizeof(states) / sizeof(states[0]); i++) {
+		decay_t *decay;
+		pac_decay_stats_t *decay_stats;
+		ecache_t *ecache;
+		pac_decay_data_get(pac, states[i], &decay, &decay_stats,
+		    &ecache);
+		malloc_mutex_lock(tsdn, &decay->mtx);
+		if (decay_pressure_set(decay, &cur_time, lg_div)) {
+			pac_maybe_decay_purge(tsdn, pac, decay, decay_stats,
+			    ecache, eagerness);
+		}
+		malloc_mutex_unlock(tsdn, &decay->mtx);
+	}
 }
 
 void
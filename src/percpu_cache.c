@@ -0,0 +1,327 @@
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/jemalloc_internal_includes.h"
+
+#include "jemalloc/internal/assert.h"
+#include "jemalloc/internal/percpu_cache.h"
+
+#ifdef JEMALLOC_HAVE_RSEQ
+#  include <linux/membarrier.h>
+#endif
+
+bool opt_percpu_tcache = false;
+bool percpu_cache_enabled = false;
+atomic_p_t percpu_caches[PERCPU_CACHE_NCPUS_MAX];
+
+/* Number of slots of each bin; 0 for bins not cached per CPU. */
+static cache_bin_sz_t percpu_cache_ncached_max[SC_NBINS];
+/* Size of a percpu_cache_t including the stacks of all its bins. */
+static size_t percpu_cache_size;
+/* Serializes percpu_cache_flush_all() calls. */
+static malloc_mutex_t percpu_cache_drain_mtx;
+
+#ifdef JEMALLOC_HAVE_RSEQ
+static int
+percpu_cache_membarrier(int cmd) {
+	return (int)syscall(SYS_membarrier, cmd, 0, 0);
+}
+
+/* Returns the CPU id as published by the kernel in the rseq area. */
+static int32_t
+percpu_cache_cpu_get(void) {
+	int32_t cpu;
+	__asm__ __volatile__("movl %%fs:4(%1), %0"
+	    : "=r" (cpu) : "r" (__rseq_offset));
+	return cpu;
+}
+#endif
+
+static bool
+percpu_cache_usable(void) {
+#ifdef JEMALLOC_HAVE_RSEQ
+	/*
+	 * glibc leaves __rseq_size at 0 when registration is disabled (e.g. via
+	 * the glibc.pthread.rseq tunable), and the kernel publishes a negative
+	 * CPU id for threads that failed to register.
+	 */
+	if (__rseq_size < offsetof(struct rseq, rseq_cs) + sizeof(uint64_t) ||
+	    percpu_cache_cpu_get() < 0) {
+		return false;
+	}
+	return percpu_cache_membarrier(
+	    MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ) == 0;
+#else
+	return false;
+#endif
+}
+
+bool
+percpu_cache_boot(tsdn_t *tsdn,
+    const cache_bin_info_t tcache_bin_info[TCACHE_NBINS_MAX],
+    unsigned tcache_nbins) {
+	/* The rseq critical sections index percpu_caches as a void *[]. */
+	assert(sizeof(atomic_p_t) == sizeof(void *));
+	if (malloc_mutex_init(&percpu_cache_drain_mtx, "percpu_cache_drain",
+	    WITNESS_RANK_PERCPU_CACHE, malloc_mutex_rank_exclusive)) {
+		return true;
+	}
+	if (!opt_percpu_tcache) {
+		return false;
+	}
+	if (!have_rseq || !percpu_cache_usable()) {
+		malloc_printf("<jemalloc>: percpu_tcache not supported on this "
+		    "system (requires rseq and membarrier)\n");
+		if (opt_abort) {
+			abort();
+		}
+		opt_percpu_tcache = false;
+		return false;
+	}
+
+	percpu_cache_size = sizeof(percpu_cache_t);
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		percpu_cache_ncached_max[i] = (i < tcache_nbins) ?
+		    tcache_bin_info[i].ncached_max : 0;
+		percpu_cache_size += percpu_cache_ncached_max[i] *
+		    sizeof(void *);
+	}
+	percpu_cache_enabled = true;
+
+	return false;
+}
+
+static percpu_cache_t *
+percpu_cache_create(tsdn_t *tsdn) {
+	percpu_cache_t *cache = (percpu_cache_t *)base_alloc(tsdn, b0get(),
+	    percpu_cache_size, CACHELINE);
+	if (cache == NULL) {
+		return NULL;
+	}
+	atomic_store_u32(&cache->draining, 0, ATOMIC_RELAXED);
+	void **stack = (void **)((byte_t *)cache + sizeof(percpu_cache_t));
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		percpu_cache_bin_t *bin = &cache->bins[i];
+		bin->full = stack;
+		stack += percpu_cache_ncached_max[i];
+		bin->empty = stack;
+		bin->head = stack;
+	}
+	assert((byte_t *)stack == (byte_t *)cache + percpu_cache_size);
+
+	return cache;
+}
+
+/*
+ * Makes sure the CPU we're (most likely) running on has a cache.  Returns
+ * true if it can't, in which case callers go to the arena directly.
+ */
+static bool
+percpu_cache_prepare(tsdn_t *tsdn) {
+#ifdef JEMALLOC_HAVE_RSEQ
+	int32_t cpu = percpu_cache_cpu_get();
+	if (cpu < 0 || cpu >= PERCPU_CACHE_NCPUS_MAX) {
+		return true;
+	}
+	if (atomic_load_p(&percpu_caches[cpu], ATOMIC_ACQUIRE) != NULL) {
+		return false;
+	}
+	percpu_cache_t *cache = percpu_cache_create(tsdn);
+	if (cache == NULL) {
+		return true;
+	}
+	void *expected = NULL;
+	/*
+	 * Another thread on the same CPU may have won the race (after we got
+	 * preempted); base memory can't be returned, so the loser's cache is
+	 * simply wasted.  This happens at most a handful of times per CPU.
+	 */
+	atomic_compare_exchange_strong_p(&percpu_caches[cpu], &expected, cache,
+	    ATOMIC_RELEASE, ATOMIC_RELAXED);
+	return false;
+#else
+	not_reached();
+	return true;
+#endif
+}
+
+/*
+ * A cache_bin_t on top of a caller provided stack, used to hand batches of
+ * objects to the arena fill / tcache flush logic.  The stack needs
+ * ncached_max + 2 slots; see cache_bin_info_compute_alloc().
+ */
+static void
+percpu_cache_scratch_init(cache_bin_t *scratch, void **stack,
+    cache_bin_sz_t ncached_max) {
+	cache_bin_info_t info;
+	cache_bin_info_init(&info, ncached_max);
+	size_t cur_offset = sizeof(void *);
+	cache_bin_init(scratch, &info, stack, &cur_offset);
+}
+
+void *
+percpu_cache_alloc_hard(tsd_t *tsd, arena_t *arena, szind_t binind) {
+	assert(percpu_cache_enabled);
+	tsdn_t *tsdn = tsd_tsdn(tsd);
+	cache_bin_sz_t ncached_max = percpu_cache_ncached_max[binind];
+	if (ncached_max == 0 || percpu_cache_prepare(tsdn)) {
+		return arena_malloc_hard(tsdn, arena, sz_index2size(binind),
+		    binind, /* zero */ false, /* slab */ true);
+	}
+
+	cache_bin_sz_t nfill = ncached_max >> 1;
+	if (nfill == 0) {
+		nfill = 1;
+	}
+	cache_bin_t scratch;
+	VARIABLE_ARRAY(void *, stack, nfill + 2);
+	percpu_cache_scratch_init(&scratch, stack, nfill);
+	arena_cache_bin_fill_small(tsdn, arena, &scratch, binind,
+	    /* nfill_min */ nfill, /* nfill_max */ nfill);
+
+	bool success;
+	void *ret = cache_bin_alloc(&scratch, &success);
+	if (!success) {
+		return NULL;
+	}
+	void *ptr;
+	while ((ptr = cache_bin_alloc(&scratch, &success)), success) {
+		/* We may have been migrated onto a full or draining CPU. */
+		if (!percpu_cache_dalloc_easy(binind, ptr)) {
+			arena_dalloc_small(tsdn, ptr);
+		}
+	}
+
+	return ret;
+}
+
+static void
+percpu_cache_scratch_flush(tsd_t *tsd, tcache_t *tcache, cache_bin_t *scratch,
+    szind_t binind) {
+	if (cache_bin_ncached_get_local(scratch) == 0) {
+		return;
+	}
+	if (tcache != NULL) {
+		tcache_bin_flush_small(tsd, tcache, scratch, binind, 0);
+		return;
+	}
+	bool success;
+	void *ptr;
+	while ((ptr = cache_bin_alloc(scratch, &success)), success) {
+		arena_dalloc_small(tsd_tsdn(tsd), ptr);
+	}
+}
+
+void
+percpu_cache_dalloc_hard(tsd_t *tsd, tcache_t *tcache, void *ptr,
+    szind_t binind) {
+	assert(percpu_cache_enabled);
+	tsdn_t *tsdn = tsd_tsdn(tsd);
+	cache_bin_sz_t ncached_max = percpu_cache_ncached_max[binind];
+	if (ncached_max == 0 || percpu_cache_prepare(tsdn)) {
+		arena_dalloc_small(tsdn, ptr);
+		return;
+	}
+	/* The cache may have just been created, or we got migrated. */
+	if (percpu_cache_dalloc_easy(binind, ptr)) {
+		return;
+	}
+
+	/* Full; flush the same share of it a tcache bin would. */
+	cache_bin_sz_t nflush = ncached_max -
+	    (ncached_max >> opt_lg_tcache_flush_small_div);
+	cache_bin_t scratch;
+	VARIABLE_ARRAY(void *, stack, nflush + 2);
+	percpu_cache_scratch_init(&scratch, stack, nflush);
+	for (cache_bin_sz_t i = 0; i < nflush; i++) {
+		void *flushed = percpu_cache_alloc_easy(binind);
+		if (flushed == NULL) {
+			break;
+		}
+		bool ret = cache_bin_dalloc_easy(&scratch, flushed);
+		assert(ret);
+	}
+	percpu_cache_scratch_flush(tsd, tcache, &scratch, binind);
+
+	if (!percpu_cache_dalloc_easy(binind, ptr)) {
+		arena_dalloc_small(tsdn, ptr);
+	}
+}
+
+static void
+percpu_cache_drain_bin(tsd_t *tsd, tcache_t *tcache, percpu_cache_bin_t *bin,
+    szind_t binind) {
+	cache_bin_sz_t ncached = (cache_bin_sz_t)(bin->empty - bin->head);
+	if (ncached == 0) {
+		return;
+	}
+	cache_bin_t scratch;
+	VARIABLE_ARRAY(void *, stack, ncached + 2);
+	percpu_cache_scratch_init(&scratch, stack, ncached);
+	while (bin->head != bin->empty) {
+		bool ret = cache_bin_dalloc_easy(&scratch, *bin->head);
+		assert(ret);
+		bin->head++;
+	}
+	percpu_cache_scratch_flush(tsd, tcache, &scratch, binind);
+}
+
+void
+percpu_cache_flush_all(tsd_t *tsd, tcache_t *tcache) {
+	if (!percpu_cache_enabled) {
+		return;
+	}
+#ifdef JEMALLOC_HAVE_RSEQ
+	tsdn_t *tsdn = tsd_tsdn(tsd);
+	malloc_mutex_lock(tsdn, &percpu_cache_drain_mtx);
+	for (unsigned cpu = 0; cpu < PERCPU_CACHE_NCPUS_MAX; cpu++) {
+		percpu_cache_t *cache = atomic_load_p(&percpu_caches[cpu],
+		    ATOMIC_ACQUIRE);
+		if (cache != NULL) {
+			atomic_store_u32(&cache->draining, 1, ATOMIC_RELAXED);
+		}
+	}
+	/*
+	 * Restart the critical sections in flight anywhere in the process;
+	 * every one started afterwards sees the draining flags.
+	 */
+	int err = percpu_cache_membarrier(
+	    MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ);
+	assert(err == 0);
+	(void)err;
+	for (unsigned cpu = 0; cpu < PERCPU_CACHE_NCPUS_MAX; cpu++) {
+		percpu_cache_t *cache = atomic_load_p(&percpu_caches[cpu],
+		    ATOMIC_ACQUIRE);
+		if (cache == NULL) {
+			continue;
+		}
+		for (szind_t i = 0; i < SC_NBINS; i++) {
+			percpu_cache_drain_bin(tsd, tcache, &cache->bins[i], i);
+		}
+		atomic_store_u32(&cache->draining, 0, ATOMIC_RELEASE);
+	}
+	malloc_mutex_unlock(tsdn, &percpu_cache_drain_mtx);
+#endif
+}
+
+void
+percpu_cache_prefork(tsdn_t *tsdn) {
+	malloc_mutex_prefork(tsdn, &percpu_cache_drain_mtx);
+}
+
+void
+percpu_cache_postfork_parent(tsdn_t *tsdn) {
+	malloc_mutex_postfork_parent(tsdn, &percpu_cache_drain_mtx);
+}
+
+void
+percpu_cache_postfork_child(tsdn_t *tsdn) {
+	malloc_mutex_postfork_child(tsdn, &percpu_cache_drain_mtx);
+#ifdef JEMALLOC_HAVE_RSEQ
+	/* The membarrier registration is per mm, and not inherited. */
+	if (percpu_cache_enabled && percpu_cache_membarrier(
+	    MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ) != 0) {
+		malloc_write("<jemalloc>: Error re-registering membarrier "
+		    "after fork\n");
+		abort();
+	}
+#endif
+}
@@ -0,0 +1,306 @@
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/jemalloc_internal_includes.h"
+
+#include "jemalloc/internal/assert.h"
+#include "jemalloc/internal/malloc_io.h"
+#include "jemalloc/internal/pressure.h"
+
+#define PRESSURE_PATH_MAX (PATH_MAX + 1)
+/* /proc/self/cgroup has a line per hierarchy, each with the full path. */
+#define PRESSURE_CGROUP_FILE_MAX (4 * PATH_MAX)
+#define PRESSURE_CGROUP_DIR "/sys/fs/cgroup"
+#define PRESSURE_PSI_SYSTEM_PATH "/proc/pressure/memory"
+
+bool opt_pressure_purge = false;
+unsigned opt_pressure_purge_threshold = PRESSURE_PURGE_THRESHOLD_DEFAULT;
+
+/* The PSI file to sample: our cgroup's, or the system-wide one. */
+static char pressure_psi_path[PRESSURE_PATH_MAX];
+/* Our cgroup's memory.events; empty if there is none (e.g. cgroup v1). */
+static char pressure_events_path[PRESSURE_PATH_MAX];
+
+/*
+ * Only accessed by background thread 0 (or, when background threads are off,
+ * by tests), except for the atomics.
+ */
+static nstime_t pressure_last_poll;
+static uint64_t pressure_last_nevents;
+static atomic_b_t pressure_state;
+static atomic_zu_t pressure_nperiods;
+
+/*
+ * Reads a (small) procfs / cgroupfs file as a string.  Returns true on error.
+ * If the file doesn't fit, buf gets its beginning and *truncated (if not NULL)
+ * is set.
+ */
+static bool
+pressure_file_read(const char *path, char *buf, size_t buf_size,
+    bool *truncated) {
+#if defined(O_CLOEXEC)
+	int fd = malloc_open(path, O_RDONLY | O_CLOEXEC);
+#else
+	int fd = malloc_open(path, O_RDONLY);
+#endif
+	if (fd == -1) {
+		return true;
+	}
+	/* Reads until EOF or a full buffer. */
+	ssize_t nread = malloc_read_fd(fd, buf, buf_size - 1);
+	char extra;
+	bool full = (nread == (ssize_t)buf_size - 1 &&
+	    malloc_read_fd(fd, &extra, 1) > 0);
+	malloc_close(fd);
+	if (nread <= 0) {
+		return true;
+	}
+	buf[nread] = '\0';
+	if (truncated != NULL) {
+		*truncated = full;
+	}
+	return false;
+}
+
+bool
+pressure_cgroup_parse(const char *buf, const char **cgroup, size_t *len) {
+	/* The cgroup v2 entry is the one of hierarchy 0, "0::<path>". */
+	const char *line = buf;
+	while (strncmp(line, "0::", 3) != 0) {
+		line = strchr(line, '\n');
+		if (line == NULL) {
+			return true;
+		}
+		line++;
+	}
+	const char *path = line + 3;
+	const char *end = strchr(path, '\n');
+	if (end == NULL) {
+		/* Possibly cut short. */
+		return true;
+	}
+	*cgroup = path;
+	*len = (end - path == 1 && path[0] == '/') ? 0 : (size_t)(end - path);
+	return false;
+}
+
+/*
+ * Sets dir to the directory of our cgroup (v2).  Returns true if there is
+ * none, or if it can't be determined, which gets reported.
+ */
+static bool
+pressure_cgroup_dir_get(char *dir, size_t dir_size) {
+	/* Only used at boot, which is serialized. */
+	static char buf[PRESSURE_CGROUP_FILE_MAX];
+	bool truncated;
+	if (pressure_file_read("/proc/self/cgroup", buf, sizeof(buf),
+	    &truncated)) {
+		return true;
+	}
+	const char *cgroup;
+	size_t len;
+	if (pressure_cgroup_parse(buf, &cgroup, &len)) {
+		if (truncated) {
+			malloc_write("<jemalloc>: /proc/self/cgroup too large "
+			    "for pressure_purge; using the system-wide memory "
+			    "pressure\n");
+		}
+		return true;
+	}
+	if ((size_t)malloc_snprintf(dir, dir_size, "%s%.*s",
+	    PRESSURE_CGROUP_DIR, (int)len, cgroup) >= dir_size) {
+		malloc_write("<jemalloc>: cgroup path too long for "
+		    "pressure_purge; using the system-wide memory pressure\n");
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Sets path to the named file of the cgroup in dir.  Returns true if there is
+ * no such readable file.
+ */
+static bool
+pressure_cgroup_path(const char *dir, const char *name, char *path,
+    size_t path_size) {
+	if ((size_t)malloc_snprintf(path, path_size, "%s/%s", dir, name) >=
+	    path_size) {
+		return true;
+	}
+	char probe[64];
+	return pressure_file_read(path, probe, sizeof(probe), NULL);
+}
+
+bool
+pressure_psi_parse(const char *buf, uint64_t *some_avg10) {
+	const char *prefix = "some avg10=";
+	size_t prefix_len = strlen(prefix);
+	if (strncmp(buf, prefix, prefix_len) != 0) {
+		return true;
+	}
+	const char *s = buf + prefix_len;
+	if (*s < '0' || *s > '9') {
+		return true;
+	}
+	char *end;
+	uint64_t hundredths = (uint64_t)malloc_strtoumax(s, &end, 10) * 100;
+	if (*end == '.') {
+		/* The kernel prints two decimals; ignore any more. */
+		uint64_t scale = 10;
+		for (s = end + 1; *s >= '0' && *s <= '9'; s++) {
+			hundredths += (uint64_t)(*s - '0') * scale;
+			scale /= 10;
+		}
+	}
+	*some_avg10 = hundredths;
+	return false;
+}
+
+bool
+pressure_events_parse(const char *buf, uint64_t *nevents) {
+	const char *keys[] = {"high ", "max "};
+	uint64_t n = 0;
+	bool found = false;
+	for (const char *line = buf; line != NULL && *line != '\0';) {
+		for (unsigned i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+			size_t key_len = strlen(keys[i]);
+			if (strncmp(line, keys[i], key_len) == 0) {
+				n += malloc_strtoumax(line + key_len, NULL, 10);
+				found = true;
+			}
+		}
+		line = strchr(line, '\n');
+		if (line != NULL) {
+			line++;
+		}
+	}
+	if (!found) {
+		return true;
+	}
+	*nevents = n;
+	return false;
+}
+
+static bool
+pressure_sample_read(pressure_sample_t *sample) {
+	char buf[512];
+	if (pressure_file_read(pressure_psi_path, buf, sizeof(buf), NULL) ||
+	    pressure_psi_parse(buf, &sample->some_avg10)) {
+		return true;
+	}
+	/* Keep the counters as they were if they can't be read this time. */
+	sample->nevents = pressure_last_nevents;
+	if (pressure_events_path[0] != '\0' && !pressure_file_read(
+	    pressure_events_path, buf, sizeof(buf), NULL)) {
+		pressure_events_parse(buf, &sample->nevents);
+	}
+	return false;
+}
+
+void
+pressure_boot(void) {
+	atomic_store_b(&pressure_state, false, ATOMIC_RELAXED);
+	atomic_store_zu(&pressure_nperiods, 0, ATOMIC_RELAXED);
+	nstime_init_zero(&pressure_last_poll);
+	pressure_last_nevents = 0;
+	if (!opt_pressure_purge) {
+		return;
+	}
+
+	char cgroup_dir[PRESSURE_PATH_MAX];
+	bool have_cgroup = !pressure_cgroup_dir_get(cgroup_dir,
+	    sizeof(cgroup_dir));
+	if (!have_cgroup || pressure_cgroup_path(cgroup_dir, "memory.pressure",
+	    pressure_psi_path, sizeof(pressure_psi_path))) {
+		strncpy(pressure_psi_path, PRESSURE_PSI_SYSTEM_PATH,
+		    sizeof(pressure_psi_path));
+	}
+	if (!have_cgroup || pressure_cgroup_path(cgroup_dir, "memory.events",
+	    pressure_events_path, sizeof(pressure_events_path))) {
+		pressure_events_path[0] = '\0';
+	}
+	pressure_sample_t sample;
+	if (!have_background_thread || pressure_sample_read(&sample)) {
+		malloc_write("<jemalloc>: pressure_purge not supported on this "
+		    "system (requires background threads and PSI)\n");
+		if (opt_abort) {
+			abort();
+		}
+		opt_pressure_purge = false;
+		return;
+	}
+	/* Only count the events from now on. */
+	pressure_last_nevents = sample.nevents;
+}
+
+bool
+pressure_active(void) {
+	return atomic_load_b(&pressure_state, ATOMIC_RELAXED);
+}
+
+uint64_t
+pressure_nperiods_get(void) {
+	return (uint64_t)atomic_load_zu(&pressure_nperiods, ATOMIC_RELAXED);
+}
+
+static void
+pressure_apply(tsdn_t *tsdn, bool pressure) {
+	unsigned lg_div = pressure ? PRESSURE_LG_DIV : 0;
+	unsigned narenas = narenas_total_get();
+	for (unsigned i = 0; i < narenas; i++) {
+		arena_t *arena = arena_get(tsdn, i, false);
+		if (arena != NULL) {
+			arena_pressure_set(tsdn, arena, lg_div);
+		}
+	}
+}
+
+void
+pressure_update(tsdn_t *tsdn, const pressure_sample_t *sample) {
+	bool new_events = sample->nevents > pressure_last_nevents;
+	pressure_last_nevents = sample->nevents;
+
+	uint64_t threshold = (uint64_t)opt_pressure_purge_threshold * 100;
+	bool pressure = pressure_active();
+	if (!pressure) {
+		if (sample->some_avg10 < threshold && !new_events) {
+			return;
+		}
+		atomic_fetch_add_zu(&pressure_nperiods, 1, ATOMIC_RELAXED);
+	} else {
+		/* Relax only once well below the threshold. */
+		if (sample->some_avg10 >= threshold / 2 || new_events) {
+			return;
+		}
+	}
+	atomic_store_b(&pressure_state, !pressure, ATOMIC_RELAXED);
+	pressure_apply(tsdn, !pressure);
+}
+
+void
+pressure_background_work(tsdn_t *tsdn) {
+	if (!opt_pressure_purge) {
+		return;
+	}
+	nstime_t now;
+	nstime_init_update(&now);
+	if (nstime_compare(&now, &pressure_last_poll) >= 0 &&
+	    nstime_ns(&now) - nstime_ns(&pressure_last_poll) <
+	    PRESSURE_POLL_INTERVAL_NS) {
+		return;
+	}
+	nstime_copy(&pressure_last_poll, &now);
+
+	pressure_sample_t sample;
+	if (!pressure_sample_read(&sample)) {
+		pressure_update(tsdn, &sample);
+	}
+}
+
+void
+pressure_background_stop(tsdn_t *tsdn) {
+	/* Nobody would notice the pressure go away anymore. */
+	if (pressure_active()) {
+		atomic_store_b(&pressure_state, false, ATOMIC_RELAXED);
+		pressure_apply(tsdn, false);
+	}
+	nstime_init_zero(&pressure_last_poll);
+}
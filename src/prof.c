@@ -33,12 +33,21 @@ bool opt_prof_gdump = false;
 bool opt_prof_final = false;
 bool opt_prof_leak = false;
 bool opt_prof_leak_error = false;
+bool opt_prof_dump_incremental = false;
+bool opt_prof_dump_gzip = false;
+prof_dump_format_t opt_prof_dump_format = prof_dump_format_heap_v2;
 bool opt_prof_accum = false;
 bool opt_prof_pid_namespace = false;
 char opt_prof_prefix[PROF_DUMP_FILENAME_LEN];
 bool opt_prof_sys_thread_name = false;
+bool opt_prof_fast_unwind = false;
 bool opt_prof_unbias = true;
 
+const char *const prof_dump_format_names[] = {
+	"heap_v2",
+	"pprof",
+};
+
 /* Accessed via prof_sample_event_handler(). */
 static counter_accum_t prof_idump_accumulated;
 
@@ -630,6 +639,17 @@ prof_boot1(void) {
 		opt_prof_leak = true;
 	}
 
+#ifndef JEMALLOC_PROF_FAST_UNWIND
+	if (opt_prof_fast_unwind) {
+		malloc_write("<jemalloc>: prof_fast_unwind not supported (requires "
+		    "--enable-prof-fast-unwind or --enable-prof-frameptr)\n");
+		if (opt_abort) {
+			abort();
+		}
+		opt_prof_fast_unwind = false;
+	}
+#endif
+
 	if (opt_prof_leak && !opt_prof) {
 		/*
 		 * Enable opt_prof, but in such a way that profiles are never
@@ -666,8 +686,7 @@ prof_boot2(tsd_t *tsd, base_t *base) {
 	    malloc_mutex_rank_exclusive)) {
 		return true;
 	}
-	if (malloc_mutex_init(&bt2gctx_mtx, "prof_bt2gctx",
-	    WITNESS_RANK_PROF_BT2GCTX, malloc_mutex_rank_exclusive)) {
+	if (prof_bt2gctx_mutexes_init()) {
 		return true;
 	}
 	if (malloc_mutex_init(&tdatas_mtx, "prof_tdatas",
@@ -766,7 +785,7 @@ prof_prefork0(tsdn_t *tsdn) {
 		unsigned i;
 
 		malloc_mutex_prefork(tsdn, &prof_dump_mtx);
-		malloc_mutex_prefork(tsdn, &bt2gctx_mtx);
+		prof_bt2gctx_prefork(tsdn);
 		malloc_mutex_prefork(tsdn, &tdatas_mtx);
 		for (i = 0; i < PROF_NTDATA_LOCKS; i++) {
 			malloc_mutex_prefork(tsdn, &tdata_locks[i]);
@@ -816,7 +835,7 @@ prof_postfork_parent(tsdn_t *tsdn) {
 			malloc_mutex_postfork_parent(tsdn, &tdata_locks[i]);
 		}
 		malloc_mutex_postfork_parent(tsdn, &tdatas_mtx);
-		malloc_mutex_postfork_parent(tsdn, &bt2gctx_mtx);
+		prof_bt2gctx_postfork_parent(tsdn);
 		malloc_mutex_postfork_parent(tsdn, &prof_dump_mtx);
 	}
 }
@@ -843,7 +862,7 @@ prof_postfork_child(tsdn_t *tsdn) {
 			malloc_mutex_postfork_child(tsdn, &tdata_locks[i]);
 		}
 		malloc_mutex_postfork_child(tsdn, &tdatas_mtx);
-		malloc_mutex_postfork_child(tsdn, &bt2gctx_mtx);
+		prof_bt2gctx_postfork_child(tsdn);
 		malloc_mutex_postfork_child(tsdn, &prof_dump_mtx);
 	}
 }
@@ -25,7 +25,6 @@
 
 /******************************************************************************/
 
-malloc_mutex_t bt2gctx_mtx;
 malloc_mutex_t tdatas_mtx;
 malloc_mutex_t prof_dump_mtx;
 
@@ -49,9 +48,24 @@ malloc_mutex_t *tdata_locks;
 
 /*
  * Global hash of (prof_bt_t *)-->(prof_gctx_t *).  This is the master data
- * structure that knows about all backtraces currently captured.
+ * structure that knows about all backtraces currently captured.  It's split
+ * into shards by backtrace hash, each with its own mutex, so that threads
+ * sampling different backtraces for the first time don't serialize.  Dumps
+ * take all the shard mutexes (in address order) to see a consistent table.
  */
-static ckh_t bt2gctx;
+typedef struct prof_bt2gctx_shard_s prof_bt2gctx_shard_t;
+struct prof_bt2gctx_shard_s {
+	JEMALLOC_ALIGNED(CACHELINE)
+	malloc_mutex_t mtx;
+	ckh_t bt2gctx;
+	/*
+	 * List of the gctx's in bt2gctx, in creation order.  Unlike a ckh
+	 * iteration, walking it can be resumed after dropping mtx, as long as
+	 * the current gctx is kept in limbo.
+	 */
+	ql_head(prof_gctx_t) gctxs;
+};
+static prof_bt2gctx_shard_t bt2gctx_shards[PROF_BT2GCTX_NSHARDS];
 
 /*
  * Tree of all extant prof_tdata_t structures, regardless of state,
@@ -142,15 +156,46 @@ prof_tdata_mutex_choose(uint64_t thr_uid) {
 	return &tdata_locks[thr_uid % PROF_NTDATA_LOCKS];
 }
 
+static prof_bt2gctx_shard_t *
+prof_bt2gctx_shard_get(const prof_bt_t *bt) {
+	size_t hash[2];
+	prof_bt_hash(bt, hash);
+	/* ckh picks buckets with the low bits, so use the high ones here. */
+	return &bt2gctx_shards[(hash[0] >> (sizeof(size_t) * 8 -
+	    PROF_LG_BT2GCTX_NSHARDS - 1)) >> 1];
+}
+
+bool
+prof_bt2gctx_mutexes_init(void) {
+	for (unsigned i = 0; i < PROF_BT2GCTX_NSHARDS; i++) {
+		if (malloc_mutex_init(&bt2gctx_shards[i].mtx, "prof_bt2gctx",
+		    WITNESS_RANK_PROF_BT2GCTX, malloc_mutex_address_ordered)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 bool
 prof_data_init(tsd_t *tsd) {
 	tdata_tree_new(&tdatas);
-	return ckh_new(tsd, &bt2gctx, PROF_CKH_MINITEMS,
-	    prof_bt_hash, prof_bt_keycomp);
+	for (unsigned i = 0; i < PROF_BT2GCTX_NSHARDS; i++) {
+		prof_bt2gctx_shard_t *shard = &bt2gctx_shards[i];
+		ql_new(&shard->gctxs);
+		if (ckh_new(tsd, &shard->bt2gctx, PROF_BT2GCTX_CKH_MINITEMS,
+		    prof_bt_hash, prof_bt_keycomp)) {
+			return true;
+		}
+	}
+	return false;
 }
 
+/*
+ * Locks the bt2gctx shard, or all of them if shard is NULL (i.e. for a
+ * consistent view of all the backtraces).
+ */
 static void
-prof_enter(tsd_t *tsd, prof_tdata_t *tdata) {
+prof_enter(tsd_t *tsd, prof_tdata_t *tdata, prof_bt2gctx_shard_t *shard) {
 	cassert(config_prof);
 	assert(tdata == prof_tdata_get(tsd, false));
 
@@ -159,15 +204,29 @@ prof_enter(tsd_t *tsd, prof_tdata_t *tdata) {
 		tdata->enq = true;
 	}
 
-	malloc_mutex_lock(tsd_tsdn(tsd), &bt2gctx_mtx);
+	if (shard != NULL) {
+		malloc_mutex_lock(tsd_tsdn(tsd), &shard->mtx);
+	} else {
+		for (unsigned i = 0; i < PROF_BT2GCTX_NSHARDS; i++) {
+			malloc_mutex_lock(tsd_tsdn(tsd),
+			    &bt2gctx_shards[i].mtx);
+		}
+	}
 }
 
 static void
-prof_leave(tsd_t *tsd, prof_tdata_t *tdata) {
+prof_leave(tsd_t *tsd, prof_tdata_t *tdata, prof_bt2gctx_shard_t *shard) {
 	cassert(config_prof);
 	assert(tdata == prof_tdata_get(tsd, false));
 
-	malloc_mutex_unlock(tsd_tsdn(tsd), &bt2gctx_mtx);
+	if (shard != NULL) {
+		malloc_mutex_unlock(tsd_tsdn(tsd), &shard->mtx);
+	} else {
+		for (unsigned i = PROF_BT2GCTX_NSHARDS; i > 0; i--) {
+			malloc_mutex_unlock(tsd_tsdn(tsd),
+			    &bt2gctx_shards[i - 1].mtx);
+		}
+	}
 
 	if (tdata != NULL) {
 		bool idump, gdump;
@@ -206,7 +265,11 @@ prof_gctx_create(tsdn_t *tsdn, prof_bt_t *bt) {
 	 * prof_tctx_destroy()/prof_gctx_try_destroy().
 	 */
 	gctx->nlimbo = 1;
+	gctx->shard_ind = (unsigned)(prof_bt2gctx_shard_get(bt) -
+	    bt2gctx_shards);
 	tctx_tree_new(&gctx->tctxs);
+	ql_elm_new(gctx, link);
+	gctx->dumping = false;
 	/* Duplicate bt. */
 	memcpy(gctx->vec, bt->vec, bt->len * sizeof(void *));
 	gctx->bt.vec = gctx->vec;
@@ -226,15 +289,17 @@ prof_gctx_try_destroy(tsd_t *tsd, prof_tdata_t *tdata_self,
 	 * avoid a race between the main body of prof_tctx_destroy() and entry
 	 * into this function.
 	 */
-	prof_enter(tsd, tdata_self);
+	prof_bt2gctx_shard_t *shard = &bt2gctx_shards[gctx->shard_ind];
+	prof_enter(tsd, tdata_self, shard);
 	malloc_mutex_lock(tsd_tsdn(tsd), gctx->lock);
 	assert(gctx->nlimbo != 0);
 	if (tctx_tree_empty(&gctx->tctxs) && gctx->nlimbo == 1) {
 		/* Remove gctx from bt2gctx. */
-		if (ckh_remove(tsd, &bt2gctx, &gctx->bt, NULL, NULL)) {
+		if (ckh_remove(tsd, &shard->bt2gctx, &gctx->bt, NULL, NULL)) {
 			not_reached();
 		}
-		prof_leave(tsd, tdata_self);
+		ql_remove(&shard->gctxs, gctx, link);
+		prof_leave(tsd, tdata_self, shard);
 		/* Destroy gctx. */
 		malloc_mutex_unlock(tsd_tsdn(tsd), gctx->lock);
 		idalloctm(tsd_tsdn(tsd), gctx, NULL, NULL, true, true);
@@ -245,7 +310,7 @@ prof_gctx_try_destroy(tsd_t *tsd, prof_tdata_t *tdata_self,
 		 */
 		gctx->nlimbo--;
 		malloc_mutex_unlock(tsd_tsdn(tsd), gctx->lock);
-		prof_leave(tsd, tdata_self);
+		prof_leave(tsd, tdata_self, shard);
 	}
 }
 
@@ -276,25 +341,28 @@ prof_lookup_global(tsd_t *tsd, prof_bt_t *bt, prof_tdata_t *tdata,
 	} btkey;
 	bool new_gctx;
 
-	prof_enter(tsd, tdata);
-	if (ckh_search(&bt2gctx, bt, &btkey.v, &gctx.v)) {
+	prof_bt2gctx_shard_t *shard = prof_bt2gctx_shard_get(bt);
+	prof_enter(tsd, tdata, shard);
+	if (ckh_search(&shard->bt2gctx, bt, &btkey.v, &gctx.v)) {
 		/* bt has never been seen before.  Insert it. */
-		prof_leave(tsd, tdata);
+		prof_leave(tsd, tdata, shard);
 		tgctx.p = prof_gctx_create(tsd_tsdn(tsd), bt);
 		if (tgctx.v == NULL) {
 			return true;
 		}
-		prof_enter(tsd, tdata);
-		if (ckh_search(&bt2gctx, bt, &btkey.v, &gctx.v)) {
+		prof_enter(tsd, tdata, shard);
+		if (ckh_search(&shard->bt2gctx, bt, &btkey.v, &gctx.v)) {
 			gctx.p = tgctx.p;
 			btkey.p = &gctx.p->bt;
-			if (ckh_insert(tsd, &bt2gctx, btkey.v, gctx.v)) {
+			if (ckh_insert(tsd, &shard->bt2gctx, btkey.v,
+			    gctx.v)) {
 				/* OOM. */
-				prof_leave(tsd, tdata);
+				prof_leave(tsd, tdata, shard);
 				idalloctm(tsd_tsdn(tsd), gctx.v, NULL, NULL,
 				    true, true);
 				return true;
 			}
+			ql_tail_insert(&shard->gctxs, gctx.p, link);
 			new_gctx = true;
 		} else {
 			new_gctx = false;
@@ -320,7 +388,7 @@ prof_lookup_global(tsd_t *tsd, prof_bt_t *bt, prof_tdata_t *tdata,
 			    true);
 		}
 	}
-	prof_leave(tsd, tdata);
+	prof_leave(tsd, tdata, shard);
 
 	*p_btkey = btkey.v;
 	*p_gctx = gctx.p;
@@ -401,6 +469,52 @@ prof_lookup(tsd_t *tsd, prof_bt_t *bt) {
 	return ret.p;
 }
 
+void
+prof_bt2gctx_prefork(tsdn_t *tsdn) {
+	for (unsigned i = 0; i < PROF_BT2GCTX_NSHARDS; i++) {
+		malloc_mutex_prefork(tsdn, &bt2gctx_shards[i].mtx);
+	}
+}
+
+void
+prof_bt2gctx_postfork_parent(tsdn_t *tsdn) {
+	for (unsigned i = PROF_BT2GCTX_NSHARDS; i > 0; i--) {
+		malloc_mutex_postfork_parent(tsdn, &bt2gctx_shards[i - 1].mtx);
+	}
+}
+
+void
+prof_bt2gctx_postfork_child(tsdn_t *tsdn) {
+	for (unsigned i = PROF_BT2GCTX_NSHARDS; i > 0; i--) {
+		malloc_mutex_postfork_child(tsdn, &bt2gctx_shards[i - 1].mtx);
+	}
+}
+
+/* Sums up the mutex stats of the shards. */
+void
+prof_bt2gctx_mutex_prof_read(tsdn_t *tsdn, mutex_prof_data_t *data) {
+	for (unsigned i = 0; i < PROF_BT2GCTX_NSHARDS; i++) {
+		malloc_mutex_t *mtx = &bt2gctx_shards[i].mtx;
+		malloc_mutex_lock(tsdn, mtx);
+		if (i == 0) {
+			malloc_mutex_prof_read(tsdn, data, mtx);
+		} else {
+			malloc_mutex_prof_accum(tsdn, data, mtx);
+		}
+		malloc_mutex_unlock(tsdn, mtx);
+	}
+}
+
+void
+prof_bt2gctx_mutex_prof_reset(tsdn_t *tsdn) {
+	for (unsigned i = 0; i < PROF_BT2GCTX_NSHARDS; i++) {
+		malloc_mutex_t *mtx = &bt2gctx_shards[i].mtx;
+		malloc_mutex_lock(tsdn, mtx);
+		malloc_mutex_prof_data_reset(tsdn, mtx);
+		malloc_mutex_unlock(tsdn, mtx);
+	}
+}
+
 /* Used in unit tests. */
 static prof_tdata_t *
 prof_tdata_count_iter(prof_tdata_tree_t *tdatas_ptr, prof_tdata_t *tdata,
@@ -440,9 +554,13 @@ prof_bt_count(void) {
 		return 0;
 	}
 
-	malloc_mutex_lock(tsd_tsdn(tsd), &bt2gctx_mtx);
-	bt_count = ckh_count(&bt2gctx);
-	malloc_mutex_unlock(tsd_tsdn(tsd), &bt2gctx_mtx);
+	bt_count = 0;
+	for (unsigned i = 0; i < PROF_BT2GCTX_NSHARDS; i++) {
+		prof_bt2gctx_shard_t *shard = &bt2gctx_shards[i];
+		malloc_mutex_lock(tsd_tsdn(tsd), &shard->mtx);
+		bt_count += ckh_count(&shard->bt2gctx);
+		malloc_mutex_unlock(tsd_tsdn(tsd), &shard->mtx);
+	}
 
 	return bt_count;
 }
@@ -648,6 +766,11 @@ prof_tctx_merge_tdata(tsdn_t *tsdn, prof_tctx_t *tctx, prof_tdata_t *tdata) {
 		malloc_mutex_unlock(tsdn, tctx->gctx->lock);
 		return;
 	case prof_tctx_state_nominal:
+		if (!tctx->gctx->dumping) {
+			/* The gctx is new since dumping started; ignore. */
+			malloc_mutex_unlock(tsdn, tctx->gctx->lock);
+			return;
+		}
 		tctx->state = prof_tctx_state_dumping;
 		malloc_mutex_unlock(tsdn, tctx->gctx->lock);
 
@@ -788,6 +911,7 @@ prof_dump_gctx_prep(tsdn_t *tsdn, prof_gctx_t *gctx, prof_gctx_tree_t *gctxs) {
 	 */
 	gctx->nlimbo++;
 	gctx_tree_insert(gctxs, gctx);
+	gctx->dumping = true;
 
 	memset(&gctx->cnt_summed, 0, sizeof(prof_cnt_t));
 
@@ -850,6 +974,7 @@ prof_gctx_finish(tsd_t *tsd, prof_gctx_tree_t *gctxs) {
 				}
 			} while (next != NULL);
 		}
+		gctx->dumping = false;
 		gctx->nlimbo--;
 		if (prof_gctx_should_destroy(gctx)) {
 			gctx->nlimbo++;
@@ -861,6 +986,56 @@ prof_gctx_finish(tsd_t *tsd, prof_gctx_tree_t *gctxs) {
 	}
 }
 
+/*
+ * Incremental dumps let go of the bt2gctx shards and tdatas_mtx every so many
+ * gctx's or tdatas, so that sampling threads (and new threads) don't have to
+ * wait for the whole dump.
+ */
+#define PROF_DUMP_INCREMENTAL_NITEMS	256
+
+static void
+prof_dump_yield(tsdn_t *tsdn, malloc_mutex_t *mtx) {
+	malloc_mutex_unlock(tsdn, mtx);
+	/* Give the waiters a chance to actually get the lock. */
+#ifdef _WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+	malloc_mutex_lock(tsdn, mtx);
+}
+
+typedef prof_tdata_t *(prof_tdata_iter_cb_t)(prof_tdata_tree_t *,
+    prof_tdata_t *, void *);
+
+/*
+ * Iterates over tdatas with tdatas_mtx held, except that incremental dumps drop
+ * it periodically; the iteration then resumes after the last tdata visited,
+ * which may be gone by then.
+ */
+static void
+prof_dump_tdatas_iter(tsdn_t *tsdn, prof_tdata_iter_cb_t *cb, void *arg) {
+	malloc_mutex_lock(tsdn, &tdatas_mtx);
+	prof_tdata_t *tdata = tdata_tree_first(&tdatas);
+	for (unsigned n = 1; tdata != NULL; n++) {
+		cb(&tdatas, tdata, arg);
+		if (!opt_prof_dump_incremental ||
+		    n % PROF_DUMP_INCREMENTAL_NITEMS != 0) {
+			tdata = tdata_tree_next(&tdatas, tdata);
+			continue;
+		}
+		prof_tdata_t key;
+		key.thr_uid = tdata->thr_uid;
+		key.thr_discrim = tdata->thr_discrim;
+		prof_dump_yield(tsdn, &tdatas_mtx);
+		tdata = tdata_tree_nsearch(&tdatas, &key);
+		if (tdata != NULL && prof_tdata_comp(tdata, &key) == 0) {
+			tdata = tdata_tree_next(&tdatas, tdata);
+		}
+	}
+	malloc_mutex_unlock(tsdn, &tdatas_mtx);
+}
+
 typedef struct prof_tdata_merge_iter_arg_s prof_tdata_merge_iter_arg_t;
 struct prof_tdata_merge_iter_arg_s {
 	tsdn_t *tsdn;
@@ -938,9 +1113,7 @@ prof_dump_header(prof_dump_iter_arg_t *arg, const prof_cnt_t *cnt_all) {
 	prof_dump_print_cnts(arg->prof_dump_write, arg->cbopaque, cnt_all);
 	arg->prof_dump_write(arg->cbopaque, "\n");
 
-	malloc_mutex_lock(arg->tsdn, &tdatas_mtx);
-	tdata_tree_iter(&tdatas, NULL, prof_tdata_dump_iter, arg);
-	malloc_mutex_unlock(arg->tsdn, &tdatas_mtx);
+	prof_dump_tdatas_iter(arg->tsdn, prof_tdata_dump_iter, arg);
 }
 
 static void
@@ -1036,21 +1209,36 @@ prof_gctx_dump_iter(prof_gctx_tree_t *gctxs, prof_gctx_t *gctx, void *opaque) {
 static void
 prof_dump_prep(tsd_t *tsd, prof_tdata_t *tdata, prof_cnt_t *cnt_all,
     size_t *leak_ngctx, prof_gctx_tree_t *gctxs) {
-	size_t tabind;
-	union {
-		prof_gctx_t	*p;
-		void		*v;
-	} gctx;
-
-	prof_enter(tsd, tdata);
+	bool incremental = opt_prof_dump_incremental;
 
 	/*
 	 * Put gctx's in limbo and clear their counters in preparation for
-	 * summing.
+	 * summing.  Incremental dumps visit one shard at a time, and the gctx's
+	 * created in the others meanwhile aren't part of the dump (see
+	 * prof_tctx_merge_tdata()), so the rest doesn't need the shards either.
 	 */
+	if (!incremental) {
+		prof_enter(tsd, tdata, NULL);
+	}
 	gctx_tree_new(gctxs);
-	for (tabind = 0; !ckh_iter(&bt2gctx, &tabind, NULL, &gctx.v);) {
-		prof_dump_gctx_prep(tsd_tsdn(tsd), gctx.p, gctxs);
+	unsigned n = 0;
+	for (unsigned i = 0; i < PROF_BT2GCTX_NSHARDS; i++) {
+		prof_bt2gctx_shard_t *shard = &bt2gctx_shards[i];
+		if (incremental) {
+			prof_enter(tsd, tdata, shard);
+		}
+		for (prof_gctx_t *gctx = ql_first(&shard->gctxs); gctx != NULL;
+		    gctx = ql_next(&shard->gctxs, gctx, link)) {
+			prof_dump_gctx_prep(tsd_tsdn(tsd), gctx, gctxs);
+			if (incremental &&
+			    ++n % PROF_DUMP_INCREMENTAL_NITEMS == 0) {
+				/* Being in limbo, gctx stays in the list. */
+				prof_dump_yield(tsd_tsdn(tsd), &shard->mtx);
+			}
+		}
+		if (incremental) {
+			prof_leave(tsd, tdata, shard);
+		}
 	}
 
 	/*
@@ -1060,10 +1248,8 @@ prof_dump_prep(tsd_t *tsd, prof_tdata_t *tdata, prof_cnt_t *cnt_all,
 	memset(cnt_all, 0, sizeof(prof_cnt_t));
 	prof_tdata_merge_iter_arg_t prof_tdata_merge_iter_arg = {tsd_tsdn(tsd),
 	    cnt_all};
-	malloc_mutex_lock(tsd_tsdn(tsd), &tdatas_mtx);
-	tdata_tree_iter(&tdatas, NULL, prof_tdata_merge_iter,
+	prof_dump_tdatas_iter(tsd_tsdn(tsd), prof_tdata_merge_iter,
 	    &prof_tdata_merge_iter_arg);
-	malloc_mutex_unlock(tsd_tsdn(tsd), &tdatas_mtx);
 
 	/* Merge tctx stats into gctx's. */
 	*leak_ngctx = 0;
@@ -1072,7 +1258,9 @@ prof_dump_prep(tsd_t *tsd, prof_tdata_t *tdata, prof_cnt_t *cnt_all,
 	gctx_tree_iter(gctxs, NULL, prof_gctx_merge_iter,
 	    &prof_gctx_merge_iter_arg);
 
-	prof_leave(tsd, tdata);
+	if (!incremental) {
+		prof_leave(tsd, tdata, NULL);
+	}
 }
 
 void
@@ -1093,6 +1281,49 @@ prof_dump_impl(tsd_t *tsd, write_cb_t *prof_dump_write, void *cbopaque,
 	}
 }
 
+typedef struct prof_dump_visit_arg_s prof_dump_visit_arg_t;
+struct prof_dump_visit_arg_s {
+	tsdn_t *tsdn;
+	prof_dump_visit_cb_t *visit;
+	void *opaque;
+};
+
+static prof_gctx_t *
+prof_gctx_visit_iter(prof_gctx_tree_t *gctxs, prof_gctx_t *gctx,
+    void *opaque) {
+	prof_dump_visit_arg_t *arg = (prof_dump_visit_arg_t *)opaque;
+	malloc_mutex_lock(arg->tsdn, gctx->lock);
+	prof_cnt_t cnts = gctx->cnt_summed;
+	malloc_mutex_unlock(arg->tsdn, gctx->lock);
+
+	/* Same filter as prof_dump_gctx(). */
+	if ((!opt_prof_accum && cnts.curobjs == 0) ||
+	    (opt_prof_accum && cnts.accumobjs == 0)) {
+		return NULL;
+	}
+	/*
+	 * The gctx is in limbo until prof_gctx_finish(), so its backtrace stays
+	 * put while the visitor runs without the gctx lock.
+	 */
+	return arg->visit(arg->opaque, &gctx->bt, &cnts) ? gctx : NULL;
+}
+
+void
+prof_dump_visit(tsd_t *tsd, prof_dump_visit_cb_t *visit, void *opaque,
+    prof_tdata_t *tdata, bool leakcheck) {
+	malloc_mutex_assert_owner(tsd_tsdn(tsd), &prof_dump_mtx);
+	prof_cnt_t cnt_all;
+	size_t leak_ngctx;
+	prof_gctx_tree_t gctxs;
+	prof_dump_prep(tsd, tdata, &cnt_all, &leak_ngctx, &gctxs);
+	prof_dump_visit_arg_t arg = {tsd_tsdn(tsd), visit, opaque};
+	gctx_tree_iter(&gctxs, NULL, prof_gctx_visit_iter, &arg);
+	prof_gctx_finish(tsd, &gctxs);
+	if (leakcheck) {
+		prof_leakcheck(&cnt_all, leak_ngctx);
+	}
+}
+
 /* Used in unit tests. */
 void
 prof_cnt_all(prof_cnt_t *cnt_all) {
@@ -1168,6 +1399,11 @@ prof_tdata_init_impl(tsd_t *tsd, uint64_t thr_uid, uint64_t thr_discrim,
 		idalloctm(tsd_tsdn(tsd), tdata, NULL, NULL, true, true);
 		return NULL;
 	}
+	/*
+	 * A tctx goes away as soon as the thread has no sampled objects left
+	 * from its backtrace, so the count often hovers around a shrink point.
+	 */
+	ckh_shrink_disable(&tdata->bt2tctx);
 
 	tdata->enq = false;
 	tdata->enq_idump = false;
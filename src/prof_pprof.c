@@ -0,0 +1,512 @@
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/jemalloc_internal_includes.h"
+
+#include "jemalloc/internal/ckh.h"
+#include "jemalloc/internal/malloc_io.h"
+#include "jemalloc/internal/prof_data.h"
+#include "jemalloc/internal/prof_pprof.h"
+
+/*
+ * The subset of profile.proto that the dumps use.  All the field numbers are
+ * below 16, so that each key takes a single byte.
+ */
+#define PPROF_WIRE_VARINT		0
+#define PPROF_WIRE_LEN			2
+
+#define PPROF_PROFILE_SAMPLE_TYPE	1
+#define PPROF_PROFILE_SAMPLE		2
+#define PPROF_PROFILE_MAPPING		3
+#define PPROF_PROFILE_LOCATION		4
+#define PPROF_PROFILE_STRING_TABLE	6
+#define PPROF_PROFILE_DROP_FRAMES	7
+#define PPROF_PROFILE_PERIOD_TYPE	11
+#define PPROF_PROFILE_PERIOD		12
+#define PPROF_PROFILE_DEFAULT_SAMPLE_TYPE	14
+
+#define PPROF_VALUE_TYPE_TYPE		1
+#define PPROF_VALUE_TYPE_UNIT		2
+
+#define PPROF_SAMPLE_LOCATION_ID	1
+#define PPROF_SAMPLE_VALUE		2
+
+#define PPROF_MAPPING_ID		1
+#define PPROF_MAPPING_MEMORY_START	2
+#define PPROF_MAPPING_MEMORY_LIMIT	3
+#define PPROF_MAPPING_FILE_OFFSET	4
+#define PPROF_MAPPING_FILENAME		5
+
+#define PPROF_LOCATION_ID		1
+#define PPROF_LOCATION_MAPPING_ID	2
+#define PPROF_LOCATION_ADDRESS		3
+
+/*
+ * Frames fully matching this are dropped by pprof, along with everything they
+ * called, i.e. the allocator itself: the public entry points, and whatever has
+ * the private namespace prefix (as when malloc() tail calls malloc_default()).
+ */
+#define PPROF_DROP_FRAMES						\
+    STRINGIFY(JEMALLOC_PRIVATE_NAMESPACE) ".*|(malloc|calloc|realloc|"	\
+    "posix_memalign|aligned_alloc|memalign|valloc|pvalloc|mallocx|"	\
+    "rallocx|smallocx_.*)|operator new.*"
+
+#define PPROF_MAPPINGS_MIN		64
+/* Longer lines of the maps file are skipped. */
+#define PPROF_MAPS_LINE_MAX		(PATH_MAX + 128)
+
+typedef struct prof_pprof_mapping_s prof_pprof_mapping_t;
+struct prof_pprof_mapping_s {
+	uintptr_t start;
+	uintptr_t limit;
+	uint64_t offset;
+	/* Index in the string table. */
+	uint64_t filename;
+};
+
+typedef struct prof_pprof_maps_buf_s prof_pprof_maps_buf_t;
+struct prof_pprof_maps_buf_s {
+	char line[PPROF_MAPS_LINE_MAX + 1];
+	char prev_path[PPROF_MAPS_LINE_MAX + 1];
+};
+
+typedef struct prof_pprof_s prof_pprof_t;
+struct prof_pprof_s {
+	tsd_t *tsd;
+	gz_write_cb_t *write_cb;
+	void *cbopaque;
+	unsigned char *buf;
+	size_t buf_size;
+	size_t buf_end;
+	uint64_t nstrings;
+	/* Executable mappings, sorted by address. */
+	prof_pprof_mapping_t *mappings;
+	size_t nmappings;
+	size_t mappings_cap;
+	/* Maps each PC to its location id. */
+	ckh_t locations;
+	uint64_t nlocations;
+	bool oom;
+};
+
+static void *
+prof_pprof_alloc(tsdn_t *tsdn, size_t size) {
+	return iallocztm(tsdn, size, sz_size2index(size), false, NULL, true,
+	    arena_get(tsdn, 0, false), true);
+}
+
+static void
+prof_pprof_flush(prof_pprof_t *pprof) {
+	if (pprof->buf_end > 0) {
+		pprof->write_cb(pprof->cbopaque, pprof->buf, pprof->buf_end);
+		pprof->buf_end = 0;
+	}
+}
+
+static void
+prof_pprof_bytes(prof_pprof_t *pprof, const void *src, size_t len) {
+	const unsigned char *s = (const unsigned char *)src;
+	while (len > 0) {
+		size_t n = pprof->buf_size - pprof->buf_end;
+		if (n > len) {
+			n = len;
+		}
+		memcpy(pprof->buf + pprof->buf_end, s, n);
+		pprof->buf_end += n;
+		s += n;
+		len -= n;
+		if (pprof->buf_end == pprof->buf_size) {
+			prof_pprof_flush(pprof);
+		}
+	}
+}
+
+static size_t
+prof_pprof_varint_len(uint64_t v) {
+	size_t len = 1;
+	while (v >= 0x80) {
+		v >>= 7;
+		len++;
+	}
+	return len;
+}
+
+static void
+prof_pprof_varint(prof_pprof_t *pprof, uint64_t v) {
+	unsigned char bytes[10];
+	size_t n = 0;
+	while (v >= 0x80) {
+		bytes[n++] = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	bytes[n++] = (unsigned char)v;
+	prof_pprof_bytes(pprof, bytes, n);
+}
+
+static void
+prof_pprof_key(prof_pprof_t *pprof, unsigned field, unsigned wire_type) {
+	assert(field < 16);
+	unsigned char key = (unsigned char)((field << 3) | wire_type);
+	prof_pprof_bytes(pprof, &key, 1);
+}
+
+/* Size of a varint field; zeros are the defaults, and get omitted. */
+static size_t
+prof_pprof_uint_len(uint64_t v) {
+	return v == 0 ? 0 : 1 + prof_pprof_varint_len(v);
+}
+
+static void
+prof_pprof_uint(prof_pprof_t *pprof, unsigned field, uint64_t v) {
+	if (v != 0) {
+		prof_pprof_key(pprof, field, PPROF_WIRE_VARINT);
+		prof_pprof_varint(pprof, v);
+	}
+}
+
+/* Starts a length delimited field, i.e. a string or an embedded message. */
+static void
+prof_pprof_len(prof_pprof_t *pprof, unsigned field, size_t len) {
+	prof_pprof_key(pprof, field, PPROF_WIRE_LEN);
+	prof_pprof_varint(pprof, len);
+}
+
+/* Appends to the string table, and returns the index. */
+static uint64_t
+prof_pprof_string(prof_pprof_t *pprof, const char *s, size_t len) {
+	prof_pprof_len(pprof, PPROF_PROFILE_STRING_TABLE, len);
+	prof_pprof_bytes(pprof, s, len);
+	return pprof->nstrings++;
+}
+
+static uint64_t
+prof_pprof_cstring(prof_pprof_t *pprof, const char *s) {
+	return prof_pprof_string(pprof, s, strlen(s));
+}
+
+static void
+prof_pprof_value_type(prof_pprof_t *pprof, unsigned field, uint64_t type,
+    uint64_t unit) {
+	prof_pprof_len(pprof, field, prof_pprof_uint_len(type) +
+	    prof_pprof_uint_len(unit));
+	prof_pprof_uint(pprof, PPROF_VALUE_TYPE_TYPE, type);
+	prof_pprof_uint(pprof, PPROF_VALUE_TYPE_UNIT, unit);
+}
+
+static void
+prof_pprof_header(prof_pprof_t *pprof) {
+	/* The first string has to be the empty one. */
+	prof_pprof_string(pprof, "", 0);
+	uint64_t count = prof_pprof_cstring(pprof, "count");
+	uint64_t bytes = prof_pprof_cstring(pprof, "bytes");
+	if (opt_prof_accum) {
+		prof_pprof_value_type(pprof, PPROF_PROFILE_SAMPLE_TYPE,
+		    prof_pprof_cstring(pprof, "alloc_objects"), count);
+		prof_pprof_value_type(pprof, PPROF_PROFILE_SAMPLE_TYPE,
+		    prof_pprof_cstring(pprof, "alloc_space"), bytes);
+	}
+	prof_pprof_value_type(pprof, PPROF_PROFILE_SAMPLE_TYPE,
+	    prof_pprof_cstring(pprof, "inuse_objects"), count);
+	uint64_t inuse_space = prof_pprof_cstring(pprof, "inuse_space");
+	prof_pprof_value_type(pprof, PPROF_PROFILE_SAMPLE_TYPE, inuse_space,
+	    bytes);
+
+	prof_pprof_value_type(pprof, PPROF_PROFILE_PERIOD_TYPE,
+	    prof_pprof_cstring(pprof, "space"), bytes);
+	prof_pprof_uint(pprof, PPROF_PROFILE_PERIOD,
+	    (uint64_t)1U << lg_prof_sample);
+	prof_pprof_uint(pprof, PPROF_PROFILE_DEFAULT_SAMPLE_TYPE, inuse_space);
+	prof_pprof_uint(pprof, PPROF_PROFILE_DROP_FRAMES,
+	    prof_pprof_cstring(pprof, PPROF_DROP_FRAMES));
+}
+
+static bool
+prof_pprof_mapping_add(prof_pprof_t *pprof, const prof_pprof_mapping_t *m) {
+	tsdn_t *tsdn = tsd_tsdn(pprof->tsd);
+	if (pprof->nmappings == pprof->mappings_cap) {
+		size_t cap = pprof->mappings_cap == 0 ? PPROF_MAPPINGS_MIN :
+		    pprof->mappings_cap * 2;
+		prof_pprof_mapping_t *mappings = (prof_pprof_mapping_t *)
+		    prof_pprof_alloc(tsdn, cap * sizeof(prof_pprof_mapping_t));
+		if (mappings == NULL) {
+			return true;
+		}
+		if (pprof->mappings != NULL) {
+			memcpy(mappings, pprof->mappings, pprof->nmappings *
+			    sizeof(prof_pprof_mapping_t));
+			idalloctm(tsdn, pprof->mappings, NULL, NULL, true,
+			    true);
+		}
+		pprof->mappings = mappings;
+		pprof->mappings_cap = cap;
+	}
+	pprof->mappings[pprof->nmappings++] = *m;
+
+	uint64_t id = pprof->nmappings;
+	prof_pprof_len(pprof, PPROF_PROFILE_MAPPING, prof_pprof_uint_len(id) +
+	    prof_pprof_uint_len(m->start) + prof_pprof_uint_len(m->limit) +
+	    prof_pprof_uint_len(m->offset) + prof_pprof_uint_len(m->filename));
+	prof_pprof_uint(pprof, PPROF_MAPPING_ID, id);
+	prof_pprof_uint(pprof, PPROF_MAPPING_MEMORY_START, m->start);
+	prof_pprof_uint(pprof, PPROF_MAPPING_MEMORY_LIMIT, m->limit);
+	prof_pprof_uint(pprof, PPROF_MAPPING_FILE_OFFSET, m->offset);
+	prof_pprof_uint(pprof, PPROF_MAPPING_FILENAME, m->filename);
+	return false;
+}
+
+/*
+ * Parses "<start>-<limit> <perms> <offset> <dev> <inode> [<path>]", and records
+ * the executable mappings, which are the ones backtraces point into.
+ */
+static bool
+prof_pprof_maps_line(prof_pprof_t *pprof, prof_pprof_maps_buf_t *maps_buf,
+    char *line) {
+	char *end;
+	prof_pprof_mapping_t m;
+	m.start = (uintptr_t)malloc_strtoumax(line, &end, 16);
+	if (end == line || *end != '-') {
+		return false;
+	}
+	char *s = end + 1;
+	m.limit = (uintptr_t)malloc_strtoumax(s, &end, 16);
+	if (end == s || *end != ' ' || m.limit <= m.start) {
+		return false;
+	}
+	const char *perms = end + 1;
+	if (strlen(perms) < 5 || perms[4] != ' ' || perms[2] != 'x') {
+		return false;
+	}
+	s = end + 6;
+	m.offset = (uint64_t)malloc_strtoumax(s, &end, 16);
+	if (end == s || *end != ' ') {
+		return false;
+	}
+	/* Skip the device and the inode. */
+	s = strchr(end + 1, ' ');
+	if (s == NULL) {
+		return false;
+	}
+	malloc_strtoumax(s, &end, 10);
+	while (*end == ' ' || *end == '\t') {
+		end++;
+	}
+	const char *path = end;
+	if (pprof->nmappings > 0 &&
+	    m.start < pprof->mappings[pprof->nmappings - 1].limit) {
+		/* Not sorted, or overlapping. */
+		return false;
+	}
+
+	/* The mappings of a file are adjacent, so only compare to the last. */
+	if (pprof->nmappings > 0 && strcmp(path, maps_buf->prev_path) == 0) {
+		m.filename = pprof->mappings[pprof->nmappings - 1].filename;
+	} else if (*path == '\0') {
+		m.filename = 0;
+	} else {
+		m.filename = prof_pprof_cstring(pprof, path);
+	}
+	strcpy(maps_buf->prev_path, path);
+	return prof_pprof_mapping_add(pprof, &m);
+}
+
+static bool
+prof_pprof_maps(prof_pprof_t *pprof, read_cb_t *read_cb, void *cbopaque) {
+	tsdn_t *tsdn = tsd_tsdn(pprof->tsd);
+	prof_pprof_maps_buf_t *maps_buf = (prof_pprof_maps_buf_t *)
+	    prof_pprof_alloc(tsdn, sizeof(prof_pprof_maps_buf_t));
+	if (maps_buf == NULL) {
+		return true;
+	}
+	char *line = maps_buf->line;
+	maps_buf->prev_path[0] = '\0';
+	size_t len = 0;
+	bool skip = false;
+	bool err = false;
+	while (!err) {
+		ssize_t nread = read_cb(cbopaque, line + len,
+		    PPROF_MAPS_LINE_MAX - len);
+		if (nread <= 0) {
+			break;
+		}
+		len += (size_t)nread;
+		char *begin = line;
+		char *nl;
+		while (!err && (nl = memchr(begin, '\n', len - (size_t)(begin -
+		    line))) != NULL) {
+			*nl = '\0';
+			if (!skip) {
+				err = prof_pprof_maps_line(pprof, maps_buf,
+				    begin);
+			}
+			skip = false;
+			begin = nl + 1;
+		}
+		len -= (size_t)(begin - line);
+		if (len == PPROF_MAPS_LINE_MAX) {
+			/* Drop the overly long line, up to its end. */
+			skip = true;
+			len = 0;
+		} else {
+			memmove(line, begin, len);
+		}
+	}
+	if (!err && len > 0 && !skip) {
+		line[len] = '\0';
+		err = prof_pprof_maps_line(pprof, maps_buf, line);
+	}
+	idalloctm(tsdn, maps_buf, NULL, NULL, true, true);
+	return err;
+}
+
+static uint64_t
+prof_pprof_mapping_find(prof_pprof_t *pprof, uintptr_t addr) {
+	size_t lo = 0;
+	size_t hi = pprof->nmappings;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		const prof_pprof_mapping_t *m = &pprof->mappings[mid];
+		if (addr < m->start) {
+			hi = mid;
+		} else if (addr >= m->limit) {
+			lo = mid + 1;
+		} else {
+			return mid + 1;
+		}
+	}
+	return 0;
+}
+
+/* Returns the id of the location of pc, or 0 on OOM. */
+static uint64_t
+prof_pprof_location(prof_pprof_t *pprof, void *pc) {
+	void *data;
+	if (!ckh_search(&pprof->locations, pc, NULL, &data)) {
+		return (uint64_t)(uintptr_t)data;
+	}
+	uint64_t id = pprof->nlocations + 1;
+	if (ckh_insert(pprof->tsd, &pprof->locations, pc,
+	    (void *)(uintptr_t)id)) {
+		return 0;
+	}
+	pprof->nlocations = id;
+
+	/* Backtraces hold return addresses; point at the calls instead. */
+	uintptr_t addr = (uintptr_t)pc - 1;
+	uint64_t mapping_id = prof_pprof_mapping_find(pprof, addr);
+	prof_pprof_len(pprof, PPROF_PROFILE_LOCATION, prof_pprof_uint_len(id) +
+	    prof_pprof_uint_len(mapping_id) + prof_pprof_uint_len(addr));
+	prof_pprof_uint(pprof, PPROF_LOCATION_ID, id);
+	prof_pprof_uint(pprof, PPROF_LOCATION_MAPPING_ID, mapping_id);
+	prof_pprof_uint(pprof, PPROF_LOCATION_ADDRESS, addr);
+	return id;
+}
+
+static uint64_t
+prof_pprof_objs(uint64_t objs_shifted_unbiased) {
+	return (objs_shifted_unbiased + ((ZU(1) << SC_LG_TINY_MIN) >> 1)) >>
+	    SC_LG_TINY_MIN;
+}
+
+static bool
+prof_pprof_sample(void *opaque, const prof_bt_t *bt, const prof_cnt_t *cnts) {
+	prof_pprof_t *pprof = (prof_pprof_t *)opaque;
+	if (pprof->oom) {
+		return true;
+	}
+
+	/* Samples refer to locations by id, so emit any new ones first. */
+	size_t locs_len = 0;
+	for (unsigned i = 0; i < bt->len; i++) {
+		uint64_t id = prof_pprof_location(pprof, bt->vec[i]);
+		if (id == 0) {
+			pprof->oom = true;
+			return true;
+		}
+		locs_len += prof_pprof_varint_len(id);
+	}
+
+	/*
+	 * Same counts as in the legacy dump.  pprof doesn't unbias the values
+	 * by itself though, so with opt_prof_unbias, use the estimates that are
+	 * tracked along with the raw counts directly.
+	 */
+	uint64_t values[4];
+	unsigned nvalues = 0;
+	if (opt_prof_accum) {
+		values[nvalues++] = opt_prof_unbias ? prof_pprof_objs(
+		    cnts->accumobjs_shifted_unbiased) : cnts->accumobjs;
+		values[nvalues++] = opt_prof_unbias ?
+		    cnts->accumbytes_unbiased : cnts->accumbytes;
+	}
+	values[nvalues++] = opt_prof_unbias ?
+	    prof_pprof_objs(cnts->curobjs_shifted_unbiased) : cnts->curobjs;
+	values[nvalues++] = opt_prof_unbias ? cnts->curbytes_unbiased :
+	    cnts->curbytes;
+	size_t values_len = 0;
+	for (unsigned i = 0; i < nvalues; i++) {
+		/* See the comment on races in prof_dump_gctx(). */
+		if (values[i] > INT64_MAX) {
+			values[i] = 0;
+		}
+		values_len += prof_pprof_varint_len(values[i]);
+	}
+
+	size_t len = 1 + prof_pprof_varint_len(values_len) + values_len;
+	if (locs_len > 0) {
+		len += 1 + prof_pprof_varint_len(locs_len) + locs_len;
+	}
+	prof_pprof_len(pprof, PPROF_PROFILE_SAMPLE, len);
+	if (locs_len > 0) {
+		prof_pprof_len(pprof, PPROF_SAMPLE_LOCATION_ID, locs_len);
+		for (unsigned i = 0; i < bt->len; i++) {
+			void *data;
+			bool missing = ckh_search(&pprof->locations,
+			    bt->vec[i], NULL, &data);
+			assert(!missing);
+			(void)missing;
+			prof_pprof_varint(pprof, (uint64_t)(uintptr_t)data);
+		}
+	}
+	prof_pprof_len(pprof, PPROF_SAMPLE_VALUE, values_len);
+	for (unsigned i = 0; i < nvalues; i++) {
+		prof_pprof_varint(pprof, values[i]);
+	}
+	return false;
+}
+
+bool
+prof_pprof_dump(tsd_t *tsd, gz_write_cb_t *write_cb, void *cbopaque,
+    unsigned char *buf, size_t buf_size, read_cb_t *maps_read_cb,
+    void *maps_cbopaque, prof_tdata_t *tdata, bool leakcheck) {
+	cassert(config_prof);
+	assert(buf_size > 0);
+
+	prof_pprof_t pprof;
+	memset(&pprof, 0, sizeof(pprof));
+	pprof.tsd = tsd;
+	pprof.write_cb = write_cb;
+	pprof.cbopaque = cbopaque;
+	pprof.buf = buf;
+	pprof.buf_size = buf_size;
+	bool have_locations = !ckh_new(tsd, &pprof.locations,
+	    PROF_CKH_MINITEMS, ckh_pointer_hash, ckh_pointer_keycomp);
+	pprof.oom = !have_locations;
+
+	if (!pprof.oom) {
+		prof_pprof_header(&pprof);
+		if (maps_read_cb != NULL) {
+			pprof.oom = prof_pprof_maps(&pprof, maps_read_cb,
+			    maps_cbopaque);
+		}
+	}
+	/* Even after OOM, so that the leak check still happens. */
+	prof_dump_visit(tsd, prof_pprof_sample, &pprof, tdata, leakcheck);
+	prof_pprof_flush(&pprof);
+
+	if (pprof.mappings != NULL) {
+		idalloctm(tsd_tsdn(tsd), pprof.mappings, NULL, NULL, true,
+		    true);
+	}
+	if (have_locations) {
+		ckh_delete(tsd, &pprof.locations);
+	}
+	return pprof.oom;
+}
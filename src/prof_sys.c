@@ -2,9 +2,11 @@
 #include "jemalloc/internal/jemalloc_internal_includes.h"
 
 #include "jemalloc/internal/buf_writer.h"
+#include "jemalloc/internal/gz_writer.h"
 #include "jemalloc/internal/ctl.h"
 #include "jemalloc/internal/malloc_io.h"
 #include "jemalloc/internal/prof_data.h"
+#include "jemalloc/internal/prof_pprof.h"
 #include "jemalloc/internal/prof_sys.h"
 
 #ifdef JEMALLOC_PROF_LIBUNWIND
@@ -45,6 +47,52 @@ bt_init(prof_bt_t *bt, void **vec) {
 	bt->len = 0;
 }
 
+#ifdef JEMALLOC_PROF_FAST_UNWIND
+/*
+ * Walks the frame pointer chain, within the bounds of the current thread's
+ * stack.  These are cached per thread, and only looked up again (from /proc)
+ * when the stack pointer is found outside of them.
+ */
+JEMALLOC_DIAGNOSTIC_PUSH
+JEMALLOC_DIAGNOSTIC_IGNORE_FRAME_ADDRESS
+static void
+prof_backtrace_fp(void **vec, unsigned *len, unsigned max_len) {
+  // stack_start - highest possible valid stack address (assumption: stacks grow downward)
+  //   stack_end - current stack frame and lowest possible valid stack address
+  //               (all earlier frames will be at higher addresses than this)
+
+  // always safe to get the current stack frame address
+  void** stack_end = (void**)__builtin_frame_address(0);
+  if (stack_end == NULL) {
+    *len = 0;
+    return;
+  }
+
+  static __thread void **stack_start = (void **)0;  // thread local
+  if (stack_start == 0 || stack_end >= stack_start) {
+    stack_start = (void**)prof_thread_stack_start((uintptr_t)stack_end);
+  }
+
+  if (stack_start == 0 || stack_end >= stack_start) {
+    *len = 0;
+    return;
+  }
+
+  unsigned ii = 0;
+  void** fp = (void**)stack_end;
+  while (fp < stack_start && ii < max_len) {
+    vec[ii++] = fp[1];
+    void** fp_prev = fp;
+    fp = fp[0];
+    if (unlikely(fp <= fp_prev)) { // sanity check forward progress
+      break;
+    }
+  }
+  *len = ii;
+}
+JEMALLOC_DIAGNOSTIC_POP
+#endif
+
 #ifdef JEMALLOC_PROF_LIBUNWIND
 static void
 prof_backtrace_impl(void **vec, unsigned *len, unsigned max_len) {
@@ -100,44 +148,10 @@ prof_backtrace_impl(void **vec, unsigned *len, unsigned max_len) {
 	_Unwind_Backtrace(prof_unwind_callback, &data);
 }
 #elif (defined(JEMALLOC_PROF_FRAME_POINTER))
-JEMALLOC_DIAGNOSTIC_PUSH
-JEMALLOC_DIAGNOSTIC_IGNORE_FRAME_ADDRESS
 static void
 prof_backtrace_impl(void **vec, unsigned *len, unsigned max_len) {
-  // stack_start - highest possible valid stack address (assumption: stacks grow downward)
-  //   stack_end - current stack frame and lowest possible valid stack address
-  //               (all earlier frames will be at higher addresses than this)
-
-  // always safe to get the current stack frame address
-  void** stack_end = (void**)__builtin_frame_address(0);
-  if (stack_end == NULL) {
-    *len = 0;
-    return;
-  }
-
-  static __thread void **stack_start = (void **)0;  // thread local
-  if (stack_start == 0 || stack_end >= stack_start) {
-    stack_start = (void**)prof_thread_stack_start((uintptr_t)stack_end);
-  }
-
-  if (stack_start == 0 || stack_end >= stack_start) {
-    *len = 0;
-    return;
-  }
-
-  unsigned ii = 0;
-  void** fp = (void**)stack_end;
-  while (fp < stack_start && ii < max_len) {
-    vec[ii++] = fp[1];
-    void** fp_prev = fp;
-    fp = fp[0];
-    if (unlikely(fp <= fp_prev)) { // sanity check forward progress
-      break;
-    }
-  }
-  *len = ii;
+	prof_backtrace_fp(vec, len, max_len);
 }
-JEMALLOC_DIAGNOSTIC_POP
 #elif (defined(JEMALLOC_PROF_GCC))
 JEMALLOC_DIAGNOSTIC_PUSH
 JEMALLOC_DIAGNOSTIC_IGNORE_FRAME_ADDRESS
@@ -469,7 +483,15 @@ prof_backtrace(tsd_t *tsd, prof_bt_t *bt) {
 
 void
 prof_hooks_init(void) {
+#ifdef JEMALLOC_PROF_FAST_UNWIND
+	if (opt_prof_fast_unwind) {
+		prof_backtrace_hook_set(&prof_backtrace_fp);
+	} else {
+		prof_backtrace_hook_set(&prof_backtrace_impl);
+	}
+#else
 	prof_backtrace_hook_set(&prof_backtrace_impl);
+#endif
 	prof_dump_hook_set(NULL);
 	prof_sample_hook_set(NULL);
 	prof_sample_free_hook_set(NULL);
@@ -627,17 +649,21 @@ prof_dump_open(prof_dump_arg_t *arg, const char *filename) {
 prof_dump_write_file_t *JET_MUTABLE prof_dump_write_file = malloc_write_fd;
 
 static void
-prof_dump_flush(void *opaque, const char *s) {
+prof_dump_write_bytes(void *opaque, const void *buf, size_t len) {
 	cassert(config_prof);
 	prof_dump_arg_t *arg = (prof_dump_arg_t *)opaque;
 	if (!arg->error) {
-		ssize_t err = prof_dump_write_file(arg->prof_dump_fd, s,
-		    strlen(s));
+		ssize_t err = prof_dump_write_file(arg->prof_dump_fd, buf, len);
 		prof_dump_check_possible_error(arg, err == -1,
 		    "<jemalloc>: failed to write during heap profile flush\n");
 	}
 }
 
+static void
+prof_dump_flush(void *opaque, const char *s) {
+	prof_dump_write_bytes(opaque, s, strlen(s));
+}
+
 static void
 prof_dump_close(prof_dump_arg_t *arg) {
 	if (arg->prof_dump_fd != -1) {
@@ -662,18 +688,22 @@ typedef struct segment_command segment_command_t;
 #define LC_SEGMENT_VALUE LC_SEGMENT
 #endif
 
-static void
-prof_dump_dyld_image_vmaddr(buf_writer_t *buf_writer, uint32_t image_index) {
+/*
+ * Gets the address range and file offset of the __TEXT segment of an image.
+ * Returns true if it has none.
+ */
+static bool
+prof_dyld_image_text_get(uint32_t image_index, unsigned long long *start,
+    unsigned long long *limit, unsigned long long *offset) {
 	const mach_header_t *header = (const mach_header_t *)
 	    _dyld_get_image_header(image_index);
 	if (header == NULL || (header->magic != MH_MAGIC_VALUE &&
 	    header->magic != MH_CIGAM_VALUE)) {
 		// Invalid header
-		return;
+		return true;
 	}
 
 	intptr_t slide = _dyld_get_image_vmaddr_slide(image_index);
-	const char *name = _dyld_get_image_name(image_index);
 	struct load_command *load_cmd = (struct load_command *)
 	    ((char *)header + sizeof(mach_header_t));
 	for (uint32_t i = 0; load_cmd && (i < header->ncmds); i++) {
@@ -681,17 +711,28 @@ prof_dump_dyld_image_vmaddr(buf_writer_t *buf_writer, uint32_t image_index) {
 			const segment_command_t *segment_cmd =
 			    (const segment_command_t *)load_cmd;
 			if (!strcmp(segment_cmd->segname, "__TEXT")) {
-				char buffer[PATH_MAX + 1];
-				malloc_snprintf(buffer, sizeof(buffer),
-				    "%016llx-%016llx: %s\n", segment_cmd->vmaddr + slide,
-				    segment_cmd->vmaddr + slide + segment_cmd->vmsize, name);
-				buf_writer_cb(buf_writer, buffer);
-				return;
+				*start = segment_cmd->vmaddr + slide;
+				*limit = *start + segment_cmd->vmsize;
+				*offset = segment_cmd->fileoff;
+				return false;
 			}
 		}
 		load_cmd =
 		    (struct load_command *)((char *)load_cmd + load_cmd->cmdsize);
 	}
+	return true;
+}
+
+static void
+prof_dump_dyld_image_vmaddr(buf_writer_t *buf_writer, uint32_t image_index) {
+	unsigned long long start, limit, offset;
+	if (prof_dyld_image_text_get(image_index, &start, &limit, &offset)) {
+		return;
+	}
+	char buffer[PATH_MAX + 1];
+	malloc_snprintf(buffer, sizeof(buffer), "%016llx-%016llx: %s\n", start,
+	    limit, _dyld_get_image_name(image_index));
+	buf_writer_cb(buf_writer, buffer);
 }
 
 static void
@@ -710,6 +751,92 @@ prof_dump_maps(buf_writer_t *buf_writer) {
 	/* No proc map file to read on MacOS, dump dyld maps for backtrace. */
 	prof_dump_dyld_maps(buf_writer);
 }
+
+/*
+ * The pprof mappings come from the __TEXT segments of the dyld images instead,
+ * formatted as /proc/<pid>/maps lines, in address order.
+ */
+typedef struct prof_dyld_maps_s prof_dyld_maps_t;
+struct prof_dyld_maps_s {
+	/* Only the images starting after the last one formatted are left. */
+	bool started;
+	unsigned long long prev_start;
+	char line[PATH_MAX + 128];
+	size_t len;
+	size_t off;
+};
+
+/* Formats the next image into maps->line.  Returns true if there is none. */
+static bool
+prof_dyld_maps_next(prof_dyld_maps_t *maps) {
+	uint32_t image_count = _dyld_image_count();
+	bool found = false;
+	uint32_t next = 0;
+	unsigned long long next_start = 0, next_limit = 0, next_offset = 0;
+	for (uint32_t i = 0; i < image_count; i++) {
+		unsigned long long start, limit, offset;
+		if (prof_dyld_image_text_get(i, &start, &limit, &offset) ||
+		    (maps->started && start <= maps->prev_start) ||
+		    (found && start >= next_start)) {
+			continue;
+		}
+		found = true;
+		next = i;
+		next_start = start;
+		next_limit = limit;
+		next_offset = offset;
+	}
+	if (!found) {
+		return true;
+	}
+	maps->started = true;
+	maps->prev_start = next_start;
+	const char *name = _dyld_get_image_name(next);
+	maps->len = malloc_snprintf(maps->line, sizeof(maps->line),
+	    "%016llx-%016llx r-xp %08llx 00:00 0 %s\n", next_start, next_limit,
+	    next_offset, name == NULL ? "" : name);
+	if (maps->len >= sizeof(maps->line)) {
+		/* Cut short; still end the line. */
+		maps->len = sizeof(maps->line) - 1;
+		maps->line[maps->len - 1] = '\n';
+	}
+	maps->off = 0;
+	return false;
+}
+
+static ssize_t
+prof_dump_read_dyld_maps_cb(void *read_cbopaque, void *buf, size_t limit) {
+	prof_dyld_maps_t *maps = (prof_dyld_maps_t *)read_cbopaque;
+	size_t nread = 0;
+	while (nread < limit) {
+		if (maps->off == maps->len && prof_dyld_maps_next(maps)) {
+			break;
+		}
+		size_t n = maps->len - maps->off;
+		if (n > limit - nread) {
+			n = limit - nread;
+		}
+		memcpy((char *)buf + nread, maps->line + maps->off, n);
+		maps->off += n;
+		nread += n;
+	}
+	return (ssize_t)nread;
+}
+
+static void
+prof_dump_pprof(tsd_t *tsd, prof_dump_arg_t *arg, gz_write_cb_t *write_cb,
+    void *cbopaque, prof_tdata_t *tdata, bool leakcheck) {
+	prof_dyld_maps_t maps;
+	maps.started = false;
+	maps.len = maps.off = 0;
+	bool err = prof_pprof_dump(tsd, write_cb, cbopaque,
+	    (unsigned char *)prof_dump_buf, PROF_DUMP_BUFSIZE,
+	    prof_dump_read_dyld_maps_cb, &maps, tdata, leakcheck);
+	if (!arg->error) {
+		prof_dump_check_possible_error(arg, err,
+		    "<jemalloc>: failed to allocate heap profile pprof data\n");
+	}
+}
 #else /* !__APPLE__ */
 #ifndef _WIN32
 JEMALLOC_FORMAT_PRINTF(1, 2)
@@ -776,6 +903,22 @@ prof_dump_maps(buf_writer_t *buf_writer) {
 	buf_writer_pipe(buf_writer, prof_dump_read_maps_cb, &mfd);
 	close(mfd);
 }
+
+static void
+prof_dump_pprof(tsd_t *tsd, prof_dump_arg_t *arg, gz_write_cb_t *write_cb,
+    void *cbopaque, prof_tdata_t *tdata, bool leakcheck) {
+	int mfd = prof_dump_open_maps == NULL ? -1 : prof_dump_open_maps();
+	bool err = prof_pprof_dump(tsd, write_cb, cbopaque,
+	    (unsigned char *)prof_dump_buf, PROF_DUMP_BUFSIZE,
+	    mfd == -1 ? NULL : prof_dump_read_maps_cb, &mfd, tdata, leakcheck);
+	if (mfd != -1) {
+		close(mfd);
+	}
+	if (!arg->error) {
+		prof_dump_check_possible_error(arg, err,
+		    "<jemalloc>: failed to allocate heap profile pprof data\n");
+	}
+}
 #endif /* __APPLE__ */
 
 static bool
@@ -797,12 +940,44 @@ prof_dump(tsd_t *tsd, bool propagate_err, const char *filename,
 
 	prof_dump_open(&arg, filename);
 	buf_writer_t buf_writer;
-	bool err = buf_writer_init(tsd_tsdn(tsd), &buf_writer, prof_dump_flush,
-	    &arg, prof_dump_buf, PROF_DUMP_BUFSIZE);
-	assert(!err);
-	prof_dump_impl(tsd, buf_writer_cb, &buf_writer, tdata, leakcheck);
-	prof_dump_maps(&buf_writer);
-	buf_writer_terminate(tsd_tsdn(tsd), &buf_writer);
+	gz_writer_t gz_writer;
+	bool err;
+	if (opt_prof_dump_gzip) {
+		err = gz_writer_init(tsd_tsdn(tsd), &gz_writer,
+		    prof_dump_write_bytes, &arg);
+		if (!arg.error) {
+			prof_dump_check_possible_error(&arg, err,
+			    "<jemalloc>: failed to allocate heap profile "
+			    "compression buffers\n");
+		}
+	}
+	if (opt_prof_dump_format == prof_dump_format_pprof) {
+		if (opt_prof_dump_gzip) {
+			prof_dump_pprof(tsd, &arg, gz_writer_write, &gz_writer,
+			    tdata, leakcheck);
+		} else {
+			prof_dump_pprof(tsd, &arg, prof_dump_write_bytes, &arg,
+			    tdata, leakcheck);
+		}
+	} else {
+		if (opt_prof_dump_gzip) {
+			err = buf_writer_init(tsd_tsdn(tsd), &buf_writer,
+			    gz_writer_cb, &gz_writer, prof_dump_buf,
+			    PROF_DUMP_BUFSIZE);
+		} else {
+			err = buf_writer_init(tsd_tsdn(tsd), &buf_writer,
+			    prof_dump_flush, &arg, prof_dump_buf,
+			    PROF_DUMP_BUFSIZE);
+		}
+		assert(!err);
+		prof_dump_impl(tsd, buf_writer_cb, &buf_writer, tdata,
+		    leakcheck);
+		prof_dump_maps(&buf_writer);
+		buf_writer_terminate(tsd_tsdn(tsd), &buf_writer);
+	}
+	if (opt_prof_dump_gzip) {
+		gz_writer_terminate(tsd_tsdn(tsd), &gz_writer);
+	}
 	prof_dump_close(&arg);
 
 	prof_dump_hook_t dump_hook = prof_dump_hook_get();
@@ -853,31 +1028,39 @@ prof_dump_filename(tsd_t *tsd, char *filename, char v, uint64_t vseq) {
 
 	assert(tsd_reentrancy_level_get(tsd) == 0);
 	const char *prefix = prof_prefix_get(tsd_tsdn(tsd));
+	/* pprof dumps end in ".pb", and compressed ones get an extra ".gz". */
+	const char *suffix;
+	if (opt_prof_dump_format == prof_dump_format_pprof) {
+		suffix = opt_prof_dump_gzip ? ".pb.gz" : ".pb";
+	} else {
+		suffix = opt_prof_dump_gzip ? ".heap.gz" : ".heap";
+	}
 
 	if (vseq != VSEQ_INVALID) {
 		if (opt_prof_pid_namespace) {
 			/* "<prefix>.<pid_namespace>.<pid>.<seq>.v<vseq>.heap" */
 			malloc_snprintf(filename, DUMP_FILENAME_BUFSIZE,
-			    "%s.%ld.%d.%"FMTu64".%c%"FMTu64".heap", prefix,
+			    "%s.%ld.%d.%"FMTu64".%c%"FMTu64"%s", prefix,
 			    prof_get_pid_namespace(), prof_getpid(), prof_dump_seq, v,
-			    vseq);
+			    vseq, suffix);
 		} else {
 			/* "<prefix>.<pid>.<seq>.v<vseq>.heap" */
 			malloc_snprintf(filename, DUMP_FILENAME_BUFSIZE,
-			    "%s.%d.%"FMTu64".%c%"FMTu64".heap", prefix, prof_getpid(),
-			    prof_dump_seq, v, vseq);
+			    "%s.%d.%"FMTu64".%c%"FMTu64"%s", prefix, prof_getpid(),
+			    prof_dump_seq, v, vseq, suffix);
 		}
 	} else {
 		if (opt_prof_pid_namespace) {
 			/* "<prefix>.<pid_namespace>.<pid>.<seq>.<v>.heap" */
 			malloc_snprintf(filename, DUMP_FILENAME_BUFSIZE,
-			    "%s.%ld.%d.%"FMTu64".%c.heap", prefix,
-			    prof_get_pid_namespace(), prof_getpid(), prof_dump_seq, v);
+			    "%s.%ld.%d.%"FMTu64".%c%s", prefix,
+			    prof_get_pid_namespace(), prof_getpid(), prof_dump_seq, v,
+			    suffix);
 		} else {
 			/* "<prefix>.<pid>.<seq>.<v>.heap" */
 			malloc_snprintf(filename, DUMP_FILENAME_BUFSIZE,
-			    "%s.%d.%"FMTu64".%c.heap", prefix, prof_getpid(),
-			    prof_dump_seq, v);
+			    "%s.%d.%"FMTu64".%c%s", prefix, prof_getpid(),
+			    prof_dump_seq, v, suffix);
 		}
 	}
 	prof_dump_seq++;
@@ -246,6 +246,42 @@ rtree_leaf_elm_lookup_hard(tsdn_t *tsdn, rtree_t *rtree, rtree_ctx_t *rtree_ctx,
 	not_reached();
 }
 
+#if RTREE_HEIGHT > 1
+static void
+rtree_leaves_iter_node(rtree_node_elm_t *node, unsigned level, uintptr_t key,
+    rtree_leaf_visitor_t *visitor, void *ctx) {
+	unsigned ptrbits = ZU(1) << (LG_SIZEOF_PTR+3);
+	unsigned shiftbits = ptrbits - rtree_levels[level].cumbits;
+	size_t nelms = ZU(1) << rtree_levels[level].bits;
+	for (size_t i = 0; i < nelms; i++) {
+		uintptr_t child_key = key | ((uintptr_t)i << shiftbits);
+		if (level + 2 < RTREE_HEIGHT) {
+			rtree_node_elm_t *child = rtree_child_node_tryread(
+			    &node[i], /* dependent */ false);
+			if (rtree_node_valid(child)) {
+				rtree_leaves_iter_node(child, level + 1,
+				    child_key, visitor, ctx);
+			}
+		} else {
+			rtree_leaf_elm_t *leaf = rtree_child_leaf_tryread(
+			    &node[i], /* dependent */ false);
+			if (rtree_leaf_valid(leaf)) {
+				visitor(ctx, child_key, leaf);
+			}
+		}
+	}
+}
+#endif
+
+void
+rtree_leaves_iter(rtree_t *rtree, rtree_leaf_visitor_t *visitor, void *ctx) {
+#if RTREE_HEIGHT > 1
+	rtree_leaves_iter_node(rtree->root, 0, 0, visitor, ctx);
+#else
+	visitor(ctx, 0, rtree->root);
+#endif
+}
+
 void
 rtree_ctx_data_init(rtree_ctx_t *ctx) {
 	for (unsigned i = 0; i < RTREE_CTX_NCACHE; i++) {
@@ -360,8 +360,6 @@ stats_arena_bins_print(emitter_t *emitter, bool mutex, unsigned i,
 
 	COL_HDR(row, pops, NULL, right, 10, uint64)
 	COL_HDR(row, pops_ps, "(#/sec)", right, 8, uint64)
-	COL_HDR(row, failed_push, NULL, right, 13, uint64)
-	COL_HDR(row, failed_push_ps, "(#/sec)", right, 8, uint64)
 	COL_HDR(row, push, NULL, right, 7, uint64)
 	COL_HDR(row, push_ps, "(#/sec)", right, 8, uint64)
 	COL_HDR(row, push_elem, NULL, right, 12, uint64)
@@ -411,11 +409,10 @@ stats_arena_bins_print(emitter_t *emitter, bool mutex, unsigned i,
 		size_t reg_size, slab_size, curregs;
 		size_t curslabs;
 		size_t nonfull_slabs;
-		uint32_t nregs, nshards;
+		uint32_t nregs, nshards, nshards_active;
 		uint64_t nmalloc, ndalloc, nrequests, nfills, nflushes;
 		uint64_t nreslabs;
-		uint64_t batch_pops, batch_failed_pushes, batch_pushes,
-		    batch_pushed_elems;
+		uint64_t batch_pops, batch_pushes, batch_pushed_elems;
 		prof_stats_t prof_live;
 		prof_stats_t prof_accum;
 
@@ -463,11 +460,11 @@ stats_arena_bins_print(emitter_t *emitter, bool mutex, unsigned i,
 		CTL_LEAF(stats_arenas_mib, 5, "curslabs", &curslabs, size_t);
 		CTL_LEAF(stats_arenas_mib, 5, "nonfull_slabs", &nonfull_slabs,
 		    size_t);
+		CTL_LEAF(stats_arenas_mib, 5, "nshards", &nshards_active,
+		    uint32_t);
 
 		CTL_LEAF(stats_arenas_mib, 5, "batch_pops", &batch_pops,
 		    uint64_t);
-		CTL_LEAF(stats_arenas_mib, 5, "batch_failed_pushes",
-		    &batch_failed_pushes, uint64_t);
 		CTL_LEAF(stats_arenas_mib, 5, "batch_pushes",
 		    &batch_pushes, uint64_t);
 		CTL_LEAF(stats_arenas_mib, 5, "batch_pushed_elems",
@@ -507,10 +504,10 @@ stats_arena_bins_print(emitter_t *emitter, bool mutex, unsigned i,
 		    &curslabs);
 		emitter_json_kv(emitter, "nonfull_slabs", emitter_type_size,
 		    &nonfull_slabs);
+		emitter_json_kv(emitter, "nshards", emitter_type_uint32,
+		    &nshards_active);
 		emitter_json_kv(emitter, "batch_pops",
 		    emitter_type_uint64, &batch_pops);
-		emitter_json_kv(emitter, "batch_failed_pushes",
-		    emitter_type_uint64, &batch_failed_pushes);
 		emitter_json_kv(emitter, "batch_pushes",
 		    emitter_type_uint64, &batch_pushes);
 		emitter_json_kv(emitter, "batch_pushed_elems",
@@ -577,9 +574,6 @@ stats_arena_bins_print(emitter_t *emitter, bool mutex, unsigned i,
 		col_pops_ps.uint64_val
 		    = rate_per_second(batch_pops, uptime);
 
-		col_failed_push.uint64_val = batch_failed_pushes;
-		col_failed_push_ps.uint64_val
-		    = rate_per_second(batch_failed_pushes, uptime);
 		col_push.uint64_val = batch_pushes;
 		col_push_ps.uint64_val
 		    = rate_per_second(batch_pushes, uptime);
@@ -858,6 +852,8 @@ stats_arena_hpa_shard_counters_print(emitter_t *emitter, unsigned i,
 	uint64_t npurges;
 	uint64_t nhugifies;
 	uint64_t nhugify_failures;
+	uint64_t nrehugifies;
+	uint64_t nrehugify_failures;
 	uint64_t ndehugifies;
 
 	CTL_M2_GET("stats.arenas.0.hpa_shard.npageslabs",
@@ -891,6 +887,10 @@ stats_arena_hpa_shard_counters_print(emitter_t *emitter, unsigned i,
 	    i, &nhugifies, uint64_t);
 	CTL_M2_GET("stats.arenas.0.hpa_shard.nhugify_failures",
 	    i, &nhugify_failures, uint64_t);
+	CTL_M2_GET("stats.arenas.0.hpa_shard.nrehugifies",
+	    i, &nrehugifies, uint64_t);
+	CTL_M2_GET("stats.arenas.0.hpa_shard.nrehugify_failures",
+	    i, &nrehugify_failures, uint64_t);
 	CTL_M2_GET("stats.arenas.0.hpa_shard.ndehugifies",
 	    i, &ndehugifies, uint64_t);
 
@@ -904,6 +904,8 @@ stats_arena_hpa_shard_counters_print(emitter_t *emitter, unsigned i,
 	    "  Purges: %" FMTu64 " (%" FMTu64 " / sec)\n"
 	    "  Hugeifies: %" FMTu64 " (%" FMTu64 " / sec)\n"
 	    "  Hugify failures: %" FMTu64 " (%" FMTu64 " / sec)\n"
+	    "  Rehugifies: %" FMTu64 " (%" FMTu64 " / sec)\n"
+	    "  Rehugify failures: %" FMTu64 " (%" FMTu64 " / sec)\n"
 	    "  Dehugifies: %" FMTu64 " (%" FMTu64 " / sec)\n"
 	    "\n",
 	    npageslabs, npageslabs_huge, npageslabs_nonhuge,
@@ -914,6 +916,8 @@ stats_arena_hpa_shard_counters_print(emitter_t *emitter, unsigned i,
 	    npurges, rate_per_second(npurges, uptime),
 	    nhugifies, rate_per_second(nhugifies, uptime),
 	    nhugify_failures, rate_per_second(nhugify_failures, uptime),
+	    nrehugifies, rate_per_second(nrehugifies, uptime),
+	    nrehugify_failures, rate_per_second(nrehugify_failures, uptime),
 	    ndehugifies, rate_per_second(ndehugifies, uptime));
 
 	emitter_json_kv(emitter, "npageslabs", emitter_type_size,
@@ -931,6 +935,10 @@ stats_arena_hpa_shard_counters_print(emitter_t *emitter, unsigned i,
 	    &nhugifies);
 	emitter_json_kv(emitter, "nhugify_failures", emitter_type_uint64,
 	    &nhugify_failures);
+	emitter_json_kv(emitter, "nrehugifies", emitter_type_uint64,
+	    &nrehugifies);
+	emitter_json_kv(emitter, "nrehugify_failures", emitter_type_uint64,
+	    &nrehugify_failures);
 	emitter_json_kv(emitter, "ndehugifies", emitter_type_uint64,
 	    &ndehugifies);
 
@@ -1183,6 +1191,7 @@ stats_arena_print(emitter_t *emitter, unsigned i, bool bins, bool large,
 	char *namep = name;
 	unsigned nthreads;
 	const char *dss;
+	int numa_node;
 	ssize_t dirty_decay_ms, muzzy_decay_ms;
 	size_t page, pactive, pdirty, pmuzzy, mapped, retained;
 	size_t base, internal, resident, metadata_edata, metadata_rtree,
@@ -1216,6 +1225,12 @@ stats_arena_print(emitter_t *emitter, unsigned i, bool bins, bool large,
 	emitter_kv(emitter, "dss", "dss allocation precedence",
 	    emitter_type_string, &dss);
 
+	CTL_M2_GET("stats.arenas.0.numa_node", i, &numa_node, int);
+	if (numa_node >= 0) {
+		emitter_kv(emitter, "numa_node", "NUMA node", emitter_type_int,
+		    &numa_node);
+	}
+
 	CTL_M2_GET("stats.arenas.0.dirty_decay_ms", i, &dirty_decay_ms,
 	    ssize_t);
 	CTL_M2_GET("stats.arenas.0.muzzy_decay_ms", i, &muzzy_decay_ms,
@@ -1646,15 +1661,19 @@ stats_general_print(emitter_t *emitter) {
 	OPT_WRITE_BOOL("cache_oblivious")
 	OPT_WRITE_BOOL("confirm_conf")
 	OPT_WRITE_BOOL("retain")
+	OPT_WRITE_BOOL("huge_slabs")
 	OPT_WRITE_CHAR_P("dss")
 	OPT_WRITE_UNSIGNED("narenas")
 	OPT_WRITE_CHAR_P("percpu_arena")
 	OPT_WRITE_SIZE_T("oversize_threshold")
 	OPT_WRITE_BOOL("hpa")
 	OPT_WRITE_SIZE_T("hpa_slab_max_alloc")
+	OPT_WRITE_SIZE_T("hpa_large_max_alloc")
 	OPT_WRITE_SIZE_T("hpa_hugification_threshold")
 	OPT_WRITE_UINT64("hpa_hugify_delay_ms")
 	OPT_WRITE_BOOL("hpa_hugify_sync")
+	OPT_WRITE_SIZE_T("hpa_rehugify_max_nhp")
+	OPT_WRITE_UINT64("hpa_rehugify_interval_ms")
 	OPT_WRITE_UINT64("hpa_min_purge_interval_ms")
 	OPT_WRITE_SSIZE_T("experimental_hpa_max_purge_nhp")
 	if (je_mallctl("opt.hpa_dirty_mult", (void *)&u32v, &u32sz, NULL, 0)
@@ -1683,9 +1702,13 @@ stats_general_print(emitter_t *emitter) {
 	OPT_WRITE_CHAR_P("metadata_thp")
 	OPT_WRITE_INT64("mutex_max_spin")
 	OPT_WRITE_BOOL_MUTABLE("background_thread", "background_thread")
+	OPT_WRITE_BOOL("pressure_purge")
+	OPT_WRITE_UNSIGNED("pressure_purge_threshold")
 	OPT_WRITE_SSIZE_T_MUTABLE("dirty_decay_ms", "arenas.dirty_decay_ms")
 	OPT_WRITE_SSIZE_T_MUTABLE("muzzy_decay_ms", "arenas.muzzy_decay_ms")
 	OPT_WRITE_SIZE_T("lg_extent_max_active_fit")
+	OPT_WRITE_SIZE_T("mem_limit")
+	OPT_WRITE_BOOL("mem_limit_fail")
 	OPT_WRITE_CHAR_P("junk")
 	OPT_WRITE_BOOL("zero")
 	OPT_WRITE_BOOL("utrace")
@@ -1693,10 +1716,14 @@ stats_general_print(emitter_t *emitter) {
 	OPT_WRITE_BOOL("experimental_infallible_new")
 	OPT_WRITE_BOOL("experimental_tcache_gc")
 	OPT_WRITE_SIZE_T("max_batched_size")
-	OPT_WRITE_SIZE_T("remote_free_max")
 	OPT_WRITE_SIZE_T("remote_free_max_batch")
+	OPT_WRITE_UNSIGNED("bin_shards_max")
 	OPT_WRITE_BOOL("tcache")
 	OPT_WRITE_SIZE_T("tcache_max")
+	OPT_WRITE_BOOL("percpu_tcache")
+	OPT_WRITE_BOOL("numa_arena")
+	OPT_WRITE_INT64("arena_rebalance_interval")
+	OPT_WRITE_UNSIGNED("arena_rebalance_threshold")
 	OPT_WRITE_UNSIGNED("tcache_nslots_small_min")
 	OPT_WRITE_UNSIGNED("tcache_nslots_small_max")
 	OPT_WRITE_UNSIGNED("tcache_nslots_large")
@@ -1705,10 +1732,13 @@ stats_general_print(emitter_t *emitter) {
 	OPT_WRITE_SIZE_T("tcache_gc_delay_bytes")
 	OPT_WRITE_UNSIGNED("lg_tcache_flush_small_div")
 	OPT_WRITE_UNSIGNED("lg_tcache_flush_large_div")
+	OPT_WRITE_BOOL("tcache_adaptive")
+	OPT_WRITE_SIZE_T("tcache_adaptive_max_bytes")
 	OPT_WRITE_UNSIGNED("debug_double_free_max_scan")
 	OPT_WRITE_CHAR_P("thp")
 	OPT_WRITE_BOOL("prof")
 	OPT_WRITE_UNSIGNED("prof_bt_max")
+	OPT_WRITE_BOOL("prof_fast_unwind")
 	OPT_WRITE_CHAR_P("prof_prefix")
 	OPT_WRITE_BOOL_MUTABLE("prof_active", "prof.active")
 	OPT_WRITE_BOOL_MUTABLE("prof_thread_active_init",
@@ -1720,6 +1750,9 @@ stats_general_print(emitter_t *emitter) {
 	OPT_WRITE_BOOL("prof_final")
 	OPT_WRITE_BOOL("prof_leak")
 	OPT_WRITE_BOOL("prof_leak_error")
+	OPT_WRITE_BOOL("prof_dump_incremental")
+	OPT_WRITE_BOOL("prof_dump_gzip")
+	OPT_WRITE_CHAR_P("prof_dump_format")
 	OPT_WRITE_BOOL("stats_print")
 	OPT_WRITE_CHAR_P("stats_print_opts")
 	OPT_WRITE_BOOL("stats_print")
@@ -1882,6 +1915,7 @@ stats_print_helper(emitter_t *emitter, bool merged, bool destroyed,
 	size_t num_background_threads;
 	size_t zero_reallocs;
 	uint64_t background_thread_num_runs, background_thread_run_interval;
+	uint64_t background_thread_num_pressure_periods;
 
 	CTL_GET("stats.allocated", &allocated, size_t);
 	CTL_GET("stats.active", &active, size_t);
@@ -1902,10 +1936,13 @@ stats_print_helper(emitter_t *emitter, bool merged, bool destroyed,
 		    &background_thread_num_runs, uint64_t);
 		CTL_GET("stats.background_thread.run_interval",
 		    &background_thread_run_interval, uint64_t);
+		CTL_GET("stats.background_thread.num_pressure_periods",
+		    &background_thread_num_pressure_periods, uint64_t);
 	} else {
 		num_background_threads = 0;
 		background_thread_num_runs = 0;
 		background_thread_run_interval = 0;
+		background_thread_num_pressure_periods = 0;
 	}
 
 	/* Generic global stats. */
@@ -1943,12 +1980,16 @@ stats_print_helper(emitter_t *emitter, bool merged, bool destroyed,
 	    &background_thread_num_runs);
 	emitter_json_kv(emitter, "run_interval", emitter_type_uint64,
 	    &background_thread_run_interval);
+	emitter_json_kv(emitter, "num_pressure_periods", emitter_type_uint64,
+	    &background_thread_num_pressure_periods);
 	emitter_json_object_end(emitter); /* Close "background_thread". */
 
 	emitter_table_printf(emitter, "Background threads: %zu, "
-	    "num_runs: %"FMTu64", run_interval: %"FMTu64" ns\n",
+	    "num_runs: %"FMTu64", run_interval: %"FMTu64" ns, "
+	    "pressure periods: %"FMTu64"\n",
 	    num_background_threads, background_thread_num_runs,
-	    background_thread_run_interval);
+	    background_thread_run_interval,
+	    background_thread_num_pressure_periods);
 
 	if (mutex) {
 		emitter_row_t row;
@@ -2051,6 +2092,583 @@ stats_print_helper(emitter_t *emitter, bool merged, bool destroyed,
 	}
 }
 
+/******************************************************************************/
+/* OpenMetrics output. */
+
+typedef struct stats_om_metric_s stats_om_metric_t;
+struct stats_om_metric_s {
+	/* The metric family, without the "jemalloc_" prefix. */
+	const char *name;
+	/* The mallctl, relative to the node of the section. */
+	const char *leaf;
+	emitter_metric_t metric_type;
+	emitter_type_t value_type;
+	const char *help;
+};
+
+#define OM_COUNTER(name, leaf, type, help)				\
+    {name, leaf, emitter_metric_counter, emitter_type_##type, help},
+#define OM_GAUGE(name, leaf, type, help)				\
+    {name, leaf, emitter_metric_gauge, emitter_type_##type, help},
+
+static const stats_om_metric_t stats_om_global_metrics[] = {
+	OM_GAUGE("allocated_bytes", "allocated", size,
+	    "Bytes allocated by the application")
+	OM_GAUGE("active_bytes", "active", size,
+	    "Bytes in active pages allocated by the application")
+	OM_GAUGE("metadata_bytes", "metadata", size,
+	    "Bytes dedicated to metadata")
+	OM_GAUGE("metadata_edata_bytes", "metadata_edata", size,
+	    "Bytes of metadata used for extent descriptors")
+	OM_GAUGE("metadata_rtree_bytes", "metadata_rtree", size,
+	    "Bytes of metadata used for the radix tree")
+	OM_GAUGE("metadata_thp_bytes", "metadata_thp", size,
+	    "Bytes of metadata backed by transparent huge pages")
+	OM_GAUGE("resident_bytes", "resident", size,
+	    "Bytes in physically resident data pages")
+	OM_GAUGE("mapped_bytes", "mapped", size,
+	    "Bytes in active extents mapped by the allocator")
+	OM_GAUGE("retained_bytes", "retained", size,
+	    "Bytes in virtual memory mappings that were retained")
+	OM_COUNTER("zero_reallocs", "zero_reallocs", size,
+	    "Calls to realloc(non-null-ptr, 0)")
+};
+
+static const stats_om_metric_t stats_om_background_thread_metrics[] = {
+	OM_GAUGE("background_threads", "num_threads", size,
+	    "Background threads running")
+	OM_COUNTER("background_thread_runs", "num_runs", uint64,
+	    "Runs of all background threads")
+	OM_GAUGE("background_thread_run_interval_ns", "run_interval", uint64,
+	    "Average run interval of the background threads")
+	OM_COUNTER("background_thread_pressure_periods",
+	    "num_pressure_periods", uint64,
+	    "Periods of memory pressure noticed by the background threads")
+};
+
+static const stats_om_metric_t stats_om_arena_metrics[] = {
+	OM_GAUGE("arena_threads", "nthreads", unsigned,
+	    "Threads assigned to the arena")
+	OM_GAUGE("arena_uptime_ns", "uptime", uint64,
+	    "Time since the arena was created")
+	OM_GAUGE("arena_dirty_decay_ms", "dirty_decay_ms", ssize,
+	    "Dirty page decay time, or -1")
+	OM_GAUGE("arena_muzzy_decay_ms", "muzzy_decay_ms", ssize,
+	    "Muzzy page decay time, or -1")
+	OM_GAUGE("arena_active_pages", "pactive", size,
+	    "Pages in active extents")
+	OM_GAUGE("arena_dirty_pages", "pdirty", size,
+	    "Pages within unused extents that are potentially dirty")
+	OM_GAUGE("arena_muzzy_pages", "pmuzzy", size,
+	    "Pages within unused extents that are muzzy")
+	OM_COUNTER("arena_dirty_purge_sweeps", "dirty_npurge", uint64,
+	    "Dirty page purge sweeps")
+	OM_COUNTER("arena_dirty_madvises", "dirty_nmadvise", uint64,
+	    "Madvise or similar calls made to purge dirty pages")
+	OM_COUNTER("arena_dirty_purged_pages", "dirty_purged", uint64,
+	    "Dirty pages purged")
+	OM_COUNTER("arena_muzzy_purge_sweeps", "muzzy_npurge", uint64,
+	    "Muzzy page purge sweeps")
+	OM_COUNTER("arena_muzzy_madvises", "muzzy_nmadvise", uint64,
+	    "Madvise or similar calls made to purge muzzy pages")
+	OM_COUNTER("arena_muzzy_purged_pages", "muzzy_purged", uint64,
+	    "Muzzy pages purged")
+	OM_GAUGE("arena_small_allocated_bytes", "small.allocated", size,
+	    "Bytes allocated by small objects")
+	OM_COUNTER("arena_small_nmalloc", "small.nmalloc", uint64,
+	    "Small allocations served by the arena bins")
+	OM_COUNTER("arena_small_ndalloc", "small.ndalloc", uint64,
+	    "Small deallocations served by the arena bins")
+	OM_COUNTER("arena_small_nrequests", "small.nrequests", uint64,
+	    "Small allocation requests")
+	OM_COUNTER("arena_small_nfills", "small.nfills", uint64,
+	    "Thread cache fills of small size classes")
+	OM_COUNTER("arena_small_nflushes", "small.nflushes", uint64,
+	    "Thread cache flushes of small size classes")
+	OM_GAUGE("arena_large_allocated_bytes", "large.allocated", size,
+	    "Bytes allocated by large objects")
+	OM_COUNTER("arena_large_nmalloc", "large.nmalloc", uint64,
+	    "Large allocations served by the arena")
+	OM_COUNTER("arena_large_ndalloc", "large.ndalloc", uint64,
+	    "Large deallocations served by the arena")
+	OM_COUNTER("arena_large_nrequests", "large.nrequests", uint64,
+	    "Large allocation requests")
+	OM_COUNTER("arena_large_nfills", "large.nfills", uint64,
+	    "Thread cache fills of large size classes")
+	OM_COUNTER("arena_large_nflushes", "large.nflushes", uint64,
+	    "Thread cache flushes of large size classes")
+	OM_GAUGE("arena_mapped_bytes", "mapped", size,
+	    "Bytes mapped by the arena")
+	OM_GAUGE("arena_retained_bytes", "retained", size,
+	    "Bytes of retained virtual memory")
+	OM_GAUGE("arena_base_bytes", "base", size,
+	    "Bytes dedicated to bootstrap-sensitive allocator metadata")
+	OM_GAUGE("arena_internal_bytes", "internal", size,
+	    "Bytes dedicated to internal allocations")
+	OM_GAUGE("arena_metadata_edata_bytes", "metadata_edata", size,
+	    "Bytes of metadata used for extent descriptors")
+	OM_GAUGE("arena_metadata_rtree_bytes", "metadata_rtree", size,
+	    "Bytes of metadata used for the radix tree")
+	OM_GAUGE("arena_metadata_thp_bytes", "metadata_thp", size,
+	    "Bytes of metadata backed by transparent huge pages")
+	OM_GAUGE("arena_tcache_bytes", "tcache_bytes", size,
+	    "Bytes cached in the thread caches")
+	OM_GAUGE("arena_tcache_stashed_bytes", "tcache_stashed_bytes", size,
+	    "Bytes stashed in the thread caches")
+	OM_GAUGE("arena_resident_bytes", "resident", size,
+	    "Bytes in physically resident data pages")
+	OM_GAUGE("arena_abandoned_vm_bytes", "abandoned_vm", size,
+	    "Bytes of virtual memory leaked due to errors")
+	OM_GAUGE("arena_extent_avail", "extent_avail", size,
+	    "Cached extent descriptors")
+};
+
+static const stats_om_metric_t stats_om_hpa_metrics[] = {
+	OM_GAUGE("hpa_sec_bytes", "hpa_sec_bytes", size,
+	    "Bytes in the small extent cache")
+	OM_GAUGE("hpa_pageslabs", "hpa_shard.npageslabs", size,
+	    "Hugepage-sized slabs")
+	OM_GAUGE("hpa_active_pages", "hpa_shard.nactive", size,
+	    "Active pages in hugepage-sized slabs")
+	OM_GAUGE("hpa_dirty_pages", "hpa_shard.ndirty", size,
+	    "Dirty pages in hugepage-sized slabs")
+	OM_GAUGE("hpa_huge_pageslabs", "hpa_shard.slabs.npageslabs_huge", size,
+	    "Hugified slabs")
+	OM_GAUGE("hpa_huge_active_pages", "hpa_shard.slabs.nactive_huge",
+	    size, "Active pages in hugified slabs")
+	OM_GAUGE("hpa_huge_dirty_pages", "hpa_shard.slabs.ndirty_huge", size,
+	    "Dirty pages in hugified slabs")
+	OM_COUNTER("hpa_purge_passes", "hpa_shard.npurge_passes", uint64,
+	    "Purge passes")
+	OM_COUNTER("hpa_purges", "hpa_shard.npurges", uint64,
+	    "Purge calls")
+	OM_COUNTER("hpa_hugifies", "hpa_shard.nhugifies", uint64,
+	    "Slabs hugified")
+	OM_COUNTER("hpa_hugify_failures", "hpa_shard.nhugify_failures", uint64,
+	    "Failed hugify attempts")
+	OM_COUNTER("hpa_rehugifies", "hpa_shard.nrehugifies", uint64,
+	    "Dehugified slabs collapsed again")
+	OM_COUNTER("hpa_rehugify_failures", "hpa_shard.nrehugify_failures",
+	    uint64, "Failed rehugify attempts")
+	OM_COUNTER("hpa_dehugifies", "hpa_shard.ndehugifies", uint64,
+	    "Slabs dehugified")
+};
+
+static const stats_om_metric_t stats_om_bin_metrics[] = {
+	OM_COUNTER("bin_nmalloc", "nmalloc", uint64,
+	    "Allocations served by the bin")
+	OM_COUNTER("bin_ndalloc", "ndalloc", uint64,
+	    "Deallocations served by the bin")
+	OM_COUNTER("bin_nrequests", "nrequests", uint64,
+	    "Allocation requests of the size class")
+	OM_GAUGE("bin_curregs", "curregs", size,
+	    "Current regions of the size class")
+	OM_COUNTER("bin_nfills", "nfills", uint64,
+	    "Thread cache fills from the bin")
+	OM_COUNTER("bin_nflushes", "nflushes", uint64,
+	    "Thread cache flushes to the bin")
+	OM_COUNTER("bin_nslabs", "nslabs", uint64,
+	    "Slabs created for the bin")
+	OM_COUNTER("bin_nreslabs", "nreslabs", uint64,
+	    "Times the current slab was replaced")
+	OM_GAUGE("bin_curslabs", "curslabs", size,
+	    "Current slabs of the bin")
+	OM_GAUGE("bin_nonfull_slabs", "nonfull_slabs", size,
+	    "Current non-full slabs of the bin")
+};
+
+static const stats_om_metric_t stats_om_lextent_metrics[] = {
+	OM_COUNTER("lextent_nmalloc", "nmalloc", uint64,
+	    "Allocations of the large size class served by the arena")
+	OM_COUNTER("lextent_ndalloc", "ndalloc", uint64,
+	    "Deallocations of the large size class served by the arena")
+	OM_COUNTER("lextent_nrequests", "nrequests", uint64,
+	    "Allocation requests of the large size class")
+	OM_GAUGE("lextent_curlextents", "curlextents", size,
+	    "Current allocations of the large size class")
+};
+
+static const stats_om_metric_t stats_om_extent_metrics[] = {
+	OM_GAUGE("extent_dirty", "ndirty", size,
+	    "Dirty extents of the page size class")
+	OM_GAUGE("extent_muzzy", "nmuzzy", size,
+	    "Muzzy extents of the page size class")
+	OM_GAUGE("extent_retained", "nretained", size,
+	    "Retained extents of the page size class")
+	OM_GAUGE("extent_dirty_bytes", "dirty_bytes", size,
+	    "Bytes in dirty extents of the page size class")
+	OM_GAUGE("extent_muzzy_bytes", "muzzy_bytes", size,
+	    "Bytes in muzzy extents of the page size class")
+	OM_GAUGE("extent_retained_bytes", "retained_bytes", size,
+	    "Bytes in retained extents of the page size class")
+};
+
+#define OM_MUTEX_METRICS(prefix)					\
+	OM_COUNTER(prefix "mutex_num_ops", "num_ops", uint64,		\
+	    "Mutex lock operations")					\
+	OM_COUNTER(prefix "mutex_num_wait", "num_wait", uint64,	\
+	    "Mutex acquisitions that had to wait")			\
+	OM_COUNTER(prefix "mutex_num_spin_acq", "num_spin_acq", uint64,	\
+	    "Mutex acquisitions through spinning")			\
+	OM_COUNTER(prefix "mutex_num_owner_switch", "num_owner_switch",	\
+	    uint64, "Mutex owner changes")				\
+	OM_COUNTER(prefix "mutex_wait_ns", "total_wait_time", uint64,	\
+	    "Time spent waiting for the mutex")				\
+	OM_GAUGE(prefix "mutex_max_wait_ns", "max_wait_time", uint64,	\
+	    "Longest wait for the mutex")				\
+	OM_GAUGE(prefix "mutex_max_num_thds", "max_num_thds", uint32,	\
+	    "Most threads waiting for the mutex at once")
+
+static const stats_om_metric_t stats_om_global_mutex_metrics[] = {
+	OM_MUTEX_METRICS("")
+};
+
+static const stats_om_metric_t stats_om_arena_mutex_metrics[] = {
+	OM_MUTEX_METRICS("arena_")
+};
+
+static const stats_om_metric_t stats_om_bin_mutex_metrics[] = {
+	OM_MUTEX_METRICS("bin_")
+};
+
+#undef OM_MUTEX_METRICS
+#undef OM_GAUGE
+#undef OM_COUNTER
+
+#define OM_NMETRICS(metrics) (sizeof(metrics) / sizeof(metrics[0]))
+
+typedef union {
+	bool bool_val;
+	unsigned unsigned_val;
+	uint32_t uint32_val;
+	uint64_t uint64_val;
+	size_t size_val;
+	ssize_t ssize_val;
+} stats_om_value_t;
+
+/* Reads the mallctl leaf (which may have several components) below mib. */
+static void
+stats_om_read(size_t *mib, size_t miblen, const char *leaf,
+    emitter_type_t value_type, stats_om_value_t *value) {
+	size_t sz;
+	switch (value_type) {
+	case emitter_type_bool:
+		sz = sizeof(bool);
+		break;
+	case emitter_type_unsigned:
+		sz = sizeof(unsigned);
+		break;
+	case emitter_type_uint32:
+		sz = sizeof(uint32_t);
+		break;
+	case emitter_type_uint64:
+		sz = sizeof(uint64_t);
+		break;
+	case emitter_type_size:
+		sz = sizeof(size_t);
+		break;
+	case emitter_type_ssize:
+		sz = sizeof(ssize_t);
+		break;
+	default:
+		unreachable();
+	}
+	size_t miblen_new = CTL_MAX_DEPTH;
+	xmallctlbymibname(mib, miblen, leaf, &miblen_new, (void *)value, &sz,
+	    NULL, 0);
+}
+
+static void
+stats_om_arena_label(char *buf, size_t buf_size, unsigned arena_ind) {
+	if (arena_ind == MALLCTL_ARENAS_ALL) {
+		malloc_snprintf(buf, buf_size, "arena=\"merged\"");
+	} else if (arena_ind == MALLCTL_ARENAS_DESTROYED) {
+		malloc_snprintf(buf, buf_size, "arena=\"destroyed\"");
+	} else {
+		malloc_snprintf(buf, buf_size, "arena=\"%u\"", arena_ind);
+	}
+}
+
+/* Emits the metric families of a section without labels of its own. */
+static void
+stats_om_emit(emitter_t *emitter, const char *prefix,
+    const stats_om_metric_t *metrics, size_t nmetrics) {
+	size_t mib[CTL_MAX_DEPTH];
+	CTL_LEAF_PREPARE(mib, 0, prefix);
+	/* The number of components in prefix. */
+	size_t miblen = 1;
+	for (const char *c = prefix; *c != '\0'; c++) {
+		miblen += (*c == '.');
+	}
+	for (size_t k = 0; k < nmetrics; k++) {
+		const stats_om_metric_t *metric = &metrics[k];
+		stats_om_value_t value;
+		stats_om_read(mib, miblen, metric->leaf, metric->value_type,
+		    &value);
+		emitter_metric_begin(emitter, metric->name,
+		    metric->metric_type, metric->help);
+		emitter_metric_sample(emitter, NULL, metric->value_type,
+		    &value);
+	}
+}
+
+static void
+stats_om_global_mutexes_emit(emitter_t *emitter) {
+	size_t mib[CTL_MAX_DEPTH];
+	CTL_LEAF_PREPARE(mib, 0, "stats.mutexes");
+	for (size_t k = 0; k < OM_NMETRICS(stats_om_global_mutex_metrics);
+	    k++) {
+		const stats_om_metric_t *metric =
+		    &stats_om_global_mutex_metrics[k];
+		emitter_metric_begin(emitter, metric->name,
+		    metric->metric_type, metric->help);
+		for (int i = 0; i < mutex_prof_num_global_mutexes; i++) {
+			char labels[64];
+			malloc_snprintf(labels, sizeof(labels),
+			    "mutex=\"%s\"", global_mutex_names[i]);
+			CTL_LEAF_PREPARE(mib, 2, global_mutex_names[i]);
+			stats_om_value_t value;
+			stats_om_read(mib, 3, metric->leaf, metric->value_type,
+			    &value);
+			emitter_metric_sample(emitter, labels,
+			    metric->value_type, &value);
+		}
+	}
+}
+
+/* Emits the per arena metric families, for each of the given arenas. */
+static void
+stats_om_arenas_emit(emitter_t *emitter, const unsigned *arena_inds,
+    unsigned narenas, const stats_om_metric_t *metrics, size_t nmetrics) {
+	size_t mib[CTL_MAX_DEPTH];
+	CTL_LEAF_PREPARE(mib, 0, "stats.arenas");
+	for (size_t k = 0; k < nmetrics; k++) {
+		const stats_om_metric_t *metric = &metrics[k];
+		emitter_metric_begin(emitter, metric->name,
+		    metric->metric_type, metric->help);
+		for (unsigned i = 0; i < narenas; i++) {
+			char labels[64];
+			stats_om_arena_label(labels, sizeof(labels),
+			    arena_inds[i]);
+			mib[2] = arena_inds[i];
+			stats_om_value_t value;
+			stats_om_read(mib, 3, metric->leaf, metric->value_type,
+			    &value);
+			emitter_metric_sample(emitter, labels,
+			    metric->value_type, &value);
+		}
+	}
+}
+
+static void
+stats_om_arena_mutexes_emit(emitter_t *emitter, const unsigned *arena_inds,
+    unsigned narenas) {
+	size_t mib[CTL_MAX_DEPTH];
+	CTL_LEAF_PREPARE(mib, 0, "stats.arenas");
+	for (size_t k = 0; k < OM_NMETRICS(stats_om_arena_mutex_metrics);
+	    k++) {
+		const stats_om_metric_t *metric =
+		    &stats_om_arena_mutex_metrics[k];
+		emitter_metric_begin(emitter, metric->name,
+		    metric->metric_type, metric->help);
+		for (unsigned i = 0; i < narenas; i++) {
+			char arena_label[32];
+			stats_om_arena_label(arena_label, sizeof(arena_label),
+			    arena_inds[i]);
+			mib[2] = arena_inds[i];
+			CTL_LEAF_PREPARE(mib, 3, "mutexes");
+			for (int j = 0; j < mutex_prof_num_arena_mutexes; j++) {
+				char labels[96];
+				malloc_snprintf(labels, sizeof(labels),
+				    "%s,mutex=\"%s\"", arena_label,
+				    arena_mutex_names[j]);
+				CTL_LEAF_PREPARE(mib, 4, arena_mutex_names[j]);
+				stats_om_value_t value;
+				stats_om_read(mib, 5, metric->leaf,
+				    metric->value_type, &value);
+				emitter_metric_sample(emitter, labels,
+				    metric->value_type, &value);
+			}
+		}
+	}
+}
+
+/*
+ * Emits the metric families of a per size class section ("bins", "lextents" or
+ * "extents"), for each of the given arenas and size classes.  The samples of a
+ * size class are skipped if its skip_leaf (if any) is zero, or with skip_zero,
+ * if they are zero themselves.
+ */
+static void
+stats_om_classes_emit(emitter_t *emitter, const unsigned *arena_inds,
+    unsigned narenas, const char *section, const char *class_label,
+    unsigned nclasses, size_t (*class_size)(unsigned), const char *sub_leaf,
+    const char *skip_leaf, bool skip_zero, const stats_om_metric_t *metrics,
+    size_t nmetrics) {
+	size_t mib[CTL_MAX_DEPTH];
+	CTL_LEAF_PREPARE(mib, 0, "stats.arenas");
+	for (size_t k = 0; k < nmetrics; k++) {
+		const stats_om_metric_t *metric = &metrics[k];
+		emitter_metric_begin(emitter, metric->name,
+		    metric->metric_type, metric->help);
+		for (unsigned i = 0; i < narenas; i++) {
+			char arena_label[32];
+			stats_om_arena_label(arena_label, sizeof(arena_label),
+			    arena_inds[i]);
+			mib[2] = arena_inds[i];
+			CTL_LEAF_PREPARE(mib, 3, section);
+			for (unsigned j = 0; j < nclasses; j++) {
+				mib[4] = j;
+				size_t miblen = 5;
+				if (skip_leaf != NULL) {
+					stats_om_value_t skip;
+					stats_om_read(mib, miblen, skip_leaf,
+					    emitter_type_uint64, &skip);
+					if (skip.uint64_val == 0) {
+						continue;
+					}
+				}
+				if (sub_leaf != NULL) {
+					CTL_LEAF_PREPARE(mib, miblen, sub_leaf);
+					miblen++;
+				}
+				stats_om_value_t value;
+				stats_om_read(mib, miblen, metric->leaf,
+				    metric->value_type, &value);
+				if (skip_zero && value.size_val == 0) {
+					continue;
+				}
+				char labels[128];
+				malloc_snprintf(labels, sizeof(labels),
+				    "%s,%s=\"%u\",size=\"%zu\"", arena_label,
+				    class_label, j, class_size(j));
+				emitter_metric_sample(emitter, labels,
+				    metric->value_type, &value);
+			}
+		}
+	}
+}
+
+static size_t
+stats_om_bin_size(unsigned binind) {
+	return sz_index2size(binind);
+}
+
+static size_t
+stats_om_lextent_size(unsigned lextent_ind) {
+	return sz_index2size(SC_NBINS + lextent_ind);
+}
+
+static size_t
+stats_om_extent_size(unsigned pind) {
+	return sz_pind2sz(pind);
+}
+
+static void
+stats_print_openmetrics(emitter_t *emitter, bool general, bool merged,
+    bool destroyed, bool unmerged, bool bins, bool large, bool mutex,
+    bool extents, bool hpa) {
+	if (general) {
+		const char *version;
+		CTL_GET("version", &version, const char *);
+		char labels[128];
+		malloc_snprintf(labels, sizeof(labels), "version=\"%s\"",
+		    version);
+		bool one = true;
+		emitter_metric_begin(emitter, "build_info",
+		    emitter_metric_gauge, "Build information");
+		emitter_metric_sample(emitter, labels, emitter_type_bool, &one);
+	}
+	if (!config_stats) {
+		return;
+	}
+
+	stats_om_emit(emitter, "stats", stats_om_global_metrics,
+	    OM_NMETRICS(stats_om_global_metrics));
+	if (have_background_thread) {
+		stats_om_emit(emitter, "stats.background_thread",
+		    stats_om_background_thread_metrics,
+		    OM_NMETRICS(stats_om_background_thread_metrics));
+	}
+	if (mutex) {
+		stats_om_global_mutexes_emit(emitter);
+	}
+
+	if (!merged && !destroyed && !unmerged) {
+		return;
+	}
+	/* The same choice of arenas as in stats_print_helper(). */
+	unsigned narenas;
+	CTL_GET("arenas.narenas", &narenas, unsigned);
+	VARIABLE_ARRAY_UNSAFE(unsigned, arena_inds, narenas + 2);
+	unsigned ninds = 0;
+	unsigned ninitialized = 0;
+	size_t mib[3];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	xmallctlnametomib("arena.0.initialized", mib, &miblen);
+	for (unsigned i = 0; i < narenas; i++) {
+		bool initialized;
+		size_t sz = sizeof(bool);
+		mib[1] = i;
+		xmallctlbymib(mib, miblen, &initialized, &sz, NULL, 0);
+		if (initialized) {
+			ninitialized++;
+			if (unmerged) {
+				arena_inds[ninds++] = i;
+			}
+		}
+	}
+	if (merged && (ninitialized > 1 || !unmerged)) {
+		arena_inds[ninds++] = MALLCTL_ARENAS_ALL;
+	}
+	bool destroyed_initialized;
+	size_t sz = sizeof(bool);
+	mib[1] = MALLCTL_ARENAS_DESTROYED;
+	xmallctlbymib(mib, miblen, &destroyed_initialized, &sz, NULL, 0);
+	if (destroyed && destroyed_initialized) {
+		arena_inds[ninds++] = MALLCTL_ARENAS_DESTROYED;
+	}
+
+	stats_om_arenas_emit(emitter, arena_inds, ninds,
+	    stats_om_arena_metrics, OM_NMETRICS(stats_om_arena_metrics));
+	if (mutex) {
+		stats_om_arena_mutexes_emit(emitter, arena_inds, ninds);
+	}
+	if (bins) {
+		unsigned nbins;
+		CTL_GET("arenas.nbins", &nbins, unsigned);
+		stats_om_classes_emit(emitter, arena_inds, ninds, "bins",
+		    "bin", nbins, stats_om_bin_size, NULL, NULL, false,
+		    stats_om_bin_metrics, OM_NMETRICS(stats_om_bin_metrics));
+		if (mutex) {
+			stats_om_classes_emit(emitter, arena_inds, ninds,
+			    "bins", "bin", nbins, stats_om_bin_size, "mutex",
+			    "nmalloc", false, stats_om_bin_mutex_metrics,
+			    OM_NMETRICS(stats_om_bin_mutex_metrics));
+		}
+	}
+	if (large) {
+		unsigned nlextents;
+		CTL_GET("arenas.nlextents", &nlextents, unsigned);
+		stats_om_classes_emit(emitter, arena_inds, ninds, "lextents",
+		    "lextent", nlextents, stats_om_lextent_size, NULL,
+		    "nmalloc", false, stats_om_lextent_metrics,
+		    OM_NMETRICS(stats_om_lextent_metrics));
+	}
+	if (extents) {
+		stats_om_classes_emit(emitter, arena_inds, ninds, "extents",
+		    "extent", SC_NPSIZES, stats_om_extent_size, NULL, NULL,
+		    true, stats_om_extent_metrics,
+		    OM_NMETRICS(stats_om_extent_metrics));
+	}
+	if (hpa) {
+		stats_om_arenas_emit(emitter, arena_inds, ninds,
+		    stats_om_hpa_metrics, OM_NMETRICS(stats_om_hpa_metrics));
+	}
+}
+
+#undef OM_NMETRICS
+
 void
 stats_print(write_cb_t *write_cb, void *cbopaque, const char *opts) {
 	int err;
@@ -2094,6 +2712,15 @@ stats_print(write_cb_t *write_cb, void *cbopaque, const char *opts) {
 	}
 
 	emitter_t emitter;
+	if (openmetrics) {
+		emitter_init(&emitter, emitter_output_openmetrics, write_cb,
+		    cbopaque);
+		emitter_begin(&emitter);
+		stats_print_openmetrics(&emitter, general, merged, destroyed,
+		    unmerged, bins, large, mutex, extents, hpa);
+		emitter_end(&emitter);
+		return;
+	}
 	emitter_init(&emitter,
 	    json ? emitter_output_json_compact : emitter_output_table,
 	    write_cb, cbopaque);
@@ -0,0 +1,207 @@
+#include "jemalloc/internal/jemalloc_preamble.h"
+#include "jemalloc/internal/jemalloc_internal_includes.h"
+
+#include "jemalloc/internal/assert.h"
+#include "jemalloc/internal/stats_snapshot.h"
+
+#define STATS_SNAPSHOT_IS_counter true
+#define STATS_SNAPSHOT_IS_gauge false
+
+static const bool stats_snapshot_global_is_counter[] = {
+#define OP(name, kind) STATS_SNAPSHOT_IS_##kind,
+	STATS_SNAPSHOT_GLOBAL_FIELDS
+#undef OP
+};
+
+static const bool stats_snapshot_bin_is_counter[] = {
+#define OP(name, kind) STATS_SNAPSHOT_IS_##kind,
+	STATS_SNAPSHOT_BIN_FIELDS
+#undef OP
+};
+
+static const bool stats_snapshot_lextent_is_counter[] = {
+#define OP(name, kind) STATS_SNAPSHOT_IS_##kind,
+	STATS_SNAPSHOT_LEXTENT_FIELDS
+#undef OP
+};
+
+/*
+ * The bin stats are plain integers, protected by the bin lock.  Reading them
+ * without it may see a value that is about to change (or, on 32-bit systems, a
+ * torn one), which is fine for our purposes, but the read must not be elided
+ * or repeated by the compiler.
+ */
+static inline uint64_t
+stats_snapshot_racy_read_u64(const uint64_t *p) {
+	return *(const volatile uint64_t *)p;
+}
+
+static inline uint64_t
+stats_snapshot_racy_read_zu(const size_t *p) {
+	return (uint64_t)*(const volatile size_t *)p;
+}
+
+static void
+stats_snapshot_bins_add(arena_t *arena, uint64_t *snap) {
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		uint64_t *dst = &snap[stats_snapshot_bin_ind(i, 0)];
+		for (unsigned j = 0; j < bin_infos[i].n_shards; j++) {
+			const bin_stats_t *stats =
+			    &arena_get_bin(arena, i, j)->stats;
+			dst[stats_snapshot_bin_nmalloc] +=
+			    stats_snapshot_racy_read_u64(&stats->nmalloc);
+			dst[stats_snapshot_bin_ndalloc] +=
+			    stats_snapshot_racy_read_u64(&stats->ndalloc);
+			dst[stats_snapshot_bin_nrequests] +=
+			    stats_snapshot_racy_read_u64(&stats->nrequests);
+			dst[stats_snapshot_bin_curregs] +=
+			    stats_snapshot_racy_read_zu(&stats->curregs);
+			dst[stats_snapshot_bin_nfills] +=
+			    stats_snapshot_racy_read_u64(&stats->nfills);
+			dst[stats_snapshot_bin_nflushes] +=
+			    stats_snapshot_racy_read_u64(&stats->nflushes);
+			dst[stats_snapshot_bin_nslabs] +=
+			    stats_snapshot_racy_read_u64(&stats->nslabs);
+			dst[stats_snapshot_bin_reslabs] +=
+			    stats_snapshot_racy_read_u64(&stats->reslabs);
+			dst[stats_snapshot_bin_curslabs] +=
+			    stats_snapshot_racy_read_zu(&stats->curslabs);
+			dst[stats_snapshot_bin_nonfull_slabs] +=
+			    stats_snapshot_racy_read_zu(&stats->nonfull_slabs);
+		}
+	}
+}
+
+static void
+stats_snapshot_lextents_add(arena_t *arena, uint64_t *snap) {
+	for (szind_t i = 0; i < SC_NSIZES - SC_NBINS; i++) {
+		arena_stats_large_t *lstats = &arena->stats.lstats[i];
+		uint64_t *dst = &snap[stats_snapshot_lextent_ind(i, 0)];
+		/* As in arena_stats_merge(), read ndalloc before nmalloc. */
+		uint64_t ndalloc = locked_read_u64_unsynchronized(
+		    &lstats->ndalloc);
+		uint64_t nmalloc = locked_read_u64_unsynchronized(
+		    &lstats->nmalloc);
+		dst[stats_snapshot_lextent_nmalloc] += nmalloc;
+		dst[stats_snapshot_lextent_ndalloc] += ndalloc;
+		dst[stats_snapshot_lextent_nrequests] += nmalloc +
+		    locked_read_u64_unsynchronized(&lstats->nrequests);
+		dst[stats_snapshot_lextent_nflushes] +=
+		    locked_read_u64_unsynchronized(&lstats->nflushes);
+		dst[stats_snapshot_lextent_curlextents] += nmalloc >= ndalloc ?
+		    nmalloc - ndalloc : 0;
+	}
+}
+
+static void
+stats_snapshot_arena_add(arena_t *arena, uint64_t *snap) {
+	pa_shard_t *shard = &arena->pa_shard;
+	pac_stats_t *pac_stats = shard->pac.stats;
+
+	snap[stats_snapshot_global_narenas]++;
+	snap[stats_snapshot_global_active] +=
+	    (uint64_t)pa_shard_nactive(shard) << LG_PAGE;
+	snap[stats_snapshot_global_dirty] +=
+	    (uint64_t)pa_shard_ndirty(shard) << LG_PAGE;
+	snap[stats_snapshot_global_muzzy] +=
+	    (uint64_t)pa_shard_nmuzzy(shard) << LG_PAGE;
+	snap[stats_snapshot_global_mapped] += pac_mapped(&shard->pac);
+	snap[stats_snapshot_global_retained] +=
+	    (uint64_t)ecache_npages_get(&shard->pac.ecache_retained) << LG_PAGE;
+	snap[stats_snapshot_global_internal] += arena_internal_get(arena);
+
+	snap[stats_snapshot_global_dirty_npurge] +=
+	    locked_read_u64_unsynchronized(&pac_stats->decay_dirty.npurge);
+	snap[stats_snapshot_global_dirty_nmadvise] +=
+	    locked_read_u64_unsynchronized(&pac_stats->decay_dirty.nmadvise);
+	snap[stats_snapshot_global_dirty_purged] +=
+	    locked_read_u64_unsynchronized(&pac_stats->decay_dirty.purged);
+	snap[stats_snapshot_global_muzzy_npurge] +=
+	    locked_read_u64_unsynchronized(&pac_stats->decay_muzzy.npurge);
+	snap[stats_snapshot_global_muzzy_nmadvise] +=
+	    locked_read_u64_unsynchronized(&pac_stats->decay_muzzy.nmadvise);
+	snap[stats_snapshot_global_muzzy_purged] +=
+	    locked_read_u64_unsynchronized(&pac_stats->decay_muzzy.purged);
+
+	stats_snapshot_bins_add(arena, snap);
+	stats_snapshot_lextents_add(arena, snap);
+}
+
+void
+stats_snapshot_read(tsdn_t *tsdn, uint64_t *snap) {
+	cassert(config_stats);
+
+	memset(snap, 0, STATS_SNAPSHOT_LEN * sizeof(uint64_t));
+	unsigned narenas = narenas_total_get();
+	for (unsigned i = 0; i < narenas; i++) {
+		arena_t *arena = arena_get(tsdn, i, false);
+		if (arena != NULL) {
+			stats_snapshot_arena_add(arena, snap);
+		}
+	}
+
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		const uint64_t *bin = &snap[stats_snapshot_bin_ind(i, 0)];
+		snap[stats_snapshot_global_allocated_small] +=
+		    bin[stats_snapshot_bin_curregs] * bin_infos[i].reg_size;
+		snap[stats_snapshot_global_nmalloc_small] +=
+		    bin[stats_snapshot_bin_nmalloc];
+		snap[stats_snapshot_global_ndalloc_small] +=
+		    bin[stats_snapshot_bin_ndalloc];
+		snap[stats_snapshot_global_nrequests_small] +=
+		    bin[stats_snapshot_bin_nrequests];
+		snap[stats_snapshot_global_nfills_small] +=
+		    bin[stats_snapshot_bin_nfills];
+		snap[stats_snapshot_global_nflushes_small] +=
+		    bin[stats_snapshot_bin_nflushes];
+	}
+	for (szind_t i = 0; i < SC_NSIZES - SC_NBINS; i++) {
+		const uint64_t *lextent =
+		    &snap[stats_snapshot_lextent_ind(i, 0)];
+		snap[stats_snapshot_global_allocated_large] +=
+		    lextent[stats_snapshot_lextent_curlextents] *
+		    sz_index2size(SC_NBINS + i);
+		snap[stats_snapshot_global_nmalloc_large] +=
+		    lextent[stats_snapshot_lextent_nmalloc];
+		snap[stats_snapshot_global_ndalloc_large] +=
+		    lextent[stats_snapshot_lextent_ndalloc];
+		snap[stats_snapshot_global_nrequests_large] +=
+		    lextent[stats_snapshot_lextent_nrequests];
+		snap[stats_snapshot_global_nflushes_large] +=
+		    lextent[stats_snapshot_lextent_nflushes];
+	}
+	snap[stats_snapshot_global_allocated] =
+	    snap[stats_snapshot_global_allocated_small] +
+	    snap[stats_snapshot_global_allocated_large];
+}
+
+static void
+stats_snapshot_delta_fields(uint64_t *delta, const uint64_t *cur,
+    const uint64_t *prev, const bool *is_counter, size_t nfields) {
+	for (size_t i = 0; i < nfields; i++) {
+		if (is_counter[i]) {
+			delta[i] = cur[i] >= prev[i] ? cur[i] - prev[i] : 0;
+		} else {
+			delta[i] = cur[i];
+		}
+	}
+}
+
+void
+stats_snapshot_delta(uint64_t *delta, const uint64_t *cur,
+    const uint64_t *prev) {
+	stats_snapshot_delta_fields(delta, cur, prev,
+	    stats_snapshot_global_is_counter, stats_snapshot_num_global_fields);
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		size_t ind = stats_snapshot_bin_ind(i, 0);
+		stats_snapshot_delta_fields(&delta[ind], &cur[ind], &prev[ind],
+		    stats_snapshot_bin_is_counter,
+		    stats_snapshot_num_bin_fields);
+	}
+	for (szind_t i = 0; i < SC_NSIZES - SC_NBINS; i++) {
+		size_t ind = stats_snapshot_lextent_ind(i, 0);
+		stats_snapshot_delta_fields(&delta[ind], &cur[ind], &prev[ind],
+		    stats_snapshot_lextent_is_counter,
+		    stats_snapshot_num_lextent_fields);
+	}
+}
@@ -3,7 +3,9 @@
 
 #include "jemalloc/internal/assert.h"
 #include "jemalloc/internal/base.h"
+#include "jemalloc/internal/mem_limit.h"
 #include "jemalloc/internal/mutex.h"
+#include "jemalloc/internal/percpu_cache.h"
 #include "jemalloc/internal/safety_check.h"
 #include "jemalloc/internal/san.h"
 #include "jemalloc/internal/sc.h"
@@ -58,6 +60,17 @@ size_t opt_tcache_gc_delay_bytes = 0;
 unsigned opt_lg_tcache_flush_small_div = 1;
 unsigned opt_lg_tcache_flush_large_div = 1;
 
+/*
+ * With tcache_adaptive, the ncached_max of each bin of the automatic tcache
+ * varies at runtime instead of staying at the value computed at boot (which
+ * becomes an upper bound).  Each time a bin is GCed, it is doubled if the bin
+ * missed (had to fill, or flush because it was full) repeatedly since the
+ * previous GC, and halved if it didn't miss at all; growth stops once the sum
+ * of ncached_max * usize over all bins reaches tcache_adaptive_max_bytes.
+ */
+bool opt_tcache_adaptive = false;
+size_t opt_tcache_adaptive_max_bytes = ((size_t)2) << 20;
+
 /*
  * Number of cache bins enabled, including both large and small.  This value
  * is only used to initialize tcache_nbins in the per-thread tcache.
@@ -362,6 +375,60 @@ tcache_gc_small_bin_shuffle(cache_bin_t *cache_bin, cache_bin_sz_t nremote,
 	}
 }
 
+/* Adjusts ncached_max for tcache_adaptive, after the regular GC. */
+static void
+tcache_gc_adapt(tsd_t *tsd, tcache_slow_t *tcache_slow, tcache_t *tcache,
+    szind_t szind) {
+	cache_bin_t *cache_bin = &tcache->bins[szind];
+	cache_bin_sz_t ncached_max = cache_bin_ncached_max_get(cache_bin);
+	cache_bin_sz_t capacity = tcache_slow->bin_ncached_capacity[szind];
+	uint8_t nmisses = tcache_slow->bin_nmisses[szind];
+	size_t usize = sz_index2size(szind);
+	tcache_slow->bin_nmisses[szind] = 0;
+	assert(ncached_max <= capacity);
+
+	cache_bin_sz_t target;
+	if (nmisses >= TCACHE_ADAPTIVE_GROW_NMISSES) {
+		size_t budget = (opt_tcache_adaptive_max_bytes >
+		    tcache_slow->ncached_max_bytes) ?
+		    opt_tcache_adaptive_max_bytes -
+		    tcache_slow->ncached_max_bytes : 0;
+		size_t grow = ncached_max;
+		if (grow > (size_t)(capacity - ncached_max)) {
+			grow = capacity - ncached_max;
+		}
+		if (grow > budget / usize) {
+			grow = budget / usize;
+		}
+		target = ncached_max + (cache_bin_sz_t)grow;
+	} else if (nmisses == 0) {
+		/* Deep enough; the regular GC flushes what's unused. */
+		target = ncached_max >> 1;
+		if (target < TCACHE_ADAPTIVE_NCACHED_MIN) {
+			target = TCACHE_ADAPTIVE_NCACHED_MIN;
+		}
+	} else {
+		return;
+	}
+	if (target == ncached_max) {
+		return;
+	}
+
+	cache_bin_sz_t ncached = cache_bin_ncached_get_local(cache_bin);
+	if (ncached > target) {
+		if (szind < SC_NBINS) {
+			tcache_bin_flush_small(tsd, tcache, cache_bin, szind,
+			    target);
+		} else {
+			tcache_bin_flush_large(tsd, tcache, cache_bin, szind,
+			    target);
+		}
+	}
+	cache_bin_ncached_max_set(cache_bin, target);
+	tcache_slow->ncached_max_bytes = tcache_slow->ncached_max_bytes -
+	    (size_t)ncached_max * usize + (size_t)target * usize;
+}
+
 static bool
 tcache_gc_small(tsd_t *tsd, tcache_slow_t *tcache_slow, tcache_t *tcache,
     szind_t szind) {
@@ -506,10 +573,15 @@ tcache_try_gc_bin(tsd_t *tsd, tcache_slow_t *tcache_slow, tcache_t *tcache,
 	tcache_bin_flush_stashed(tsd, tcache, cache_bin, szind, is_small);
 	bool ret = is_small ? tcache_gc_small(tsd, tcache_slow, tcache, szind) :
 	    tcache_gc_large(tsd, tcache_slow, tcache, szind);
+	if (opt_tcache_adaptive) {
+		tcache_gc_adapt(tsd, tcache_slow, tcache, szind);
+	}
 	cache_bin_low_water_set(cache_bin);
 	return ret;
 }
 
+static void tcache_flush_cache(tsd_t *tsd, tcache_t *tcache);
+
 static void
 tcache_event(tsd_t *tsd) {
 	tcache_t *tcache = tcache_get(tsd);
@@ -520,6 +592,17 @@ tcache_event(tsd_t *tsd) {
 	tcache_slow_t *tcache_slow = tsd_tcache_slowp_get(tsd);
 	assert(tcache_slow != NULL);
 
+	/* Give everything back if the memory limit forced a reclaim. */
+	bool flush_shared;
+	if (mem_limit_get() != 0 && mem_limit_flush_check(
+	    &tcache_slow->mem_limit_flush_epoch, &flush_shared)) {
+		tcache_flush_cache(tsd, tcache);
+		if (flush_shared) {
+			percpu_cache_flush_all(tsd, tcache);
+		}
+		return;
+	}
+
 	/* When the new tcache gc is not enabled, GC one bin at a time. */
 	if (!opt_experimental_tcache_gc) {
 		szind_t szind = tcache_slow->next_gc_bin;
@@ -611,6 +694,7 @@ tcache_alloc_small_hard(tsdn_t *tsdn, arena_t *arena,
 	    /* nfill_min */ opt_experimental_tcache_gc ?
 	    ((nfill >> 1) + 1) : nfill, /* nfill_max */ nfill);
 	tcache_slow->bin_refilled[binind] = true;
+	tcache_bin_miss_record(tcache_slow, binind);
 	tcache_nfill_small_burst_prepare(tcache_slow, binind);
 	ret = cache_bin_alloc(cache_bin, tcache_success);
 
@@ -681,7 +765,8 @@ tcache_bin_flush_impl_small(tsd_t *tsd, tcache_t *tcache, cache_bin_t *cache_bin
 	assert(binind < SC_NBINS);
 	arena_t *tcache_arena = tcache_slow->arena;
 	assert(tcache_arena != NULL);
-	unsigned tcache_binshard = tsd_binshardsp_get(tsdn_tsd(tsdn))->binshard[binind];
+	unsigned tcache_binshard = arena_binshard_active_get(tcache_arena,
+	    binind, tsd_binshardsp_get(tsdn_tsd(tsdn))->binshard[binind]);
 
 	/*
 	 * Variable length array must have > 0 length; the last element is never
@@ -817,15 +902,16 @@ tcache_bin_flush_impl_small(tsd_t *tsd, tcache_t *tcache, cache_bin_t *cache_bin
 		 *   becoming empty, and therefore purging, large mutex
 		 *   acquisition, etc.).
 		 * - Propagate the "why" behind a flush down to the level of the
-		 *   batcher, and include a batch pop attempt down full tcache
-		 *   flushing pathways.  This is just a lot of plumbing and
+		 *   remote free stack, and include a batch pop attempt down
+		 *   full tcache flushing pathways.  This is just a lot of plumbing and
 		 *   internal complexity.
 		 *
 		 * We don't do any of these right now, but the decision calculus
 		 * and tradeoffs are subtle enough that the reasoning was worth
 		 * leaving in this comment.
 		 */
-		bool bin_is_batched = arena_bin_has_batch(binind);
+		bool bin_is_batched = arena_bin_has_batch(binind)
+		    && bin_remote_free_reg_size_ok(bin_infos[binind].reg_size);
 		bool home_binshard = (cur_arena == tcache_arena
 		    && cur_binshard == tcache_binshard);
 		bool can_batch = (flush_start - prev_flush_start
@@ -834,54 +920,32 @@ tcache_bin_flush_impl_small(tsd_t *tsd, tcache_t *tcache, cache_bin_t *cache_bin
 
 		/*
 		 * We try to avoid the batching pathway if we can, so we always
-		 * at least *try* to lock.
+		 * at least *try* to lock.  Pushing onto the remote free stack
+		 * can't fail, so once the trylock fails we're done with this
+		 * bin.
 		 */
 		bool locked = false;
 		bool batched = false;
-		bool batch_failed = false;
 		if (can_batch) {
 			locked = !malloc_mutex_trylock(tsdn, &cur_bin->lock);
 		}
 		if (can_batch && !locked) {
-			bin_with_batch_t *batched_bin =
-			    (bin_with_batch_t *)cur_bin;
-			size_t push_idx = batcher_push_begin(tsdn,
-			    &batched_bin->remote_frees,
-			    flush_start - prev_flush_start);
-			bin_batching_test_after_push(push_idx);
-
-			if (push_idx != BATCHER_NO_IDX) {
-				batched = true;
-				unsigned nbatched
-				    = flush_start - prev_flush_start;
-				for (unsigned i = 0; i < nbatched; i++) {
-					unsigned src_ind = prev_flush_start + i;
-					batched_bin->remote_free_data[
-					    push_idx + i].ptr
-						= ptrs->ptr[src_ind];
-					batched_bin->remote_free_data[
-					    push_idx + i].slab
-						= item_edata[src_ind].edata;
-				}
-				batcher_push_end(tsdn,
-				    &batched_bin->remote_frees);
-			} else {
-				batch_failed = true;
+			bin_remote_free_batch_t batch;
+			bin_remote_free_batch_init(&batch);
+			for (unsigned i = prev_flush_start; i < flush_start;
+			    i++) {
+				bin_remote_free_batch_append(&batch,
+				    ptrs->ptr[i], item_edata[i].edata);
 			}
+			bin_remote_free_push((bin_with_batch_t *)cur_bin,
+			    &batch);
+			bin_batching_test_after_push(batch.nelems);
+			batched = true;
 		}
 		if (!batched) {
 			if (!locked) {
 				malloc_mutex_lock(tsdn, &cur_bin->lock);
 			}
-			/*
-			 * Unlike other stats (which only ever get flushed into
-			 * a tcache's associated arena), batch_failed counts get
-			 * accumulated into the bin where the push attempt
-			 * failed.
-			 */
-			if (config_stats && batch_failed) {
-				cur_bin->stats.batch_failed_pushes++;
-			}
 
 			/*
 			 * Flush stats first, if that was the right lock.  Note
@@ -1271,11 +1335,24 @@ tcache_arena_dissociate(tsdn_t *tsdn, tcache_slow_t *tcache_slow,
 	tcache_slow->arena = NULL;
 }
 
+/*
+ * Threads bound to manual arenas allocate small objects from their arena
+ * directly, so that they don't get handed objects from other arenas out of the
+ * shared per-CPU caches.
+ */
+static void
+tcache_percpu_cache_update(tcache_slow_t *tcache_slow) {
+	tcache_slow->percpu_cache = percpu_cache_enabled &&
+	    arena_is_auto(tcache_slow->arena);
+}
+
+/* Only used for the automatic tcache. */
 void
 tcache_arena_reassociate(tsdn_t *tsdn, tcache_slow_t *tcache_slow,
     tcache_t *tcache, arena_t *arena) {
 	tcache_arena_dissociate(tsdn, tcache_slow, tcache);
 	tcache_arena_associate(tsdn, tcache_slow, tcache, arena);
+	tcache_percpu_cache_update(tcache_slow);
 }
 
 static void
@@ -1298,6 +1375,8 @@ tcache_init(tsd_t *tsd, tcache_slow_t *tcache_slow, tcache_t *tcache,
 	tcache_slow->next_gc_bin_small = 0;
 	tcache_slow->next_gc_bin_large = SC_NBINS;
 	tcache_slow->arena = NULL;
+	tcache_slow->percpu_cache = false;
+	tcache_slow->mem_limit_flush_epoch = mem_limit_flush_epoch_get();
 	tcache_slow->dyn_alloc = mem;
 
 	/*
@@ -1310,6 +1389,7 @@ tcache_init(tsd_t *tsd, tcache_slow_t *tcache_slow, tcache_t *tcache,
 	size_t cur_offset = 0;
 	cache_bin_preincrement(tcache_bin_info, tcache_nbins, mem,
 	    &cur_offset);
+	tcache_slow->ncached_max_bytes = 0;
 	for (unsigned i = 0; i < tcache_nbins; i++) {
 		if (i < SC_NBINS) {
 			tcache_bin_fill_ctl_init(tcache_slow, i);
@@ -1317,10 +1397,16 @@ tcache_init(tsd_t *tsd, tcache_slow_t *tcache_slow, tcache_t *tcache,
 			tcache_slow->bin_flush_delay_items[i]
 			    = tcache_gc_item_delay_compute(i);
 		}
+		tcache_slow->bin_ncached_capacity[i] =
+		    tcache_bin_info[i].ncached_max;
+		tcache_slow->bin_nmisses[i] = 0;
 		cache_bin_t *cache_bin = &tcache->bins[i];
 		if (tcache_bin_info[i].ncached_max > 0) {
 			cache_bin_init(cache_bin, &tcache_bin_info[i], mem,
 			    &cur_offset);
+			tcache_slow->ncached_max_bytes +=
+			    (size_t)tcache_bin_info[i].ncached_max *
+			    sz_index2size(i);
 		} else {
 			cache_bin_init_disabled(cache_bin,
 			    tcache_bin_info[i].ncached_max);
@@ -1349,8 +1435,35 @@ tcache_init(tsd_t *tsd, tcache_slow_t *tcache_slow, tcache_t *tcache,
 	}
 }
 
+/*
+ * Starts the bins of an automatic tcache off small for tcache_adaptive: about
+ * TCACHE_ADAPTIVE_INIT_BYTES worth of items each, and at least one.
+ */
+static void
+tcache_adaptive_init(tcache_slow_t *tcache_slow, tcache_t *tcache) {
+	unsigned tcache_nbins = tcache_nbins_get(tcache_slow);
+	for (szind_t i = 0; i < tcache_nbins; i++) {
+		cache_bin_t *cache_bin = &tcache->bins[i];
+		if (tcache_bin_disabled(i, cache_bin, tcache_slow)) {
+			continue;
+		}
+		size_t usize = sz_index2size(i);
+		cache_bin_sz_t ncached_max = cache_bin_ncached_max_get(
+		    cache_bin);
+		size_t init = TCACHE_ADAPTIVE_INIT_BYTES / usize;
+		if (init < TCACHE_ADAPTIVE_NCACHED_MIN) {
+			init = TCACHE_ADAPTIVE_NCACHED_MIN;
+		}
+		if (init >= ncached_max) {
+			continue;
+		}
+		cache_bin_ncached_max_set(cache_bin, (cache_bin_sz_t)init);
+		tcache_slow->ncached_max_bytes -= (ncached_max - init) * usize;
+	}
+}
+
 static inline unsigned
-tcache_ncached_max_compute(szind_t szind) {
+tcache_ncached_max_compute(szind_t szind, bool adaptive) {
 	if (szind >= SC_NBINS) {
 		return opt_tcache_nslots_large;
 	}
@@ -1383,6 +1496,14 @@ tcache_ncached_max_compute(szind_t szind) {
 		nslots_small_min = nslots_small_max;
 	}
 
+	/*
+	 * With tcache_adaptive this is only an upper bound, which hot size
+	 * classes may grow to.
+	 */
+	if (adaptive) {
+		return nslots_small_max;
+	}
+
 	unsigned candidate;
 	if (opt_lg_tcache_nslots_mul < 0) {
 		candidate = slab_nregs >> (-opt_lg_tcache_nslots_mul);
@@ -1415,13 +1536,34 @@ tcache_bin_info_compute(cache_bin_info_t tcache_bin_info[TCACHE_NBINS_MAX]) {
 	for (szind_t i = 0; i < TCACHE_NBINS_MAX; i++) {
 		unsigned ncached_max = tcache_get_default_ncached_max_set(i) ?
 		    (unsigned)tcache_get_default_ncached_max()[i].ncached_max:
-		    tcache_ncached_max_compute(i);
+		    tcache_ncached_max_compute(i, opt_tcache_adaptive);
 		assert(ncached_max <= CACHE_BIN_NCACHED_MAX);
 		cache_bin_info_init(&tcache_bin_info[i],
 		    (cache_bin_sz_t)ncached_max);
 	}
 }
 
+/*
+ * Explicit tcaches aren't GCed, so tcache_adaptive would leave them at its
+ * upper bound forever; they get the sizes the bins have without it instead.
+ */
+static const cache_bin_info_t *
+tcache_explicit_bin_info_get(
+    cache_bin_info_t tcache_bin_info[TCACHE_NBINS_MAX]) {
+	if (!opt_tcache_adaptive) {
+		return tcache_get_default_ncached_max();
+	}
+	for (szind_t i = 0; i < TCACHE_NBINS_MAX; i++) {
+		unsigned ncached_max = tcache_get_default_ncached_max_set(i) ?
+		    (unsigned)tcache_get_default_ncached_max()[i].ncached_max:
+		    tcache_ncached_max_compute(i, /* adaptive */ false);
+		assert(ncached_max <= CACHE_BIN_NCACHED_MAX);
+		cache_bin_info_init(&tcache_bin_info[i],
+		    (cache_bin_sz_t)ncached_max);
+	}
+	return tcache_bin_info;
+}
+
 static bool
 tsd_tcache_data_init_impl(tsd_t *tsd, arena_t *arena,
     const cache_bin_info_t *tcache_bin_info) {
@@ -1429,6 +1571,16 @@ tsd_tcache_data_init_impl(tsd_t *tsd, arena_t *arena,
 	tcache_t *tcache = tsd_tcachep_get_unsafe(tsd);
 
 	assert(cache_bin_still_zero_initialized(&tcache->bins[0]));
+	cache_bin_info_t percpu_bin_info[TCACHE_NBINS_MAX];
+	if (percpu_cache_enabled) {
+		/* Small objects are cached per CPU instead; see below. */
+		memcpy(percpu_bin_info, tcache_bin_info,
+		    sizeof(percpu_bin_info));
+		for (szind_t i = 0; i < SC_NBINS; i++) {
+			cache_bin_info_init(&percpu_bin_info[i], 0);
+		}
+		tcache_bin_info = percpu_bin_info;
+	}
 	unsigned tcache_nbins = tcache_nbins_get(tcache_slow);
 	size_t size, alignment;
 	cache_bin_info_compute_alloc(tcache_bin_info, tcache_nbins,
@@ -1449,6 +1601,9 @@ tsd_tcache_data_init_impl(tsd_t *tsd, arena_t *arena,
 	}
 
 	tcache_init(tsd, tcache_slow, tcache, mem, tcache_bin_info);
+	if (opt_tcache_adaptive) {
+		tcache_adaptive_init(tcache_slow, tcache);
+	}
 	/*
 	 * Initialization is a bit tricky here.  After malloc init is done, all
 	 * threads can rely on arena_choose and associate tcache accordingly.
@@ -1474,6 +1629,7 @@ tsd_tcache_data_init_impl(tsd_t *tsd, arena_t *arena,
 		}
 	}
 	assert(arena == tcache_slow->arena);
+	tcache_percpu_cache_update(tcache_slow);
 
 	return false;
 }
@@ -1495,9 +1651,12 @@ tcache_create_explicit(tsd_t *tsd) {
 	 * the cache bins have the requested alignment.
 	 */
 	unsigned tcache_nbins = global_do_not_change_tcache_nbins;
+	cache_bin_info_t explicit_bin_info[TCACHE_NBINS_MAX];
+	const cache_bin_info_t *tcache_bin_info =
+	    tcache_explicit_bin_info_get(explicit_bin_info);
 	size_t tcache_size, alignment;
-	cache_bin_info_compute_alloc(tcache_get_default_ncached_max(),
-	    tcache_nbins, &tcache_size, &alignment);
+	cache_bin_info_compute_alloc(tcache_bin_info, tcache_nbins,
+	    &tcache_size, &alignment);
 
 	size_t size = tcache_size + sizeof(tcache_t)
 	    + sizeof(tcache_slow_t);
@@ -1514,8 +1673,7 @@ tcache_create_explicit(tsd_t *tsd) {
 	tcache_slow_t *tcache_slow =
 	    (void *)((byte_t *)mem + tcache_size + sizeof(tcache_t));
 	tcache_default_settings_init(tcache_slow);
-	tcache_init(tsd, tcache_slow, tcache, mem,
-	    tcache_get_default_ncached_max());
+	tcache_init(tsd, tcache_slow, tcache, mem, tcache_bin_info);
 
 	tcache_arena_associate(tsd_tsdn(tsd), tcache_slow, tcache,
 	    arena_ichoose(tsd, NULL));
@@ -1683,6 +1841,11 @@ void
 tcache_flush(tsd_t *tsd) {
 	assert(tcache_available(tsd));
 	tcache_flush_cache(tsd, tsd_tcachep_get(tsd));
+	/*
+	 * Objects freed by this thread may be cached on any CPU, so all of the
+	 * per-CPU caches have to go.
+	 */
+	percpu_cache_flush_all(tsd, tsd_tcachep_get(tsd));
 }
 
 static void
@@ -1694,7 +1857,10 @@ tcache_destroy(tsd_t *tsd, tcache_t *tcache, bool tsd_tcache) {
 
 	if (tsd_tcache) {
 		cache_bin_t *cache_bin = &tcache->bins[0];
-		cache_bin_assert_empty(cache_bin);
+		/* Small bins are disabled e.g. with opt_percpu_tcache. */
+		if (!cache_bin_disabled(cache_bin)) {
+			cache_bin_assert_empty(cache_bin);
+		}
 	}
 	if (tsd_tcache && cache_bin_stack_use_thp()) {
 		b0_dalloc_tcache_stack(tsd_tsdn(tsd), tcache_slow->dyn_alloc);
@@ -1884,6 +2050,10 @@ tcache_boot(tsdn_t *tsdn, base_t *base) {
 	 * accessed using tcache_get_default_ncached_max.
 	 */
 	tcache_bin_info_compute(opt_tcache_ncached_max);
+	if (percpu_cache_boot(tsdn, opt_tcache_ncached_max,
+	    global_do_not_change_tcache_nbins)) {
+		return true;
+	}
 
 	if (malloc_mutex_init(&tcaches_mtx, "tcaches", WITNESS_RANK_TCACHES,
 	    malloc_mutex_rank_exclusive)) {
@@ -1896,15 +2066,18 @@ tcache_boot(tsdn_t *tsdn, base_t *base) {
 void
 tcache_prefork(tsdn_t *tsdn) {
 	malloc_mutex_prefork(tsdn, &tcaches_mtx);
+	percpu_cache_prefork(tsdn);
 }
 
 void
 tcache_postfork_parent(tsdn_t *tsdn) {
+	percpu_cache_postfork_parent(tsdn);
 	malloc_mutex_postfork_parent(tsdn, &tcaches_mtx);
 }
 
 void
 tcache_postfork_child(tsdn_t *tsdn) {
+	percpu_cache_postfork_child(tsdn);
 	malloc_mutex_postfork_child(tsdn, &tcaches_mtx);
 }
 
@@ -59,6 +59,14 @@ stats_interval_fetch_elapsed(tsd_t *tsd) {
 	return last_event - last_stats_event;
 }
 
+static uint64_t
+arena_rebalance_fetch_elapsed(tsd_t *tsd) {
+	uint64_t last_event = thread_allocated_last_event_get(tsd);
+	uint64_t last_rebalance_event = arena_rebalance_last_event_get(tsd);
+	arena_rebalance_last_event_set(tsd, last_event);
+	return last_event - last_rebalance_event;
+}
+
 static uint64_t
 peak_alloc_fetch_elapsed(tsd_t *tsd) {
 	return TE_INVALID_ELAPSED;
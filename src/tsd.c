@@ -129,6 +129,17 @@ tsd_force_recompute(tsdn_t *tsdn) {
 	malloc_mutex_unlock(tsdn, &tsd_nominal_tsds_lock);
 }
 
+void
+tsd_nominal_foreach(tsdn_t *tsdn, void (*visitor)(tsd_t *, void *),
+    void *arg) {
+	malloc_mutex_lock(tsdn, &tsd_nominal_tsds_lock);
+	tsd_t *remote_tsd;
+	ql_foreach(remote_tsd, &tsd_nominal_tsds, TSD_MANGLE(tsd_link)) {
+		visitor(remote_tsd, arg);
+	}
+	malloc_mutex_unlock(tsdn, &tsd_nominal_tsds_lock);
+}
+
 void
 tsd_global_slow_inc(tsdn_t *tsdn) {
 	atomic_fetch_add_u32(&tsd_global_slow_count, 1, ATOMIC_RELAXED);
@@ -400,6 +411,7 @@ _malloc_tsd_cleanup_register(bool (*f)(void)) {
 
 static void
 tsd_do_data_cleanup(tsd_t *tsd) {
+	alloc_tag_cleanup(tsd);
 	prof_tdata_cleanup(tsd);
 	iarena_cleanup(tsd);
 	arena_cleanup(tsd);
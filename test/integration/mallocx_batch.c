@@ -0,0 +1,148 @@
+#include "test/jemalloc_test.h"
+
+#define BATCH_MAX 64
+
+static size_t
+get_large_size(size_t ind) {
+	size_t mib[4];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	expect_d_eq(mallctlnametomib("arenas.lextent.0.size", mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[2] = ind;
+	size_t ret;
+	size_t sz = sizeof(ret);
+	expect_d_eq(mallctlbymib(mib, miblen, (void *)&ret, &sz, NULL, 0), 0,
+	    "Unexpected mallctlbymib() failure");
+	return ret;
+}
+
+static size_t
+get_large_minclass(void) {
+	return get_large_size(0);
+}
+
+static size_t
+get_large_maxclass(void) {
+	unsigned nlextents;
+	size_t sz = sizeof(nlextents);
+	expect_d_eq(mallctl("arenas.nlextents", (void *)&nlextents, &sz, NULL,
+	    0), 0, "Unexpected mallctl() failure");
+	return get_large_size(nlextents - 1);
+}
+
+static void
+verify_batch(void **ptrs, size_t filled, size_t size, int flags) {
+	size_t usize = nallocx(size, flags);
+	for (size_t i = 0; i < filled; i++) {
+		expect_ptr_not_null(ptrs[i], "Unexpected NULL pointer");
+		expect_zu_eq(sallocx(ptrs[i], 0), usize,
+		    "Unexpected usable size");
+		if (flags & MALLOCX_ZERO) {
+			for (size_t j = 0; j < usize; j++) {
+				expect_zu_eq(((unsigned char *)ptrs[i])[j], 0,
+				    "Expected zeroed memory");
+			}
+		}
+		/* Dirty the region, so that overlaps would show. */
+		memset(ptrs[i], (int)(i & 0xff), usize);
+	}
+	for (size_t i = 0; i < filled; i++) {
+		expect_zu_eq(((unsigned char *)ptrs[i])[0], i & 0xff,
+		    "Overlapping regions");
+		expect_zu_eq(((unsigned char *)ptrs[i])[usize - 1], i & 0xff,
+		    "Overlapping regions");
+	}
+}
+
+static void
+test_batch(size_t size, int flags) {
+	void *ptrs[BATCH_MAX];
+	size_t nums[] = {0, 1, 7, BATCH_MAX};
+	for (size_t i = 0; i < sizeof(nums) / sizeof(nums[0]); i++) {
+		size_t num = nums[i];
+		size_t filled = mallocx_batch(ptrs, num, size, flags);
+		expect_zu_eq(filled, num, "Unexpected mallocx_batch() result"
+		    " for size=%zu, flags=%#x", size, flags);
+		verify_batch(ptrs, filled, size, flags);
+		dallocx_batch(ptrs, filled, flags);
+	}
+}
+
+static void
+test_batch_sizes(int flags) {
+	test_batch(1, flags);
+	test_batch(8, flags);
+	test_batch(get_large_minclass() - 1, flags);
+	test_batch(get_large_minclass(), flags);
+	test_batch(get_large_minclass() * 4 + 1, flags);
+	test_batch(ZU(1) << 20, flags);
+}
+
+TEST_BEGIN(test_mallocx_batch) {
+	test_batch_sizes(0);
+}
+TEST_END
+
+TEST_BEGIN(test_mallocx_batch_flags) {
+	test_batch_sizes(MALLOCX_ZERO);
+	test_batch_sizes(MALLOCX_TCACHE_NONE);
+	test_batch_sizes(MALLOCX_LG_ALIGN(12));
+
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	test_batch_sizes(flags);
+
+	void *ptrs[BATCH_MAX];
+	expect_zu_eq(mallocx_batch(ptrs, BATCH_MAX, get_large_minclass(),
+	    flags),
+	    BATCH_MAX, "Unexpected mallocx_batch() result");
+	for (size_t i = 0; i < BATCH_MAX; i++) {
+		unsigned ind;
+		sz = sizeof(ind);
+		expect_d_eq(mallctl("arenas.lookup", &ind, &sz, &ptrs[i],
+		    sizeof(ptrs[i])), 0, "Unexpected mallctl() failure");
+		expect_u_eq(ind, arena_ind, "Allocated from the wrong arena");
+	}
+	dallocx_batch(ptrs, BATCH_MAX, flags);
+}
+TEST_END
+
+TEST_BEGIN(test_dallocx_batch_stats) {
+	test_skip_if(!config_stats);
+
+	void *ptrs[BATCH_MAX];
+	size_t usize = nallocx(get_large_minclass(), 0);
+	size_t filled = mallocx_batch(ptrs, BATCH_MAX, get_large_minclass(), 0);
+	expect_zu_eq(filled, BATCH_MAX, "Unexpected mallocx_batch() result");
+
+	uint64_t deallocated0, deallocated1;
+	size_t sz = sizeof(uint64_t);
+	expect_d_eq(mallctl("thread.deallocated", (void *)&deallocated0, &sz,
+	    NULL, 0), 0, "Unexpected mallctl() failure");
+	dallocx_batch(ptrs, filled, 0);
+	expect_d_eq(mallctl("thread.deallocated", (void *)&deallocated1, &sz,
+	    NULL, 0), 0, "Unexpected mallctl() failure");
+	expect_u64_eq(deallocated1 - deallocated0, usize * filled,
+	    "Deallocated bytes should be accounted for");
+}
+TEST_END
+
+TEST_BEGIN(test_mallocx_batch_oom) {
+	void *ptrs[BATCH_MAX];
+	expect_zu_eq(mallocx_batch(ptrs, BATCH_MAX, get_large_maxclass() + 1,
+	    0),
+	    0, "Expected failure for oversized allocations");
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_mallocx_batch,
+	    test_mallocx_batch_flags,
+	    test_dallocx_batch_stats,
+	    test_mallocx_batch_oom);
+}
@@ -0,0 +1,215 @@
+#include "test/jemalloc_test.h"
+
+#define NALLOCS 10
+#define SZ 100
+
+static unsigned
+thread_tag_set(unsigned tag) {
+	unsigned old_tag;
+	size_t sz = sizeof(old_tag);
+	expect_d_eq(mallctl("thread.tag", (void *)&old_tag, &sz,
+	    (void *)&tag, sizeof(tag)), 0, "Unexpected mallctl() failure");
+	return old_tag;
+}
+
+static uint64_t
+tag_read(unsigned tag, const char *name) {
+	char cmd[128];
+	malloc_snprintf(cmd, sizeof(cmd), "tags.tag.%u.thread_%s", tag, name);
+	uint64_t val;
+	size_t sz = sizeof(val);
+	expect_d_eq(mallctl(cmd, (void *)&val, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure for %s", cmd);
+	return val;
+}
+
+typedef struct tag_counts_s tag_counts_t;
+struct tag_counts_s {
+	uint64_t allocated;
+	uint64_t deallocated;
+	uint64_t nmalloc;
+	uint64_t ndalloc;
+};
+
+static void
+tag_counts_read(unsigned tag, tag_counts_t *counts) {
+	counts->allocated = tag_read(tag, "allocated");
+	counts->deallocated = tag_read(tag, "deallocated");
+	if (config_stats) {
+		counts->nmalloc = tag_read(tag, "nmalloc");
+		counts->ndalloc = tag_read(tag, "ndalloc");
+	} else {
+		counts->nmalloc = counts->ndalloc = 0;
+	}
+}
+
+static void
+tag_counts_expect_impl(unsigned tag, const tag_counts_t *before,
+    uint64_t nmalloc, uint64_t ndalloc, size_t usize) {
+	tag_counts_t after;
+	tag_counts_read(tag, &after);
+	expect_u64_eq(after.allocated - before->allocated, nmalloc * usize,
+	    "Unexpected allocated bytes for tag %u", tag);
+	expect_u64_eq(after.deallocated - before->deallocated, ndalloc * usize,
+	    "Unexpected deallocated bytes for tag %u", tag);
+	if (config_stats) {
+		expect_u64_eq(after.nmalloc - before->nmalloc, nmalloc,
+		    "Unexpected nmalloc for tag %u", tag);
+		expect_u64_eq(after.ndalloc - before->ndalloc, ndalloc,
+		    "Unexpected ndalloc for tag %u", tag);
+	}
+}
+
+static void
+tag_counts_expect(unsigned tag, const tag_counts_t *before, uint64_t n,
+    size_t usize) {
+	tag_counts_expect_impl(tag, before, n, n, usize);
+}
+
+static void
+do_mallocs(unsigned tag, void **ptrs) {
+	unsigned old_tag = thread_tag_set(tag);
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		ptrs[i] = malloc(SZ);
+		expect_ptr_not_null(ptrs[i], "Unexpected malloc() failure");
+	}
+	thread_tag_set(old_tag);
+}
+
+static void
+do_frees(unsigned tag, void **ptrs) {
+	unsigned old_tag = thread_tag_set(tag);
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		free(ptrs[i]);
+	}
+	thread_tag_set(old_tag);
+}
+
+static void
+do_allocs(unsigned tag) {
+	void *ptrs[NALLOCS];
+	do_mallocs(tag, ptrs);
+	do_frees(tag, ptrs);
+}
+
+TEST_BEGIN(test_thread_tag) {
+	unsigned ntags;
+	size_t sz = sizeof(ntags);
+	expect_d_eq(mallctl("tags.ntags", (void *)&ntags, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	expect_u_gt(ntags, 1, "There should be tags beyond the default one");
+
+	expect_u_eq(thread_tag_set(1), 0, "The default tag should be 0");
+	expect_u_eq(thread_tag_set(0), 1, "Unexpected tag");
+
+	unsigned tag = ntags;
+	expect_d_eq(mallctl("thread.tag", NULL, NULL, (void *)&tag,
+	    sizeof(tag)), EINVAL, "Out of range tags should be rejected");
+	expect_u_eq(thread_tag_set(0), 0,
+	    "A rejected tag shouldn't have been set");
+
+	char cmd[128];
+	uint64_t val;
+	sz = sizeof(val);
+	malloc_snprintf(cmd, sizeof(cmd), "tags.tag.%u.thread_allocated",
+	    ntags);
+	expect_d_eq(mallctl(cmd, (void *)&val, &sz, NULL, 0), ENOENT,
+	    "Out of range tags shouldn't be readable");
+	expect_d_eq(mallctl("tags.tag.0.thread_allocated", (void *)&val, &sz,
+	    (void *)&val, sizeof(val)), EPERM, "Tags should be read-only");
+}
+TEST_END
+
+TEST_BEGIN(test_tag_accounting) {
+	size_t usize = sz_s2u(SZ);
+	tag_counts_t before, other_before;
+	tag_counts_read(2, &before);
+	tag_counts_read(3, &other_before);
+
+	do_allocs(2);
+	tag_counts_expect(2, &before, NALLOCS, usize);
+	tag_counts_expect(3, &other_before, 0, usize);
+
+	/* Activity under other tags isn't credited to the previous one. */
+	tag_counts_read(2, &before);
+	do_allocs(3);
+	tag_counts_expect(2, &before, 0, usize);
+	tag_counts_expect(3, &other_before, NALLOCS, usize);
+}
+TEST_END
+
+TEST_BEGIN(test_tag_cross_free) {
+	size_t usize = sz_s2u(SZ);
+	void *ptrs[NALLOCS];
+	tag_counts_t before5, before6;
+	tag_counts_read(5, &before5);
+	tag_counts_read(6, &before6);
+
+	/*
+	 * The tag isn't recorded with the allocations: frees are credited to
+	 * the tag current at the time of the free.
+	 */
+	do_mallocs(5, ptrs);
+	do_frees(6, ptrs);
+	tag_counts_expect_impl(5, &before5, NALLOCS, 0, usize);
+	tag_counts_expect_impl(6, &before6, 0, NALLOCS, usize);
+}
+TEST_END
+
+static void *
+thd_malloc_start(void *arg) {
+	do_mallocs(7, (void **)arg);
+	return NULL;
+}
+
+TEST_BEGIN(test_tag_cross_thread_free) {
+	size_t usize = sz_s2u(SZ);
+	void *ptrs[NALLOCS];
+	tag_counts_t before7, before8;
+	tag_counts_read(7, &before7);
+	tag_counts_read(8, &before8);
+
+	thd_t thd;
+	thd_create(&thd, thd_malloc_start, (void *)ptrs);
+	thd_join(thd, NULL);
+	do_frees(8, ptrs);
+	tag_counts_expect_impl(7, &before7, NALLOCS, 0, usize);
+	tag_counts_expect_impl(8, &before8, 0, NALLOCS, usize);
+}
+TEST_END
+
+static void *
+thd_start(void *arg) {
+	unsigned tag = *(unsigned *)arg;
+	do_allocs(tag);
+	/* Exit with the tag still set, so that its activity is pending. */
+	thread_tag_set(tag);
+	void *p = malloc(SZ);
+	expect_ptr_not_null(p, "Unexpected malloc() failure");
+	free(p);
+	return NULL;
+}
+
+TEST_BEGIN(test_tag_exited_thread) {
+	unsigned tag = 4;
+	size_t usize = sz_s2u(SZ);
+	tag_counts_t before;
+	tag_counts_read(tag, &before);
+
+	thd_t thd;
+	thd_create(&thd, thd_start, (void *)&tag);
+	thd_join(thd, NULL);
+
+	tag_counts_expect(tag, &before, NALLOCS + 1, usize);
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_thread_tag,
+	    test_tag_accounting,
+	    test_tag_cross_free,
+	    test_tag_cross_thread_free,
+	    test_tag_exited_thread);
+}
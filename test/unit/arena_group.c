@@ -0,0 +1,164 @@
+#include "test/jemalloc_test.h"
+
+#define SMALL_SIZE 64
+#define LARGE_SIZE (4 * SC_LARGE_MINCLASS)
+
+static unsigned
+do_arena_create(void) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	return arena_ind;
+}
+
+static unsigned
+do_arena_create_grouped(unsigned group_ind) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("arenas.create_grouped", (void *)&arena_ind, &sz,
+	    (void *)&group_ind, sizeof(group_ind)), 0,
+	    "Unexpected mallctl() failure");
+	return arena_ind;
+}
+
+static unsigned
+arena_group_get(unsigned arena_ind) {
+	size_t mib[3];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	expect_d_eq(mallctlnametomib("arena.0.group", mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[1] = (size_t)arena_ind;
+	unsigned group_ind;
+	size_t sz = sizeof(group_ind);
+	expect_d_eq(mallctlbymib(mib, miblen, (void *)&group_ind, &sz, NULL,
+	    0), 0, "Unexpected mallctlbymib() failure");
+	return group_ind;
+}
+
+static int
+do_arena_destroy(unsigned arena_ind) {
+	size_t mib[3];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	expect_d_eq(mallctlnametomib("arena.0.destroy", mib, &miblen), 0,
+	    "Unexpected mallctlnametomib() failure");
+	mib[1] = (size_t)arena_ind;
+	return mallctlbymib(mib, miblen, NULL, NULL, NULL, 0);
+}
+
+static void
+arena_decay_ms_disable(unsigned arena_ind) {
+	size_t mib[3];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	expect_d_eq(mallctlnametomib("arena.0.dirty_decay_ms", mib, &miblen),
+	    0, "Unexpected mallctlnametomib() failure");
+	mib[1] = (size_t)arena_ind;
+	ssize_t decay_ms = -1;
+	expect_d_eq(mallctlbymib(mib, miblen, NULL, NULL, (void *)&decay_ms,
+	    sizeof(decay_ms)), 0, "Unexpected mallctlbymib() failure");
+}
+
+static size_t
+arena_pdirty_get(unsigned arena_ind) {
+	uint64_t epoch = 1;
+	expect_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl() failure");
+
+	size_t mib[4];
+	size_t miblen = sizeof(mib) / sizeof(size_t);
+	expect_d_eq(mallctlnametomib("stats.arenas.0.pdirty", mib, &miblen),
+	    0, "Unexpected mallctlnametomib() failure");
+	mib[2] = (size_t)arena_ind;
+	size_t pdirty;
+	size_t sz = sizeof(pdirty);
+	expect_d_eq(mallctlbymib(mib, miblen, (void *)&pdirty, &sz, NULL, 0),
+	    0, "Unexpected mallctlbymib() failure");
+	return pdirty;
+}
+
+static unsigned
+ptr_arena_get(void *ptr) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("arenas.lookup", (void *)&arena_ind, &sz,
+	    (void *)&ptr, sizeof(ptr)), 0, "Unexpected mallctl() failure");
+	return arena_ind;
+}
+
+TEST_BEGIN(test_arena_group_create) {
+	unsigned first = do_arena_create();
+	unsigned second = do_arena_create_grouped(first);
+	/* Creating into the group of a member joins the same group. */
+	unsigned third = do_arena_create_grouped(second);
+
+	expect_u_ne(first, second, "Arenas should be distinct");
+	expect_u_eq(arena_group_get(first), first,
+	    "The first arena should use its own pages");
+	expect_u_eq(arena_group_get(second), first, "Unexpected group");
+	expect_u_eq(arena_group_get(third), first, "Unexpected group");
+
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	unsigned bad_ind = UINT_MAX - 1;
+	expect_d_eq(mallctl("arenas.create_grouped", (void *)&arena_ind, &sz,
+	    (void *)&bad_ind, sizeof(bad_ind)), EFAULT,
+	    "Grouping with a nonexistent arena should fail");
+	expect_d_eq(mallctl("arenas.create_grouped", (void *)&arena_ind, &sz,
+	    NULL, 0), EINVAL, "The group arena index is required");
+
+	expect_d_eq(do_arena_destroy(first), EFAULT,
+	    "Arenas sharing their pages shouldn't be destroyable");
+	expect_d_eq(do_arena_destroy(third), 0, "Unexpected destroy failure");
+	expect_d_eq(do_arena_destroy(second), 0, "Unexpected destroy failure");
+	expect_d_eq(do_arena_destroy(first), 0, "Unexpected destroy failure");
+}
+TEST_END
+
+TEST_BEGIN(test_arena_group_alloc) {
+	test_skip_if(!config_stats);
+
+	unsigned first = do_arena_create();
+	unsigned second = do_arena_create_grouped(first);
+	int flags_first = MALLOCX_ARENA(first) | MALLOCX_TCACHE_NONE;
+	int flags_second = MALLOCX_ARENA(second) | MALLOCX_TCACHE_NONE;
+
+	/* Allocations are still owned by the arena they are made from. */
+	void *small = mallocx(SMALL_SIZE, flags_second);
+	expect_ptr_not_null(small, "Unexpected mallocx() failure");
+	expect_u_eq(ptr_arena_get(small), second, "Unexpected arena");
+	void *large = mallocx(LARGE_SIZE, flags_second);
+	expect_ptr_not_null(large, "Unexpected mallocx() failure");
+	expect_u_eq(ptr_arena_get(large), second, "Unexpected arena");
+
+	/* In place resizing goes through the shared page allocator. */
+	size_t usize = xallocx(large, LARGE_SIZE / 2, 0, flags_second);
+	expect_zu_eq(usize, LARGE_SIZE / 2, "Unexpected xallocx() failure");
+	expect_u_eq(ptr_arena_get(large), second, "Unexpected arena");
+	dallocx(small, flags_second);
+
+	/* Pages freed by one arena of the group are reused by the others. */
+	arena_decay_ms_disable(second);
+	dallocx(large, flags_second);
+	size_t pdirty = arena_pdirty_get(first);
+	expect_zu_gt(pdirty, 0,
+	    "Pages freed by the group should be reported by its first arena");
+	expect_zu_eq(arena_pdirty_get(second), 0,
+	    "The second arena shouldn't have pages of its own");
+	void *reused = mallocx(LARGE_SIZE / 2, flags_first);
+	expect_ptr_not_null(reused, "Unexpected mallocx() failure");
+	expect_zu_lt(arena_pdirty_get(first), pdirty,
+	    "Freed pages should have been reused across the group");
+	expect_u_eq(ptr_arena_get(reused), first, "Unexpected arena");
+	dallocx(reused, flags_first);
+
+	expect_d_eq(do_arena_destroy(second), 0, "Unexpected destroy failure");
+	expect_d_eq(do_arena_destroy(first), 0, "Unexpected destroy failure");
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_arena_group_create,
+	    test_arena_group_alloc);
+}
@@ -0,0 +1,143 @@
+#include "test/jemalloc_test.h"
+
+/*
+ * Config -- "narenas:3,arena_rebalance_interval:1048576,
+ * arena_rebalance_threshold:50"
+ */
+
+#define INTERVAL ((size_t)1 << 20)
+#define ALLOC_SIZE 4096
+
+static unsigned
+thread_arena_get(void) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("thread.arena", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	return arena_ind;
+}
+
+static void
+thread_arena_set(unsigned arena_ind) {
+	expect_d_eq(mallctl("thread.arena", NULL, NULL, (void *)&arena_ind,
+	    sizeof(arena_ind)), 0, "Unexpected mallctl() failure");
+}
+
+static void
+alloc_bytes(size_t nbytes) {
+	for (size_t allocated = 0; allocated < nbytes;
+	    allocated += ALLOC_SIZE) {
+		void *p = malloc(ALLOC_SIZE);
+		expect_ptr_not_null(p, "Unexpected malloc() failure");
+		free(p);
+	}
+}
+
+static void *
+thd_start_heavy(void *arg) {
+	thread_arena_set(0);
+	/* End mid-window, so that the next thread doesn't start a new one. */
+	alloc_bytes(2 * INTERVAL + INTERVAL / 2);
+	*(unsigned *)arg = thread_arena_get();
+	return NULL;
+}
+
+static void *
+thd_start_light(void *arg) {
+	thread_arena_set(0);
+	alloc_bytes(INTERVAL / 8);
+	*(unsigned *)arg = thread_arena_get();
+	return NULL;
+}
+
+TEST_BEGIN(test_arena_rebalance) {
+	test_skip_if(have_percpu_arena &&
+	    PERCPU_ARENA_ENABLED(opt_percpu_arena));
+
+	/*
+	 * Arena 0 gets all the load, but the only thread on it would just
+	 * carry it over to arena 1.
+	 */
+	thd_t thd;
+	unsigned arena_ind;
+	thd_create(&thd, thd_start_heavy, (void *)&arena_ind);
+	thd_join(thd, NULL);
+	expect_u_eq(arena_ind, 0, "Thread shouldn't have migrated");
+
+	/* A thread with a small share of the load should move, though. */
+	thd_create(&thd, thd_start_light, (void *)&arena_ind);
+	thd_join(thd, NULL);
+	expect_u_eq(arena_ind, 1, "Thread should have migrated to arena 1");
+}
+TEST_END
+
+TEST_BEGIN(test_arena_rebalance_manual) {
+	test_skip_if(have_percpu_arena &&
+	    PERCPU_ARENA_ENABLED(opt_percpu_arena));
+
+	/* Threads bound to manual arenas stay there. */
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL,
+	    0), 0, "Unexpected mallctl() failure");
+	thread_arena_set(arena_ind);
+	alloc_bytes(4 * INTERVAL);
+	expect_u_eq(thread_arena_get(), arena_ind,
+	    "Thread shouldn't have left its manual arena");
+}
+TEST_END
+
+TEST_BEGIN(test_arena_rebalance_same_window) {
+	test_skip_if(have_percpu_arena &&
+	    PERCPU_ARENA_ENABLED(opt_percpu_arena));
+
+	/* Gives arena 0 all the load of the last window, again. */
+	thd_t thd;
+	unsigned arena_ind;
+	thd_create(&thd, thd_start_heavy, (void *)&arena_ind);
+	thd_join(thd, NULL);
+	expect_u_eq(arena_ind, 0, "Thread shouldn't have migrated");
+
+	/*
+	 * Two threads leaving arena 0 in the same window each take their share
+	 * of its load along, so the second one goes to the other arena.
+	 */
+	unsigned arena_ind2;
+	thd_create(&thd, thd_start_light, (void *)&arena_ind);
+	thd_join(thd, NULL);
+	thd_create(&thd, thd_start_light, (void *)&arena_ind2);
+	thd_join(thd, NULL);
+	expect_u_ne(arena_ind, 0, "Thread should have migrated");
+	expect_u_ne(arena_ind2, 0, "Thread should have migrated");
+	expect_u_ne(arena_ind, arena_ind2,
+	    "Threads shouldn't pile onto the same arena");
+}
+TEST_END
+
+TEST_BEGIN(test_arena_rebalance_load_sub) {
+	atomic_zu_t load;
+	atomic_store_zu(&load, 100, ATOMIC_RELAXED);
+	expect_zu_eq(arena_rebalance_load_sub(&load, 60), 60,
+	    "Unexpected amount subtracted");
+	expect_zu_eq(atomic_load_zu(&load, ATOMIC_RELAXED), 40,
+	    "Unexpected load");
+	/* Shares exceeding the (stale) load must not wrap it around. */
+	expect_zu_eq(arena_rebalance_load_sub(&load, 60), 40,
+	    "Should only subtract the remaining load");
+	expect_zu_eq(atomic_load_zu(&load, ATOMIC_RELAXED), 0,
+	    "Load should saturate at 0");
+	expect_zu_eq(arena_rebalance_load_sub(&load, 1), 0,
+	    "Nothing left to subtract");
+	expect_zu_eq(atomic_load_zu(&load, ATOMIC_RELAXED), 0,
+	    "Load should saturate at 0");
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_arena_rebalance,
+	    test_arena_rebalance_manual,
+	    test_arena_rebalance_same_window,
+	    test_arena_rebalance_load_sub);
+}
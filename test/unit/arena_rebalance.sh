@@ -0,0 +1,3 @@
+#!/bin/sh
+
+export MALLOC_CONF="narenas:3,arena_rebalance_interval:1048576,arena_rebalance_threshold:50"
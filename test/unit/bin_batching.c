@@ -15,7 +15,7 @@ struct stress_thread_data_s {
 	void **to_dalloc;
 };
 
-static atomic_zu_t push_failure_count;
+static atomic_zu_t push_count;
 static atomic_zu_t pop_attempt_results[2];
 static atomic_zu_t dalloc_zero_slab_count;
 static atomic_zu_t dalloc_nonzero_slab_count;
@@ -40,28 +40,25 @@ should_skip() {
 }
 
 static void
-increment_push_failure(size_t push_idx) {
-	if (push_idx == BATCHER_NO_IDX) {
-		atomic_fetch_add_zu(&push_failure_count, 1, ATOMIC_RELAXED);
-	} else {
-		assert_zu_lt(push_idx, 4, "Only 4 elems");
-		volatile size_t x = 10000;
-		while (--x) {
-			/* Spin for a while, to try to provoke a failure. */
-			if (x == push_idx) {
+increment_push(size_t nelems) {
+	assert_zu_eq(nelems, 1, "Batches are limited to 1 elem");
+	atomic_fetch_add_zu(&push_count, 1, ATOMIC_RELAXED);
+	volatile size_t x = 10000;
+	while (--x) {
+		/* Spin for a while, to try to provoke racing pops. */
+		if (x == nelems) {
 #ifdef _WIN32
-				SwitchToThread();
+			SwitchToThread();
 #else
-				sched_yield();
+			sched_yield();
 #endif
-			}
 		}
 	}
 }
 
 static void
-increment_pop_attempt(size_t elems_to_pop) {
-	bool elems = (elems_to_pop != BATCHER_NO_IDX);
+increment_pop_attempt(size_t nelems) {
+	bool elems = (nelems != 0);
 	atomic_fetch_add_zu(&pop_attempt_results[elems], 1, ATOMIC_RELAXED);
 }
 
@@ -113,11 +110,11 @@ stress_thread(void *arg) {
 static void
 stress_run(void (*main_thread_fn)(), int nruns) {
 	bin_batching_test_ndalloc_slabs_max = 1;
-	bin_batching_test_after_push_hook = &increment_push_failure;
+	bin_batching_test_after_push_hook = &increment_push;
 	bin_batching_test_mid_pop_hook = &increment_pop_attempt;
 	bin_batching_test_after_unlock_hook = &increment_slab_dalloc_count;
 
-	atomic_store_zu(&push_failure_count, 0, ATOMIC_RELAXED);
+	atomic_store_zu(&push_count, 0, ATOMIC_RELAXED);
 	atomic_store_zu(&pop_attempt_results[0], 0, ATOMIC_RELAXED);
 	atomic_store_zu(&pop_attempt_results[1], 0, ATOMIC_RELAXED);
 	atomic_store_zu(&dalloc_zero_slab_count, 0, ATOMIC_RELAXED);
@@ -248,8 +245,8 @@ TEST_BEGIN(test_races) {
 
 	stress_run(&test_races_main_fn, /* nruns */ 400);
 
-	assert_zu_lt(0, atomic_load_zu(&push_failure_count, ATOMIC_RELAXED),
-	    "Should have seen some push failures");
+	assert_zu_lt(0, atomic_load_zu(&push_count, ATOMIC_RELAXED),
+	    "Should have seen some pushes");
 	assert_zu_lt(0, atomic_load_zu(&pop_attempt_results[0], ATOMIC_RELAXED),
 	    "Should have seen some pop failures");
 	assert_zu_lt(0, atomic_load_zu(&pop_attempt_results[1], ATOMIC_RELAXED),
@@ -7,4 +7,4 @@
 # allocate/deallocate PAGE/2-sized objects (to trigger the "non-empty" ->
 # "empty" and "non-empty"-> "full" transitions often, which have special
 # handling). But the value of PAGE isn't easily available in test scripts.
-export MALLOC_CONF="narenas:2,bin_shards:1-1000000000:3,max_batched_size:1000000000,remote_free_max_batch:1,remote_free_max:4"
+export MALLOC_CONF="narenas:2,bin_shards:1-1000000000:3,max_batched_size:1000000000,remote_free_max_batch:1"
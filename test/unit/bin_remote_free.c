@@ -0,0 +1,152 @@
+#include "test/jemalloc_test.h"
+
+#include "jemalloc/internal/bin.h"
+
+/* Stand-ins for the slabs; only their (aligned) addresses matter. */
+static edata_t *
+fake_slab(size_t i) {
+	return (edata_t *)(uintptr_t)((i + 1) * CACHELINE);
+}
+
+TEST_BEGIN(test_simple) {
+	enum { NBATCHES = 4, BATCH_NELEMS_MAX = 5 };
+	bin_with_batch_t batched_bin;
+	bin_remote_free_t regions[NBATCHES][BATCH_NELEMS_MAX];
+
+	bin_remote_free_init(&batched_bin);
+	expect_ptr_null(bin_remote_free_pop_all(&batched_bin),
+	    "Shouldn't get any items out of an empty stack");
+
+	/* Batch i holds i + 1 elements. */
+	for (size_t i = 0; i < NBATCHES; i++) {
+		bin_remote_free_batch_t batch;
+		bin_remote_free_batch_init(&batch);
+		for (size_t j = 0; j <= i; j++) {
+			bin_remote_free_batch_append(&batch, &regions[i][j],
+			    fake_slab(i * BATCH_NELEMS_MAX + j));
+		}
+		expect_zu_eq(i + 1, batch.nelems, "Wrong batch size");
+		bin_remote_free_push(&batched_bin, &batch);
+	}
+
+	/* Batches come out most recent first, each one in order. */
+	bin_remote_free_t *elem = bin_remote_free_pop_all(&batched_bin);
+	for (size_t i = NBATCHES; i-- > 0;) {
+		for (size_t j = 0; j <= i; j++) {
+			expect_ptr_eq(&regions[i][j], elem,
+			    "Item popped out of order");
+			expect_ptr_eq(fake_slab(i * BATCH_NELEMS_MAX + j),
+			    bin_remote_free_slab_get(elem), "Wrong slab");
+			expect_b_eq(j == 0, bin_remote_free_batch_head(elem),
+			    "Only the first element should mark the batch");
+			elem = elem->next;
+		}
+	}
+	expect_ptr_null(elem, "Popped more items than pushed");
+	expect_ptr_null(bin_remote_free_pop_all(&batched_bin),
+	    "Popping should take everything");
+}
+TEST_END
+
+enum {
+	STRESS_TEST_THREADS = 4,
+	STRESS_TEST_ELEMS_PER_THREAD = 1000,
+	STRESS_TEST_BATCH_NELEMS_MAX = 7,
+	STRESS_TEST_NELEMS = STRESS_TEST_THREADS * STRESS_TEST_ELEMS_PER_THREAD,
+};
+
+typedef struct stress_test_data_s stress_test_data_t;
+struct stress_test_data_s {
+	bin_with_batch_t batched_bin;
+	atomic_u32_t thread_id;
+	atomic_u32_t done_threads;
+	bin_remote_free_t regions[STRESS_TEST_NELEMS];
+	size_t pop_count[STRESS_TEST_NELEMS];
+	size_t npushes;
+	size_t npops;
+};
+
+static void *
+stress_test_thd(void *arg) {
+	stress_test_data_t *data = arg;
+	uint32_t thread_id = atomic_fetch_add_u32(&data->thread_id, 1,
+	    ATOMIC_RELAXED);
+	uint64_t prng = thread_id;
+	size_t start = thread_id * STRESS_TEST_ELEMS_PER_THREAD;
+	size_t end = start + STRESS_TEST_ELEMS_PER_THREAD;
+
+	for (size_t i = start; i < end;) {
+		bin_remote_free_batch_t batch;
+		bin_remote_free_batch_init(&batch);
+		size_t nelems = 1 + (size_t)prng_range_u64(&prng,
+		    STRESS_TEST_BATCH_NELEMS_MAX);
+		for (size_t j = 0; j < nelems && i < end; j++, i++) {
+			bin_remote_free_batch_append(&batch, &data->regions[i],
+			    fake_slab(i));
+		}
+		bin_remote_free_push(&data->batched_bin, &batch);
+	}
+	atomic_fetch_add_u32(&data->done_threads, 1, ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+static void
+stress_test_pop(stress_test_data_t *data) {
+	bin_remote_free_t *elem = bin_remote_free_pop_all(&data->batched_bin);
+	if (elem != NULL) {
+		data->npops++;
+	}
+	while (elem != NULL) {
+		size_t i = (size_t)(elem - data->regions);
+		assert_zu_lt(i, STRESS_TEST_NELEMS, "Unknown element popped");
+		expect_ptr_eq(fake_slab(i), bin_remote_free_slab_get(elem),
+		    "Wrong slab");
+		data->pop_count[i]++;
+		data->npushes += bin_remote_free_batch_head(elem);
+		elem = elem->next;
+	}
+}
+
+TEST_BEGIN(test_stress) {
+	static stress_test_data_t data;
+	bin_remote_free_init(&data.batched_bin);
+	atomic_store_u32(&data.thread_id, 0, ATOMIC_RELAXED);
+	atomic_store_u32(&data.done_threads, 0, ATOMIC_RELAXED);
+	memset(data.pop_count, 0, sizeof(data.pop_count));
+	data.npushes = 0;
+	data.npops = 0;
+
+	thd_t threads[STRESS_TEST_THREADS];
+	for (int i = 0; i < STRESS_TEST_THREADS; i++) {
+		thd_create(&threads[i], stress_test_thd, &data);
+	}
+	/* Pop concurrently with the pushes. */
+	while (atomic_load_u32(&data.done_threads, ATOMIC_ACQUIRE)
+	    != STRESS_TEST_THREADS) {
+		stress_test_pop(&data);
+	}
+	for (int i = 0; i < STRESS_TEST_THREADS; i++) {
+		thd_join(threads[i], NULL);
+	}
+	stress_test_pop(&data);
+
+	for (size_t i = 0; i < STRESS_TEST_NELEMS; i++) {
+		assert_zu_eq(1, data.pop_count[i],
+		    "Every element should be popped exactly once");
+	}
+	expect_zu_ge(STRESS_TEST_NELEMS, data.npushes,
+	    "Can't have more pushes than elements");
+	expect_zu_le(STRESS_TEST_NELEMS / STRESS_TEST_BATCH_NELEMS_MAX,
+	    data.npushes, "Too few pushes");
+	expect_zu_ge(data.npushes, data.npops,
+	    "Can't have more non-empty pops than pushes");
+	expect_ptr_null(bin_remote_free_pop_all(&data.batched_bin),
+	    "Stack should be empty");
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(test_simple, test_stress);
+}
@@ -0,0 +1,112 @@
+#include "test/jemalloc_test.h"
+
+/* Config -- "narenas:1,bin_shards_max:4" */
+
+#define NTHREADS 4
+
+static uint32_t
+bin0_nshards_active(void) {
+	uint64_t epoch = 1;
+	expect_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl() failure");
+	uint32_t nshards;
+	size_t sz = sizeof(nshards);
+	expect_d_eq(mallctl("stats.arenas.0.bins.0.nshards", (void *)&nshards,
+	    &sz, NULL, 0), 0, "Unexpected mallctl() failure");
+	return nshards;
+}
+
+TEST_BEGIN(test_bin_lock_contended) {
+	test_skip_if(!config_stats);
+
+	bin_t bin;
+	expect_false(bin_init(&bin, 0), "Unexpected bin_init() failure");
+	mutex_prof_data_t *data = &bin.lock.prof_data;
+
+	data->n_lock_ops = BIN_CONTENTION_WINDOW - 1;
+	data->n_spin_acquired = BIN_CONTENTION_WINDOW - 1;
+	expect_false(bin_lock_contended(&bin),
+	    "Shouldn't check before the end of the window");
+	data->n_lock_ops = BIN_CONTENTION_WINDOW;
+	expect_true(bin_lock_contended(&bin), "Bin lock should be contended");
+
+	data->n_lock_ops += BIN_CONTENTION_WINDOW;
+	data->n_wait_times = BIN_CONTENTION_WINDOW / BIN_CONTENTION_RATIO - 1;
+	expect_false(bin_lock_contended(&bin),
+	    "Bin lock shouldn't be contended");
+
+	data->n_lock_ops += BIN_CONTENTION_WINDOW;
+	data->n_wait_times += BIN_CONTENTION_WINDOW / BIN_CONTENTION_RATIO;
+	expect_true(bin_lock_contended(&bin), "Bin lock should be contended");
+
+	/* Resetting the prof data starts a new window. */
+	data->n_lock_ops = BIN_CONTENTION_WINDOW;
+	data->n_spin_acquired = BIN_CONTENTION_WINDOW;
+	data->n_wait_times = 0;
+	expect_false(bin_lock_contended(&bin),
+	    "Shouldn't check right after a reset");
+}
+TEST_END
+
+static void *
+thd_start(void *varg) {
+	void *ptr = mallocx(1, MALLOCX_TCACHE_NONE);
+	edata_t *edata = emap_edata_lookup(tsdn_fetch(), &arena_emap_global,
+	    ptr);
+	unsigned binshard = edata_binshard_get(edata);
+	dallocx(ptr, MALLOCX_TCACHE_NONE);
+	return (void *)(uintptr_t)(binshard + 1);
+}
+
+TEST_BEGIN(test_bin_shards_grow) {
+	test_skip_if(!config_stats);
+	test_skip_if(have_percpu_arena &&
+	    PERCPU_ARENA_ENABLED(opt_percpu_arena));
+
+	uint32_t nshards;
+	size_t sz = sizeof(nshards);
+	expect_d_eq(mallctl("arenas.bin.0.nshards", (void *)&nshards, &sz,
+	    NULL, 0), 0, "Unexpected mallctl() failure");
+	expect_u_eq(4, nshards, "All the shards should be allocated");
+	expect_u_eq(1, bin0_nshards_active(), "Only one shard should be used");
+
+	/* Make it look like the last window of lock operations was contended. */
+	tsdn_t *tsdn = tsdn_fetch();
+	arena_t *arena = arena_get(tsdn, 0, false);
+	bin_t *bin = arena_bin_choose(tsdn, arena, 0, NULL);
+	malloc_mutex_lock(tsdn, &bin->lock);
+	bin->lock.prof_data.n_lock_ops += BIN_CONTENTION_WINDOW;
+	bin->lock.prof_data.n_spin_acquired += BIN_CONTENTION_WINDOW;
+	malloc_mutex_unlock(tsdn, &bin->lock);
+
+	void *ptr = mallocx(1, MALLOCX_TCACHE_NONE);
+	expect_ptr_not_null(ptr, "Unexpected mallocx() failure");
+	dallocx(ptr, MALLOCX_TCACHE_NONE);
+	expect_u_eq(2, bin0_nshards_active(),
+	    "Contention should activate another shard");
+
+	/* New threads get spread over the active shards. */
+	thd_t thds[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_create(&thds[i], thd_start, NULL);
+	}
+	bool sharded = false;
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		void *ret;
+		thd_join(thds[i], &ret);
+		unsigned binshard = (unsigned)(uintptr_t)ret - 1;
+		expect_u_lt(binshard, 2, "Inactive bin shard used");
+		if (binshard == 1) {
+			sharded = true;
+		}
+	}
+	expect_true(sharded, "The new shard should get used");
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_bin_lock_contended,
+	    test_bin_shards_grow);
+}
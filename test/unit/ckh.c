@@ -202,10 +202,49 @@ TEST_BEGIN(test_insert_iter_remove) {
 }
 TEST_END
 
+TEST_BEGIN(test_shrink_disable) {
+#define NITEMS ZU(1000)
+	tsd_t *tsd = tsd_fetch();
+	ckh_t ckh;
+	uintptr_t keys[NITEMS];
+
+	for (unsigned disable = 0; disable < 2; disable++) {
+		expect_false(ckh_new(tsd, &ckh, 2, ckh_pointer_hash,
+		    ckh_pointer_keycomp), "Unexpected ckh_new() error");
+		if (disable) {
+			ckh_shrink_disable(&ckh);
+		}
+		unsigned lg_minbuckets = ckh.lg_curbuckets;
+		for (size_t i = 0; i < NITEMS; i++) {
+			keys[i] = (i + 1) * 16;
+			expect_false(ckh_insert(tsd, &ckh, (void *)keys[i],
+			    NULL), "Unexpected ckh_insert() failure");
+		}
+		unsigned lg_maxbuckets = ckh.lg_curbuckets;
+		expect_u_gt(lg_maxbuckets, lg_minbuckets,
+		    "The table should have grown");
+		for (size_t i = 0; i < NITEMS; i++) {
+			expect_false(ckh_remove(tsd, &ckh, (void *)keys[i],
+			    NULL, NULL), "Unexpected ckh_remove() failure");
+		}
+		if (disable) {
+			expect_u_eq(ckh.lg_curbuckets, lg_maxbuckets,
+			    "The table shouldn't have shrunk");
+		} else {
+			expect_u_eq(ckh.lg_curbuckets, lg_minbuckets,
+			    "The table should have shrunk back");
+		}
+		ckh_delete(tsd, &ckh);
+	}
+#undef NITEMS
+}
+TEST_END
+
 int
 main(void) {
 	return test(
 	    test_new_delete,
 	    test_count_insert_search_remove,
-	    test_insert_iter_remove);
+	    test_insert_iter_remove,
+	    test_shrink_disable);
 }
@@ -561,6 +561,66 @@ GENERATE_TEST(json_array)
 GENERATE_TEST(json_nested_array)
 GENERATE_TEST(table_row)
 
+static void
+emit_metrics(emitter_t *emitter) {
+	size_t zu = 4096;
+	uint64_t u64 = 123;
+	ssize_t neg = -1;
+	bool b_true = true;
+
+	emitter_begin(emitter);
+	emitter_kv(emitter, "k", "K", emitter_type_size, &zu);
+	emitter_metric_begin(emitter, "foo_bytes", emitter_metric_gauge,
+	    "Some gauge");
+	emitter_metric_sample(emitter, NULL, emitter_type_size, &zu);
+	emitter_metric_sample(emitter, "", emitter_type_ssize, &neg);
+	emitter_metric_begin(emitter, "bar", emitter_metric_counter, NULL);
+	emitter_metric_sample(emitter, "arena=\"0\"", emitter_type_uint64,
+	    &u64);
+	emitter_metric_sample(emitter, "arena=\"1\",bin=\"2\"",
+	    emitter_type_bool, &b_true);
+	emitter_end(emitter);
+}
+
+static const char *metrics_json =
+"{\n"
+"\t\"k\": 4096\n"
+"}\n";
+static const char *metrics_json_compact =
+"{"
+	"\"k\":4096"
+"}";
+static const char *metrics_table =
+"K: 4096\n";
+static const char *metrics_openmetrics =
+"# TYPE jemalloc_foo_bytes gauge\n"
+"# HELP jemalloc_foo_bytes Some gauge\n"
+"jemalloc_foo_bytes 4096\n"
+"jemalloc_foo_bytes -1\n"
+"# TYPE jemalloc_bar counter\n"
+"jemalloc_bar_total{arena=\"0\"} 123\n"
+"jemalloc_bar_total{arena=\"1\",bin=\"2\"} 1\n"
+"# EOF\n";
+
+TEST_BEGIN(test_metrics) {
+	/* The metrics only show up in openmetrics mode ... */
+	expect_emit_output(emit_metrics, metrics_json, metrics_json_compact,
+	    metrics_table);
+
+	/* ... where nothing else does. */
+	emitter_t emitter;
+	char buf[MALLOC_PRINTF_BUFSIZE];
+	buf_descriptor_t buf_descriptor;
+	buf_descriptor.buf = buf;
+	buf_descriptor.len = MALLOC_PRINTF_BUFSIZE;
+	buf_descriptor.mid_quote = false;
+	emitter_init(&emitter, emitter_output_openmetrics, &forwarding_cb,
+	    &buf_descriptor);
+	emit_metrics(&emitter);
+	expect_str_eq(metrics_openmetrics, buf, "openmetrics output failure");
+}
+TEST_END
+
 int
 main(void) {
 	return test_no_reentrancy(
@@ -571,5 +631,6 @@ main(void) {
 	    test_modal,
 	    test_json_array,
 	    test_json_nested_array,
-	    test_table_row);
+	    test_table_row,
+	    test_metrics);
 }
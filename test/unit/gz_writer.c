@@ -0,0 +1,249 @@
+#include "test/jemalloc_test.h"
+
+#include "jemalloc/internal/gz_writer.h"
+
+#define TEST_MAX_LEN (256 * 1024)
+
+static char test_in[TEST_MAX_LEN + 1];
+static size_t test_in_len;
+/* Fixed Huffman codes take at most 9 bits per input byte. */
+static unsigned char test_out[TEST_MAX_LEN * 2];
+static size_t test_out_len;
+static unsigned char test_inflated[TEST_MAX_LEN];
+static size_t test_nflushes;
+
+static void
+test_write_cb(void *cbopaque, const void *buf, size_t len) {
+	assert_ptr_eq(cbopaque, &test_out_len, "Wrong callback argument");
+	assert_zu_le(len, GZ_WRITER_OUT_BUFSIZE, "Chunk too large");
+	assert_zu_le(test_out_len + len, sizeof(test_out), "Output overflow");
+	memcpy(test_out + test_out_len, buf, len);
+	test_out_len += len;
+	test_nflushes++;
+}
+
+static uint32_t
+test_crc32(const unsigned char *buf, size_t len) {
+	uint32_t crc = UINT32_C(0xffffffff);
+	for (size_t i = 0; i < len; i++) {
+		crc ^= buf[i];
+		for (unsigned k = 0; k < 8; k++) {
+			crc = (crc >> 1) ^ (UINT32_C(0xedb88320) & (0U -
+			    (crc & 1U)));
+		}
+	}
+	return crc ^ UINT32_C(0xffffffff);
+}
+
+/* A minimal inflater, for the fixed Huffman blocks that gz_writer emits. */
+typedef struct {
+	const unsigned char *in;
+	size_t len;
+	size_t pos;
+	unsigned bit;
+} test_bits_t;
+
+static unsigned
+test_bit(test_bits_t *b) {
+	assert_zu_lt(b->pos, b->len, "Truncated stream");
+	unsigned ret = (b->in[b->pos] >> b->bit) & 1U;
+	if (++b->bit == 8) {
+		b->bit = 0;
+		b->pos++;
+	}
+	return ret;
+}
+
+static unsigned
+test_bits(test_bits_t *b, unsigned n) {
+	unsigned ret = 0;
+	for (unsigned i = 0; i < n; i++) {
+		ret |= test_bit(b) << i;
+	}
+	return ret;
+}
+
+static unsigned
+test_code(test_bits_t *b, unsigned n) {
+	unsigned ret = 0;
+	for (unsigned i = 0; i < n; i++) {
+		ret = (ret << 1) | test_bit(b);
+	}
+	return ret;
+}
+
+static unsigned
+test_sym(test_bits_t *b) {
+	unsigned code = test_code(b, 7);
+	if (code <= 0x17) {
+		return 256 + code;
+	}
+	code = (code << 1) | test_bit(b);
+	if (code >= 0x30 && code <= 0xbf) {
+		return code - 0x30;
+	}
+	if (code >= 0xc0 && code <= 0xc7) {
+		return 280 + code - 0xc0;
+	}
+	code = (code << 1) | test_bit(b);
+	assert_u_ge(code, 0x190, "Invalid code");
+	return 144 + code - 0x190;
+}
+
+static size_t
+test_inflate(void) {
+	static const unsigned len_base[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13,
+	    15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163,
+	    195, 227, 258};
+	static const unsigned len_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1,
+	    1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+	static const unsigned dist_base[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25,
+	    33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049,
+	    3073, 4097, 6145, 8193, 12289, 16385, 24577};
+	static const unsigned dist_extra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4,
+	    4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+	assert_zu_ge(test_out_len, 18, "Stream too short");
+	expect_u_eq(test_out[0], 0x1f, "Wrong magic");
+	expect_u_eq(test_out[1], 0x8b, "Wrong magic");
+	expect_u_eq(test_out[2], 8, "Wrong compression method");
+	expect_u_eq(test_out[3], 0, "Unexpected flags");
+
+	test_bits_t b = {test_out, test_out_len - 8, 10, 0};
+	size_t n = 0;
+	unsigned final;
+	do {
+		final = test_bit(&b);
+		assert_u_eq(test_bits(&b, 2), 1, "Expected a fixed block");
+		for (unsigned sym = test_sym(&b); sym != 256;
+		    sym = test_sym(&b)) {
+			if (sym < 256) {
+				assert_zu_lt(n, TEST_MAX_LEN,
+				    "Too much output");
+				test_inflated[n++] = (unsigned char)sym;
+				continue;
+			}
+			assert_u_le(sym, 285, "Invalid length symbol");
+			size_t len = len_base[sym - 257] +
+			    test_bits(&b, len_extra[sym - 257]);
+			unsigned dcode = test_code(&b, 5);
+			assert_u_lt(dcode, 30, "Invalid distance symbol");
+			size_t dist = dist_base[dcode] +
+			    test_bits(&b, dist_extra[dcode]);
+			assert_zu_le(dist, n, "Distance too far back");
+			assert_zu_le(n + len, TEST_MAX_LEN, "Too much output");
+			for (size_t i = 0; i < len; i++, n++) {
+				test_inflated[n] = test_inflated[n - dist];
+			}
+		}
+	} while (!final);
+	if (b.bit != 0) {
+		b.pos++;
+	}
+	expect_zu_eq(b.pos, test_out_len - 8, "Trailing garbage");
+
+	const unsigned char *trailer = test_out + test_out_len - 8;
+	uint32_t crc = 0;
+	uint32_t isize = 0;
+	for (unsigned i = 0; i < 4; i++) {
+		crc |= (uint32_t)trailer[i] << (i * 8);
+		isize |= (uint32_t)trailer[4 + i] << (i * 8);
+	}
+	expect_u_eq(crc, test_crc32(test_inflated, n), "Wrong CRC");
+	expect_u_eq(isize, (uint32_t)n, "Wrong size");
+	return n;
+}
+
+/* Compresses test_in in pieces of up to max_piece bytes. */
+static void
+test_compress(size_t max_piece) {
+	tsdn_t *tsdn = tsd_tsdn(tsd_fetch());
+	gz_writer_t gz_writer;
+	test_out_len = 0;
+	test_nflushes = 0;
+	assert_false(gz_writer_init(tsdn, &gz_writer, test_write_cb,
+	    &test_out_len), "Unexpected init failure");
+	uint64_t state = max_piece;
+	for (size_t i = 0; i < test_in_len;) {
+		size_t n = 1 + (size_t)prng_range_u64(&state, max_piece);
+		if (n > test_in_len - i) {
+			n = test_in_len - i;
+		}
+		char c = test_in[i + n];
+		test_in[i + n] = '\0';
+		gz_writer_cb(&gz_writer, test_in + i);
+		test_in[i + n] = c;
+		i += n;
+	}
+	gz_writer_terminate(tsdn, &gz_writer);
+	expect_ptr_null(gz_writer.bufs, "Buffers should be freed");
+}
+
+static void
+test_roundtrip(size_t max_piece) {
+	test_compress(max_piece);
+	size_t n = test_inflate();
+	assert_zu_eq(n, test_in_len, "Wrong decompressed length");
+	expect_d_eq(memcmp(test_inflated, test_in, n), 0,
+	    "Wrong decompressed content");
+}
+
+TEST_BEGIN(test_gz_writer_empty) {
+	test_in_len = 0;
+	test_roundtrip(1);
+	expect_zu_eq(test_nflushes, 1, "Expected a single flush");
+}
+TEST_END
+
+TEST_BEGIN(test_gz_writer_profile) {
+	/* Something like a heap profile, larger than a few windows. */
+	test_in_len = 0;
+	uint64_t state = 42;
+	while (test_in_len < TEST_MAX_LEN - 256) {
+		test_in_len += malloc_snprintf(test_in + test_in_len,
+		    TEST_MAX_LEN - test_in_len, "@ 0x%zx 0x%zx 0x%zx\n  t*: "
+		    "%u: %u [0: 0]\n", (size_t)0x7f0000401000 +
+		    (size_t)prng_range_u64(&state, 1 << 12) * 16,
+		    (size_t)0x7f0000402000 +
+		    (size_t)prng_range_u64(&state, 1 << 8) * 16,
+		    (size_t)0x400000 + (size_t)prng_range_u64(&state, 64) * 16,
+		    (unsigned)prng_range_u64(&state, 100),
+		    (unsigned)prng_range_u64(&state, 100000));
+	}
+	size_t pieces[] = {1, 15, 1000, 70000, TEST_MAX_LEN};
+	for (unsigned i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+		test_roundtrip(pieces[i]);
+		expect_zu_lt(test_out_len, test_in_len / 2,
+		    "Expected the text to compress well");
+	}
+}
+TEST_END
+
+TEST_BEGIN(test_gz_writer_random) {
+	/* Few and short matches, and all the byte values (but '\0'). */
+	uint64_t state = 7;
+	for (test_in_len = 0; test_in_len < TEST_MAX_LEN; test_in_len++) {
+		test_in[test_in_len] = (char)(1 + prng_range_u64(&state, 255));
+	}
+	test_in[test_in_len] = '\0';
+	test_roundtrip(4096);
+	expect_zu_le(test_out_len, test_in_len / 8 * 9 + 64,
+	    "Output too large");
+
+	/* Long runs, for the longest matches and the shortest distances. */
+	for (size_t i = 0; i < test_in_len; i++) {
+		test_in[i] = "ab"[(i / 1000) % 2];
+	}
+	test_roundtrip(4096);
+	expect_zu_lt(test_out_len, test_in_len / 100,
+	    "Expected runs to compress very well");
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_gz_writer_empty,
+	    test_gz_writer_profile,
+	    test_gz_writer_random);
+}
@@ -0,0 +1,229 @@
+#include "test/jemalloc_test.h"
+
+/*
+ * The walker and record types, as an application declares them from the
+ * manual, without the internal headers.
+ */
+#define HEAP_WALK_SLAB 0
+#define HEAP_WALK_REGION 1
+#define HEAP_WALK_LARGE 2
+#define HEAP_WALK_DIRTY 3
+
+typedef struct heap_walk_record_s heap_walk_record_t;
+struct heap_walk_record_s {
+	unsigned kind;
+	const void *addr;
+	size_t size;
+	unsigned arena_ind;
+	unsigned nregs;
+	unsigned nfree;
+};
+
+typedef struct heap_walker_s heap_walker_t;
+struct heap_walker_s {
+	void (*cb)(void *ctx, const heap_walk_record_t *record);
+	void *ctx;
+};
+
+#define NPTRS 200
+#define SMALL_SIZE 64
+
+typedef struct walk_result_s walk_result_t;
+struct walk_result_s {
+	unsigned arena_ind;
+	void **ptrs;
+	void *large;
+	/* The number of times each of ptrs was reported. */
+	unsigned nseen[NPTRS];
+	unsigned nlarge;
+	unsigned ndirty;
+	/* The regions reported for the current slab, and the ones expected. */
+	unsigned nregions;
+	unsigned nregions_expected;
+	bool in_slab;
+	bool mismatch;
+};
+
+static void
+walk_slab_end(walk_result_t *result) {
+	if (result->in_slab && result->nregions != result->nregions_expected) {
+		result->mismatch = true;
+	}
+	result->in_slab = false;
+}
+
+static void
+walk_cb(void *ctx, const heap_walk_record_t *record) {
+	walk_result_t *result = (walk_result_t *)ctx;
+	if (record->kind != HEAP_WALK_REGION) {
+		walk_slab_end(result);
+	}
+	if (record->arena_ind != result->arena_ind) {
+		return;
+	}
+	switch (record->kind) {
+	case HEAP_WALK_SLAB:
+		result->in_slab = true;
+		result->nregions = 0;
+		result->nregions_expected = record->nregs - record->nfree;
+		break;
+	case HEAP_WALK_REGION:
+		result->nregions++;
+		expect_zu_eq(record->size, SMALL_SIZE, "Wrong region size");
+		for (unsigned i = 0; i < NPTRS; i++) {
+			if (result->ptrs[i] == record->addr) {
+				result->nseen[i]++;
+			}
+		}
+		break;
+	case HEAP_WALK_LARGE:
+		if (record->addr == result->large) {
+			result->nlarge++;
+			expect_zu_eq(record->size, SC_LARGE_MINCLASS,
+			    "Wrong large size");
+		}
+		break;
+	case HEAP_WALK_DIRTY:
+		result->ndirty++;
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+walk(walk_result_t *result) {
+	memset(result->nseen, 0, sizeof(result->nseen));
+	result->nlarge = result->ndirty = 0;
+	result->in_slab = result->mismatch = false;
+	heap_walker_t walker = {walk_cb, result};
+	expect_d_eq(mallctl("experimental.heap_walk", NULL, NULL, &walker,
+	    sizeof(walker)), 0, "Unexpected mallctl failure");
+	walk_slab_end(result);
+	expect_false(result->mismatch,
+	    "Region records should match the slab's free count");
+}
+
+TEST_BEGIN(test_heap_walk) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("arenas.create", &arena_ind, &sz, NULL, 0), 0,
+	    "Unexpected mallctl failure");
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+
+	void *ptrs[NPTRS];
+	for (unsigned i = 0; i < NPTRS; i++) {
+		ptrs[i] = mallocx(SMALL_SIZE, flags);
+		expect_ptr_not_null(ptrs[i], "Unexpected mallocx failure");
+	}
+	void *large = mallocx(SC_LARGE_MINCLASS, flags);
+	expect_ptr_not_null(large, "Unexpected mallocx failure");
+
+	walk_result_t result;
+	result.arena_ind = arena_ind;
+	result.ptrs = ptrs;
+	result.large = large;
+	walk(&result);
+	for (unsigned i = 0; i < NPTRS; i++) {
+		expect_u_eq(result.nseen[i], 1,
+		    "Each live region should be reported once");
+	}
+	expect_u_eq(result.nlarge, 1,
+	    "The large allocation should be reported once");
+
+	for (unsigned i = 0; i < NPTRS; i += 2) {
+		dallocx(ptrs[i], flags);
+	}
+	dallocx(large, flags);
+	walk(&result);
+	for (unsigned i = 0; i < NPTRS; i++) {
+		expect_u_eq(result.nseen[i], i % 2,
+		    "Only the live regions should be reported");
+	}
+	expect_u_eq(result.nlarge, 0,
+	    "The freed large allocation should not be reported");
+	if (!opt_hpa) {
+		expect_u_gt(result.ndirty, 0,
+		    "The freed large allocation should leave dirty pages");
+	}
+
+	for (unsigned i = 1; i < NPTRS; i += 2) {
+		dallocx(ptrs[i], flags);
+	}
+}
+TEST_END
+
+TEST_BEGIN(test_heap_walk_einval) {
+	heap_walker_t walker = {NULL, NULL};
+	expect_d_eq(mallctl("experimental.heap_walk", NULL, NULL, &walker,
+	    sizeof(walker)), EINVAL, "Should fail without a callback");
+	walker.cb = walk_cb;
+	expect_d_eq(mallctl("experimental.heap_walk", NULL, NULL, &walker,
+	    sizeof(walker) - 1), EINVAL, "Should fail on a wrong size");
+	expect_d_eq(mallctl("experimental.heap_walk", NULL, NULL, NULL, 0),
+	    EINVAL, "Should fail without input");
+	size_t out = 0, out_sz = sizeof(out);
+	expect_d_eq(mallctl("experimental.heap_walk", &out, &out_sz, &walker,
+	    sizeof(walker)), EPERM, "Should be write-only");
+}
+TEST_END
+
+static atomic_b_t churn_stop;
+
+/* Keeps extents being created, split and remapped. */
+static void *
+thd_churn_start(void *arg) {
+	unsigned arena_ind = *(unsigned *)arg;
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	void *ptrs[8];
+	for (unsigned n = 0; !atomic_load_b(&churn_stop, ATOMIC_ACQUIRE);
+	    n++) {
+		for (unsigned i = 0; i < 8; i++) {
+			size_t size = SC_LARGE_MINCLASS << ((n + i) % 6);
+			ptrs[i] = mallocx(size, flags);
+			expect_ptr_not_null(ptrs[i],
+			    "Unexpected mallocx failure");
+		}
+		for (unsigned i = 0; i < 8; i++) {
+			dallocx(ptrs[i], flags);
+		}
+	}
+	return NULL;
+}
+
+static void
+walk_large_cb(void *ctx, const heap_walk_record_t *record) {
+	if (record->kind == HEAP_WALK_LARGE) {
+		expect_zu_ge(record->size, SC_LARGE_MINCLASS,
+		    "Large records should have a large size class");
+		expect_zu_eq(record->size, sz_s2u(record->size),
+		    "Large records should have a size class");
+		(*(unsigned *)ctx)++;
+	}
+}
+
+TEST_BEGIN(test_heap_walk_concurrent) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("arenas.create", &arena_ind, &sz, NULL, 0), 0,
+	    "Unexpected mallctl failure");
+
+	atomic_store_b(&churn_stop, false, ATOMIC_RELEASE);
+	thd_t thd;
+	thd_create(&thd, thd_churn_start, (void *)&arena_ind);
+	unsigned nlarge = 0;
+	heap_walker_t walker = {walk_large_cb, &nlarge};
+	for (unsigned i = 0; i < 200; i++) {
+		expect_d_eq(mallctl("experimental.heap_walk", NULL, NULL,
+		    &walker, sizeof(walker)), 0, "Unexpected mallctl failure");
+	}
+	atomic_store_b(&churn_stop, true, ATOMIC_RELEASE);
+	thd_join(thd, NULL);
+}
+TEST_END
+
+int
+main(void) {
+	return test(test_heap_walk, test_heap_walk_einval,
+	    test_heap_walk_concurrent);
+}
@@ -37,7 +37,13 @@ static hpa_shard_opts_t test_hpa_shard_opts_default = {
 	/* min_purge_interval_ms */
 	5 * 1000,
 	/* experimental_max_purge_nhp */
-	-1
+	-1,
+	/* large_max_alloc */
+	0,
+	/* rehugify_max_nhp */
+	0,
+	/* rehugify_interval_ms */
+	0
 };
 
 static hpa_shard_opts_t test_hpa_shard_opts_purge = {
@@ -56,7 +62,13 @@ static hpa_shard_opts_t test_hpa_shard_opts_purge = {
 	/* min_purge_interval_ms */
 	5 * 1000,
 	/* experimental_max_purge_nhp */
-	-1
+	-1,
+	/* large_max_alloc */
+	0,
+	/* rehugify_max_nhp */
+	0,
+	/* rehugify_interval_ms */
+	0
 };
 
 static hpa_shard_t *
@@ -375,9 +387,13 @@ defer_test_purge(void *ptr, size_t size) {
 }
 
 static size_t ndefer_hugify_calls = 0;
+static size_t ndefer_hugify_sync_calls = 0;
 static bool
 defer_test_hugify(void *ptr, size_t size, bool sync) {
 	++ndefer_hugify_calls;
+	if (sync) {
+		++ndefer_hugify_sync_calls;
+	}
 	return false;
 }
 
@@ -733,6 +749,173 @@ TEST_BEGIN(test_experimental_max_purge_nhp) {
 }
 TEST_END
 
+TEST_BEGIN(test_rehugify) {
+	test_skip_if(!hpa_supported());
+
+	hpa_hooks_t hooks;
+	hooks.map = &defer_test_map;
+	hooks.unmap = &defer_test_unmap;
+	hooks.purge = &defer_test_purge;
+	hooks.hugify = &defer_test_hugify;
+	hooks.dehugify = &defer_test_dehugify;
+	hooks.curtime = &defer_test_curtime;
+	hooks.ms_since = &defer_test_ms_since;
+
+	hpa_shard_opts_t opts = test_hpa_shard_opts_default;
+	opts.deferral_allowed = true;
+	opts.rehugify_max_nhp = 1;
+	opts.rehugify_interval_ms = 1000;
+
+	hpa_shard_t *shard = create_test_data(&hooks, &opts);
+
+	bool deferred_work_generated = false;
+
+	nstime_init(&defer_curtime, 0);
+	ndefer_hugify_calls = 0;
+	ndefer_hugify_sync_calls = 0;
+	ndefer_dehugify_calls = 0;
+	ndefer_purge_calls = 0;
+	tsdn_t *tsdn = tsd_tsdn(tsd_fetch());
+	enum {NALLOCS = 2 * HUGEPAGE_PAGES};
+	edata_t *edatas[NALLOCS];
+	for (int i = 0; i < NALLOCS; i++) {
+		edatas[i] = pai_alloc(tsdn, &shard->pai, PAGE, PAGE, false,
+		    false, false, &deferred_work_generated);
+		expect_ptr_not_null(edatas[i], "Unexpected null edata");
+	}
+	nstime_init2(&defer_curtime, 11, 0);
+	hpa_shard_do_deferred_work(tsdn, shard);
+	expect_zu_eq(2, ndefer_hugify_calls, "Failed to hugify");
+	expect_zu_eq(0, ndefer_hugify_sync_calls,
+	    "Only rehugifications should be synchronous");
+
+	/* Free half of each hugepage, which gets them both purged. */
+	for (int i = 0; i < NALLOCS; i += 2) {
+		pai_dalloc(tsdn, &shard->pai, edatas[i],
+		    &deferred_work_generated);
+	}
+	hpa_shard_do_deferred_work(tsdn, shard);
+	expect_zu_eq(2, ndefer_dehugify_calls, "Should have dehugified");
+
+	/* Once dense again, only the budgeted one gets collapsed. */
+	for (int i = 0; i < NALLOCS; i += 2) {
+		edatas[i] = pai_alloc(tsdn, &shard->pai, PAGE, PAGE, false,
+		    false, false, &deferred_work_generated);
+		expect_ptr_not_null(edatas[i], "Unexpected null edata");
+	}
+	ndefer_hugify_calls = 0;
+	nstime_init2(&defer_curtime, 22, 0);
+	hpa_shard_do_deferred_work(tsdn, shard);
+	expect_zu_eq(2, ndefer_hugify_calls, "Failed to hugify");
+	expect_zu_eq(1, ndefer_hugify_sync_calls, "Failed to rehugify");
+	expect_u64_eq(1, shard->stats.nrehugifies, "Wrong rehugify count");
+	expect_u64_eq(0, shard->stats.nrehugify_failures,
+	    "Unexpected rehugify failure");
+
+	ndefer_hugify_calls = 0;
+	ndefer_hugify_sync_calls = 0;
+	ndefer_dehugify_calls = 0;
+	ndefer_purge_calls = 0;
+
+	destroy_test_data(shard);
+}
+TEST_END
+
+TEST_BEGIN(test_alloc_large_fraction) {
+	test_skip_if(!hpa_supported());
+
+	hpa_shard_opts_t opts = test_hpa_shard_opts_default;
+	opts.large_max_alloc = HUGEPAGE;
+	hpa_shard_t *shard = create_test_data(&hpa_hooks_default, &opts);
+	tsdn_t *tsdn = tsd_tsdn(tsd_fetch());
+
+	bool deferred_work_generated = false;
+	edata_t *edata1 = pai_alloc(tsdn, &shard->pai, HUGEPAGE / 2, PAGE,
+	    false, false, /* frequent_reuse */ false, &deferred_work_generated);
+	expect_ptr_not_null(edata1, "Allocation above slab max failed");
+	edata_t *edata2 = pai_alloc(tsdn, &shard->pai, ALLOC_MAX + PAGE, PAGE,
+	    false, false, /* frequent_reuse */ false, &deferred_work_generated);
+	expect_ptr_not_null(edata2, "Allocation above slab max failed");
+	expect_ptr_eq(HUGEPAGE_ADDR2BASE(edata_base_get(edata1)),
+	    HUGEPAGE_ADDR2BASE(edata_base_get(edata2)),
+	    "Large allocations should be packed into the same hugepage");
+
+	edata_t *edata = pai_alloc(tsdn, &shard->pai, HUGEPAGE + PAGE, PAGE,
+	    false, false, /* frequent_reuse */ false, &deferred_work_generated);
+	expect_ptr_null(edata, "Allocation above large max succeeded");
+
+	pai_dalloc(tsdn, &shard->pai, edata1, &deferred_work_generated);
+	pai_dalloc(tsdn, &shard->pai, edata2, &deferred_work_generated);
+
+	destroy_test_data(shard);
+}
+TEST_END
+
+TEST_BEGIN(test_alloc_large_run) {
+	test_skip_if(!hpa_supported());
+
+	hpa_hooks_t hooks = hpa_hooks_default;
+	hooks.hugify = &defer_test_hugify;
+	hooks.curtime = &defer_test_curtime;
+	hooks.ms_since = &defer_test_ms_since;
+
+	hpa_shard_opts_t opts = test_hpa_shard_opts_default;
+	opts.deferral_allowed = true;
+	opts.large_max_alloc = 4 * HUGEPAGE;
+	hpa_shard_t *shard = create_test_data(&hooks, &opts);
+	tsdn_t *tsdn = tsd_tsdn(tsd_fetch());
+
+	nstime_init(&defer_curtime, 0);
+	ndefer_hugify_calls = 0;
+	bool deferred_work_generated = false;
+
+	size_t size = 2 * HUGEPAGE + HUGEPAGE / 2;
+	edata_t *edata = pai_alloc(tsdn, &shard->pai, size, PAGE, false, false,
+	    /* frequent_reuse */ false, &deferred_work_generated);
+	expect_ptr_not_null(edata, "Allocation above a hugepage failed");
+	void *base = edata_base_get(edata);
+	expect_ptr_eq(HUGEPAGE_ADDR2BASE(base), base,
+	    "Allocations above a hugepage should be hugepage-aligned");
+
+	/* The rest of the last hugepage gets packed with other allocations. */
+	edata_t *small = pai_alloc(tsdn, &shard->pai, ALLOC_MAX, PAGE, false,
+	    false, /* frequent_reuse */ false, &deferred_work_generated);
+	expect_ptr_not_null(small, "Unexpected alloc failure");
+	expect_ptr_eq((void *)((uintptr_t)base + size),
+	    edata_base_get(small), "Should have packed the last hugepage");
+
+	/* Only the full hugepages meet the hugification threshold. */
+	nstime_init2(&defer_curtime, 11, 0);
+	hpa_shard_do_deferred_work(tsdn, shard);
+	expect_zu_eq(2, ndefer_hugify_calls, "Should hugify full hugepages");
+	ndefer_hugify_calls = 0;
+
+	/* The same hugepages get reused once freed. */
+	pai_dalloc(tsdn, &shard->pai, edata, &deferred_work_generated);
+	edata = pai_alloc(tsdn, &shard->pai, size, PAGE, false, false,
+	    /* frequent_reuse */ false, &deferred_work_generated);
+	expect_ptr_not_null(edata, "Allocation above a hugepage failed");
+	expect_ptr_eq(base, edata_base_get(edata), "Failed to reuse the run");
+	pai_dalloc(tsdn, &shard->pai, edata, &deferred_work_generated);
+
+	/* But the last of them isn't empty, so this one needs a new run. */
+	edata = pai_alloc(tsdn, &shard->pai, 3 * HUGEPAGE, PAGE, false, false,
+	    /* frequent_reuse */ false, &deferred_work_generated);
+	expect_ptr_not_null(edata, "Allocation above a hugepage failed");
+	expect_ptr_ne(base, edata_base_get(edata),
+	    "Shouldn't overlap the packed hugepage");
+	pai_dalloc(tsdn, &shard->pai, edata, &deferred_work_generated);
+
+	edata = pai_alloc(tsdn, &shard->pai, 4 * HUGEPAGE + PAGE, PAGE, false,
+	    false, /* frequent_reuse */ false, &deferred_work_generated);
+	expect_ptr_null(edata, "Allocation above large max succeeded");
+
+	pai_dalloc(tsdn, &shard->pai, small, &deferred_work_generated);
+
+	destroy_test_data(shard);
+}
+TEST_END
+
 int
 main(void) {
 	/*
@@ -752,6 +935,9 @@ main(void) {
 	    test_stress,
 	    test_alloc_dalloc_batch,
 	    test_defer_time,
+	    test_rehugify,
+	    test_alloc_large_fraction,
+	    test_alloc_large_run,
 	    test_purge_no_infinite_loop,
 	    test_no_min_purge_interval,
 	    test_min_purge_interval,
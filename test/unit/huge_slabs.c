@@ -0,0 +1,115 @@
+#include "test/jemalloc_test.h"
+#include "test/arena_util.h"
+
+static edata_t *
+ptr_edata(void *ptr) {
+	return emap_edata_lookup(tsdn_fetch(), &arena_emap_global, ptr);
+}
+
+static void *
+region_base(void *ptr) {
+	return HUGEPAGE_ADDR2BASE(edata_base_get(ptr_edata(ptr)));
+}
+
+TEST_BEGIN(test_huge_slabs_alloc) {
+	test_skip_if(!opt_huge_slabs || opt_hpa);
+
+	unsigned arena_ind = do_arena_create(-1, -1);
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+
+	void *small = mallocx(1, flags);
+	expect_ptr_not_null(small, "Unexpected mallocx() failure");
+	edata_t *edata = ptr_edata(small);
+	expect_true(edata_slab_get(edata), "Small allocations use slabs");
+	expect_true(edata_slab_region_get(edata),
+	    "Slabs should come from a slab region");
+	void *region = region_base(small);
+	expect_ptr_eq(region, edata_base_get(edata),
+	    "The first slab should start the first region");
+
+	/* The slabs of other size classes share the region. */
+	void *ptrs[SC_NBINS];
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		ptrs[i] = mallocx(sz_index2size(i), flags);
+		expect_ptr_not_null(ptrs[i], "Unexpected mallocx() failure");
+		expect_true(edata_slab_region_get(ptr_edata(ptrs[i])),
+		    "Slabs should come from a slab region");
+	}
+	expect_ptr_eq(region, region_base(ptrs[0]),
+	    "Slabs should fill up the region first");
+
+	void *large = mallocx(SC_LARGE_MINCLASS, flags);
+	expect_ptr_not_null(large, "Unexpected mallocx() failure");
+	expect_false(edata_slab_region_get(ptr_edata(large)),
+	    "Large allocations shouldn't use slab regions");
+	expect_ptr_ne(region, region_base(large),
+	    "Large allocations shouldn't use slab regions");
+
+	for (szind_t i = 0; i < SC_NBINS; i++) {
+		dallocx(ptrs[i], flags);
+	}
+	dallocx(small, flags);
+	dallocx(large, flags);
+	do_arena_destroy(arena_ind);
+}
+TEST_END
+
+TEST_BEGIN(test_huge_slabs_segregation) {
+	test_skip_if(!opt_huge_slabs || opt_hpa);
+
+	unsigned arena_ind = do_arena_create(-1, -1);
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+
+	/* Fill a number of slabs, and free them all. */
+	size_t sz = SC_SMALL_MAXCLASS;
+	enum { NPTRS = 64 };
+	void *ptrs[NPTRS];
+	for (unsigned i = 0; i < NPTRS; i++) {
+		ptrs[i] = mallocx(sz, flags);
+		expect_ptr_not_null(ptrs[i], "Unexpected mallocx() failure");
+	}
+	void *region = region_base(ptrs[0]);
+	for (unsigned i = 0; i < NPTRS; i++) {
+		dallocx(ptrs[i], flags);
+	}
+
+	arena_t *arena = arena_get(tsdn_fetch(), arena_ind, false);
+	ecache_t *ecache = &arena->pa_shard.pac.ecache_dirty;
+	expect_zu_gt(eset_npages_get(&ecache->slab_region_eset), 0,
+	    "The freed slabs should be cached apart");
+
+	/* Large allocations don't take the cached slab region extents... */
+	void *large = mallocx(SC_LARGE_MINCLASS, flags);
+	expect_ptr_not_null(large, "Unexpected mallocx() failure");
+	expect_false(edata_slab_region_get(ptr_edata(large)),
+	    "Large allocations shouldn't use slab regions");
+	expect_ptr_ne(region, region_base(large),
+	    "Large allocations shouldn't use slab regions");
+	dallocx(large, flags);
+
+	/* ... while slabs do. */
+	void *small = mallocx(1, flags);
+	expect_ptr_not_null(small, "Unexpected mallocx() failure");
+	expect_ptr_eq(region, region_base(small),
+	    "Slabs should reuse the cached slab region extents");
+	dallocx(small, flags);
+
+	/* Also once purged. */
+	do_purge(arena_ind);
+	expect_zu_eq(0, ecache_npages_get(ecache), "Should be purged");
+	small = mallocx(1, flags);
+	expect_ptr_not_null(small, "Unexpected mallocx() failure");
+	expect_ptr_eq(region, region_base(small),
+	    "Slabs should reuse the retained slab region extents");
+	dallocx(small, flags);
+
+	do_arena_destroy(arena_ind);
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_huge_slabs_alloc,
+	    test_huge_slabs_segregation);
+}
@@ -270,9 +270,183 @@ TEST_BEGIN(test_batch) {
 }
 TEST_END
 
+TEST_BEGIN(test_batch_many) {
+	/*
+	 * Enough pointers for several lookup batches, in an order unrelated to
+	 * their addresses, with some NULL and unknown ones mixed in.
+	 */
+	const size_t n = 3000;
+	void **ptrs = mallocx(n * sizeof(void *), 0);
+	size_t *out = mallocx(n * sizeof(size_t) * 3, 0);
+	assert_ptr_not_null(ptrs, "Unexpected mallocx failure");
+	assert_ptr_not_null(out, "Unexpected mallocx failure");
+	for (size_t i = 0; i < n; i++) {
+		size_t sz = (i % 7 == 0) ? SC_LARGE_MINCLASS : 8 + (i % 3) * 40;
+		ptrs[i] = mallocx(sz, 0);
+		assert_ptr_not_null(ptrs[i], "Unexpected mallocx failure");
+	}
+	for (size_t i = n - 1; i > 0; i--) {
+		size_t j = (i * 7919) % (i + 1);
+		void *tmp = ptrs[i];
+		ptrs[i] = ptrs[j];
+		ptrs[j] = tmp;
+	}
+	void *saved[2] = {ptrs[3], ptrs[n / 2]};
+	ptrs[3] = NULL;
+	ptrs[n / 2] = (void *)&n;
+
+	size_t out_sz = n * sizeof(size_t) * 3;
+	assert_d_eq(mallctl("experimental.utilization.batch_query", out,
+	    &out_sz, ptrs, n * sizeof(void *)), 0,
+	    "Unexpected mallctl failure");
+	for (size_t i = 0; i < n; i++) {
+		size_t expected[3] = {0, 0, 0};
+		if (i != 3 && i != n / 2) {
+			size_t one_sz = sizeof(expected);
+			assert_d_eq(mallctl(
+			    "experimental.utilization.batch_query", expected,
+			    &one_sz, &ptrs[i], sizeof(void *)), 0,
+			    "Unexpected mallctl failure");
+			expect_zu_ne(expected[2], 0, "Should find the extent");
+		}
+		expect_d_eq(memcmp(&out[i * 3], expected, sizeof(expected)), 0,
+		    "Batched and single lookups should agree at %zu", i);
+	}
+
+	ptrs[3] = saved[0];
+	ptrs[n / 2] = saved[1];
+	for (size_t i = 0; i < n; i++) {
+		dallocx(ptrs[i], 0);
+	}
+	dallocx(out, 0);
+	dallocx(ptrs, 0);
+}
+TEST_END
+
+static bool
+defrag_hint_get(void *p) {
+	bool hint;
+	size_t hint_sz = sizeof(hint);
+	assert_d_eq(mallctl("experimental.utilization.defrag_hints", &hint,
+	    &hint_sz, &p, sizeof(p)), 0, "Unexpected mallctl failure");
+	return hint;
+}
+
+static size_t
+defrag_slab_nfree_get(void *p) {
+	size_t out[3];
+	size_t out_sz = sizeof(out);
+	assert_d_eq(mallctl("experimental.utilization.batch_query", out,
+	    &out_sz, &p, sizeof(p)), 0, "Unexpected mallctl failure");
+	return out[0];
+}
+
+static void
+thread_alloc_counts_get(uint64_t *allocated, uint64_t *deallocated) {
+	if (!config_stats) {
+		return;
+	}
+	size_t sz = sizeof(uint64_t);
+	assert_d_eq(mallctl("thread.allocated", allocated, &sz, NULL, 0), 0,
+	    "Unexpected mallctl failure");
+	assert_d_eq(mallctl("thread.deallocated", deallocated, &sz, NULL, 0),
+	    0, "Unexpected mallctl failure");
+}
+
+TEST_BEGIN(test_defrag) {
+	const size_t sz = 64;
+	const size_t nregs = bin_infos[sz_size2index(sz)].nregs;
+	test_skip_if(nregs < 8);
+
+	unsigned arena_ind;
+	size_t ind_sz = sizeof(arena_ind);
+	assert_d_eq(mallctl("arenas.create", &arena_ind, &ind_sz, NULL, 0),
+	    0, "Unexpected mallctl failure");
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+
+	/* Fill four slabs, one after the other. */
+	const size_t nslabs = 4;
+	void **ptrs = mallocx(sizeof(void *) * nslabs * nregs, 0);
+	assert_ptr_not_null(ptrs, "Unexpected mallocx failure");
+	for (size_t i = 0; i < nslabs * nregs; i++) {
+		ptrs[i] = mallocx(sz, flags);
+		assert_ptr_not_null(ptrs[i], "Unexpected mallocx failure");
+		memset(ptrs[i], (int)(i & 0xff), sz);
+	}
+	/* Keep the first slab half full, and one region in each of the others. */
+	for (size_t i = 0; i < nslabs * nregs; i++) {
+		if ((i < nregs && i % 2 == 0) || (i >= nregs && i % nregs != 0)) {
+			dallocx(ptrs[i], flags);
+			ptrs[i] = NULL;
+		}
+	}
+
+	void *in[] = {ptrs[1], NULL};
+	bool out[] = {true, true};
+	size_t out_sz = sizeof(bool);
+	expect_d_eq(mallctl("experimental.utilization.defrag_hints", out,
+	    &out_sz, in, sizeof(in)), EINVAL,
+	    "Should fail when *oldlenp and newlen do not match");
+	out_sz = sizeof(out);
+	expect_d_eq(mallctl("experimental.utilization.defrag_hints", out,
+	    &out_sz, in, sizeof(in)), 0, "Unexpected mallctl failure");
+	expect_false(out[0], "Should not hint at the fullest slab");
+	expect_false(out[1], "Should not hint at NULL");
+
+	void *large = mallocx(SC_LARGE_MINCLASS, flags);
+	assert_ptr_not_null(large, "Unexpected mallocx failure");
+	expect_false(defrag_hint_get(large), "Should not hint at large sizes");
+	dallocx(large, flags);
+
+	/* Nothing is fuller than the first slab. */
+	uint64_t allocated = 0, deallocated = 0;
+	thread_alloc_counts_get(&allocated, &deallocated);
+	expect_ptr_eq(rallocx(ptrs[1], sz, flags | MALLOCX_DEFRAG), ptrs[1],
+	    "Should not move out of the fullest slab");
+	uint64_t allocated1 = 0, deallocated1 = 0;
+	thread_alloc_counts_get(&allocated1, &deallocated1);
+	expect_u64_eq(allocated1, allocated,
+	    "A defrag that doesn't move shouldn't count as an allocation");
+	expect_u64_eq(deallocated1, deallocated,
+	    "A defrag that doesn't move shouldn't count as a deallocation");
+
+	size_t nhints = 0;
+	for (size_t i = nregs; i < nslabs * nregs; i += nregs) {
+		if (!defrag_hint_get(ptrs[i])) {
+			/* Only the current slab can go unhinted. */
+			continue;
+		}
+		nhints++;
+		size_t nfree = defrag_slab_nfree_get(ptrs[i]);
+		void *q = rallocx(ptrs[i], sz, flags | MALLOCX_DEFRAG);
+		assert_ptr_not_null(q, "Unexpected rallocx failure");
+		expect_ptr_ne(q, ptrs[i], "Should move into a fuller slab");
+		expect_zu_lt(defrag_slab_nfree_get(q), nfree,
+		    "Should move into a fuller slab");
+		expect_false(defrag_hint_get(q),
+		    "Should not hint at the slab moved to");
+		for (size_t j = 0; j < sz; j++) {
+			expect_u_eq(((unsigned char *)q)[j], (unsigned)(i & 0xff),
+			    "Content should be preserved");
+		}
+		ptrs[i] = q;
+	}
+	expect_zu_ge(nhints, nslabs - 2,
+	    "Should hint at the sparse slabs other than the current one");
+
+	for (size_t i = 0; i < nslabs * nregs; i++) {
+		if (ptrs[i] != NULL) {
+			dallocx(ptrs[i], flags);
+		}
+	}
+	dallocx(ptrs, 0);
+}
+TEST_END
+
 int
 main(void) {
 	assert_zu_lt(SC_SMALL_MAXCLASS + 100000, TEST_MAX_SIZE,
 	    "Test case cannot cover large classes");
-	return test(test_query, test_batch);
+	return test(test_query, test_batch, test_batch_many,
+	    test_defrag);
 }
@@ -285,10 +285,14 @@ TEST_BEGIN(test_mallctl_opt) {
 	TEST_MALLCTL_OPT(bool, confirm_conf, always);
 	TEST_MALLCTL_OPT(const char *, metadata_thp, always);
 	TEST_MALLCTL_OPT(bool, retain, always);
+	TEST_MALLCTL_OPT(bool, huge_slabs, always);
 	TEST_MALLCTL_OPT(const char *, dss, always);
 	TEST_MALLCTL_OPT(bool, hpa, always);
 	TEST_MALLCTL_OPT(size_t, hpa_slab_max_alloc, always);
+	TEST_MALLCTL_OPT(size_t, hpa_large_max_alloc, always);
 	TEST_MALLCTL_OPT(bool, hpa_hugify_sync, always);
+	TEST_MALLCTL_OPT(size_t, hpa_rehugify_max_nhp, always);
+	TEST_MALLCTL_OPT(uint64_t, hpa_rehugify_interval_ms, always);
 	TEST_MALLCTL_OPT(size_t, hpa_sec_nshards, always);
 	TEST_MALLCTL_OPT(size_t, hpa_sec_max_alloc, always);
 	TEST_MALLCTL_OPT(size_t, hpa_sec_max_bytes, always);
@@ -311,7 +315,17 @@ TEST_BEGIN(test_mallctl_opt) {
 	TEST_MALLCTL_OPT(bool, xmalloc, xmalloc);
 	TEST_MALLCTL_OPT(bool, tcache, always);
 	TEST_MALLCTL_OPT(size_t, lg_extent_max_active_fit, always);
+	TEST_MALLCTL_OPT(size_t, mem_limit, always);
+	TEST_MALLCTL_OPT(bool, pressure_purge, always);
+	TEST_MALLCTL_OPT(unsigned, pressure_purge_threshold, always);
+	TEST_MALLCTL_OPT(bool, mem_limit_fail, always);
 	TEST_MALLCTL_OPT(size_t, tcache_max, always);
+	TEST_MALLCTL_OPT(bool, percpu_tcache, always);
+	TEST_MALLCTL_OPT(bool, tcache_adaptive, always);
+	TEST_MALLCTL_OPT(size_t, tcache_adaptive_max_bytes, always);
+	TEST_MALLCTL_OPT(bool, numa_arena, always);
+	TEST_MALLCTL_OPT(int64_t, arena_rebalance_interval, always);
+	TEST_MALLCTL_OPT(unsigned, arena_rebalance_threshold, always);
 	TEST_MALLCTL_OPT(const char *, thp, always);
 	TEST_MALLCTL_OPT(const char *, zero_realloc, always);
 	TEST_MALLCTL_OPT(bool, prof, prof);
@@ -326,9 +340,13 @@ TEST_BEGIN(test_mallctl_opt) {
 	TEST_MALLCTL_OPT(bool, prof_final, prof);
 	TEST_MALLCTL_OPT(bool, prof_leak, prof);
 	TEST_MALLCTL_OPT(bool, prof_leak_error, prof);
+	TEST_MALLCTL_OPT(bool, prof_dump_incremental, prof);
+	TEST_MALLCTL_OPT(bool, prof_dump_gzip, prof);
+	TEST_MALLCTL_OPT(const char *, prof_dump_format, prof);
 	TEST_MALLCTL_OPT(ssize_t, prof_recent_alloc_max, prof);
 	TEST_MALLCTL_OPT(bool, prof_stats, prof);
 	TEST_MALLCTL_OPT(bool, prof_sys_thread_name, prof);
+	TEST_MALLCTL_OPT(bool, prof_fast_unwind, prof);
 	TEST_MALLCTL_OPT(ssize_t, lg_san_uaf_align, uaf_detection);
 	TEST_MALLCTL_OPT(unsigned, debug_double_free_max_scan, always);
 
@@ -1019,6 +1037,8 @@ TEST_BEGIN(test_stats_arenas_hpa_shard_counters) {
 	TEST_STATS_ARENAS_HPA_SHARD_COUNTERS(uint64_t, npurge_passes);
 	TEST_STATS_ARENAS_HPA_SHARD_COUNTERS(uint64_t, npurges);
 	TEST_STATS_ARENAS_HPA_SHARD_COUNTERS(uint64_t, nhugifies);
+	TEST_STATS_ARENAS_HPA_SHARD_COUNTERS(uint64_t, nrehugifies);
+	TEST_STATS_ARENAS_HPA_SHARD_COUNTERS(uint64_t, nrehugify_failures);
 	TEST_STATS_ARENAS_HPA_SHARD_COUNTERS(uint64_t, ndehugifies);
 
 #undef TEST_STATS_ARENAS_HPA_SHARD_COUNTERS
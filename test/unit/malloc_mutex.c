@@ -0,0 +1,133 @@
+#include "test/jemalloc_test.h"
+
+#define NTHREADS	4
+#define NINCRS		500000
+
+TEST_BEGIN(test_malloc_mutex_basic) {
+	malloc_mutex_t mtx;
+
+	expect_false(malloc_mutex_init(&mtx, "test", WITNESS_RANK_OMIT,
+	    malloc_mutex_rank_exclusive),
+	    "Unexpected malloc_mutex_init() failure");
+	malloc_mutex_lock(TSDN_NULL, &mtx);
+	expect_true(malloc_mutex_is_locked(&mtx), "Mutex should be locked");
+	expect_true(malloc_mutex_trylock_final(&mtx),
+	    "Trylock of a locked mutex should fail");
+	malloc_mutex_unlock(TSDN_NULL, &mtx);
+	expect_false(malloc_mutex_is_locked(&mtx), "Mutex should be unlocked");
+
+	expect_false(malloc_mutex_trylock(TSDN_NULL, &mtx),
+	    "Trylock of an unlocked mutex should succeed");
+	malloc_mutex_unlock(TSDN_NULL, &mtx);
+}
+TEST_END
+
+typedef struct {
+	malloc_mutex_t	mtx;
+	unsigned	x;
+} thd_start_arg_t;
+
+static void *
+thd_start(void *varg) {
+	thd_start_arg_t *arg = (thd_start_arg_t *)varg;
+
+	for (unsigned i = 0; i < NINCRS; i++) {
+		if (i % 2 == 0 || malloc_mutex_trylock(TSDN_NULL, &arg->mtx)) {
+			malloc_mutex_lock(TSDN_NULL, &arg->mtx);
+		}
+		arg->x++;
+		malloc_mutex_unlock(TSDN_NULL, &arg->mtx);
+	}
+	return NULL;
+}
+
+TEST_BEGIN(test_malloc_mutex_race) {
+	thd_start_arg_t arg;
+	thd_t thds[NTHREADS];
+
+	expect_false(malloc_mutex_init(&arg.mtx, "test", WITNESS_RANK_OMIT,
+	    malloc_mutex_rank_exclusive),
+	    "Unexpected malloc_mutex_init() failure");
+	arg.x = 0;
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_create(&thds[i], thd_start, (void *)&arg);
+	}
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_join(thds[i], NULL);
+	}
+	expect_u_eq(arg.x, NTHREADS * NINCRS,
+	    "Race-related counter corruption");
+}
+TEST_END
+
+#ifdef JEMALLOC_FUTEX_LOCK
+typedef struct {
+	malloc_mutex_t	*mtx;
+	atomic_b_t	acquired;
+} handoff_arg_t;
+
+static void *
+thd_handoff_start(void *varg) {
+	handoff_arg_t *arg = (handoff_arg_t *)varg;
+
+	malloc_mutex_lock(TSDN_NULL, arg->mtx);
+	atomic_store_b(&arg->acquired, true, ATOMIC_RELEASE);
+	malloc_mutex_unlock(TSDN_NULL, arg->mtx);
+	return NULL;
+}
+#endif
+
+TEST_BEGIN(test_malloc_mutex_handoff) {
+#ifndef JEMALLOC_FUTEX_LOCK
+	test_skip("Handoff is specific to futex-based mutexes");
+#else
+	malloc_mutex_t mtx;
+
+	expect_false(malloc_mutex_init(&mtx, "test", WITNESS_RANK_OMIT,
+	    malloc_mutex_rank_exclusive),
+	    "Unexpected malloc_mutex_init() failure");
+	malloc_mutex_lock(TSDN_NULL, &mtx);
+	/* Pretend that a waiter is starving. */
+	atomic_store_u32(&mtx.nstarving, 1, ATOMIC_RELAXED);
+	malloc_mutex_unlock(TSDN_NULL, &mtx);
+	expect_u32_eq(malloc_mutex_futex_handoff,
+	    atomic_load_u32(&mtx.lock, ATOMIC_RELAXED),
+	    "Unlock should hand the lock off to the starving waiter");
+	expect_true(malloc_mutex_trylock_final(&mtx),
+	    "Trylock shouldn't take a handed off lock");
+
+	/* Nor should a waiter that isn't starving. */
+	handoff_arg_t arg;
+	arg.mtx = &mtx;
+	atomic_store_b(&arg.acquired, false, ATOMIC_RELAXED);
+	thd_t thd;
+	thd_create(&thd, thd_handoff_start, (void *)&arg);
+	sleep_ns(10 * 1000 * 1000);
+	expect_false(atomic_load_b(&arg.acquired, ATOMIC_ACQUIRE),
+	    "Only starving waiters should take a handed off lock");
+
+	/* Only starving waiters take the handoff. */
+	expect_false(malloc_mutex_futex_handoff_take(&mtx),
+	    "Unexpected handoff failure");
+	atomic_store_u32(&mtx.nstarving, 0, ATOMIC_RELAXED);
+	MALLOC_MUTEX_UNLOCK(&mtx);
+	thd_join(thd, NULL);
+	expect_true(atomic_load_b(&arg.acquired, ATOMIC_ACQUIRE),
+	    "The waiter should get the lock once it's released");
+	expect_u32_eq(malloc_mutex_futex_unlocked,
+	    atomic_load_u32(&mtx.lock, ATOMIC_RELAXED),
+	    "Lock should be released normally with no starving waiters");
+	expect_false(malloc_mutex_trylock_final(&mtx),
+	    "Trylock of an unlocked mutex should succeed");
+	malloc_mutex_unlock(TSDN_NULL, &mtx);
+#endif
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_malloc_mutex_basic,
+	    test_malloc_mutex_race,
+	    test_malloc_mutex_handoff);
+}
@@ -0,0 +1,200 @@
+#include "test/jemalloc_test.h"
+
+#include "jemalloc/internal/mem_limit.h"
+
+#define NLARGE 16
+#define LARGE_SIZE (1024 * 1024)
+
+static size_t hook_ncalls;
+static size_t hook_limit;
+static size_t hook_usage;
+
+static void
+hook(size_t limit, size_t usage) {
+	hook_ncalls++;
+	hook_limit = limit;
+	hook_usage = usage;
+}
+
+static void
+mem_limit_write(size_t limit) {
+	expect_d_eq(mallctl("mem_limit", NULL, NULL, (void *)&limit,
+	    sizeof(limit)), 0, "Unexpected mallctl failure");
+}
+
+static unsigned
+arena_create(void) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl failure");
+	return arena_ind;
+}
+
+static size_t
+arena_ndirty(unsigned arena_ind) {
+	arena_t *arena = arena_get(TSDN_NULL, arena_ind, false);
+	assert_ptr_not_null(arena, "Arena should exist");
+	return pa_shard_ndirty(&arena->pa_shard);
+}
+
+TEST_BEGIN(test_mem_limit_ctl) {
+	size_t limit;
+	size_t sz = sizeof(limit);
+	expect_d_eq(mallctl("mem_limit", (void *)&limit, &sz, NULL, 0), 0,
+	    "Unexpected mallctl failure");
+	expect_zu_eq(0, limit, "No limit by default");
+
+	mem_limit_write((size_t)1 << 40);
+	expect_d_eq(mallctl("mem_limit", (void *)&limit, &sz, NULL, 0), 0,
+	    "Unexpected mallctl failure");
+	expect_zu_eq((size_t)1 << 40, limit, "Limit not updated");
+	mem_limit_write(0);
+
+	mem_limit_hook_t old_hook;
+	mem_limit_hook_t new_hook = &hook;
+	sz = sizeof(old_hook);
+	expect_d_eq(mallctl("experimental.hooks.mem_limit", (void *)&old_hook,
+	    &sz, (void *)&new_hook, sizeof(new_hook)), 0,
+	    "Unexpected mallctl failure");
+	expect_ptr_null(old_hook, "No hook by default");
+	expect_ptr_eq(&hook, mem_limit_hook_get(), "Hook not installed");
+	new_hook = NULL;
+	expect_d_eq(mallctl("experimental.hooks.mem_limit", NULL, NULL,
+	    (void *)&new_hook, sizeof(new_hook)), 0,
+	    "Unexpected mallctl failure");
+}
+TEST_END
+
+TEST_BEGIN(test_mem_limit_reclaim) {
+	unsigned arena_ind = arena_create();
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+
+	/* Decay is disabled, so all of these stay dirty. */
+	void *ptrs[NLARGE];
+	for (unsigned i = 0; i < NLARGE; i++) {
+		ptrs[i] = mallocx(LARGE_SIZE, flags);
+		expect_ptr_not_null(ptrs[i], "Unexpected mallocx failure");
+	}
+	for (unsigned i = 0; i < NLARGE; i++) {
+		dallocx(ptrs[i], flags);
+	}
+	expect_zu_ge(arena_ndirty(arena_ind) << LG_PAGE, NLARGE * LARGE_SIZE,
+	    "Freed extents should be dirty");
+
+	size_t usage = mem_limit_usage(TSDN_NULL);
+	unsigned epoch = mem_limit_flush_epoch_get();
+	hook_ncalls = 0;
+	mem_limit_hook_set(&hook);
+	/*
+	 * Only fits once the dirty pages are gone.  Another arena can't reuse
+	 * them, so it has to map new pages.
+	 */
+	int other_flags = MALLOCX_ARENA(arena_create()) | MALLOCX_TCACHE_NONE;
+	mem_limit_write(usage - NLARGE * LARGE_SIZE / 2);
+	void *p = mallocx(2 * LARGE_SIZE, other_flags);
+	mem_limit_write(0);
+	mem_limit_hook_set(NULL);
+
+	expect_ptr_not_null(p, "Allocation should succeed after a reclaim");
+	expect_zu_eq(0, arena_ndirty(arena_ind),
+	    "Reclaim should purge the dirty pages");
+	expect_zu_eq(0, hook_ncalls,
+	    "Hook shouldn't be called when the reclaim is enough");
+
+	/*
+	 * Every tcache flushes, but only one of them (possibly ours, already)
+	 * flushes the shared caches.
+	 */
+	unsigned epoch_other = epoch;
+	bool shared, shared_other;
+	expect_true(mem_limit_flush_check(&epoch, &shared),
+	    "Reclaim should ask the tcaches to flush");
+	expect_true(mem_limit_flush_check(&epoch_other, &shared_other),
+	    "Every tcache should flush");
+	expect_false(shared && shared_other,
+	    "Shared caches should only be flushed once");
+	expect_false(mem_limit_flush_check(&epoch, &shared),
+	    "Nothing left to flush");
+	dallocx(p, other_flags);
+}
+TEST_END
+
+TEST_BEGIN(test_mem_limit_reuse) {
+	unsigned arena_ind = arena_create();
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+
+	void *ptrs[NLARGE];
+	for (unsigned i = 0; i < NLARGE; i++) {
+		ptrs[i] = mallocx(LARGE_SIZE, flags);
+		expect_ptr_not_null(ptrs[i], "Unexpected mallocx failure");
+	}
+	for (unsigned i = 0; i < NLARGE; i++) {
+		dallocx(ptrs[i], flags);
+	}
+	size_t ndirty = arena_ndirty(arena_ind);
+	unsigned epoch = mem_limit_flush_epoch_get();
+
+	/* Reusing dirty pages doesn't add to the usage, even at the limit. */
+	hook_ncalls = 0;
+	mem_limit_hook_set(&hook);
+	mem_limit_write(mem_limit_usage(TSDN_NULL));
+	for (unsigned i = 0; i < NLARGE; i++) {
+		ptrs[i] = mallocx(LARGE_SIZE, flags);
+	}
+	mem_limit_write(0);
+	mem_limit_hook_set(NULL);
+
+	for (unsigned i = 0; i < NLARGE; i++) {
+		expect_ptr_not_null(ptrs[i],
+		    "Allocations reusing dirty pages should succeed");
+	}
+	expect_zu_eq(0, hook_ncalls, "Reuse shouldn't exceed the limit");
+	expect_u_eq(epoch, mem_limit_flush_epoch_get(),
+	    "Reuse shouldn't trigger a reclaim");
+	expect_zu_lt(arena_ndirty(arena_ind), ndirty,
+	    "Dirty pages should have been reused");
+	for (unsigned i = 0; i < NLARGE; i++) {
+		dallocx(ptrs[i], flags);
+	}
+}
+TEST_END
+
+TEST_BEGIN(test_mem_limit_fail) {
+	unsigned arena_ind = arena_create();
+	int flags = MALLOCX_ARENA(arena_ind) | MALLOCX_TCACHE_NONE;
+	void *p = mallocx(LARGE_SIZE, flags);
+	expect_ptr_not_null(p, "Unexpected mallocx failure");
+
+	hook_ncalls = 0;
+	mem_limit_hook_set(&hook);
+	mem_limit_write(PAGE);
+	void *q = mallocx(LARGE_SIZE, flags);
+	size_t nhook_alloc = hook_ncalls;
+	size_t usize = xallocx(p, 2 * LARGE_SIZE, 0, flags);
+	size_t nhook_expand = hook_ncalls - nhook_alloc;
+	mem_limit_write(0);
+	mem_limit_hook_set(NULL);
+
+	expect_ptr_null(q, "Allocation over the limit should fail");
+	expect_zu_eq(1, nhook_alloc, "Hook should be called once");
+	expect_zu_eq(PAGE, hook_limit, "Wrong limit passed to the hook");
+	expect_zu_gt(hook_usage, PAGE, "Usage should exceed the limit");
+	expect_zu_eq(LARGE_SIZE, usize, "Expansion over the limit should fail");
+	expect_zu_eq(1, nhook_expand, "Hook should be called once");
+
+	q = mallocx(LARGE_SIZE, flags);
+	expect_ptr_not_null(q, "Allocation should succeed without a limit");
+	dallocx(q, flags);
+	dallocx(p, flags);
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_mem_limit_ctl,
+	    test_mem_limit_reclaim,
+	    test_mem_limit_reuse,
+	    test_mem_limit_fail);
+}
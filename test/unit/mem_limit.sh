@@ -0,0 +1,3 @@
+#!/bin/sh
+
+export MALLOC_CONF="mem_limit_fail:true,dirty_decay_ms:-1,muzzy_decay_ms:-1"
@@ -0,0 +1,83 @@
+#include "test/jemalloc_test.h"
+
+static bool
+numa_arena_enabled(void) {
+	bool enabled;
+	size_t sz = sizeof(enabled);
+	expect_d_eq(mallctl("opt.numa_arena", (void *)&enabled, &sz, NULL, 0),
+	    0, "Unexpected mallctl failure");
+	return enabled;
+}
+
+static int
+arena_numa_node_get(unsigned arena_ind) {
+	uint64_t epoch = 1;
+	expect_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl failure");
+	char cmd[64];
+	malloc_snprintf(cmd, sizeof(cmd), "stats.arenas.%u.numa_node",
+	    arena_ind);
+	int node;
+	size_t sz = sizeof(node);
+	expect_d_eq(mallctl(cmd, (void *)&node, &sz, NULL, 0), 0,
+	    "Unexpected mallctl failure");
+	return node;
+}
+
+TEST_BEGIN(test_numa_arena_bound) {
+	test_skip_if(!numa_arena_enabled());
+
+	expect_d_ge(arena_numa_node_get(0), 0, "Arena 0 should be bound");
+	expect_d_eq(arena_numa_node_get(MALLCTL_ARENAS_ALL), -1,
+	    "Merged stats aren't bound to any node");
+
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl failure");
+	expect_d_eq(arena_numa_node_get(arena_ind), -1,
+	    "Manual arenas shouldn't be bound");
+}
+TEST_END
+
+static void *
+thd_start(void *arg) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("thread.arena", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl failure");
+	/* Touch memory from both the small and the large paths. */
+	size_t sizes[] = {8, 4096, 1024 * 1024};
+	for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		void *p = malloc(sizes[i]);
+		expect_ptr_not_null(p, "Unexpected malloc failure");
+		memset(p, 0xa5, sizes[i]);
+		free(p);
+	}
+	*(unsigned *)arg = arena_ind;
+	return NULL;
+}
+
+TEST_BEGIN(test_numa_arena_threads) {
+	test_skip_if(!numa_arena_enabled());
+
+	enum { NTHREADS = 8 };
+	thd_t thds[NTHREADS];
+	unsigned arena_inds[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_create(&thds[i], thd_start, &arena_inds[i]);
+	}
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_join(thds[i], NULL);
+		expect_d_ge(arena_numa_node_get(arena_inds[i]), 0,
+		    "Threads should be assigned bound arenas");
+	}
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_numa_arena_bound,
+	    test_numa_arena_threads);
+}
@@ -0,0 +1,147 @@
+#include "test/jemalloc_test.h"
+
+#define NTHREADS 8
+#define NITER 20000
+#define NLIVE 64
+
+static bool
+percpu_tcache_enabled(void) {
+	bool enabled;
+	size_t sz = sizeof(enabled);
+	expect_d_eq(mallctl("opt.percpu_tcache", (void *)&enabled, &sz, NULL,
+	    0), 0, "Unexpected mallctl failure");
+	return enabled;
+}
+
+static size_t
+bin_curregs_get(szind_t binind) {
+	uint64_t epoch = 1;
+	expect_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl failure");
+	char cmd[128];
+	malloc_snprintf(cmd, sizeof(cmd), "stats.arenas.0.bins.%u.curregs",
+	    (unsigned)binind);
+	size_t curregs;
+	size_t sz = sizeof(curregs);
+	expect_d_eq(mallctl(cmd, (void *)&curregs, &sz, NULL, 0), 0,
+	    "Unexpected mallctl failure");
+	return curregs;
+}
+
+TEST_BEGIN(test_percpu_cache_ncached_max) {
+	test_skip_if(!percpu_tcache_enabled());
+
+	/* The small bins of the automatic tcache are disabled. */
+	size_t size = 64;
+	size_t ncached_max;
+	size_t sz = sizeof(ncached_max);
+	expect_d_eq(mallctl("thread.tcache.ncached_max.read_sizeclass",
+	    (void *)&ncached_max, &sz, (void *)&size, sizeof(size)), 0,
+	    "Unexpected mallctl failure");
+	expect_zu_eq(ncached_max, 0, "Small bins should be disabled");
+}
+TEST_END
+
+TEST_BEGIN(test_percpu_cache_reuse) {
+	test_skip_if(!percpu_tcache_enabled());
+
+	/*
+	 * Objects are handed back LIFO unless we get migrated in between;
+	 * retry a few times to make that very unlikely.
+	 */
+	bool reused = false;
+	for (unsigned i = 0; i < 100 && !reused; i++) {
+		void *p = malloc(48);
+		expect_ptr_not_null(p, "Unexpected malloc failure");
+		free(p);
+		void *q = malloc(48);
+		expect_ptr_not_null(q, "Unexpected malloc failure");
+		reused = (p == q);
+		free(q);
+	}
+	expect_true(reused, "Freed object should be reused from the cache");
+}
+TEST_END
+
+static void *
+thd_start(void *arg) {
+	unsigned tid = (unsigned)(uintptr_t)arg;
+	void *ptrs[NLIVE] = {NULL};
+	size_t sizes[NLIVE];
+	uint64_t prng = tid + 1;
+
+	for (unsigned i = 0; i < NITER; i++) {
+		unsigned slot = (unsigned)prng_range_u64(&prng, NLIVE);
+		if (ptrs[slot] != NULL) {
+			unsigned char *c = (unsigned char *)ptrs[slot];
+			for (size_t j = 0; j < sizes[slot]; j++) {
+				expect_u_eq(c[j], (unsigned char)tid,
+				    "Object corrupted while live");
+			}
+			if (i % 2 == 0) {
+				free(ptrs[slot]);
+			} else {
+				sdallocx(ptrs[slot], sizes[slot], 0);
+			}
+		}
+		sizes[slot] = 1 + (size_t)prng_range_u64(&prng,
+		    SC_SMALL_MAXCLASS);
+		ptrs[slot] = (i % 3 == 0) ? calloc(1, sizes[slot]) :
+		    malloc(sizes[slot]);
+		expect_ptr_not_null(ptrs[slot], "Unexpected malloc failure");
+		memset(ptrs[slot], (int)tid, sizes[slot]);
+	}
+	for (unsigned i = 0; i < NLIVE; i++) {
+		free(ptrs[i]);
+	}
+
+	return NULL;
+}
+
+TEST_BEGIN(test_percpu_cache_threads) {
+	test_skip_if(!percpu_tcache_enabled());
+
+	thd_t thds[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_create(&thds[i], thd_start, (void *)(uintptr_t)i);
+	}
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_join(thds[i], NULL);
+	}
+}
+TEST_END
+
+TEST_BEGIN(test_percpu_cache_flush) {
+	test_skip_if(!percpu_tcache_enabled());
+	test_skip_if(!config_stats);
+
+	size_t size = 3584;
+	szind_t binind = sz_size2index(size);
+	void *ptrs[NLIVE];
+
+	expect_d_eq(mallctl("thread.tcache.flush", NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctl failure");
+	size_t curregs_before = bin_curregs_get(binind);
+	for (unsigned i = 0; i < NLIVE; i++) {
+		ptrs[i] = malloc(size);
+		expect_ptr_not_null(ptrs[i], "Unexpected malloc failure");
+	}
+	for (unsigned i = 0; i < NLIVE; i++) {
+		free(ptrs[i]);
+	}
+	/* Flushing empties the caches of all CPUs, not just ours. */
+	expect_d_eq(mallctl("thread.tcache.flush", NULL, NULL, NULL, 0), 0,
+	    "Unexpected mallctl failure");
+	expect_zu_eq(bin_curregs_get(binind), curregs_before,
+	    "Cached objects should have been returned to the arena");
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_percpu_cache_ncached_max,
+	    test_percpu_cache_reuse,
+	    test_percpu_cache_threads,
+	    test_percpu_cache_flush);
+}
@@ -0,0 +1,193 @@
+#include "test/jemalloc_test.h"
+
+#include "jemalloc/internal/pressure.h"
+
+TEST_BEGIN(test_psi_parse) {
+	uint64_t avg10;
+	expect_false(pressure_psi_parse("some avg10=12.34 avg60=1.00 "
+	    "avg300=0.50 total=123\nfull avg10=1.00 avg60=0.00 avg300=0.00 "
+	    "total=45\n", &avg10), "Unexpected parse failure");
+	expect_u64_eq(1234, avg10, "Wrong avg10");
+	expect_false(pressure_psi_parse("some avg10=0.00 avg60=0.00",
+	    &avg10), "Unexpected parse failure");
+	expect_u64_eq(0, avg10, "Wrong avg10");
+	expect_false(pressure_psi_parse("some avg10=7.5", &avg10),
+	    "Unexpected parse failure");
+	expect_u64_eq(750, avg10, "Wrong avg10");
+	expect_false(pressure_psi_parse("some avg10=100.009", &avg10),
+	    "Unexpected parse failure");
+	expect_u64_eq(10000, avg10, "Extra decimals should be ignored");
+
+	expect_true(pressure_psi_parse("full avg10=1.00", &avg10),
+	    "The \"some\" line comes first");
+	expect_true(pressure_psi_parse("some avg10=", &avg10),
+	    "Missing value should fail");
+	expect_true(pressure_psi_parse("", &avg10), "Empty file should fail");
+}
+TEST_END
+
+TEST_BEGIN(test_events_parse) {
+	uint64_t nevents;
+	expect_false(pressure_events_parse("low 1\nhigh 12\nmax 3\noom 0\n"
+	    "oom_kill 0\n", &nevents), "Unexpected parse failure");
+	expect_u64_eq(15, nevents, "Should count the high and max events");
+	expect_false(pressure_events_parse("max 2", &nevents),
+	    "Unexpected parse failure");
+	expect_u64_eq(2, nevents, "Should count the max events");
+	expect_true(pressure_events_parse("low 1\noom 2\n", &nevents),
+	    "No counter to parse");
+}
+TEST_END
+
+TEST_BEGIN(test_cgroup_parse) {
+	const char *cgroup;
+	size_t len;
+	expect_false(pressure_cgroup_parse("0::/user.slice/app.scope\n",
+	    &cgroup, &len), "Unexpected parse failure");
+	expect_zu_eq(len, strlen("/user.slice/app.scope"), "Wrong length");
+	expect_d_eq(strncmp(cgroup, "/user.slice/app.scope", len), 0,
+	    "Wrong cgroup");
+	/* Hybrid hierarchies list the v2 entry after the v1 ones. */
+	expect_false(pressure_cgroup_parse("12:memory:/a\n1:name=systemd:/a\n"
+	    "0::/a/b\n", &cgroup, &len), "Unexpected parse failure");
+	expect_zu_eq(len, 4, "Wrong length");
+	expect_d_eq(strncmp(cgroup, "/a/b", len), 0, "Wrong cgroup");
+	expect_false(pressure_cgroup_parse("0::/\n", &cgroup, &len),
+	    "Unexpected parse failure");
+	expect_zu_eq(len, 0, "The root should be empty");
+
+	expect_true(pressure_cgroup_parse("12:memory:/a\n", &cgroup, &len),
+	    "No cgroup v2 entry");
+	expect_true(pressure_cgroup_parse("1:cpu:/a\n0::/a/very/lo", &cgroup,
+	    &len), "A cut short entry shouldn't be used");
+	expect_true(pressure_cgroup_parse("", &cgroup, &len),
+	    "Empty file should fail");
+}
+TEST_END
+
+static unsigned
+arena_create(void) {
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl failure");
+	return arena_ind;
+}
+
+static ssize_t
+arena_dirty_decay_ms_get(unsigned arena_ind) {
+	char cmd[64];
+	malloc_snprintf(cmd, sizeof(cmd), "arena.%u.dirty_decay_ms", arena_ind);
+	ssize_t decay_ms;
+	size_t sz = sizeof(decay_ms);
+	expect_d_eq(mallctl(cmd, (void *)&decay_ms, &sz, NULL, 0), 0,
+	    "Unexpected mallctl failure");
+	return decay_ms;
+}
+
+static void
+arena_dirty_decay_ms_set(unsigned arena_ind, ssize_t decay_ms) {
+	char cmd[64];
+	malloc_snprintf(cmd, sizeof(cmd), "arena.%u.dirty_decay_ms", arena_ind);
+	expect_d_eq(mallctl(cmd, NULL, NULL, (void *)&decay_ms,
+	    sizeof(decay_ms)), 0, "Unexpected mallctl failure");
+}
+
+/* The decay time actually in effect. */
+static ssize_t
+arena_dirty_decay_ms_effective(unsigned arena_ind) {
+	arena_t *arena = arena_get(TSDN_NULL, arena_ind, false);
+	assert_ptr_not_null(arena, "Arena should exist");
+	return decay_ms_read(&arena->pa_shard.pac.decay_dirty);
+}
+
+static void
+sample_update(uint64_t some_avg10, uint64_t nevents) {
+	pressure_sample_t sample = {some_avg10, nevents};
+	pressure_update(tsd_tsdn(tsd_fetch()), &sample);
+}
+
+TEST_BEGIN(test_pressure_update) {
+	test_skip_if(background_thread_enabled());
+
+	unsigned arena_ind = arena_create();
+	arena_dirty_decay_ms_set(arena_ind, 8000);
+	uint64_t threshold = (uint64_t)opt_pressure_purge_threshold * 100;
+	uint64_t nperiods = pressure_nperiods_get();
+
+	sample_update(threshold - 1, 0);
+	expect_false(pressure_active(), "Below the threshold");
+	expect_zd_eq(8000, arena_dirty_decay_ms_effective(arena_ind),
+	    "Decay time shouldn't change without pressure");
+
+	sample_update(threshold, 0);
+	expect_true(pressure_active(), "At the threshold");
+	expect_u64_eq(nperiods + 1, pressure_nperiods_get(),
+	    "Should count the pressure period");
+	expect_zd_eq(8000 >> PRESSURE_LG_DIV,
+	    arena_dirty_decay_ms_effective(arena_ind),
+	    "Decay time should be shortened under pressure");
+	expect_zd_eq(8000, arena_dirty_decay_ms_get(arena_ind),
+	    "The configured decay time should be reported");
+
+	/* Settings made and arenas created under pressure get shortened. */
+	arena_dirty_decay_ms_set(arena_ind, 16000);
+	expect_zd_eq(16000 >> PRESSURE_LG_DIV,
+	    arena_dirty_decay_ms_effective(arena_ind),
+	    "New decay time should be shortened under pressure");
+	unsigned arena_ind_new = arena_create();
+	arena_dirty_decay_ms_set(arena_ind_new, 8000);
+	expect_zd_eq(8000 >> PRESSURE_LG_DIV,
+	    arena_dirty_decay_ms_effective(arena_ind_new),
+	    "New arenas should be shortened under pressure");
+
+	sample_update(threshold / 2, 0);
+	expect_true(pressure_active(), "Should only relax well below");
+	sample_update(threshold / 2 - 1, 0);
+	expect_false(pressure_active(), "Should relax");
+	expect_zd_eq(16000, arena_dirty_decay_ms_effective(arena_ind),
+	    "Decay time should be restored");
+	expect_zd_eq(8000, arena_dirty_decay_ms_effective(arena_ind_new),
+	    "Decay time should be restored");
+
+	/* memory.events going up counts as pressure, regardless of PSI. */
+	sample_update(0, 5);
+	expect_true(pressure_active(), "New events should mean pressure");
+	expect_u64_eq(nperiods + 2, pressure_nperiods_get(),
+	    "Should count the pressure period");
+	sample_update(0, 6);
+	expect_true(pressure_active(), "Still getting events");
+	sample_update(0, 6);
+	expect_false(pressure_active(), "No more events");
+	expect_zd_eq(16000, arena_dirty_decay_ms_effective(arena_ind),
+	    "Decay time should be restored");
+}
+TEST_END
+
+TEST_BEGIN(test_pressure_disabled_decay) {
+	test_skip_if(background_thread_enabled());
+
+	unsigned arena_ind = arena_create();
+	uint64_t threshold = (uint64_t)opt_pressure_purge_threshold * 100;
+	ssize_t settings[] = {-1, 0, 1};
+	for (unsigned i = 0; i < sizeof(settings) / sizeof(settings[0]);
+	    i++) {
+		arena_dirty_decay_ms_set(arena_ind, settings[i]);
+		sample_update(threshold, 0);
+		expect_zd_eq(settings[i],
+		    arena_dirty_decay_ms_effective(arena_ind),
+		    "Only gradual decay gets shortened, and stays gradual");
+		sample_update(0, 0);
+	}
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_psi_parse,
+	    test_events_parse,
+	    test_cgroup_parse,
+	    test_pressure_update,
+	    test_pressure_disabled_decay);
+}
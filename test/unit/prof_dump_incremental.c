@@ -0,0 +1,131 @@
+#include "test/jemalloc_test.h"
+
+#include "jemalloc/internal/prof_data.h"
+#include "jemalloc/internal/prof_sys.h"
+
+/* Several times PROF_DUMP_INCREMENTAL_NITEMS. */
+#define NBT		1500
+#define NTHREADS	4
+#define NALLOCS_PER_THREAD	200
+
+static int
+prof_dump_open_file_intercept(const char *filename, int mode) {
+	int fd = open("/dev/null", O_WRONLY);
+	assert_d_ne(fd, -1, "Unexpected open() failure");
+	return fd;
+}
+
+/* Counts the backtraces in the dump, i.e. the lines starting with '@'. */
+static char prev_char;
+static size_t nbt_dumped;
+
+static ssize_t
+prof_dump_write_file_intercept(int fd, const void *s, size_t len) {
+	const char *c = (const char *)s;
+	for (size_t i = 0; i < len; i++) {
+		if (c[i] == '@' && prev_char == '\n') {
+			nbt_dumped++;
+		}
+		prev_char = c[i];
+	}
+	return (ssize_t)len;
+}
+
+static void
+dump(void) {
+	prev_char = '\0';
+	nbt_dumped = 0;
+	expect_d_eq(mallctl("prof.dump", NULL, NULL, NULL, 0), 0,
+	    "Unexpected error while dumping heap profile");
+}
+
+TEST_BEGIN(test_dump_incremental) {
+	test_skip_if(!config_prof);
+
+	bool incremental;
+	size_t sz = sizeof(incremental);
+	expect_d_eq(mallctl("opt.prof_dump_incremental", &incremental, &sz,
+	    NULL, 0), 0, "Unexpected mallctl failure");
+	expect_true(incremental, "Expected incremental dumps");
+
+	prof_dump_open_file_t *open_file_orig = prof_dump_open_file;
+	prof_dump_write_file_t *write_file_orig = prof_dump_write_file;
+	prof_dump_open_file = prof_dump_open_file_intercept;
+	prof_dump_write_file = prof_dump_write_file_intercept;
+
+	void *ptrs[NBT];
+	for (unsigned i = 0; i < NBT; i++) {
+		ptrs[i] = btalloc(1, i);
+	}
+	prof_cnt_t cnt_all;
+	prof_cnt_all(&cnt_all);
+	expect_u64_ge(cnt_all.curobjs, NBT, "Missing samples");
+
+	dump();
+	expect_zu_ge(nbt_dumped, NBT, "Missing backtraces in the dump");
+	/* The dump leaves the counters as they were. */
+	prof_cnt_t cnt_all_after;
+	prof_cnt_all(&cnt_all_after);
+	expect_u64_eq(cnt_all.curobjs, cnt_all_after.curobjs,
+	    "Dumping shouldn't change the counters");
+
+	for (unsigned i = 0; i < NBT; i++) {
+		dallocx(ptrs[i], 0);
+	}
+
+	prof_dump_open_file = open_file_orig;
+	prof_dump_write_file = write_file_orig;
+}
+TEST_END
+
+static void *
+thd_start(void *varg) {
+	unsigned thd_ind = *(unsigned *)varg;
+	for (unsigned i = 0; i < NALLOCS_PER_THREAD; i++) {
+		/* New backtraces, which may show up in the middle of a dump. */
+		void *p = btalloc(1, NBT + thd_ind * NALLOCS_PER_THREAD + i);
+		dallocx(p, 0);
+		if (i % 10 == 0) {
+			dump();
+		}
+	}
+	return NULL;
+}
+
+TEST_BEGIN(test_dump_incremental_concurrent) {
+	test_skip_if(!config_prof);
+
+	prof_dump_open_file_t *open_file_orig = prof_dump_open_file;
+	prof_dump_write_file_t *write_file_orig = prof_dump_write_file;
+	prof_dump_open_file = prof_dump_open_file_intercept;
+	prof_dump_write_file = prof_dump_write_file_intercept;
+
+	thd_t thds[NTHREADS];
+	unsigned thd_args[NTHREADS];
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_args[i] = i;
+		thd_create(&thds[i], thd_start, (void *)&thd_args[i]);
+	}
+	for (unsigned i = 0; i < 20; i++) {
+		dump();
+	}
+	for (unsigned i = 0; i < NTHREADS; i++) {
+		thd_join(thds[i], NULL);
+	}
+	/*
+	 * The gctx's that were created in the middle of a dump must have been
+	 * left alone by it, and still be dumpable.
+	 */
+	dump();
+
+	prof_dump_open_file = open_file_orig;
+	prof_dump_write_file = write_file_orig;
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_dump_incremental,
+	    test_dump_incremental_concurrent);
+}
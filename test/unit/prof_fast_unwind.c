@@ -0,0 +1,112 @@
+#include "test/jemalloc_test.h"
+
+#define BT_MAX 64
+
+typedef struct bt_s bt_t;
+struct bt_s {
+	void *vec[BT_MAX];
+	unsigned len;
+};
+
+static prof_backtrace_hook_t
+bt_hook_get(void) {
+	prof_backtrace_hook_t hook;
+	size_t sz = sizeof(hook);
+	expect_d_eq(mallctl("experimental.hooks.prof_backtrace", &hook, &sz,
+	    NULL, 0), 0, "Unexpected mallctl failure");
+	return hook;
+}
+
+static JEMALLOC_NOINLINE void
+bt_get_a(prof_backtrace_hook_t hook, bt_t *bt) {
+	bt->len = 0;
+	hook(bt->vec, &bt->len, BT_MAX);
+}
+
+static JEMALLOC_NOINLINE void
+bt_get_b(prof_backtrace_hook_t hook, bt_t *bt) {
+	bt->len = 0;
+	hook(bt->vec, &bt->len, BT_MAX);
+}
+
+static void
+bt_expect_eq(const bt_t *a, const bt_t *b, bool eq) {
+	bool same = a->len == b->len
+	    && memcmp(a->vec, b->vec, a->len * sizeof(void *)) == 0;
+	expect_b_eq(same, eq, "Backtraces should be %s",
+	    eq ? "the same" : "different");
+}
+
+TEST_BEGIN(test_fast_unwind) {
+	test_skip_if(!config_prof);
+	bool fast_unwind;
+	size_t sz = sizeof(fast_unwind);
+	expect_d_eq(mallctl("opt.prof_fast_unwind", &fast_unwind, &sz, NULL,
+	    0), 0, "Unexpected mallctl failure");
+	/* Not supported on this system. */
+	test_skip_if(!fast_unwind);
+
+	prof_backtrace_hook_t hook = bt_hook_get();
+	bt_t a1, a2, b;
+	bt_get_a(hook, &a1);
+	bt_get_a(hook, &a2);
+	bt_get_b(hook, &b);
+	/* At least the helper, this function and the test harness. */
+	expect_u_ge(a1.len, 3, "Backtrace too short");
+	/* a1 and a2 only differ by the return address into this function. */
+	expect_u_eq(a1.len, a2.len, "Backtraces should have the same depth");
+	expect_ptr_eq(a1.vec[0], a2.vec[0],
+	    "Should return into the same helper");
+	expect_d_eq(memcmp(&a1.vec[2], &a2.vec[2],
+	    (a1.len - 2) * sizeof(void *)), 0,
+	    "Frames above this function should be the same");
+	expect_ptr_ne(a1.vec[1], a2.vec[1],
+	    "Should return to different call sites of this function");
+	bt_expect_eq(&a1, &b, false);
+	expect_ptr_ne(a1.vec[0], b.vec[0],
+	    "Should return into different helpers");
+}
+TEST_END
+
+static void *
+thd_start(void *arg) {
+	bt_t *bt = (bt_t *)arg;
+	bt_get_a(bt_hook_get(), bt);
+	return NULL;
+}
+
+TEST_BEGIN(test_fast_unwind_thread) {
+	test_skip_if(!config_prof);
+	bool fast_unwind;
+	size_t sz = sizeof(fast_unwind);
+	expect_d_eq(mallctl("opt.prof_fast_unwind", &fast_unwind, &sz, NULL,
+	    0), 0, "Unexpected mallctl failure");
+	test_skip_if(!fast_unwind);
+
+	/* Other threads' stacks are found through /proc/<pid>/task. */
+	bt_t bt;
+	thd_t thd;
+	thd_create(&thd, thd_start, &bt);
+	thd_join(thd, NULL);
+	expect_u_ge(bt.len, 2, "Backtrace too short");
+}
+TEST_END
+
+TEST_BEGIN(test_fast_unwind_max_len) {
+	test_skip_if(!config_prof);
+	prof_backtrace_hook_t hook = bt_hook_get();
+	bt_t full, truncated;
+	bt_get_a(hook, &full);
+	truncated.len = 0;
+	hook(truncated.vec, &truncated.len, 1);
+	expect_u_eq(truncated.len, 1, "Should respect the maximum length");
+	expect_ptr_not_null(truncated.vec[0], "Unexpected first frame");
+	expect_u_gt(full.len, 1, "Backtrace too short");
+}
+TEST_END
+
+int
+main(void) {
+	return test(test_fast_unwind, test_fast_unwind_thread,
+	    test_fast_unwind_max_len);
+}
@@ -0,0 +1,7 @@
+#!/bin/sh
+
+if [ "x${enable_prof_fast_unwind}" = "x1" ] ; then
+  export MALLOC_CONF="prof:true,prof_fast_unwind:true"
+elif [ "x${enable_prof}" = "x1" ] ; then
+  export MALLOC_CONF="prof:true"
+fi
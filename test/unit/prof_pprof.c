@@ -0,0 +1,432 @@
+#include "test/jemalloc_test.h"
+
+#include "jemalloc/internal/prof_data.h"
+#include "jemalloc/internal/prof_sys.h"
+
+#define NBT		100
+#define ALLOC_SIZE	4096
+#define MAX_DUMP	(1024 * 1024)
+#define MAX_STRINGS	1024
+#define MAX_MAPPINGS	256
+#define MAX_LOCATIONS	(32 * 1024)
+
+static unsigned char dump_buf[MAX_DUMP];
+static size_t dump_len;
+
+static int
+prof_dump_open_file_intercept(const char *filename, int mode) {
+	size_t len = strlen(filename);
+	expect_zu_gt(len, 3, "Unexpected file name");
+	expect_str_eq(filename + len - 3, ".pb", "Expected a .pb file");
+	int fd = open("/dev/null", O_WRONLY);
+	assert_d_ne(fd, -1, "Unexpected open() failure");
+	return fd;
+}
+
+static ssize_t
+prof_dump_write_file_intercept(int fd, const void *buf, size_t len) {
+	assert_zu_le(dump_len + len, MAX_DUMP, "Dump too large");
+	memcpy(dump_buf + dump_len, buf, len);
+	dump_len += len;
+	return (ssize_t)len;
+}
+
+static const char *fake_maps;
+
+static int
+prof_dump_open_maps_fake(void) {
+	int fds[2];
+	assert_d_eq(pipe(fds), 0, "Unexpected pipe() failure");
+	size_t len = strlen(fake_maps);
+	assert_zd_eq(write(fds[1], fake_maps, len), (ssize_t)len,
+	    "Unexpected write() failure");
+	close(fds[1]);
+	return fds[0];
+}
+
+/* The decoded profile.  Strings point into dump_buf. */
+typedef struct {
+	const unsigned char *s;
+	size_t len;
+} test_str_t;
+
+typedef struct {
+	uint64_t id;
+	uint64_t start;
+	uint64_t limit;
+	uint64_t offset;
+	uint64_t filename;
+} test_mapping_t;
+
+static test_str_t strs[MAX_STRINGS];
+static size_t nstrs;
+static uint64_t sample_types[4];
+static size_t nsample_types;
+static uint64_t period_type;
+static uint64_t period;
+static uint64_t default_sample_type;
+static test_mapping_t mappings[MAX_MAPPINGS];
+static size_t nmappings;
+static uint64_t location_mapping[MAX_LOCATIONS];
+static size_t nlocations;
+static size_t nsamples;
+/*
+ * Samples with exactly one ALLOC_SIZE object in use, as reported with the
+ * counts scaled by test_scale.
+ */
+static size_t nsamples_test_size;
+static uint64_t test_scale = 1;
+
+typedef struct {
+	const unsigned char *p;
+	const unsigned char *end;
+} test_pb_t;
+
+static uint64_t
+test_varint(test_pb_t *pb) {
+	uint64_t v = 0;
+	for (unsigned shift = 0;; shift += 7) {
+		assert_true(pb->p < pb->end, "Truncated varint");
+		assert_u_lt(shift, 64, "Varint too long");
+		unsigned char b = *pb->p++;
+		v |= (uint64_t)(b & 0x7f) << shift;
+		if ((b & 0x80) == 0) {
+			return v;
+		}
+	}
+}
+
+/* Reads a key, and the length or value that follows. */
+static unsigned
+test_field(test_pb_t *pb, uint64_t *v, test_pb_t *sub) {
+	uint64_t key = test_varint(pb);
+	unsigned wire_type = (unsigned)(key & 7);
+	if (wire_type == 0) {
+		*v = test_varint(pb);
+	} else {
+		assert_u_eq(wire_type, 2, "Unexpected wire type");
+		uint64_t len = test_varint(pb);
+		assert_u64_le(len, (uint64_t)(pb->end - pb->p),
+		    "Truncated field");
+		sub->p = pb->p;
+		sub->end = pb->p + len;
+		pb->p += len;
+	}
+	return (unsigned)(key >> 3);
+}
+
+static const char *
+test_string(uint64_t ind, char *buf, size_t buf_size) {
+	assert_u64_lt(ind, nstrs, "String index out of range");
+	size_t len = strs[ind].len < buf_size - 1 ? strs[ind].len :
+	    buf_size - 1;
+	memcpy(buf, strs[ind].s, len);
+	buf[len] = '\0';
+	return buf;
+}
+
+static void
+test_value_type(test_pb_t *pb, uint64_t *type, uint64_t *unit) {
+	*type = *unit = 0;
+	while (pb->p < pb->end) {
+		uint64_t v;
+		test_pb_t sub;
+		unsigned field = test_field(pb, &v, &sub);
+		if (field == 1) {
+			*type = v;
+		} else if (field == 2) {
+			*unit = v;
+		}
+	}
+}
+
+static void
+test_sample(test_pb_t *pb) {
+	uint64_t values[4];
+	size_t nvalues = 0;
+	while (pb->p < pb->end) {
+		uint64_t v;
+		test_pb_t sub;
+		unsigned field = test_field(pb, &v, &sub);
+		assert_true(field == 1 || field == 2,
+		    "Unexpected sample field");
+		while (sub.p < sub.end) {
+			uint64_t x = test_varint(&sub);
+			if (field == 1) {
+				/* Locations come before their samples. */
+				assert_u64_ge(x, 1, "Invalid location id");
+				assert_u64_le(x, nlocations,
+				    "Unknown location");
+			} else {
+				assert_zu_lt(nvalues, 4, "Too many values");
+				values[nvalues++] = x;
+			}
+		}
+	}
+	assert_zu_eq(nvalues, nsample_types, "Wrong number of values");
+	/* inuse_objects and inuse_space are last. */
+	if (values[nvalues - 2] == test_scale &&
+	    values[nvalues - 1] == test_scale * ALLOC_SIZE) {
+		nsamples_test_size++;
+	}
+	nsamples++;
+}
+
+static void
+test_mapping(test_pb_t *pb) {
+	assert_zu_lt(nmappings, MAX_MAPPINGS, "Too many mappings");
+	test_mapping_t *m = &mappings[nmappings++];
+	memset(m, 0, sizeof(*m));
+	while (pb->p < pb->end) {
+		uint64_t v;
+		test_pb_t sub;
+		switch (test_field(pb, &v, &sub)) {
+		case 1: m->id = v; break;
+		case 2: m->start = v; break;
+		case 3: m->limit = v; break;
+		case 4: m->offset = v; break;
+		case 5: m->filename = v; break;
+		default: break;
+		}
+	}
+	expect_u64_eq(m->id, nmappings, "Mapping ids should be sequential");
+	expect_u64_lt(m->start, m->limit, "Empty mapping");
+	expect_u64_lt(m->filename, nstrs, "Filename not in the string table");
+}
+
+static void
+test_location(test_pb_t *pb) {
+	uint64_t id = 0, mapping_id = 0, address = 0;
+	while (pb->p < pb->end) {
+		uint64_t v;
+		test_pb_t sub;
+		switch (test_field(pb, &v, &sub)) {
+		case 1: id = v; break;
+		case 2: mapping_id = v; break;
+		case 3: address = v; break;
+		default: break;
+		}
+	}
+	assert_u64_eq(id, nlocations + 1, "Location ids should be sequential");
+	assert_zu_lt(nlocations, MAX_LOCATIONS, "Too many locations");
+	location_mapping[nlocations++] = mapping_id;
+	expect_u64_ne(address, 0, "Missing address");
+	if (mapping_id != 0) {
+		assert_u64_le(mapping_id, nmappings, "Unknown mapping");
+		const test_mapping_t *m = &mappings[mapping_id - 1];
+		expect_true(address >= m->start && address < m->limit,
+		    "Address outside of its mapping");
+	}
+}
+
+static void
+test_decode(void) {
+	nstrs = nsample_types = nmappings = nlocations = nsamples = 0;
+	nsamples_test_size = 0;
+	period_type = period = default_sample_type = 0;
+
+	test_pb_t pb = {dump_buf, dump_buf + dump_len};
+	while (pb.p < pb.end) {
+		uint64_t v;
+		test_pb_t sub;
+		uint64_t unit;
+		switch (test_field(&pb, &v, &sub)) {
+		case 1:
+			assert_zu_lt(nsample_types, 4, "Too many sample types");
+			test_value_type(&sub,
+			    &sample_types[nsample_types++], &unit);
+			break;
+		case 2:
+			test_sample(&sub);
+			break;
+		case 3:
+			test_mapping(&sub);
+			break;
+		case 4:
+			test_location(&sub);
+			break;
+		case 6:
+			assert_zu_lt(nstrs, MAX_STRINGS, "Too many strings");
+			strs[nstrs].s = sub.p;
+			strs[nstrs].len = (size_t)(sub.end - sub.p);
+			nstrs++;
+			break;
+		case 11:
+			test_value_type(&sub, &period_type, &unit);
+			break;
+		case 12:
+			period = v;
+			break;
+		case 14:
+			default_sample_type = v;
+			break;
+		default:
+			break;
+		}
+	}
+
+	char buf[64];
+	assert_zu_ge(nstrs, 1, "Empty string table");
+	expect_zu_eq(strs[0].len, 0, "The first string should be empty");
+	const char *types[] = {"alloc_objects", "alloc_space", "inuse_objects",
+	    "inuse_space"};
+	assert_zu_eq(nsample_types, 4, "Expected the alloc and inuse values");
+	for (unsigned i = 0; i < 4; i++) {
+		expect_str_eq(test_string(sample_types[i], buf, sizeof(buf)),
+		    types[i], "Wrong sample type");
+	}
+	expect_str_eq(test_string(period_type, buf, sizeof(buf)), "space",
+	    "Wrong period type");
+	expect_u64_eq(period, 1, "Wrong period");
+	expect_str_eq(test_string(default_sample_type, buf, sizeof(buf)),
+	    "inuse_space", "Wrong default sample type");
+}
+
+static void
+dump(void) {
+	dump_len = 0;
+	expect_d_eq(mallctl("prof.dump", NULL, NULL, NULL, 0), 0,
+	    "Unexpected error while dumping heap profile");
+	test_decode();
+}
+
+TEST_BEGIN(test_pprof_dump) {
+	test_skip_if(!config_prof);
+
+	const char *format;
+	size_t sz = sizeof(format);
+	expect_d_eq(mallctl("opt.prof_dump_format", &format, &sz, NULL, 0),
+	    0, "Unexpected mallctl failure");
+	expect_str_eq(format, "pprof", "Expected pprof dumps");
+
+	prof_dump_open_file_t *open_file_orig = prof_dump_open_file;
+	prof_dump_write_file_t *write_file_orig = prof_dump_write_file;
+	prof_dump_open_file = prof_dump_open_file_intercept;
+	prof_dump_write_file = prof_dump_write_file_intercept;
+
+	void *ptrs[NBT];
+	for (unsigned i = 0; i < NBT; i++) {
+		ptrs[i] = btalloc(ALLOC_SIZE, i);
+	}
+	dump();
+	expect_zu_ge(nsamples, NBT, "Missing samples");
+	expect_zu_ge(nsamples_test_size, NBT,
+	    "Expected the exact counts, with every allocation sampled");
+	if (prof_dump_open_maps != NULL && nlocations > 0) {
+		/* Most of the backtraces point into mapped files. */
+		size_t nmapped = 0;
+		for (size_t i = 0; i < nlocations; i++) {
+			nmapped += (location_mapping[i] != 0);
+		}
+		expect_zu_gt(nmappings, 0, "Missing mappings");
+		expect_zu_gt(nmapped, nlocations / 2,
+		    "Too many locations outside of the mappings");
+	}
+
+	for (unsigned i = 0; i < NBT; i++) {
+		dallocx(ptrs[i], 0);
+	}
+	dump();
+	expect_zu_eq(nsamples_test_size, 0, "Freed objects still in use");
+
+	prof_dump_open_file = open_file_orig;
+	prof_dump_write_file = write_file_orig;
+}
+TEST_END
+
+TEST_BEGIN(test_pprof_maps) {
+	test_skip_if(!config_prof);
+	/* Without a maps file (e.g. on MacOS), the dyld images are used. */
+	test_skip_if(prof_dump_open_maps == NULL);
+
+	prof_dump_open_file_t *open_file_orig = prof_dump_open_file;
+	prof_dump_write_file_t *write_file_orig = prof_dump_write_file;
+	prof_dump_open_maps_t *open_maps_orig = prof_dump_open_maps;
+	prof_dump_open_file = prof_dump_open_file_intercept;
+	prof_dump_write_file = prof_dump_write_file_intercept;
+	prof_dump_open_maps = prof_dump_open_maps_fake;
+
+	fake_maps =
+	    "00400000-00452000 r-xp 00000000 08:02 173521  /usr/bin/foo\n"
+	    "00651000-00652000 r--p 00051000 08:02 173521  /usr/bin/foo\n"
+	    "00652000-00655000 rw-p 00052000 08:02 173521  /usr/bin/foo\n"
+	    "01000000-01021000 rw-p 00000000 00:00 0       [heap]\n"
+	    "7f0000000000-7f0000100000 r-xp 00010000 08:02 1 /lib/libbar.so\n"
+	    "7f0000100000-7f0000180000 r-xp 00110000 08:02 1 /lib/libbar.so\n"
+	    "7f0000200000-7f0000300000 r-xp 00000000 00:00 0 \n"
+	    "not a mapping\n"
+	    "7fff00000000-7fff00001000 r-xp 00000000 00:00 0 [vdso]";
+	dump();
+
+	char buf[64];
+	assert_zu_eq(nmappings, 5, "Expected the executable mappings only");
+	expect_u64_eq(mappings[0].start, 0x400000, "Wrong start");
+	expect_u64_eq(mappings[0].limit, 0x452000, "Wrong limit");
+	expect_str_eq(test_string(mappings[0].filename, buf, sizeof(buf)),
+	    "/usr/bin/foo", "Wrong filename");
+	expect_u64_eq(mappings[1].offset, 0x10000, "Wrong offset");
+	expect_str_eq(test_string(mappings[1].filename, buf, sizeof(buf)),
+	    "/lib/libbar.so", "Wrong filename");
+	expect_u64_eq(mappings[2].filename, mappings[1].filename,
+	    "The filename should be shared");
+	expect_u64_eq(mappings[3].filename, 0, "Expected no filename");
+	expect_str_eq(test_string(mappings[4].filename, buf, sizeof(buf)),
+	    "[vdso]", "Wrong filename");
+	/* Nothing the backtraces point into. */
+	for (size_t i = 0; i < nlocations; i++) {
+		expect_u64_eq(location_mapping[i], 0, "Unexpected mapping");
+	}
+
+	prof_dump_open_file = open_file_orig;
+	prof_dump_write_file = write_file_orig;
+	prof_dump_open_maps = open_maps_orig;
+}
+TEST_END
+
+TEST_BEGIN(test_pprof_unbias) {
+	test_skip_if(!config_prof);
+
+	prof_dump_open_file_t *open_file_orig = prof_dump_open_file;
+	prof_dump_write_file_t *write_file_orig = prof_dump_write_file;
+	prof_dump_open_file = prof_dump_open_file_intercept;
+	prof_dump_write_file = prof_dump_write_file_intercept;
+
+	/*
+	 * Make the unbiased estimates differ from the raw counts, which they
+	 * otherwise don't with every allocation sampled.
+	 */
+	szind_t szind = sz_size2index(ALLOC_SIZE);
+	size_t unbiased_sz_orig = prof_unbiased_sz[szind];
+	size_t shifted_unbiased_cnt_orig = prof_shifted_unbiased_cnt[szind];
+	prof_unbiased_sz[szind] = 2 * ALLOC_SIZE;
+	prof_shifted_unbiased_cnt[szind] = (size_t)2 << SC_LG_TINY_MIN;
+
+	void *ptrs[NBT];
+	for (unsigned i = 0; i < NBT; i++) {
+		ptrs[i] = btalloc(ALLOC_SIZE, i);
+	}
+	/* Same counts as the legacy dump: unbiased only with prof_unbias. */
+	test_scale = opt_prof_unbias ? 2 : 1;
+	dump();
+	expect_zu_ge(nsamples_test_size, NBT,
+	    "Expected the %s counts", opt_prof_unbias ? "unbiased" : "raw");
+	test_scale = 1;
+
+	for (unsigned i = 0; i < NBT; i++) {
+		dallocx(ptrs[i], 0);
+	}
+	prof_unbiased_sz[szind] = unbiased_sz_orig;
+	prof_shifted_unbiased_cnt[szind] = shifted_unbiased_cnt_orig;
+
+	prof_dump_open_file = open_file_orig;
+	prof_dump_write_file = write_file_orig;
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_pprof_dump,
+	    test_pprof_maps,
+	    test_pprof_unbias);
+}
@@ -991,9 +991,139 @@ TEST_BEGIN(test_stats_print_json) {
 }
 TEST_END
 
+#define OM_LINE_MAX 512
+#define OM_FAMILIES_MAX 512
+
+typedef struct om_checker_s om_checker_t;
+struct om_checker_s {
+	char line[OM_LINE_MAX];
+	size_t line_len;
+	/* The metric families seen so far; the last one is the current one. */
+	char families[OM_FAMILIES_MAX][64];
+	bool counter[OM_FAMILIES_MAX];
+	unsigned nfamilies;
+	unsigned nsamples;
+	bool eof;
+};
+
+static void
+om_check_line(om_checker_t *checker, const char *line) {
+	expect_false(checker->eof, "Output after \"# EOF\": %s", line);
+	if (strncmp(line, "# EOF", strlen("# EOF")) == 0) {
+		checker->eof = true;
+		return;
+	}
+	if (strncmp(line, "# HELP ", strlen("# HELP ")) == 0) {
+		return;
+	}
+	if (strncmp(line, "# TYPE jemalloc_", strlen("# TYPE jemalloc_")) == 0) {
+		const char *name = line + strlen("# TYPE jemalloc_");
+		size_t name_len = strcspn(name, " ");
+		const char *type = name + name_len + 1;
+		expect_true(strcmp(type, "counter") == 0 ||
+		    strcmp(type, "gauge") == 0, "Unexpected type: %s", line);
+		expect_u_lt(checker->nfamilies, OM_FAMILIES_MAX,
+		    "Too many metric families");
+		for (unsigned i = 0; i < checker->nfamilies; i++) {
+			expect_false(strlen(checker->families[i]) == name_len &&
+			    strncmp(checker->families[i], name, name_len) == 0,
+			    "Interleaved metric family: %s", line);
+		}
+		malloc_snprintf(checker->families[checker->nfamilies],
+		    sizeof(checker->families[0]), "%.*s", (int)name_len, name);
+		checker->counter[checker->nfamilies] =
+		    (strcmp(type, "counter") == 0);
+		checker->nfamilies++;
+		return;
+	}
+
+	expect_u_gt(checker->nfamilies, 0, "Sample without a family: %s", line);
+	unsigned cur = checker->nfamilies - 1;
+	char expected[128];
+	malloc_snprintf(expected, sizeof(expected), "jemalloc_%s%s",
+	    checker->families[cur], checker->counter[cur] ? "_total" : "");
+	size_t expected_len = strlen(expected);
+	expect_d_eq(strncmp(line, expected, expected_len), 0,
+	    "Sample of another family: %s", line);
+	const char *s = line + expected_len;
+	if (*s == '{') {
+		s = strchr(s, '}');
+		expect_ptr_not_null(s, "Unterminated labels: %s", line);
+		s++;
+	}
+	expect_c_eq(*s, ' ', "Malformed sample: %s", line);
+	s++;
+	if (*s == '-') {
+		s++;
+	}
+	expect_true(*s >= '0' && *s <= '9', "Malformed value: %s", line);
+	expect_zu_eq(strspn(s, "0123456789"), strlen(s),
+	    "Malformed value: %s", line);
+	checker->nsamples++;
+}
+
+static void
+om_write_cb(void *opaque, const char *str) {
+	om_checker_t *checker = (om_checker_t *)opaque;
+	for (const char *c = str; *c != '\0'; c++) {
+		if (*c != '\n') {
+			expect_zu_lt(checker->line_len, OM_LINE_MAX - 1,
+			    "Line too long");
+			checker->line[checker->line_len++] = *c;
+			continue;
+		}
+		checker->line[checker->line_len] = '\0';
+		om_check_line(checker, checker->line);
+		checker->line_len = 0;
+	}
+}
+
+TEST_BEGIN(test_stats_print_openmetrics) {
+	const char *opts[] = {
+		"O",
+		"Og",
+		"Om",
+		"Oa",
+		"Ob",
+		"Ol",
+		"Ox",
+		"Oe",
+		"Oh",
+		"Oblxeh",
+		"OJ",
+	};
+	unsigned arena_ind;
+	size_t sz = sizeof(arena_ind);
+	expect_d_eq(mallctl("arenas.create", (void *)&arena_ind, &sz, NULL, 0),
+	    0, "Unexpected mallctl failure");
+	void *p = mallocx(SC_LARGE_MINCLASS, MALLOCX_ARENA(arena_ind) |
+	    MALLOCX_TCACHE_NONE);
+	expect_ptr_not_null(p, "Unexpected mallocx() failure");
+
+	for (unsigned i = 0; i < sizeof(opts) / sizeof(const char *); i++) {
+		om_checker_t *checker = (om_checker_t *)malloc(
+		    sizeof(om_checker_t));
+		expect_ptr_not_null(checker, "Unexpected malloc() failure");
+		memset(checker, 0, sizeof(*checker));
+		malloc_stats_print(om_write_cb, (void *)checker, opts[i]);
+		expect_true(checker->eof, "Missing \"# EOF\", opts=\"%s\"",
+		    opts[i]);
+		expect_zu_eq(checker->line_len, 0,
+		    "Unterminated line, opts=\"%s\"", opts[i]);
+		if (config_stats) {
+			expect_u_gt(checker->nsamples, 0,
+			    "Missing samples, opts=\"%s\"", opts[i]);
+		}
+		free(checker);
+	}
+	dallocx(p, MALLOCX_TCACHE_NONE);
+}
+TEST_END
+
 int
 main(void) {
 	return test(
 	    test_json_parser,
-	    test_stats_print_json);
+	    test_stats_print_json,
+	    test_stats_print_openmetrics);
 }
@@ -0,0 +1,218 @@
+#include "test/jemalloc_test.h"
+
+#include "jemalloc/internal/stats_snapshot.h"
+
+#define SNAPSHOT_SIZE (STATS_SNAPSHOT_LEN * sizeof(uint64_t))
+
+static uint64_t snap[STATS_SNAPSHOT_LEN];
+static uint64_t prev[STATS_SNAPSHOT_LEN];
+/* The delta, then the current snapshot. */
+static uint64_t delta_out[2 * STATS_SNAPSHOT_LEN];
+
+static void
+snapshot_take(uint64_t *dst) {
+	size_t sz = SNAPSHOT_SIZE;
+	expect_d_eq(mallctl("experimental.stats_snapshot", dst, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+}
+
+static void
+snapshot_delta_take(uint64_t *dst, const uint64_t *prev_snap) {
+	size_t sz = 2 * SNAPSHOT_SIZE;
+	expect_d_eq(mallctl("experimental.stats_snapshot", dst, &sz,
+	    (void *)prev_snap, SNAPSHOT_SIZE), 0,
+	    "Unexpected mallctl() failure");
+}
+
+static size_t
+layout_get(const char *name) {
+	char cmd[128];
+	malloc_snprintf(cmd, sizeof(cmd),
+	    "experimental.stats_snapshot_layout.%s", name);
+	size_t ind;
+	size_t sz = sizeof(ind);
+	expect_d_eq(mallctl(cmd, (void *)&ind, &sz, NULL, 0), 0,
+	    "Unexpected mallctl(\"%s\") failure", cmd);
+	return ind;
+}
+
+static uint64_t
+ctl_stat_get(const char *name) {
+	uint64_t epoch = 1;
+	expect_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl() failure");
+	uint64_t ret;
+	size_t sz = sizeof(ret);
+	expect_d_eq(mallctl(name, (void *)&ret, &sz, NULL, 0), 0,
+	    "Unexpected mallctl(\"%s\") failure", name);
+	return ret;
+}
+
+TEST_BEGIN(test_stats_snapshot_args) {
+	test_skip_if(!config_stats);
+
+	size_t sz = 0;
+	expect_d_eq(mallctl("experimental.stats_snapshot", NULL, &sz, NULL, 0),
+	    0, "Unexpected mallctl() failure");
+	expect_zu_eq(sz, SNAPSHOT_SIZE, "Unexpected snapshot size");
+
+	sz = SNAPSHOT_SIZE - sizeof(uint64_t);
+	expect_d_eq(mallctl("experimental.stats_snapshot", snap, &sz, NULL, 0),
+	    EINVAL, "Should fail with a short buffer");
+	sz = 2 * SNAPSHOT_SIZE;
+	expect_d_eq(mallctl("experimental.stats_snapshot", delta_out, &sz,
+	    prev, SNAPSHOT_SIZE + sizeof(uint64_t)), EINVAL,
+	    "Should fail with a mismatched previous snapshot");
+	sz = SNAPSHOT_SIZE;
+	expect_d_eq(mallctl("experimental.stats_snapshot", delta_out, &sz,
+	    prev, SNAPSHOT_SIZE), EINVAL,
+	    "Should fail with a delta buffer too short for both snapshots");
+	sz = 2 * SNAPSHOT_SIZE;
+	expect_d_eq(mallctl("experimental.stats_snapshot", delta_out, &sz,
+	    &delta_out[STATS_SNAPSHOT_LEN], SNAPSHOT_SIZE), EINVAL,
+	    "Should fail when the output overlaps the previous snapshot");
+	expect_d_eq(mallctl("experimental.stats_snapshot", NULL, NULL, prev,
+	    SNAPSHOT_SIZE), EINVAL,
+	    "The previous snapshot is input only");
+
+	snapshot_take(snap);
+	expect_u64_ge(snap[stats_snapshot_global_narenas], 1,
+	    "Should have seen at least one arena");
+	expect_u64_eq(snap[stats_snapshot_global_allocated],
+	    snap[stats_snapshot_global_allocated_small] +
+	    snap[stats_snapshot_global_allocated_large],
+	    "Inconsistent allocated bytes");
+	expect_u64_ge(snap[stats_snapshot_global_active],
+	    snap[stats_snapshot_global_allocated],
+	    "Active bytes should include the allocated ones");
+}
+TEST_END
+
+TEST_BEGIN(test_stats_snapshot_ctl_match) {
+	test_skip_if(!config_stats);
+
+	void *small = mallocx(1, MALLOCX_TCACHE_NONE);
+	void *large = mallocx(SC_LARGE_MINCLASS, MALLOCX_TCACHE_NONE);
+	expect_ptr_not_null(small, "Unexpected mallocx() failure");
+	expect_ptr_not_null(large, "Unexpected mallocx() failure");
+
+	/* Nothing allocates between the refresh and the snapshot. */
+	uint64_t nmalloc_small =
+	    ctl_stat_get("stats.arenas." STRINGIFY(MALLCTL_ARENAS_ALL)
+	    ".small.nmalloc");
+	uint64_t nmalloc_large =
+	    ctl_stat_get("stats.arenas." STRINGIFY(MALLCTL_ARENAS_ALL)
+	    ".large.nmalloc");
+	snapshot_take(snap);
+	expect_u64_eq(snap[stats_snapshot_global_nmalloc_small], nmalloc_small,
+	    "Snapshot should match the mallctl stats");
+	expect_u64_eq(snap[stats_snapshot_global_nmalloc_large], nmalloc_large,
+	    "Snapshot should match the mallctl stats");
+
+	size_t allocated;
+	size_t sz = sizeof(allocated);
+	uint64_t epoch = 1;
+	expect_d_eq(mallctl("epoch", NULL, NULL, (void *)&epoch,
+	    sizeof(epoch)), 0, "Unexpected mallctl() failure");
+	expect_d_eq(mallctl("stats.allocated", (void *)&allocated, &sz, NULL,
+	    0), 0, "Unexpected mallctl() failure");
+	snapshot_take(snap);
+	expect_u64_eq(snap[stats_snapshot_global_allocated], allocated,
+	    "Snapshot should match the mallctl stats");
+
+	dallocx(small, MALLOCX_TCACHE_NONE);
+	dallocx(large, MALLOCX_TCACHE_NONE);
+}
+TEST_END
+
+TEST_BEGIN(test_stats_snapshot_delta) {
+	test_skip_if(!config_stats);
+
+#define NALLOCS 8
+	void *ptrs[NALLOCS];
+	size_t size = SC_LARGE_MINCLASS * 2;
+	szind_t lind = sz_size2index(size) - SC_NBINS;
+	size_t nmalloc_ind = stats_snapshot_lextent_ind(lind,
+	    stats_snapshot_lextent_nmalloc);
+	size_t ndalloc_ind = stats_snapshot_lextent_ind(lind,
+	    stats_snapshot_lextent_ndalloc);
+	size_t cur_ind = stats_snapshot_lextent_ind(lind,
+	    stats_snapshot_lextent_curlextents);
+
+	snapshot_take(prev);
+	uint64_t cur0 = prev[cur_ind];
+	memcpy(snap, prev, SNAPSHOT_SIZE);
+
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		ptrs[i] = mallocx(size, MALLOCX_TCACHE_NONE);
+		expect_ptr_not_null(ptrs[i], "Unexpected mallocx() failure");
+	}
+	snapshot_delta_take(delta_out, prev);
+	expect_u64_eq(delta_out[nmalloc_ind], NALLOCS,
+	    "Unexpected nmalloc delta");
+	expect_u64_eq(delta_out[ndalloc_ind], 0, "Unexpected ndalloc delta");
+	expect_u64_eq(delta_out[cur_ind], cur0 + NALLOCS,
+	    "Gauges should be absolute");
+	expect_d_eq(memcmp(prev, snap, SNAPSHOT_SIZE), 0,
+	    "The previous snapshot shouldn't be modified");
+	const uint64_t *cur = &delta_out[STATS_SNAPSHOT_LEN];
+	expect_u64_eq(cur[nmalloc_ind], prev[nmalloc_ind] + NALLOCS,
+	    "The current snapshot should follow the delta");
+	expect_u64_eq(cur[cur_ind], cur0 + NALLOCS,
+	    "The current snapshot should follow the delta");
+	memcpy(prev, cur, SNAPSHOT_SIZE);
+
+	for (unsigned i = 0; i < NALLOCS; i++) {
+		dallocx(ptrs[i], MALLOCX_TCACHE_NONE);
+	}
+	snapshot_delta_take(delta_out, prev);
+	expect_u64_eq(delta_out[nmalloc_ind], 0, "Unexpected nmalloc delta");
+	expect_u64_eq(delta_out[ndalloc_ind], NALLOCS,
+	    "Unexpected ndalloc delta");
+	expect_u64_eq(delta_out[cur_ind], cur0, "Gauges should be absolute");
+#undef NALLOCS
+}
+TEST_END
+
+TEST_BEGIN(test_stats_snapshot_layout) {
+	test_skip_if(!config_stats);
+
+	expect_zu_eq(layout_get("global.narenas"),
+	    stats_snapshot_global_narenas, "Unexpected global field index");
+	expect_zu_eq(layout_get("global.muzzy_purged"),
+	    stats_snapshot_global_muzzy_purged,
+	    "Unexpected global field index");
+
+	unsigned nbins, nlextents;
+	size_t sz = sizeof(unsigned);
+	expect_d_eq(mallctl("arenas.nbins", (void *)&nbins, &sz, NULL, 0), 0,
+	    "Unexpected mallctl() failure");
+	expect_d_eq(mallctl("arenas.nlextents", (void *)&nlextents, &sz, NULL,
+	    0), 0, "Unexpected mallctl() failure");
+
+	/* What an application would compute, without the internal header. */
+	size_t bin = nbins - 1;
+	expect_zu_eq(layout_get("bins_offset") +
+	    bin * layout_get("bin_nfields") + layout_get("bin.curslabs"),
+	    stats_snapshot_bin_ind(bin, stats_snapshot_bin_curslabs),
+	    "Unexpected bin field index");
+	size_t lextent = nlextents - 1;
+	size_t last = layout_get("lextents_offset") +
+	    lextent * layout_get("lextent_nfields") +
+	    layout_get("lextent.curlextents");
+	expect_zu_eq(last, stats_snapshot_lextent_ind(lextent,
+	    stats_snapshot_lextent_curlextents),
+	    "Unexpected large size class field index");
+	expect_zu_eq((last + 1) * sizeof(uint64_t), SNAPSHOT_SIZE,
+	    "The last field should end the snapshot");
+}
+TEST_END
+
+int
+main(void) {
+	return test(
+	    test_stats_snapshot_args,
+	    test_stats_snapshot_ctl_match,
+	    test_stats_snapshot_delta,
+	    test_stats_snapshot_layout);
+}
@@ -0,0 +1,126 @@
+#include "test/jemalloc_test.h"
+
+#define NPTRS 256
+#define NROUNDS 400
+
+static size_t
+ncached_max_get(size_t size) {
+	size_t ncached_max;
+	size_t sz = sizeof(ncached_max);
+	expect_d_eq(mallctl("thread.tcache.ncached_max.read_sizeclass",
+	    (void *)&ncached_max, &sz, (void *)&size, sizeof(size)), 0,
+	    "Unexpected mallctl failure");
+	return ncached_max;
+}
+
+static size_t
+nslots_small_max_get(void) {
+	unsigned nslots;
+	size_t sz = sizeof(nslots);
+	expect_d_eq(mallctl("opt.tcache_nslots_small_max", (void *)&nslots,
+	    &sz, NULL, 0), 0, "Unexpected mallctl failure");
+	return nslots;
+}
+
+static bool
+tcache_adaptive_enabled(void) {
+	bool tcache, adaptive;
+	size_t sz = sizeof(bool);
+	expect_d_eq(mallctl("opt.tcache", (void *)&tcache, &sz, NULL, 0), 0,
+	    "Unexpected mallctl failure");
+	expect_d_eq(mallctl("opt.tcache_adaptive", (void *)&adaptive, &sz,
+	    NULL, 0), 0, "Unexpected mallctl failure");
+	return tcache && adaptive;
+}
+
+/* Allocates and frees NPTRS objects at a time, missing in both directions. */
+static void
+churn(size_t size, unsigned nrounds) {
+	static void *ptrs[NPTRS];
+	for (unsigned i = 0; i < nrounds; i++) {
+		for (unsigned j = 0; j < NPTRS; j++) {
+			ptrs[j] = malloc(size);
+			expect_ptr_not_null(ptrs[j], "Unexpected malloc failure");
+		}
+		for (unsigned j = 0; j < NPTRS; j++) {
+			free(ptrs[j]);
+		}
+	}
+}
+
+TEST_BEGIN(test_tcache_adaptive_grow_shrink) {
+	test_skip_if(!tcache_adaptive_enabled());
+
+	size_t hot = 64, cold = 96;
+	/* Bins start out small. */
+	expect_zu_lt(ncached_max_get(hot), nslots_small_max_get(),
+	    "Bins should start below their capacity");
+
+	churn(hot, NROUNDS);
+	expect_zu_eq(ncached_max_get(hot), nslots_small_max_get(),
+	    "A hot bin should grow to its capacity");
+
+	/* Now only the cold size class is used, without missing. */
+	for (unsigned i = 0; i < NROUNDS * NPTRS; i++) {
+		void *p = malloc(cold);
+		expect_ptr_not_null(p, "Unexpected malloc failure");
+		free(p);
+	}
+	expect_zu_eq(ncached_max_get(hot), TCACHE_ADAPTIVE_NCACHED_MIN,
+	    "An unused bin should shrink to the minimum");
+}
+TEST_END
+
+TEST_BEGIN(test_tcache_adaptive_budget) {
+	test_skip_if(!tcache_adaptive_enabled());
+
+	size_t max_bytes;
+	size_t sz = sizeof(max_bytes);
+	expect_d_eq(mallctl("opt.tcache_adaptive_max_bytes",
+	    (void *)&max_bytes, &sz, NULL, 0), 0,
+	    "Unexpected mallctl failure");
+
+	size_t size = 4096;
+	size_t init = ncached_max_get(size);
+	churn(size, NROUNDS / 4);
+	size_t ncached_max = ncached_max_get(size);
+	expect_zu_gt(ncached_max, init, "A hot bin should grow");
+	expect_zu_lt(ncached_max, nslots_small_max_get(),
+	    "The budget should keep the bin from reaching its capacity");
+	expect_zu_le(ncached_max * size, max_bytes,
+	    "The budget should be respected");
+}
+TEST_END
+
+TEST_BEGIN(test_tcache_adaptive_explicit) {
+	test_skip_if(!tcache_adaptive_enabled());
+
+	unsigned tcache_ind;
+	size_t sz = sizeof(tcache_ind);
+	expect_d_eq(mallctl("tcache.create", (void *)&tcache_ind, &sz, NULL,
+	    0), 0, "Unexpected mallctl failure");
+
+	/* Nothing GCs explicit tcaches, so they shouldn't start at the cap. */
+	size_t size = 64;
+	szind_t szind = sz_size2index(size);
+	cache_bin_t *cache_bin = &tcaches[tcache_ind].tcache->bins[szind];
+	cache_bin_sz_t ncached_max = cache_bin_ncached_max_get(cache_bin);
+	expect_zu_lt(ncached_max, nslots_small_max_get(),
+	    "Explicit tcache bins shouldn't be sized for tcache_adaptive");
+
+	void *p = mallocx(size, MALLOCX_TCACHE(tcache_ind));
+	expect_ptr_not_null(p, "Unexpected mallocx failure");
+	dallocx(p, MALLOCX_TCACHE(tcache_ind));
+	expect_d_eq(mallctl("tcache.destroy", NULL, NULL,
+	    (void *)&tcache_ind, sizeof(tcache_ind)), 0,
+	    "Unexpected mallctl failure");
+}
+TEST_END
+
+int
+main(void) {
+	return test_no_reentrancy(
+	    test_tcache_adaptive_grow_shrink,
+	    test_tcache_adaptive_budget,
+	    test_tcache_adaptive_explicit);
+}
@@ -0,0 +1,3 @@
+#!/bin/sh
+
+export MALLOC_CONF="tcache_adaptive:true,tcache_adaptive_max_bytes:262144,tcache_gc_incr_bytes:1024"